@@ -6,33 +6,119 @@ set(AVG_EXPORTED_FUNCTIONS
     "_avg_init"
     "_avg_shutdown"
     "_avg_load_script"
+    "_avg_load_script_begin"
+    "_avg_load_script_begin_async"
+    "_avg_load_script_step"
+    "_avg_load_script_progress"
+    "_avg_hash_script"
+    "_avg_get_script_hash"
+    "_avg_export_compiled"
+    "_avg_export_compiled_size"
+    "_avg_import_compiled"
+    "_avg_link_script"
+    "_avg_link_script_begin"
+    "_avg_get_unresolved_links"
+    "_avg_reload_script"
+    "_avg_reload_linked_script"
+    "_avg_get_reload_stats"
+    "_avg_register_modules"
+    "_avg_load_module"
+    "_avg_unload_module"
+    "_avg_is_module_loaded"
+    "_avg_get_pending_module"
+    "_avg_next_prefetch_module"
+    "_avg_set_module_budget"
+    "_avg_set_module_prefetch_depth"
+    "_avg_get_module_resident_bytes"
+    "_avg_set_text_compression"
+    "_avg_get_text_stats"
+    "_avg_load_locale"
+    "_avg_unload_locale"
+    "_avg_get_locale"
     "_avg_goto_node"
     "_avg_select_choice"
     "_avg_go_back"
     "_avg_can_go_back"
+    "_avg_tick"
+    "_avg_get_tick_events"
+    "_avg_set_auto_mode"
+    "_avg_get_auto_mode"
+    "_avg_set_text_speed"
+    "_avg_set_auto_delay"
+    "_avg_complete_text"
+    "_avg_get_choice_time_remaining"
     "_avg_get_current_node_id"
     "_avg_get_node_type"
     "_avg_get_speaker"
     "_avg_get_text"
+    "_avg_get_text_spans"
+    "_avg_get_text_span_count"
+    "_avg_get_span_string"
     "_avg_get_next_node_id"
     "_avg_get_choice_count"
     "_avg_get_choice_text"
+    "_avg_get_choice_spans"
+    "_avg_get_choice_span_count"
+    "_avg_get_choice_span_string"
     "_avg_get_choice_next"
+    "_avg_get_choice_visibility"
     "_avg_get_background"
     "_avg_get_character"
     "_avg_get_expression"
     "_avg_get_bgm"
     "_avg_get_sound_effect"
+    "_avg_get_scene_events"
+    "_avg_get_asset_name"
+    "_avg_get_scene_state"
+    "_avg_backlog_size"
+    "_avg_backlog_page"
+    "_avg_backlog_speaker"
+    "_avg_set_search_indexing"
+    "_avg_search"
+    "_avg_get_search_results"
+    "_avg_get_node_id"
     "_avg_set_variable"
     "_avg_get_variable"
+    "_avg_get_flag_index"
+    "_avg_get_flag"
+    "_avg_set_flag"
+    "_avg_get_flag_group"
+    "_avg_flag_group_any"
+    "_avg_flag_group_all"
+    "_avg_flag_group_count"
+    "_avg_set_flag_group"
+    "_avg_get_flag_count"
+    "_avg_get_flag_words"
     "_avg_save_state"
     "_avg_load_state"
+    "_avg_snapshot_take"
+    "_avg_snapshot_restore"
+    "_avg_snapshot_has"
+    "_avg_snapshot_save"
+    "_avg_snapshot_clear"
+    "_avg_is_node_read"
+    "_avg_is_current_node_read"
+    "_avg_get_node_count"
+    "_avg_get_read_count"
+    "_avg_get_chapter_node_count"
+    "_avg_get_chapter_read_count"
+    "_avg_save_read_state"
+    "_avg_load_read_state"
+    "_avg_clear_read_state"
+    "_avg_analytics_enable"
+    "_avg_analytics_set_time"
+    "_avg_analytics_export"
+    "_avg_analytics_export_size"
+    "_avg_analytics_reset"
+    "_avg_session_record"
+    "_avg_session_set_time"
+    "_avg_session_log"
+    "_avg_session_log_size"
+    "_avg_get_node_visit_count"
+    "_avg_dump_trace"
+    "_avg_clear_trace"
     "_avg_reset"
     "_avg_free_string"
-    "_avg_set_audio_play_bgm_callback"
-    "_avg_set_audio_play_se_callback"
-    "_avg_set_audio_stop_bgm_callback"
-    "_avg_trigger_audio_from_node"
     "_malloc"
     "_free"
 )
@@ -44,9 +130,15 @@ set(AVG_EXPORTED_RUNTIME_METHODS
     "UTF8ToString"
     "stringToUTF8"
     "lengthBytesUTF8"
-    "addFunction"
+    "HEAPU8"
+    "HEAP32"
 )
 
+# Benchmark variant: heap statistics exports for the Node.js runner
+if(AVG_WASM_BENCHMARK)
+    list(APPEND AVG_EXPORTED_FUNCTIONS "_avg_get_heap_used" "_avg_get_heap_peak" "_avg_reset_heap_peak")
+endif()
+
 # Convert lists to JSON array format for Emscripten
 string(REPLACE ";" "','" EXPORTED_FUNCTIONS_STR "${AVG_EXPORTED_FUNCTIONS}")
 set(EXPORTED_FUNCTIONS_JSON "['${EXPORTED_FUNCTIONS_STR}']")
@@ -70,6 +162,24 @@ function(apply_wasm_settings TARGET_NAME)
         $<$<CONFIG:RelWithDebInfo>:-O2 -g>
     )
 
+    # The benchmark variant must also load under Node.js
+    if(AVG_WASM_BENCHMARK)
+        set(AVG_WASM_ENVIRONMENT "web,node")
+        target_compile_definitions(${TARGET_NAME} PRIVATE AVG_WASM_BENCHMARK=1)
+    else()
+        set(AVG_WASM_ENVIRONMENT "web")
+    endif()
+
+    # Pthread build: script loading can run on a worker (needs COOP/COEP headers)
+    if(AVG_WASM_THREADS)
+        set(AVG_WASM_ENVIRONMENT "${AVG_WASM_ENVIRONMENT},worker")
+        target_compile_options(${TARGET_NAME} PRIVATE -pthread)
+        target_link_options(${TARGET_NAME} PRIVATE
+            -pthread
+            "SHELL:-s PTHREAD_POOL_SIZE=1"
+        )
+    endif()
+
     # Linker options (apply to final executable)
     target_link_options(${TARGET_NAME} PRIVATE
         # Core WASM settings
@@ -77,16 +187,12 @@ function(apply_wasm_settings TARGET_NAME)
         "SHELL:-s ALLOW_MEMORY_GROWTH=1"
         "SHELL:-s MODULARIZE=1"
         "SHELL:-s EXPORT_NAME='AVGEngineModule'"
-        "SHELL:-s ENVIRONMENT=web"
+        "SHELL:-s ENVIRONMENT=${AVG_WASM_ENVIRONMENT}"
 
         # Memory settings
         "SHELL:-s INITIAL_MEMORY=16777216"   # 16MB
         "SHELL:-s MAXIMUM_MEMORY=134217728"  # 128MB
 
-        # Function table settings (needed for addFunction)
-        "SHELL:-s ALLOW_TABLE_GROWTH=1"
-        "SHELL:-s RESERVED_FUNCTION_POINTERS=20"
-
         # Export functions
         "SHELL:-s EXPORTED_FUNCTIONS=${EXPORTED_FUNCTIONS_JSON}"
         "SHELL:-s EXPORTED_RUNTIME_METHODS=${EXPORTED_RUNTIME_JSON}"
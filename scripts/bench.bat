@@ -0,0 +1,55 @@
+@echo off
+setlocal enabledelayedexpansion
+
+echo Running native benchmarks...
+
+:: Get script directory and project root
+set "SCRIPT_DIR=%~dp0"
+pushd "%SCRIPT_DIR%.."
+set "PROJECT_ROOT=%CD%"
+popd
+
+cd /d "%PROJECT_ROOT%"
+
+:: Build the native library and benchmark suite
+if not exist "build\native-bench" mkdir "build\native-bench"
+cmake -S . -B build\native-bench -DCMAKE_BUILD_TYPE=Release -DBUILD_WASM=OFF -DBUILD_TESTS=ON
+if errorlevel 1 (
+    echo CMake configuration failed!
+    exit /b 1
+)
+
+cmake --build build\native-bench --config Release --target avg_bench avg_replay
+if errorlevel 1 (
+    echo Benchmark build failed!
+    exit /b 1
+)
+
+set "BENCH_EXE=build\native-bench\bin\avg_bench.exe"
+if exist "build\native-bench\bin\Release\avg_bench.exe" set "BENCH_EXE=build\native-bench\bin\Release\avg_bench.exe"
+
+:: Run a size sweep; extra options are passed through to every run
+if not exist "build\bench-results" mkdir "build\bench-results"
+for %%N in (1000 10000 100000) do (
+    echo Benchmarking %%N nodes...
+    "%BENCH_EXE%" --nodes %%N --out "build\bench-results\native_%%N.json" %*
+    if errorlevel 1 exit /b 1
+)
+
+:: Replay the recorded session corpus, if there is one: a script.json plus
+:: the .avgr logs recorded on it
+set "REPLAY_EXE=build\native-bench\bin\avg_replay.exe"
+if exist "build\native-bench\bin\Release\avg_replay.exe" set "REPLAY_EXE=build\native-bench\bin\Release\avg_replay.exe"
+set "SESSION_DIR=tests\sessions"
+if defined AVG_SESSION_DIR set "SESSION_DIR=%AVG_SESSION_DIR%"
+set "SESSION_LOGS="
+for %%F in ("%SESSION_DIR%\*.avgr") do set "SESSION_LOGS=!SESSION_LOGS! "%%F""
+if exist "%SESSION_DIR%\script.json" if defined SESSION_LOGS (
+    echo Replaying sessions in %SESSION_DIR%...
+    "%REPLAY_EXE%" --script "%SESSION_DIR%\script.json" !SESSION_LOGS! --out "build\bench-results\replay.json"
+    if errorlevel 1 exit /b 1
+)
+
+echo Results written to build\bench-results\
+
+endlocal
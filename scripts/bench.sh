@@ -0,0 +1,31 @@
+#!/bin/bash
+
+echo "Running native benchmarks..."
+
+# Build the native library and benchmark suite
+mkdir -p build/native-bench
+cmake -S . -B build/native-bench -DCMAKE_BUILD_TYPE=Release -DBUILD_WASM=OFF -DBUILD_TESTS=ON
+cmake --build build/native-bench --target avg_bench avg_replay
+
+if [ ! -f "build/native-bench/bin/avg_bench" ]; then
+    echo "Benchmark build failed!"
+    exit 1
+fi
+
+# Run a size sweep; pass extra options (e.g. --unicode 0.3) through to every run
+mkdir -p build/bench-results
+for nodes in 1000 10000 100000; do
+    echo "Benchmarking ${nodes} nodes..."
+    build/native-bench/bin/avg_bench --nodes "${nodes}" --out "build/bench-results/native_${nodes}.json" "$@" || exit 1
+done
+
+# Replay the recorded session corpus, if there is one: a script.json plus
+# the .avgr logs recorded on it
+SESSION_DIR="${AVG_SESSION_DIR:-tests/sessions}"
+if [ -f "${SESSION_DIR}/script.json" ] && ls "${SESSION_DIR}"/*.avgr >/dev/null 2>&1; then
+    echo "Replaying sessions in ${SESSION_DIR}..."
+    build/native-bench/bin/avg_replay --script "${SESSION_DIR}/script.json" "${SESSION_DIR}"/*.avgr \
+        --out "build/bench-results/replay.json" || exit 1
+fi
+
+echo "Results written to build/bench-results/"
@@ -0,0 +1,465 @@
+#!/usr/bin/env node
+
+/**
+ * WASM benchmark runner for AVG Game Engine
+ *
+ * Loads the real Emscripten build (configure with -DAVG_WASM_BENCHMARK=ON or the
+ * wasm-bench preset), drives it through web/src/js/engine/AVGEngine.js exactly
+ * like the browser front end does, and reports JS<->WASM call costs, script load
+ * time and peak heap use. Output uses the same JSON layout as the native avg_bench
+ * suite, and the built-in generator produces the same scripts for the same seed,
+ * so the two result sets can be compared directly.
+ *
+ * Usage: node scripts/bench_wasm.js [--build build/wasm-bench] [--nodes 1000] ...
+ */
+
+const fs = require('fs');
+const path = require('path');
+const vm = require('vm');
+
+const projectRoot = path.join(__dirname, '..');
+
+// ---------------------------------------------------------------------------
+// Options (mirrors tests/cpp/bench/bench_main.cpp)
+
+function parseArgs(argv) {
+    const opts = {
+        build: path.join(projectRoot, 'build', 'wasm-bench'),
+        script: null,
+        out: null,
+        nodes: 1000,
+        branch: 3,
+        choiceRatio: 0.1,
+        textMin: 20,
+        textMax: 200,
+        skewedLengths: true,
+        unicode: 0,
+        seed: 1,
+        iterations: 100000,
+        history: 1000,
+        repeat: 3
+    };
+
+    const numeric = {
+        '--nodes': 'nodes', '--branch': 'branch', '--choice-ratio': 'choiceRatio',
+        '--text-min': 'textMin', '--text-max': 'textMax', '--unicode': 'unicode',
+        '--seed': 'seed', '--iterations': 'iterations', '--history': 'history',
+        '--repeat': 'repeat'
+    };
+
+    for (let i = 0; i < argv.length; i++) {
+        const arg = argv[i];
+        if (arg === '--uniform-text') {
+            opts.skewedLengths = false;
+        } else if (arg === '--help' || arg === '-h') {
+            console.log('Usage: node scripts/bench_wasm.js [--build DIR] [--script PATH] [--out PATH]');
+            console.log('       [--nodes N] [--branch N] [--choice-ratio F] [--text-min N] [--text-max N]');
+            console.log('       [--uniform-text] [--unicode F] [--seed N] [--iterations N] [--history N] [--repeat N]');
+            process.exit(0);
+        } else if (arg in numeric) {
+            opts[numeric[arg]] = Number(argv[++i]);
+        } else if (arg === '--build' || arg === '--script' || arg === '--out') {
+            opts[arg.slice(2)] = argv[++i];
+        } else {
+            console.error(`Unknown option ${arg}`);
+            process.exit(1);
+        }
+    }
+
+    return opts;
+}
+
+// ---------------------------------------------------------------------------
+// Synthetic script generator (port of tests/cpp/bench/script_generator.cpp)
+
+const MASK64 = (1n << 64n) - 1n;
+
+class Random {
+    constructor(seed) {
+        this.state = BigInt(seed) & MASK64 || 0x9E3779B97F4A7C15n;
+    }
+
+    next() {
+        let s = this.state;
+        s ^= (s << 13n) & MASK64;
+        s ^= s >> 7n;
+        s ^= (s << 17n) & MASK64;
+        this.state = s;
+        return s;
+    }
+
+    mod(n) {
+        return Number(this.next() % BigInt(n));
+    }
+
+    range(lo, hi) {
+        if (hi <= lo) return lo;
+        return lo + this.mod(hi - lo + 1);
+    }
+
+    unit() {
+        return Number(this.next() >> 11n) * (1.0 / 9007199254740992.0);
+    }
+}
+
+const SPEAKERS = ['Narrator', 'Protagonist', 'Aoi', 'Mira', 'Kenji', 'Stranger'];
+const BACKGROUNDS = ['room.jpg', 'street.jpg', 'school.jpg', 'night.jpg'];
+const BGM = ['main_theme.mp3', 'calm.mp3', 'tension.mp3'];
+const WORDS = ['the', 'a', 'door', 'window', 'light', 'quiet', 'morning', 'remember',
+    'never', 'should', 'together', 'strange', 'room', 'voice', 'maybe', 'again'];
+const UNICODE = ['é', 'あ', '漢', '字', '\u{1F642}'];
+
+function generateScript(shape) {
+    const rng = new Random(shape.seed);
+    const parts = ['{"title":"Synthetic","version":"1.0.0","nodes":['];
+    const ids = [];
+
+    const pickTextLength = () => {
+        if (!shape.skewedLengths) {
+            return rng.range(shape.textMin, shape.textMax);
+        }
+        const u = rng.unit();
+        return shape.textMin + Math.floor(u * u * (shape.textMax - shape.textMin));
+    };
+
+    const appendText = (length) => {
+        let text = '';
+        let written = 0;
+        while (written < length) {
+            if (written > 0) {
+                text += ' ';
+                written++;
+            }
+            if (shape.unicode > 0 && rng.unit() < shape.unicode) {
+                text += UNICODE[rng.mod(UNICODE.length)];
+                written++;
+            } else {
+                const word = WORDS[rng.mod(WORDS.length)];
+                text += word;
+                written += word.length;
+            }
+        }
+        if (rng.mod(16) === 0) {
+            text += ' \\"quoted\\"';
+        }
+        return text;
+    };
+
+    for (let i = 0; i < shape.nodes; i++) {
+        const last = i === shape.nodes - 1;
+        const choice = !last && shape.branch > 0 && rng.unit() < shape.choiceRatio;
+        const id = `n${i}`;
+        ids.push(id);
+
+        let node = (i > 0 ? ',' : '') + `{"id":"${id}","type":"${last ? 'end' : (choice ? 'choice' : 'dialogue')}"`;
+        if (!choice) {
+            node += `,"speaker":"${SPEAKERS[rng.mod(SPEAKERS.length)]}"`;
+        }
+        node += `,"text":"${appendText(pickTextLength())}"`;
+        node += `,"chapter":"ch${Math.floor(i / 1000)}"`;
+        if (rng.mod(8) === 0) {
+            node += `,"background":"${BACKGROUNDS[rng.mod(BACKGROUNDS.length)]}"`;
+        }
+        if (rng.mod(32) === 0) {
+            node += `,"bgm":"${BGM[rng.mod(BGM.length)]}"`;
+        }
+
+        if (choice) {
+            const choices = [];
+            for (let c = 0; c < shape.branch; c++) {
+                const target = rng.mod(10) === 0
+                    ? rng.range(0, i)
+                    : rng.range(i + 1, Math.min(shape.nodes - 1, i + 50));
+                const text = appendText(rng.range(8, 40));
+                choices.push(`{"text":"${text}","next":"n${target}"}`);
+            }
+            node += `,"choices":[${choices.join(',')}]`;
+        } else if (!last) {
+            node += `,"next":"n${i + 1}"`;
+        }
+
+        parts.push(node + '}');
+    }
+
+    parts.push(']}');
+    return { script: parts.join(''), ids };
+}
+
+// ---------------------------------------------------------------------------
+// Engine loading: run the real front-end wrapper inside a sandboxed context
+
+async function loadEngine(buildDir) {
+    const jsPath = path.resolve(buildDir, 'avg_engine.js');
+    const wasmPath = path.resolve(buildDir, 'avg_engine.wasm');
+    if (!fs.existsSync(jsPath) || !fs.existsSync(wasmPath)) {
+        throw new Error(`WASM build not found in ${buildDir}. Build with: cmake --preset wasm-bench && cmake --build --preset wasm-bench`);
+    }
+
+    const context = vm.createContext({
+        AVGEngineModule: require(jsPath),
+        console,
+        setTimeout,
+        performance,
+        // Audio is a browser concern; the wrapper only needs the interface
+        audioManager: { playBGM() {}, playSE() {}, stopBGM() {} }
+    });
+
+    const engineDir = path.join(projectRoot, 'web', 'src', 'js', 'engine');
+    for (const file of ['WasmLoader.js', 'AVGEngine.js']) {
+        vm.runInContext(fs.readFileSync(path.join(engineDir, file), 'utf8'), context, { filename: file });
+    }
+
+    const engine = vm.runInContext('avgEngine', context);
+    const start = process.hrtime.bigint();
+    if (!(await engine.init(wasmPath))) {
+        throw new Error('avgEngine.init failed');
+    }
+    const instantiateMs = Number(process.hrtime.bigint() - start) / 1e6;
+    trackJsHeap(engine.wasm);
+
+    return { engine, module: engine.wasm, instantiateMs };
+}
+
+// ---------------------------------------------------------------------------
+// Measurement helpers
+
+function heapUsed(module) {
+    return typeof module._avg_get_heap_used === 'function' ? module._avg_get_heap_used() : 0;
+}
+
+function memoryBytes(module) {
+    return module.HEAPU8 ? module.HEAPU8.buffer.byteLength : 0;
+}
+
+// Buffers the JS wrapper allocates with _malloc never pass through operator
+// new, so they are tracked here the same way the C++ side tracks its own
+const jsHeap = { live: 0, peak: 0, sizes: new Map() };
+
+function trackJsHeap(module) {
+    const malloc = module._malloc;
+    const free = module._free;
+    module._malloc = (size) => {
+        const ptr = malloc(size);
+        if (ptr) {
+            jsHeap.sizes.set(ptr, size);
+            jsHeap.live += size;
+            jsHeap.peak = Math.max(jsHeap.peak, jsHeap.live);
+        }
+        return ptr;
+    };
+    module._free = (ptr) => {
+        const size = jsHeap.sizes.get(ptr);
+        if (size !== undefined) {
+            jsHeap.sizes.delete(ptr);
+            jsHeap.live -= size;
+        }
+        free(ptr);
+    };
+}
+
+// Highest heap use above the starting point while fn runs. Older builds
+// without the peak exports only give the net growth.
+function measure(module, name, operations, bytes, fn) {
+    const tracksPeak = typeof module._avg_reset_heap_peak === 'function';
+    const heapBefore = tracksPeak ? module._avg_reset_heap_peak() : heapUsed(module);
+    const jsBefore = jsHeap.live;
+    jsHeap.peak = jsBefore;
+    const start = process.hrtime.bigint();
+    const done = fn();
+    const totalMs = Number(process.hrtime.bigint() - start) / 1e6;
+    const heapPeak = tracksPeak ? module._avg_get_heap_peak() : heapUsed(module);
+    return {
+        name,
+        operations: done === undefined ? operations : done,
+        totalMs,
+        bytes,
+        peakHeapBytes: Math.max(0, heapPeak - heapBefore) + (jsHeap.peak - jsBefore)
+    };
+}
+
+function keepBest(results, r) {
+    const existing = results.find(e => e.name === r.name);
+    if (!existing) {
+        results.push(r);
+    } else if (r.totalMs < existing.totalMs) {
+        Object.assign(existing, r);
+    }
+}
+
+function pickTargets(ids, count, seed) {
+    const rng = new Random(seed);
+    const targets = new Array(count);
+    for (let i = 0; i < count; i++) {
+        targets[i] = ids[rng.mod(ids.length)];
+    }
+    return targets;
+}
+
+// ---------------------------------------------------------------------------
+
+async function main() {
+    const opts = parseArgs(process.argv.slice(2));
+
+    let script;
+    let ids;
+    if (opts.script) {
+        script = fs.readFileSync(opts.script, 'utf8');
+        ids = JSON.parse(script).nodes.map(n => n.id);
+    } else {
+        ({ script, ids } = generateScript(opts));
+    }
+    const scriptBytes = Buffer.byteLength(script, 'utf8');
+
+    const { engine, module, instantiateMs } = await loadEngine(opts.build);
+    const f = engine.functions;
+    const results = [{ name: 'instantiate', operations: 1, totalMs: instantiateMs, bytes: 0, peakHeapBytes: 0 }];
+
+    const memoryBefore = memoryBytes(module);
+    const heapBefore = heapUsed(module);
+
+    for (let r = 0; r < opts.repeat; r++) {
+        // Fresh engine per repetition so every load starts cold
+        f.shutdown();
+        f.init();
+
+        // JS string -> linear memory copy on its own
+        const ptr = module._malloc(scriptBytes + 1);
+        keepBest(results, measure(module, 'marshal_script', 1, scriptBytes, () => {
+            module.stringToUTF8(script, ptr, scriptBytes + 1);
+        }));
+
+        // Parse and link only, from a string already in linear memory
+        keepBest(results, measure(module, 'load_script_raw', 1, scriptBytes, () => {
+            if (module._avg_load_script(ptr) !== 1) throw new Error('avg_load_script failed');
+        }));
+        module._free(ptr);
+
+        // What the front end pays: AVGEngine.loadScript including cwrap marshalling
+        f.shutdown();
+        f.init();
+        keepBest(results, measure(module, 'load_script_js', 1, scriptBytes, () => {
+            try {
+                engine.loadScript(script);
+            } catch (error) {
+                // cwrap marshals 'string' arguments on the WASM stack, which large scripts overflow
+                console.error(`load_script_js failed: ${error.message}`);
+            }
+        }));
+    }
+
+    // Make sure a script is loaded for the navigation phases
+    f.shutdown();
+    f.init();
+    {
+        const ptr = module._malloc(scriptBytes + 1);
+        module.stringToUTF8(script, ptr, scriptBytes + 1);
+        module._avg_load_script(ptr);
+        module._free(ptr);
+    }
+    const memoryAfterLoad = memoryBytes(module);
+    const heapAfterLoad = heapUsed(module);
+
+    // Boundary crossing cost by call shape
+    const n = opts.iterations;
+    results.push(measure(module, 'call_raw_int', n, 0, () => {
+        for (let i = 0; i < n; i++) module._avg_can_go_back();
+    }));
+    results.push(measure(module, 'call_cwrap_int', n, 0, () => {
+        for (let i = 0; i < n; i++) f.canGoBack();
+    }));
+    results.push(measure(module, 'call_cwrap_string_return', n, 0, () => {
+        for (let i = 0; i < n; i++) f.getText();
+    }));
+    const probeIds = pickTargets(ids, 1024, opts.seed + 3);
+    results.push(measure(module, 'call_cwrap_string_arg', n, 0, () => {
+        for (let i = 0; i < n; i++) f.isNodeRead(probeIds[i & 1023]);
+    }));
+    results.push(measure(module, 'get_current_node', n, 0, () => {
+        for (let i = 0; i < n; i++) engine.getCurrentNode();
+    }));
+
+    // Navigation through the JS wrapper
+    const targets = pickTargets(ids, n, opts.seed + 1);
+    results.push(measure(module, 'goto_node', n, 0, () => {
+        for (const t of targets) engine.gotoNode(t);
+    }));
+
+    f.reset();
+    engine.gotoNode(ids[0]);
+    const rng = new Random(opts.seed + 1);
+    results.push(measure(module, 'play_through', n, 0, () => {
+        let steps = 0;
+        for (let i = 0; i < n; i++) {
+            const node = engine.getCurrentNode();
+            let moved;
+            if (!node || node.type === 'end') {
+                moved = engine.gotoNode(ids[0]);
+            } else if (node.choices.length > 0) {
+                moved = engine.selectChoice(rng.mod(node.choices.length));
+            } else {
+                moved = engine.gotoNode(node.nextNodeId);
+            }
+            if (moved) steps++;
+        }
+        return steps;
+    }));
+
+    // Save/load with a realistic history
+    const historyRng = new Random(opts.seed + 2);
+    for (let i = 0; i < opts.history; i++) {
+        engine.gotoNode(ids[historyRng.mod(ids.length)]);
+    }
+    for (let i = 0; i < 64; i++) {
+        engine.setVariable(`var${i}`, i);
+    }
+    const rounds = 100;
+    let saved = engine.saveState();
+    const savedBytes = Buffer.byteLength(saved, 'utf8');
+    results.push(measure(module, 'serialize', rounds, savedBytes * rounds, () => {
+        for (let i = 0; i < rounds; i++) saved = engine.saveState();
+    }));
+    results.push(measure(module, 'deserialize', rounds, savedBytes * rounds, () => {
+        for (let i = 0; i < rounds; i++) engine.loadState(saved);
+    }));
+
+    const report = {
+        suite: 'avg_bench_wasm',
+        engineVersion: require(path.join(projectRoot, 'package.json')).version,
+        node: process.version,
+        config: {
+            nodes: ids.length, branch: opts.branch, choiceRatio: opts.choiceRatio,
+            textMin: opts.textMin, textMax: opts.textMax, skewedLengths: opts.skewedLengths,
+            unicode: opts.unicode, seed: opts.seed, iterations: opts.iterations,
+            history: opts.history, repeat: opts.repeat, script: opts.script
+        },
+        scriptBytes,
+        residentScriptBytes: Math.max(0, heapAfterLoad - heapBefore),
+        wasmMemoryBytes: { beforeLoad: memoryBefore, afterLoad: memoryAfterLoad, final: memoryBytes(module) },
+        results: results.map(r => ({
+            name: r.name,
+            operations: r.operations,
+            totalMs: Number(r.totalMs.toFixed(3)),
+            nsPerOp: r.operations > 0 ? Number((r.totalMs * 1e6 / r.operations).toFixed(1)) : 0,
+            mbPerSec: r.bytes > 0 && r.totalMs > 0 ? Number((r.bytes / 1048576 / (r.totalMs / 1000)).toFixed(2)) : 0,
+            peakHeapBytes: r.peakHeapBytes
+        }))
+    };
+
+    const json = JSON.stringify(report, null, 2) + '\n';
+    if (opts.out) {
+        fs.writeFileSync(opts.out, json);
+    } else {
+        process.stdout.write(json);
+    }
+
+    engine.shutdown();
+}
+
+if (require.main === module) {
+    main().catch(error => {
+        console.error(error.message);
+        process.exit(1);
+    });
+}
+
+module.exports = { generateScript, Random };
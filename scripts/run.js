@@ -14,7 +14,7 @@ const scriptName = process.argv[2];
 
 if (!scriptName) {
     console.error('Usage: node run.js <script_name>');
-    console.error('Available scripts: build, build_wasm, build_web, dev_server, clean, deploy');
+    console.error('Available scripts: build, build_wasm, build_web, dev_server, clean, bench, deploy');
     process.exit(1);
 }
 
@@ -0,0 +1,63 @@
+#!/usr/bin/env node
+
+/**
+ * Split a game script into chapter modules that the engine loads on demand.
+ *
+ * Nodes are grouped by their "chapter" field. Each chapter except the one
+ * holding the start node is written to <outDir>/modules/<chapter>.json; the
+ * remaining nodes go to <outDir>/script.json together with the module
+ * manifest ("modules": [{ "id", "nodes": [...] }]).
+ *
+ * Usage: node scripts/split_script.js <script.json> <outDir>
+ */
+
+const fs = require('fs');
+const path = require('path');
+
+const [inputPath, outDir] = process.argv.slice(2);
+if (!inputPath || !outDir) {
+    console.error('Usage: node split_script.js <script.json> <outDir>');
+    process.exit(1);
+}
+
+const script = JSON.parse(fs.readFileSync(inputPath, 'utf8'));
+const nodes = script.nodes || [];
+const startNode = nodes.find(node => node.id === script.startNode) || nodes[0];
+const residentChapter = startNode ? startNode.chapter : undefined;
+
+const base = [];
+const chapters = new Map();
+for (const node of nodes) {
+    if (!node.chapter || node.chapter === residentChapter) {
+        base.push(node);
+        continue;
+    }
+    if (!chapters.has(node.chapter)) {
+        chapters.set(node.chapter, []);
+    }
+    chapters.get(node.chapter).push(node);
+}
+
+const modulesDir = path.join(outDir, 'modules');
+fs.mkdirSync(modulesDir, { recursive: true });
+
+const manifest = [];
+for (const [chapter, chapterNodes] of chapters) {
+    if (!/^[\w.-]+$/.test(chapter)) {
+        console.error(`Chapter name cannot be used as a file name: ${chapter}`);
+        process.exit(1);
+    }
+    fs.writeFileSync(path.join(modulesDir, `${chapter}.json`), JSON.stringify({ nodes: chapterNodes }));
+    manifest.push({ id: chapter, nodes: chapterNodes.map(node => node.id) });
+}
+
+const output = { ...script, nodes: base };
+if (manifest.length > 0) {
+    output.modules = manifest;
+}
+fs.writeFileSync(path.join(outDir, 'script.json'), JSON.stringify(output, null, 2));
+
+console.log(`Base script: ${base.length} nodes`);
+for (const module of manifest) {
+    console.log(`Module ${module.id}: ${module.nodes.length} nodes`);
+}
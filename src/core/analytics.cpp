@@ -0,0 +1,213 @@
+#include "analytics.h"
+#include "game_state.h"
+#include <algorithm>
+
+namespace avg {
+
+static void writeVarint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static int dwellBucket(uint64_t micros) {
+    uint64_t units = micros / (NodeAnalytics::kDwellBaseMs * 1000);
+    int bucket = 0;
+    while (units > 0 && bucket < NodeAnalytics::kDwellBuckets - 1) {
+        units >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+NodeAnalytics::NodeAnalytics()
+    : enabled(false), nowMicros(0), currentNode(-1), enterMicros(0) {
+    choiceBase.push_back(0);
+}
+
+void NodeAnalytics::setEnabled(bool value) {
+    enabled = value;
+    currentNode = -1;
+}
+
+void NodeAnalytics::layout(const GameState& state) {
+    size_t nodeCount = static_cast<size_t>(state.getNodeCount());
+    size_t oldCount = visits.size();
+
+    std::vector<uint32_t> newBase(nodeCount + 1, 0);
+    for (size_t i = 0; i < nodeCount; i++) {
+        const DialogueNode* node = state.getNodeByIndex(static_cast<int>(i));
+        // Keep the old layout of nodes whose module is currently evicted
+        uint32_t choiceCount = node ? static_cast<uint32_t>(node->choices.size()) :
+                               (i < oldCount ? choiceBase[i + 1] - choiceBase[i] : 0);
+        newBase[i + 1] = newBase[i] + choiceCount;
+    }
+
+    // Carry choice counts over node by node; choice lists may have changed length
+    std::vector<uint32_t> newChoices(newBase[nodeCount], 0);
+    for (size_t i = 0; i < nodeCount && i < oldCount; i++) {
+        uint32_t oldSize = choiceBase[i + 1] - choiceBase[i];
+        uint32_t newSize = newBase[i + 1] - newBase[i];
+        for (uint32_t c = 0; c < oldSize && c < newSize; c++) {
+            newChoices[newBase[i] + c] = choices[choiceBase[i] + c];
+        }
+    }
+
+    visits.resize(nodeCount, 0);
+    dwell.resize(nodeCount * kDwellBuckets, 0);
+    choiceBase.swap(newBase);
+    choices.swap(newChoices);
+
+    if (currentNode >= static_cast<int>(nodeCount)) {
+        currentNode = -1;
+    }
+}
+
+void NodeAnalytics::recordDwell() {
+    if (currentNode < 0 || nowMicros < enterMicros) {
+        return;
+    }
+
+    dwell[static_cast<size_t>(currentNode) * kDwellBuckets + dwellBucket(nowMicros - enterMicros)]++;
+}
+
+void NodeAnalytics::onEnterNode(int nodeIndex) {
+    if (!enabled || nodeIndex < 0 || static_cast<size_t>(nodeIndex) >= visits.size()) {
+        return;
+    }
+
+    recordDwell();
+    visits[nodeIndex]++;
+    currentNode = nodeIndex;
+    enterMicros = nowMicros;
+}
+
+void NodeAnalytics::resumeAt(int nodeIndex) {
+    if (!enabled || nodeIndex < 0 || static_cast<size_t>(nodeIndex) >= visits.size()) {
+        return;
+    }
+
+    currentNode = nodeIndex;
+    enterMicros = nowMicros;
+}
+
+void NodeAnalytics::onSelectChoice(int nodeIndex, int choiceIndex) {
+    if (!enabled || nodeIndex < 0 || static_cast<size_t>(nodeIndex) >= visits.size()) {
+        return;
+    }
+
+    uint32_t slot = choiceBase[nodeIndex] + static_cast<uint32_t>(choiceIndex);
+    if (choiceIndex >= 0 && slot < choiceBase[nodeIndex + 1]) {
+        choices[slot]++;
+    }
+}
+
+uint32_t NodeAnalytics::getVisitCount(int nodeIndex) const {
+    if (nodeIndex < 0 || static_cast<size_t>(nodeIndex) >= visits.size()) {
+        return 0;
+    }
+    return visits[nodeIndex];
+}
+
+uint32_t NodeAnalytics::getChoiceCount(int nodeIndex, int choiceIndex) const {
+    if (nodeIndex < 0 || static_cast<size_t>(nodeIndex) >= visits.size() || choiceIndex < 0) {
+        return 0;
+    }
+    uint32_t slot = choiceBase[nodeIndex] + static_cast<uint32_t>(choiceIndex);
+    return slot < choiceBase[nodeIndex + 1] ? choices[slot] : 0;
+}
+
+uint32_t NodeAnalytics::getDwellCount(int nodeIndex, int bucket) const {
+    if (nodeIndex < 0 || static_cast<size_t>(nodeIndex) >= visits.size() ||
+        bucket < 0 || bucket >= kDwellBuckets) {
+        return 0;
+    }
+    return dwell[static_cast<size_t>(nodeIndex) * kDwellBuckets + bucket];
+}
+
+// Blob format (all integers LEB128 varints unless noted):
+//   "AVGA"                magic, 4 bytes
+//   version               currently 1
+//   nodeCount, bucketCount, dwellBaseMs
+//   recordCount
+//   records, only for nodes with any visit, dwell or choice count, in
+//   ascending node order:
+//     nodeIndexDelta      difference to the previous record's node index
+//     visits
+//     bucketMask          bit b set if dwell bucket b is non-zero
+//     counts              one per set bit of bucketMask
+//     choiceCount         number of choice slots for this node
+//     choiceCounts        choiceCount values
+// Sparse records keep blobs small since most sessions touch few nodes, and
+// blobs from many sessions can be summed record by record.
+std::vector<uint8_t> NodeAnalytics::exportBlob() const {
+    std::vector<uint8_t> out;
+    out.reserve(64);
+    out.push_back('A');
+    out.push_back('V');
+    out.push_back('G');
+    out.push_back('A');
+    writeVarint(out, 1);
+    writeVarint(out, static_cast<uint32_t>(visits.size()));
+    writeVarint(out, kDwellBuckets);
+    writeVarint(out, kDwellBaseMs);
+
+    std::vector<uint32_t> touched;
+    for (size_t i = 0; i < visits.size(); i++) {
+        // Dwell alone counts: after reset() or resumeAt() a node can have
+        // time recorded without a visit
+        bool any = visits[i] != 0;
+        const uint32_t* buckets = &dwell[i * kDwellBuckets];
+        for (int b = 0; !any && b < kDwellBuckets; b++) {
+            any = buckets[b] != 0;
+        }
+        for (uint32_t c = choiceBase[i]; !any && c < choiceBase[i + 1]; c++) {
+            any = choices[c] != 0;
+        }
+        if (any) {
+            touched.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    writeVarint(out, static_cast<uint32_t>(touched.size()));
+
+    uint32_t previous = 0;
+    for (uint32_t node : touched) {
+        writeVarint(out, node - previous);
+        previous = node;
+        writeVarint(out, visits[node]);
+
+        const uint32_t* buckets = &dwell[static_cast<size_t>(node) * kDwellBuckets];
+        uint32_t mask = 0;
+        for (int b = 0; b < kDwellBuckets; b++) {
+            if (buckets[b] != 0) {
+                mask |= 1u << b;
+            }
+        }
+        writeVarint(out, mask);
+        for (int b = 0; b < kDwellBuckets; b++) {
+            if (buckets[b] != 0) {
+                writeVarint(out, buckets[b]);
+            }
+        }
+
+        writeVarint(out, choiceBase[node + 1] - choiceBase[node]);
+        for (uint32_t c = choiceBase[node]; c < choiceBase[node + 1]; c++) {
+            writeVarint(out, choices[c]);
+        }
+    }
+
+    return out;
+}
+
+void NodeAnalytics::reset() {
+    std::fill(visits.begin(), visits.end(), 0);
+    std::fill(dwell.begin(), dwell.end(), 0);
+    std::fill(choices.begin(), choices.end(), 0);
+    // Dwell on the current node restarts from now
+    enterMicros = nowMicros;
+}
+
+} // namespace avg
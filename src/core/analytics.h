@@ -0,0 +1,64 @@
+#ifndef ANALYTICS_H
+#define ANALYTICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace avg {
+
+class GameState;
+
+// Optional per-node play statistics kept in flat arrays indexed by node.
+// Time comes from the host (setTime) so the engine never queries a clock.
+//
+// Dwell time on a node is recorded into log2 buckets: bucket 0 holds visits
+// shorter than kDwellBaseMs, bucket b holds [kDwellBaseMs << (b-1), kDwellBaseMs << b),
+// and the last bucket collects everything longer.
+class NodeAnalytics {
+public:
+    static const int kDwellBuckets = 16;
+    static const uint32_t kDwellBaseMs = 64;
+
+    NodeAnalytics();
+
+    void setEnabled(bool value);
+    bool isEnabled() const { return enabled; }
+
+    // Rebuild the array layout for the loaded script, keeping existing counts
+    void layout(const GameState& state);
+
+    void setTime(uint64_t micros) { nowMicros = micros; }
+
+    // Called on every node transition / choice selection
+    void onEnterNode(int nodeIndex);
+    // Start timing the dwell on nodeIndex without counting a visit (the
+    // node was entered while analytics were off)
+    void resumeAt(int nodeIndex);
+    void onSelectChoice(int nodeIndex, int choiceIndex);
+
+    uint32_t getVisitCount(int nodeIndex) const;
+    uint32_t getChoiceCount(int nodeIndex, int choiceIndex) const;
+    uint32_t getDwellCount(int nodeIndex, int bucket) const;
+
+    // Compact binary export (see analytics.cpp for the format)
+    std::vector<uint8_t> exportBlob() const;
+    void reset();
+
+private:
+    bool enabled;
+    uint64_t nowMicros;
+    int currentNode;
+    uint64_t enterMicros;
+
+    std::vector<uint32_t> visits;       // [node]
+    std::vector<uint32_t> dwell;        // [node * kDwellBuckets + bucket]
+    std::vector<uint32_t> choiceBase;   // [node] offset into choices, size nodeCount + 1
+    std::vector<uint32_t> choices;      // [choiceBase[node] + choice]
+
+    void recordDwell();
+};
+
+} // namespace avg
+
+#endif // ANALYTICS_H
@@ -1,8 +1,54 @@
 #include "avg_engine.h"
+#include "../utils/simple_json.h"
+#include "../utils/trace.h"
+#include <algorithm>
 
 namespace avg {
 
-AVGEngine::AVGEngine() : initialized(false) {
+namespace {
+
+// Upper bound on nodes visited by one prefetch walk
+const int kPrefetchMaxNodes = 256;
+
+// Upper bound on timeline navigations per tick, so a loop of nodes with
+// zero reading time cannot spin forever
+const int kMaxTimelineActions = 256;
+
+// Text with the values of its variable spans inserted, as the front end
+// shows it
+std::string withVariables(const std::string& text, const DialogueNode& node, const GameState& state) {
+    std::string result;
+    size_t copied = 0;
+    size_t byte = 0;
+    uint32_t codepoint = 0;
+    for (const auto& span : node.textSpans) {
+        if (span.type != TextSpanType::Variable || span.value >= node.spanStrings.size()) {
+            continue;
+        }
+        while (byte < text.size() && codepoint < span.start) {
+            byte++;
+            while (byte < text.size() && (static_cast<unsigned char>(text[byte]) & 0xC0) == 0x80) {
+                byte++;
+            }
+            codepoint++;
+        }
+        result.append(text, copied, byte - copied);
+        result += std::to_string(state.getVariable(node.spanStrings.c_str() + span.value));
+        copied = byte;
+    }
+    // No variables; a value is never empty
+    if (result.empty()) {
+        return text;
+    }
+    result.append(text, copied, std::string::npos);
+    return result;
+}
+
+} // namespace
+
+AVGEngine::AVGEngine()
+    : reloadStats(), scriptHash(0), graphModified(false), loadThreads(1), currentNodeWasRead(false), textCompression(false), searchIndexing(false), initialized(false), pendingNavigation(PendingNavigation::None),
+      pendingModule(-1), moduleClock(0), moduleMemoryBudget(0), modulePrefetchDepth(8) {
 }
 
 AVGEngine::~AVGEngine() {
@@ -23,25 +69,214 @@ void AVGEngine::shutdown() {
         return;
     }
 
+    scriptLoader.cancel();
     gameState.reset();
     initialized = false;
 }
 
 bool AVGEngine::loadScript(const char* jsonData) {
+    AVG_TRACE_SCOPE("AVGEngine::loadScript");
+
     if (!initialized) {
         return false;
     }
 
-    return gameState.loadScript(jsonData);
+    // Loads add to the graph, so only a load into an empty one matches the
+    // source hash
+    bool merged = gameState.getNodeCount() > 0;
+    ScriptLoader::Options options;
+    options.threads = loadThreads;
+    ScriptLoader loader;
+    if (!loader.begin(jsonData, false, options) ||
+        loader.step(gameState, -1) != ScriptLoader::Status::Done) {
+        graphModified = true;
+        return false;
+    }
+
+    scriptHash = hashScript(jsonData);
+    graphModified = merged;
+    SessionRecorder::Scope scope(recorder);
+    if (scope.recording()) {
+        recorder.recordScript(scriptHash);
+    }
+    onScriptLoaded();
+    return true;
+}
+
+bool AVGEngine::beginLoadScript(const char* jsonData, bool useWorkerThread) {
+    if (!initialized || !jsonData) {
+        return false;
+    }
+
+    scriptHash = hashScript(jsonData);
+    graphModified = gameState.getNodeCount() > 0;
+    SessionRecorder::Scope scope(recorder);
+    if (scope.recording()) {
+        recorder.recordScript(scriptHash);
+    }
+    ScriptLoader::Options options;
+    options.threads = loadThreads;
+    if (useWorkerThread && scriptLoader.beginAsync(jsonData, options)) {
+        return true;
+    }
+
+    return scriptLoader.begin(jsonData, true, options);
+}
+
+uint64_t AVGEngine::hashScript(const char* jsonData) {
+    if (!jsonData) {
+        return 0;
+    }
+
+    return CompiledScript::hashSource(jsonData, std::char_traits<char>::length(jsonData));
+}
+
+void AVGEngine::exportCompiled(std::vector<uint8_t>& out) const {
+    if (!canExportCompiled()) {
+        out.clear();
+        return;
+    }
+
+    CompiledScript::write(gameState, scriptHash, out);
+}
+
+bool AVGEngine::importCompiled(const uint8_t* data, size_t size) {
+    AVG_TRACE_SCOPE("AVGEngine::importCompiled");
+
+    if (!initialized) {
+        return false;
+    }
+
+    uint64_t hash = 0;
+    if (!CompiledScript::read(data, size, gameState, &hash)) {
+        return false;
+    }
+
+    scriptHash = hash;
+    graphModified = false;
+    SessionRecorder::Scope scope(recorder);
+    if (scope.recording()) {
+        recorder.recordScript(scriptHash);
+    }
+    pendingNavigation = PendingNavigation::None;
+    pendingNodeId.clear();
+    pendingModule = -1;
+    prefetchQueue.clear();
+    onScriptLoaded();
+    return true;
+}
+
+bool AVGEngine::linkScript(const char* nameSpace, const char* jsonData) {
+    AVG_TRACE_SCOPE("AVGEngine::linkScript");
+
+    if (!initialized || !nameSpace || !jsonData) {
+        return false;
+    }
+
+    ScriptLoader::Options options;
+    options.link = true;
+    options.nameSpace = nameSpace;
+    options.threads = loadThreads;
+    ScriptLoader loader;
+    // A failed link can leave nodes committed, so mark before it runs
+    graphModified = true;
+    if (!loader.begin(jsonData, false, options) ||
+        loader.step(gameState, -1) != ScriptLoader::Status::Done) {
+        return false;
+    }
+
+    onScriptLoaded();
+    return true;
+}
+
+bool AVGEngine::beginLinkScript(const char* nameSpace, const char* jsonData, bool useWorkerThread) {
+    if (!initialized || !nameSpace || !jsonData) {
+        return false;
+    }
+
+    ScriptLoader::Options options;
+    options.link = true;
+    options.nameSpace = nameSpace;
+    options.threads = loadThreads;
+    graphModified = true;
+    if (useWorkerThread && scriptLoader.beginAsync(jsonData, options)) {
+        return true;
+    }
+
+    return scriptLoader.begin(jsonData, true, options);
+}
+
+bool AVGEngine::reloadScript(const char* jsonData, const char* nameSpace) {
+    AVG_TRACE_SCOPE("AVGEngine::reloadScript");
+
+    if (!initialized || !jsonData) {
+        return false;
+    }
+
+    ScriptLoader::Options options;
+    options.reload = true;
+    options.threads = loadThreads;
+    if (nameSpace) {
+        options.link = true;
+        options.nameSpace = nameSpace;
+    }
+
+    ScriptLoader loader;
+    graphModified = true;
+    if (!loader.begin(jsonData, false, options) ||
+        loader.step(gameState, -1) != ScriptLoader::Status::Done) {
+        return false;
+    }
+
+    reloadStats = loader.getReloadStats();
+    compactText();
+    updateSearchIndex();
+    readTracker.resize(static_cast<size_t>(gameState.getNodeCount()));
+    analytics.layout(gameState);
+    return true;
+}
+
+ScriptLoader::Status AVGEngine::stepLoadScript(int64_t budgetMicros) {
+    AVG_TRACE_SCOPE("AVGEngine::stepLoadScript");
+
+    if (!initialized) {
+        return ScriptLoader::Status::Failed;
+    }
+
+    if (scriptLoader.getStatus() != ScriptLoader::Status::Running) {
+        return scriptLoader.getStatus();
+    }
+
+    ScriptLoader::Status status = scriptLoader.step(gameState, budgetMicros);
+    if (status == ScriptLoader::Status::Done) {
+        onScriptLoaded();
+    } else if (status == ScriptLoader::Status::Failed) {
+        graphModified = true;
+    }
+    return status;
+}
+
+void AVGEngine::onScriptLoaded() {
+    compactText();
+    updateSearchIndex();
+    readTracker.resize(static_cast<size_t>(gameState.getNodeCount()));
+    analytics.layout(gameState);
+    onEnterCurrentNode();
 }
 
 bool AVGEngine::gotoNode(const char* nodeId) {
+    AVG_TRACE_SCOPE("AVGEngine::gotoNode");
+
     if (!initialized || !nodeId) {
         return false;
     }
 
-    const DialogueNode* node = gameState.getNode(nodeId);
-    if (!node) {
+    SessionRecorder::Scope scope(recorder);
+    if (scope.recording()) {
+        recorder.recordGoto(gameState, nodeId);
+    }
+
+    if (!requireResident(nodeId, PendingNavigation::Goto)) {
         return false;
     }
 
@@ -52,14 +287,26 @@ bool AVGEngine::gotoNode(const char* nodeId) {
     }
 
     gameState.setCurrentNode(nodeId);
+    const DialogueNode* node = gameState.getCurrentNode();
+    if (node) {
+        gameState.runEffects(*node, node->effects);
+    }
+    onEnterCurrentNode();
     return true;
 }
 
 bool AVGEngine::selectChoice(int choiceIndex) {
+    AVG_TRACE_SCOPE("AVGEngine::selectChoice");
+
     if (!initialized) {
         return false;
     }
 
+    SessionRecorder::Scope scope(recorder);
+    if (scope.recording()) {
+        recorder.recordChoice(choiceIndex);
+    }
+
     const DialogueNode* currentNode = gameState.getCurrentNode();
     if (!currentNode) {
         return false;
@@ -70,7 +317,32 @@ bool AVGEngine::selectChoice(int choiceIndex) {
     }
 
     const Choice& choice = currentNode->choices[choiceIndex];
-    return gotoNode(choice.nextNodeId.c_str());
+    if (!gameState.testCondition(*currentNode, choice.condition) || gameState.getNodeIndex(choice.nextNodeId) < 0) {
+        return false;
+    }
+
+    int nodeIndex = gameState.getCurrentNodeIndex();
+    gameState.runEffects(*currentNode, choice.effects);
+    bool moved = gotoNode(choice.nextNodeId.c_str());
+
+    // A choice waiting on its target module still counts as made
+    if (moved || pendingNavigation == PendingNavigation::Goto) {
+        analytics.onSelectChoice(nodeIndex, choiceIndex);
+    }
+    return moved;
+}
+
+void AVGEngine::getChoiceVisibility(std::vector<uint8_t>& visible) const {
+    visible.clear();
+    const DialogueNode* node = getCurrentNode();
+    if (!node) {
+        return;
+    }
+
+    visible.resize(node->choices.size());
+    for (size_t i = 0; i < node->choices.size(); i++) {
+        visible[i] = gameState.testCondition(*node, node->choices[i].condition) ? 1 : 0;
+    }
 }
 
 bool AVGEngine::goBack() {
@@ -78,12 +350,25 @@ bool AVGEngine::goBack() {
         return false;
     }
 
+    SessionRecorder::Scope scope(recorder);
+    if (scope.recording()) {
+        recorder.recordEvent(SessionOp::Back);
+    }
+
     std::string previousNodeId = gameState.popHistory();
     if (previousNodeId.empty()) {
         return false;
     }
 
+    if (!requireResident(previousNodeId, PendingNavigation::Back) &&
+        pendingNavigation == PendingNavigation::Back) {
+        // Put the entry back; goBack() runs again once the module is loaded
+        gameState.pushHistory(previousNodeId);
+        return false;
+    }
+
     gameState.setCurrentNode(previousNodeId);
+    onEnterCurrentNode();
     return true;
 }
 
@@ -107,11 +392,114 @@ std::string AVGEngine::getCurrentNodeId() const {
     return gameState.getCurrentNodeId();
 }
 
+std::string AVGEngine::getCurrentText() const {
+    if (!initialized) {
+        return "";
+    }
+
+    return gameState.getNodeText(gameState.getCurrentNodeIndex());
+}
+
+void AVGEngine::setTextCompression(bool enabled) {
+    if (textCompression == enabled) {
+        return;
+    }
+
+    textCompression = enabled;
+    if (enabled) {
+        gameState.compactText();
+    } else {
+        gameState.expandText();
+    }
+}
+
+bool AVGEngine::loadLocale(const char* jsonData) {
+    AVG_TRACE_SCOPE("AVGEngine::loadLocale");
+
+    if (!initialized || !jsonData) {
+        return false;
+    }
+
+    int changed = gameState.loadLocale(jsonData);
+    if (changed < 0) {
+        return false;
+    }
+
+    if (changed > 0) {
+        compactText();
+        updateSearchIndex();
+        timeline.enterNode(gameState.getCurrentNodeIndex(), gameState.getCurrentNode(), getCurrentText());
+    }
+    return true;
+}
+
+void AVGEngine::unloadLocale() {
+    if (!initialized) {
+        return;
+    }
+
+    if (gameState.unloadLocale() > 0) {
+        compactText();
+        updateSearchIndex();
+        timeline.enterNode(gameState.getCurrentNodeIndex(), gameState.getCurrentNode(), getCurrentText());
+    }
+}
+
+std::string AVGEngine::getLocale() const {
+    if (!initialized) {
+        return "";
+    }
+
+    return gameState.getLocale().getLocale();
+}
+
+void AVGEngine::setSearchIndexing(bool enabled) {
+    searchIndexing = enabled;
+    if (!enabled) {
+        gameState.clearSearchIndex();
+    }
+    updateSearchIndex();
+}
+
+void AVGEngine::search(const char* query, size_t maxResults, std::vector<SearchHit>& hits) const {
+    hits.clear();
+    if (!initialized || !query) {
+        return;
+    }
+
+    gameState.getSearchIndex().search(query, maxResults, hits);
+}
+
+void AVGEngine::updateSearchIndex() {
+    if (gameState.isSearchIndexCurrent()) {
+        return;
+    }
+
+    // A stale index (e.g. imported, then the script changed) is dropped
+    if (searchIndexing) {
+        AVG_TRACE_SCOPE("AVGEngine::updateSearchIndex");
+        gameState.buildSearchIndex();
+    } else {
+        gameState.clearSearchIndex();
+    }
+}
+
+void AVGEngine::compactText() {
+    if (textCompression) {
+        AVG_TRACE_SCOPE("AVGEngine::compactText");
+        gameState.compactText();
+    }
+}
+
 void AVGEngine::setVariable(const char* name, int value) {
     if (!initialized || !name) {
         return;
     }
 
+    SessionRecorder::Scope scope(recorder);
+    if (scope.recording()) {
+        recorder.recordSetVariable(name, value);
+    }
     gameState.setVariable(name, value);
 }
 
@@ -124,19 +512,545 @@ int AVGEngine::getVariable(const char* name) const {
 }
 
 std::string AVGEngine::saveState() const {
+    AVG_TRACE_SCOPE("AVGEngine::saveState");
+
     if (!initialized) {
         return "";
     }
 
+    SessionRecorder::Scope scope(recorder);
+    if (scope.recording()) {
+        recorder.recordEvent(SessionOp::Save);
+    }
     return gameState.serialize();
 }
 
 bool AVGEngine::loadState(const char* saveData) {
+    AVG_TRACE_SCOPE("AVGEngine::loadState");
+
     if (!initialized || !saveData) {
         return false;
     }
 
-    return gameState.deserialize(saveData);
+    SessionRecorder::Scope scope(recorder);
+    if (scope.recording()) {
+        recorder.recordLoad(saveData);
+    }
+    if (!gameState.deserialize(saveData)) {
+        return false;
+    }
+
+    onStateRestored();
+    return true;
+}
+
+bool AVGEngine::takeSnapshot(int slot) {
+    AVG_TRACE_SCOPE("AVGEngine::takeSnapshot");
+
+    if (!initialized || slot < 0 || slot >= kSnapshotSlots) {
+        return false;
+    }
+
+    SessionRecorder::Scope scope(recorder);
+    if (scope.recording()) {
+        recorder.recordSlot(SessionOp::SnapshotTake, slot);
+    }
+    gameState.takeSnapshot(snapshots[slot]);
+    return true;
+}
+
+bool AVGEngine::restoreSnapshot(int slot) {
+    AVG_TRACE_SCOPE("AVGEngine::restoreSnapshot");
+
+    if (!hasSnapshot(slot)) {
+        return false;
+    }
+
+    SessionRecorder::Scope scope(recorder);
+    if (scope.recording()) {
+        recorder.recordSlot(SessionOp::SnapshotRestore, slot);
+    }
+    if (!gameState.restoreSnapshot(snapshots[slot].data(), snapshots[slot].size())) {
+        return false;
+    }
+
+    onStateRestored();
+    return true;
+}
+
+bool AVGEngine::hasSnapshot(int slot) const {
+    return initialized && slot >= 0 && slot < kSnapshotSlots && !snapshots[slot].empty();
+}
+
+std::string AVGEngine::saveSnapshot(int slot) const {
+    if (!hasSnapshot(slot)) {
+        return "";
+    }
+
+    return gameState.serializeSnapshot(snapshots[slot].data(), snapshots[slot].size());
+}
+
+void AVGEngine::clearSnapshot(int slot) {
+    if (slot >= 0 && slot < kSnapshotSlots) {
+        std::vector<uint8_t>().swap(snapshots[slot]);
+    }
+}
+
+void AVGEngine::onStateRestored() {
+    backlog.clear();
+
+    // The saved scene is shown even while its node waits for a module
+    syncScene();
+
+    // A save inside an unloaded module is entered once the module arrives
+    if (!requireResident(gameState.getCurrentNodeId(), PendingNavigation::Enter) &&
+        pendingNavigation == PendingNavigation::Enter) {
+        return;
+    }
+
+    onEnterCurrentNode();
+}
+
+void AVGEngine::onEnterCurrentNode() {
+    markCurrentNodeRead();
+    analytics.onEnterNode(gameState.getCurrentNodeIndex());
+    const DialogueNode* node = gameState.getCurrentNode();
+    timeline.enterNode(gameState.getCurrentNodeIndex(), node, getCurrentText());
+    if (node) {
+        recordBacklog(*node);
+        gameState.applyScene(*node);
+        syncScene();
+        if (node->type == NodeType::CHOICE && !node->choices.empty()) {
+            sceneEvents.choiceShown(gameState.getCurrentNodeIndex(), static_cast<int>(node->choices.size()));
+        }
+    }
+    updateModules();
+}
+
+void AVGEngine::recordBacklog(const DialogueNode& node) {
+    int index = gameState.getCurrentNodeIndex();
+    // Loads and module arrivals re-enter the node that is already logged
+    if (index == backlog.newestNode()) {
+        return;
+    }
+
+    std::string text = withVariables(getCurrentText(), node, gameState);
+    if (!text.empty()) {
+        backlog.push(index, node.speaker, text);
+    }
+}
+
+void AVGEngine::syncScene() {
+    sceneEvents.sync(gameState.getCurrentNodeIndex(), gameState.getScene(), gameState.getSceneGeneration());
+}
+
+void AVGEngine::forwardTimelineEvents(size_t& handled) {
+    // Sound effects go to the scene event ring in firing order, between the
+    // scene changes of any navigation in the same tick
+    const std::vector<TimelineEvent>& events = timeline.events();
+    for (; handled < events.size(); handled++) {
+        if (events[handled].type != TimelineEventType::SoundEffect) {
+            continue;
+        }
+        const DialogueNode* node = gameState.getNodeByIndex(events[handled].nodeIndex);
+        if (node) {
+            sceneEvents.soundEffect(events[handled].nodeIndex, *node);
+        }
+    }
+}
+
+const std::vector<TimelineEvent>& AVGEngine::tick(int64_t deltaMicros) {
+    AVG_TRACE_SCOPE("AVGEngine::tick");
+
+    timeline.clearEvents();
+    if (!initialized) {
+        return timeline.events();
+    }
+
+    int64_t target = timeline.getTime() + std::max<int64_t>(deltaMicros, 0);
+    size_t handled = 0;
+    for (int actions = 0; actions < kMaxTimelineActions && timeline.runUntil(target); actions++) {
+        forwardTimelineEvents(handled);
+        const TimelineEvent& event = timeline.events().back();
+        if (event.type == TimelineEventType::ChoiceTimeout) {
+            selectChoice(event.value);
+            continue;
+        }
+
+        const DialogueNode* node = gameState.getCurrentNode();
+        if (node) {
+            gotoNode(node->nextNodeId.c_str());
+        }
+    }
+    forwardTimelineEvents(handled);
+    return timeline.events();
+}
+
+bool AVGEngine::registerModules(const char* manifestJson) {
+    if (!initialized || !manifestJson) {
+        return false;
+    }
+
+    SimpleJSON json;
+    if (!json.parse(manifestJson)) {
+        return false;
+    }
+
+    // Walk the arrays by index until an entry is missing; getArraySize
+    // scans every key and would make large manifests quadratic
+    bool ok = true;
+    for (int i = 0;; i++) {
+        std::string moduleKey = "modules[" + std::to_string(i) + "]";
+        std::string moduleId = json.getString(moduleKey + ".id");
+        if (moduleId.empty()) {
+            break;
+        }
+
+        std::vector<std::string> nodeIds;
+        for (int j = 0;; j++) {
+            std::string nodeId = json.getString(moduleKey + ".nodes[" + std::to_string(j) + "]");
+            if (nodeId.empty()) {
+                break;
+            }
+            nodeIds.push_back(std::move(nodeId));
+        }
+
+        if (gameState.registerModule(moduleId, nodeIds) < 0) {
+            ok = false;
+        }
+    }
+
+    readTracker.resize(static_cast<size_t>(gameState.getNodeCount()));
+    analytics.layout(gameState);
+    return ok;
+}
+
+bool AVGEngine::loadModule(const char* moduleId, const char* jsonData) {
+    AVG_TRACE_SCOPE("AVGEngine::loadModule");
+
+    if (!initialized || !moduleId || !jsonData) {
+        return false;
+    }
+
+    int moduleIndex = gameState.findModule(moduleId);
+    if (moduleIndex < 0) {
+        return false;
+    }
+    graphModified = true;
+    if (!gameState.loadModule(moduleIndex, jsonData)) {
+        return false;
+    }
+
+    gameState.markModuleResident(moduleIndex);
+    compactText();
+    updateSearchIndex();
+    gameState.touchModule(moduleIndex, ++moduleClock);
+    prefetchQueue.erase(std::remove(prefetchQueue.begin(), prefetchQueue.end(), moduleIndex), prefetchQueue.end());
+    analytics.layout(gameState);
+
+    if (pendingModule != moduleIndex) {
+        enforceModuleBudget(moduleIndex);
+        return true;
+    }
+
+    // Finish the navigation that was waiting for this module; the log
+    // already has the call that started it
+    SessionRecorder::Scope scope(recorder);
+    PendingNavigation navigation = pendingNavigation;
+    std::string nodeId;
+    nodeId.swap(pendingNodeId);
+    pendingNavigation = PendingNavigation::None;
+    pendingModule = -1;
+
+    switch (navigation) {
+        case PendingNavigation::Goto:
+            gotoNode(nodeId.c_str());
+            break;
+        case PendingNavigation::Back:
+            goBack();
+            break;
+        case PendingNavigation::Enter:
+            if (gameState.getCurrentNodeId() == nodeId) {
+                onEnterCurrentNode();
+            }
+            break;
+        default:
+            break;
+    }
+
+    // Evict after moving so the module that was just left can go
+    enforceModuleBudget(moduleIndex);
+    return true;
+}
+
+bool AVGEngine::unloadModule(const char* moduleId) {
+    if (!initialized || !moduleId) {
+        return false;
+    }
+
+    int moduleIndex = gameState.findModule(moduleId);
+    if (moduleIndex < 0 || moduleIndex == gameState.getModuleForIndex(gameState.getCurrentNodeIndex())) {
+        return false;
+    }
+
+    gameState.evictModule(moduleIndex);
+    return true;
+}
+
+bool AVGEngine::isModuleLoaded(const char* moduleId) const {
+    if (!initialized || !moduleId) {
+        return false;
+    }
+
+    int moduleIndex = gameState.findModule(moduleId);
+    return moduleIndex >= 0 && gameState.getModules()[moduleIndex].resident;
+}
+
+std::string AVGEngine::getPendingModule() const {
+    if (pendingModule < 0) {
+        return "";
+    }
+    return gameState.getModules()[pendingModule].id;
+}
+
+std::string AVGEngine::popPrefetchModule() {
+    while (!prefetchQueue.empty()) {
+        int moduleIndex = prefetchQueue.front();
+        prefetchQueue.erase(prefetchQueue.begin());
+        if (!gameState.getModules()[moduleIndex].resident) {
+            return gameState.getModules()[moduleIndex].id;
+        }
+    }
+    return "";
+}
+
+void AVGEngine::setModuleMemoryBudget(size_t bytes) {
+    moduleMemoryBudget = bytes;
+    enforceModuleBudget(gameState.getModuleForIndex(gameState.getCurrentNodeIndex()));
+}
+
+size_t AVGEngine::getModuleResidentBytes() const {
+    size_t total = 0;
+    for (const auto& module : gameState.getModules()) {
+        if (module.resident) {
+            total += module.residentBytes;
+        }
+    }
+    return total;
+}
+
+bool AVGEngine::requireResident(const std::string& nodeId, PendingNavigation navigation) {
+    // Any new navigation replaces one that was still waiting
+    pendingNavigation = PendingNavigation::None;
+    pendingNodeId.clear();
+    pendingModule = -1;
+
+    int index = gameState.getNodeIndex(nodeId);
+    if (gameState.isNodeResident(index)) {
+        return true;
+    }
+
+    int moduleIndex = gameState.getModuleForIndex(index);
+    if (moduleIndex < 0) {
+        return false;
+    }
+
+    pendingNavigation = navigation;
+    pendingNodeId = nodeId;
+    pendingModule = moduleIndex;
+    return false;
+}
+
+void AVGEngine::updateModules() {
+    const std::vector<ScriptModule>& modules = gameState.getModules();
+    if (modules.empty()) {
+        return;
+    }
+
+    int currentIndex = gameState.getCurrentNodeIndex();
+    gameState.touchModule(gameState.getModuleForIndex(currentIndex), ++moduleClock);
+
+    // Walk the resident graph a few links ahead and queue unloaded modules
+    // it leads into, nearest first
+    prefetchQueue.clear();
+    if (modulePrefetchDepth == 0 || currentIndex < 0) {
+        return;
+    }
+
+    std::vector<int> frontier(1, currentIndex);
+    std::vector<int> next;
+    std::vector<int> visited(1, currentIndex);
+    auto visit = [&](const std::string& targetId) {
+        int target = gameState.getNodeIndex(targetId);
+        if (target < 0 || std::find(visited.begin(), visited.end(), target) != visited.end()) {
+            return;
+        }
+        visited.push_back(target);
+
+        if (gameState.isNodeResident(target)) {
+            next.push_back(target);
+            return;
+        }
+
+        int moduleIndex = gameState.getModuleForIndex(target);
+        if (moduleIndex >= 0 && moduleIndex != pendingModule &&
+            std::find(prefetchQueue.begin(), prefetchQueue.end(), moduleIndex) == prefetchQueue.end()) {
+            prefetchQueue.push_back(moduleIndex);
+        }
+    };
+
+    for (int depth = 0; depth < modulePrefetchDepth && !frontier.empty(); depth++) {
+        next.clear();
+        for (int index : frontier) {
+            const DialogueNode* node = gameState.getNodeByIndex(index);
+            if (!node) {
+                continue;
+            }
+            if (!node->nextNodeId.empty()) {
+                visit(node->nextNodeId);
+            }
+            for (const auto& choice : node->choices) {
+                visit(choice.nextNodeId);
+            }
+            if (static_cast<int>(visited.size()) >= kPrefetchMaxNodes) {
+                return;
+            }
+        }
+        frontier.swap(next);
+    }
+}
+
+void AVGEngine::enforceModuleBudget(int keepModule) {
+    if (moduleMemoryBudget == 0) {
+        return;
+    }
+
+    int currentModule = gameState.getModuleForIndex(gameState.getCurrentNodeIndex());
+    size_t total = getModuleResidentBytes();
+
+    while (total > moduleMemoryBudget) {
+        // Least recently used resident module other than the ones in use
+        int victim = -1;
+        const std::vector<ScriptModule>& modules = gameState.getModules();
+        for (size_t i = 0; i < modules.size(); i++) {
+            int index = static_cast<int>(i);
+            if (!modules[i].resident || index == keepModule || index == currentModule) {
+                continue;
+            }
+            if (victim < 0 || modules[i].lastUsed < modules[victim].lastUsed) {
+                victim = index;
+            }
+        }
+
+        if (victim < 0) {
+            break;
+        }
+        total -= gameState.evictModule(victim);
+    }
+}
+
+void AVGEngine::markCurrentNodeRead() {
+    int index = gameState.getCurrentNodeIndex();
+    if (index < 0) {
+        currentNodeWasRead = false;
+        return;
+    }
+
+    currentNodeWasRead = readTracker.isRead(static_cast<size_t>(index));
+    readTracker.markRead(static_cast<size_t>(index));
+}
+
+bool AVGEngine::isNodeRead(const char* nodeId) const {
+    if (!initialized || !nodeId) {
+        return false;
+    }
+
+    int index = gameState.getNodeIndex(nodeId);
+    return index >= 0 && readTracker.isRead(static_cast<size_t>(index));
+}
+
+int AVGEngine::getReadCount() const {
+    if (!initialized) {
+        return 0;
+    }
+
+    return static_cast<int>(readTracker.countRead(0, static_cast<size_t>(gameState.getNodeCount())));
+}
+
+int AVGEngine::getChapterReadCount(const char* chapter) const {
+    if (!initialized || !chapter) {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (const auto& range : gameState.getChapters()) {
+        if (range.name == chapter) {
+            count += readTracker.countRead(static_cast<size_t>(range.begin),
+                                           static_cast<size_t>(range.end));
+        }
+    }
+    return static_cast<int>(count);
+}
+
+int AVGEngine::getChapterNodeCount(const char* chapter) const {
+    if (!initialized || !chapter) {
+        return 0;
+    }
+
+    int count = 0;
+    for (const auto& range : gameState.getChapters()) {
+        if (range.name == chapter) {
+            count += range.end - range.begin;
+        }
+    }
+    return count;
+}
+
+std::string AVGEngine::saveReadState() const {
+    if (!initialized) {
+        return "";
+    }
+
+    std::vector<uint64_t> idHashes;
+    gameState.getNodeIdHashes(idHashes);
+    return readTracker.serialize(idHashes);
+}
+
+bool AVGEngine::loadReadState(const char* readData) {
+    if (!initialized || !readData) {
+        return false;
+    }
+
+    std::vector<uint64_t> idHashes;
+    gameState.getNodeIdHashes(idHashes);
+    return readTracker.deserialize(readData, idHashes);
+}
+
+void AVGEngine::clearReadState() {
+    if (!initialized) {
+        return;
+    }
+
+    readTracker.clear();
+    currentNodeWasRead = false;
+}
+
+void AVGEngine::setAnalyticsEnabled(bool enabled) {
+    analytics.setEnabled(enabled);
+    if (enabled) {
+        analytics.layout(gameState);
+        analytics.resumeAt(gameState.getCurrentNodeIndex());
+    }
+}
+
+void AVGEngine::setSessionRecording(bool enabled) {
+    if (!enabled) {
+        recorder.stop();
+        return;
+    }
+
+    bool running = initialized && !gameState.getCurrentNodeId().empty();
+    recorder.start(scriptHash, running ? gameState.serialize() : std::string());
 }
 
 void AVGEngine::reset() {
@@ -144,7 +1058,14 @@ void AVGEngine::reset() {
         return;
     }
 
+    SessionRecorder::Scope scope(recorder);
+    if (scope.recording()) {
+        recorder.recordEvent(SessionOp::Reset);
+    }
     gameState.reset();
+    backlog.clear();
+    timeline.enterNode(-1, nullptr, std::string());
+    syncScene();
 }
 
 } // namespace avg
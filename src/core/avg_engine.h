@@ -1,8 +1,17 @@
 #ifndef AVG_ENGINE_H
 #define AVG_ENGINE_H
 
+#include "analytics.h"
+#include "backlog.h"
+#include "compiled_script.h"
 #include "game_state.h"
+#include "read_tracker.h"
+#include "scene_events.h"
+#include "script_loader.h"
+#include "session_recorder.h"
+#include "timeline.h"
 #include <string>
+#include <vector>
 
 namespace avg {
 
@@ -18,15 +27,126 @@ public:
     // Script loading
     bool loadScript(const char* jsonData);
 
-    // Navigation
+    // Incremental script loading. Call stepLoadScript() once per frame until
+    // it returns Done or Failed; do not navigate while a load is running.
+    // With useWorkerThread the scan/parse phases run on a worker thread (when
+    // the build has threads) and steps only commit the parsed nodes.
+    bool beginLoadScript(const char* jsonData, bool useWorkerThread = false);
+    ScriptLoader::Status stepLoadScript(int64_t budgetMicros);
+    float getLoadProgress() const { return scriptLoader.getProgress(); }
+    // Parse threads for every load, link and reload (1 = the loading thread
+    // only, 0 = one per hardware thread); see ScriptLoader::Options
+    void setLoadThreads(int threads) { loadThreads = threads; }
+
+    // Compiled script cache. getScriptHash is the content hash of the last
+    // script loaded with loadScript/beginLoadScript; a host caches the
+    // exported blob under that hash and imports it instead of parsing when
+    // hashScript() of the source matches. Once a link, reload, module load,
+    // failed load or load on top of existing nodes has changed the graph it
+    // no longer matches that source, and exportCompiled leaves out empty. The
+    // same holds while a locale is loaded, as nodes show its strings.
+    static uint64_t hashScript(const char* jsonData);
+    uint64_t getScriptHash() const { return scriptHash; }
+    bool canExportCompiled() const { return scriptHash != 0 && !graphModified && gameState.getLocale().empty(); }
+    void exportCompiled(std::vector<uint8_t>& out) const;
+    // Replaces the loaded script and resets the session, like a fresh load
+    bool importCompiled(const uint8_t* data, size_t size);
+
+    // Link another script file (e.g. a DLC route) into the loaded graph under
+    // a namespace; see ScriptLoader::begin. Existing nodes are never replaced
+    // and the current node is kept. beginLinkScript is the incremental form,
+    // advanced with stepLoadScript().
+    bool linkScript(const char* nameSpace, const char* jsonData);
+    bool beginLinkScript(const char* nameSpace, const char* jsonData, bool useWorkerThread = false);
+    const std::vector<std::string>& getUnresolvedLinks() const { return gameState.getUnresolvedLinks(); }
+
+    // Hot reload: apply an edited script while the game runs. Nodes are
+    // diffed by id and content hash; the current node, variables and history
+    // stay valid (nodes they reference are kept even if the file dropped
+    // them). nameSpace selects a linked file; nullptr is the root script.
+    bool reloadScript(const char* jsonData, const char* nameSpace = nullptr);
+    const ScriptLoader::ReloadStats& getReloadStats() const { return reloadStats; }
+
+    // Script modules (lazily loaded chapters). The manifest lists each
+    // module's node ids: {"modules":[{"id":"ch2","nodes":["ch2_start",...]}]}.
+    // Navigating into a module that is not loaded fails and records the
+    // module as pending; the host fetches it and calls loadModule(), which
+    // completes the navigation. Loaded modules are evicted least recently
+    // used first once the memory budget (0 = unlimited) is exceeded.
+    bool registerModules(const char* manifestJson);
+    bool loadModule(const char* moduleId, const char* jsonData);
+    bool unloadModule(const char* moduleId);
+    bool isModuleLoaded(const char* moduleId) const;
+    // Module needed by a blocked navigation, or "" if none
+    std::string getPendingModule() const;
+    // Next module predicted to be needed soon, or "" (removes it from the queue)
+    std::string popPrefetchModule();
+    void setModuleMemoryBudget(size_t bytes);
+    void setModulePrefetchDepth(int depth) { modulePrefetchDepth = depth < 0 ? 0 : depth; }
+    size_t getModuleResidentBytes() const;
+
+    // Navigation. Entering a node runs its "set" effects; a choice runs
+    // its own first, and fails while its "if" condition is false.
     bool gotoNode(const char* nodeId);
     bool selectChoice(int choiceIndex);
+    // One byte per choice of the current node: 1 when its condition holds
+    void getChoiceVisibility(std::vector<uint8_t>& visible) const;
     bool goBack();
     bool canGoBack() const;
 
-    // Current node access
+    // Timeline: typewriter/auto mode timing, delayed sound effects and timed
+    // choices. The host calls tick() once per frame with the elapsed time
+    // and handles the returned events; when AutoAdvance or ChoiceTimeout is
+    // returned the engine has already moved on. Entering a node (however it
+    // happens) restarts the timeline for that node.
+    const std::vector<TimelineEvent>& tick(int64_t deltaMicros);
+    const std::vector<TimelineEvent>& getTickEvents() const { return timeline.events(); }
+    void setAutoMode(bool enabled) { timeline.setAutoMode(enabled); }
+    bool isAutoMode() const { return timeline.isAutoMode(); }
+    void setTextSpeed(int64_t charMicros) { timeline.setTextSpeed(charMicros); }
+    void setAutoDelay(int64_t baseMicros, int64_t charMicros) { timeline.setAutoDelay(baseMicros, charMicros); }
+    // The player skipped the typewriter effect
+    void completeText() { timeline.completeText(); }
+    int64_t getChoiceTimeRemaining() const { return timeline.getChoiceTimeRemaining(); }
+
+    // Scene events (BGM, sound effects, background, characters, choices) for
+    // the front end, emitted only when the effective scene actually changes.
+    // The host drains the ring once per frame; see SceneEventQueue.
+    SceneEventQueue& getSceneEvents() { return sceneEvents; }
+    const SceneEventQueue& getSceneEvents() const { return sceneEvents; }
+
+    // Full-text search over dialogue, speakers and choices (see SearchIndex
+    // for the query syntax). With indexing on, the index is rebuilt after
+    // every load, link, reload, module or locale load that changed strings;
+    // an index imported with a compiled blob is used as is. Off by default.
+    void setSearchIndexing(bool enabled);
+    bool isSearchIndexing() const { return searchIndexing; }
+    void search(const char* query, size_t maxResults, std::vector<SearchHit>& hits) const;
+
+    // Lines shown this session, newest last, with variables filled in as
+    // they were displayed. Entering a node with text appends it; loading a
+    // save or resetting clears the log.
+    Backlog& getBacklog() { return backlog; }
+    const Backlog& getBacklog() const { return backlog; }
+
+    // Current node access. Use getCurrentText() for the dialogue text: with
+    // text compression on, the node's own text field is empty.
     const DialogueNode* getCurrentNode() const;
     std::string getCurrentNodeId() const;
+    std::string getCurrentText() const;
+
+    // Keep dialogue text in compressed blocks (see TextStore), decoded when
+    // a node is shown. Off by default; toggling converts resident text.
+    void setTextCompression(bool enabled);
+    bool isTextCompressed() const { return textCompression; }
+
+    // Localisation: load a locale's string table (see GameState::loadLocale)
+    // in place of the active one. Only the script structure stays shared, so
+    // switching language costs one table parse instead of a script reload.
+    // The current line restarts its typewriter in the new language.
+    bool loadLocale(const char* jsonData);
+    void unloadLocale();
+    std::string getLocale() const;
 
     // Variables
     void setVariable(const char* name, int value);
@@ -36,15 +156,110 @@ public:
     std::string saveState() const;
     bool loadState(const char* saveData);
 
+    // In-memory snapshot slots for instant quick save/load. takeSnapshot
+    // copies the session into a flat record (GameState::takeSnapshot) and
+    // restoreSnapshot enters it like loadState, with no JSON in between.
+    // Persisting a slot is a separate step the host can defer: saveSnapshot
+    // formats it as loadState JSON.
+    static const int kSnapshotSlots = 16;
+    bool takeSnapshot(int slot);
+    bool restoreSnapshot(int slot);
+    bool hasSnapshot(int slot) const;
+    std::string saveSnapshot(int slot) const;
+    void clearSnapshot(int slot);
+
+    // Read tracking (global across save slots)
+    bool isNodeRead(const char* nodeId) const;
+    // True if the current node had already been read before this visit
+    bool isCurrentNodeRead() const { return currentNodeWasRead; }
+    int getReadCount() const;
+    int getChapterReadCount(const char* chapter) const;
+    int getChapterNodeCount(const char* chapter) const;
+    // Stored by node id; loading merges into the bits already set (the start
+    // node is marked read as soon as a script loads)
+    std::string saveReadState() const;
+    bool loadReadState(const char* readData);
+    void clearReadState();
+
+    // Play analytics (off by default). The host supplies timestamps in
+    // microseconds; transitions are timed against the last value set.
+    void setAnalyticsEnabled(bool enabled);
+    void setAnalyticsTime(uint64_t micros) { analytics.setTime(micros); }
+    const NodeAnalytics& getAnalytics() const { return analytics; }
+    NodeAnalytics& getAnalytics() { return analytics; }
+
+    // Session recording (off by default): an input log of this session for
+    // the native replay tool (see SessionRecorder). Starting a recording
+    // drops the previous log and notes the script hash and the current
+    // session. Loads of linked files and modules are not recorded. The host
+    // supplies timestamps in microseconds.
+    void setSessionRecording(bool enabled);
+    bool isSessionRecording() const { return recorder.isRecording(); }
+    void setSessionTime(uint64_t micros) { recorder.setTime(micros); }
+    const std::vector<uint8_t>& getSessionLog() const { return recorder.getLog(); }
+
     // Reset
     void reset();
 
     GameState& getGameState() { return gameState; }
     const GameState& getGameState() const { return gameState; }
+    const ReadTracker& getReadTracker() const { return readTracker; }
 
 private:
     GameState gameState;
+    ReadTracker readTracker;
+    NodeAnalytics analytics;
+    ScriptLoader scriptLoader;
+    ScriptLoader::ReloadStats reloadStats;
+    Timeline timeline;
+    SceneEventQueue sceneEvents;
+    Backlog backlog;
+    std::vector<uint8_t> snapshots[kSnapshotSlots];
+    // Recording a call is not a change of engine state, so const calls
+    // (saveState) record too
+    mutable SessionRecorder recorder;
+    uint64_t scriptHash;
+    // Set when the graph changed since the load that set scriptHash
+    bool graphModified;
+    int loadThreads;
+    bool currentNodeWasRead;
+    bool textCompression;
+    bool searchIndexing;
     bool initialized;
+
+    // Navigation waiting for a module to be loaded
+    enum class PendingNavigation {
+        None,
+        Goto,
+        Back,
+        Enter
+    };
+
+    PendingNavigation pendingNavigation;
+    std::string pendingNodeId;
+    int pendingModule;
+    std::vector<int> prefetchQueue;
+    uint64_t moduleClock;
+    size_t moduleMemoryBudget;
+    int modulePrefetchDepth;
+
+    void markCurrentNodeRead();
+    void onEnterCurrentNode();
+    void onScriptLoaded();
+    // Enter the session just restored from a save or snapshot
+    void onStateRestored();
+    void recordBacklog(const DialogueNode& node);
+    // Compress text added since the last call, if compression is on
+    void compactText();
+    // Rebuild the search index after strings changed, or drop it when
+    // indexing is off
+    void updateSearchIndex();
+    void forwardTimelineEvents(size_t& handled);
+    // Emit scene events for changes to the effective scene
+    void syncScene();
+    bool requireResident(const std::string& nodeId, PendingNavigation navigation);
+    void updateModules();
+    void enforceModuleBudget(int keepModule);
 };
 
 } // namespace avg
@@ -0,0 +1,146 @@
+#include "backlog.h"
+#include <cstring>
+
+namespace avg {
+
+namespace {
+
+size_t roundUpPow2(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+void putWord(uint8_t* out, uint32_t value) {
+    std::memcpy(out, &value, sizeof(value));
+}
+
+} // namespace
+
+Backlog::Backlog() : head(0), tail(0), textHead(0) {
+    setCapacity(kDefaultLines, kDefaultTextBytes);
+}
+
+void Backlog::setCapacity(size_t lineCount, size_t textBytes) {
+    lines.assign(roundUpPow2(lineCount ? lineCount : 1), Line());
+    text.assign(roundUpPow2(textBytes ? textBytes : 1), 0);
+    clear();
+}
+
+void Backlog::push(int nodeIndex, const std::string& speaker, const std::string& lineText) {
+    const size_t textCapacity = text.size();
+    size_t length = lineText.size();
+    if (length > textCapacity) {
+        // Keep whole UTF-8 sequences
+        length = textCapacity;
+        while (length > 0 && (static_cast<unsigned char>(lineText[length]) & 0xC0) == 0x80) {
+            length--;
+        }
+    }
+
+    // Make room in both rings
+    while (head - tail >= lines.size()) {
+        tail++;
+    }
+    while (tail < head && lines[tail & (lines.size() - 1)].textStart + textCapacity < textHead + length) {
+        tail++;
+    }
+
+    Line& line = lines[head & (lines.size() - 1)];
+    line.nodeIndex = nodeIndex;
+    line.speaker = speaker.empty() ? -1 : internSpeaker(speaker);
+    line.textStart = textHead;
+    line.textLength = static_cast<uint32_t>(length);
+
+    size_t at = static_cast<size_t>(textHead & (textCapacity - 1));
+    size_t first = length < textCapacity - at ? length : textCapacity - at;
+    std::memcpy(&text[at], lineText.data(), first);
+    std::memcpy(&text[0], lineText.data() + first, length - first);
+
+    textHead += length;
+    head++;
+}
+
+int Backlog::newestNode() const {
+    return head == tail ? -1 : lines[(head - 1) & (lines.size() - 1)].nodeIndex;
+}
+
+size_t Backlog::page(size_t offset, size_t count, uint8_t* out, size_t outBytes) const {
+    const size_t kHeader = 2 * sizeof(uint32_t);
+    const size_t kRecord = 4 * sizeof(uint32_t);
+    if (!out || outBytes < kHeader) {
+        return 0;
+    }
+
+    size_t available = size();
+    offset = offset < available ? offset : available;
+    count = count < available - offset ? count : available - offset;
+    uint64_t last = head - offset;
+    uint64_t first = last - count;
+
+    // Drop the oldest lines of the range until the page fits
+    size_t textBytes = 0;
+    for (uint64_t i = first; i < last; i++) {
+        textBytes += lines[i & (lines.size() - 1)].textLength;
+    }
+    while (first < last && kHeader + (last - first) * kRecord + textBytes > outBytes) {
+        textBytes -= lines[first & (lines.size() - 1)].textLength;
+        first++;
+    }
+
+    uint32_t written = static_cast<uint32_t>(last - first);
+    putWord(out, written);
+    putWord(out + 4, static_cast<uint32_t>(textBytes));
+
+    uint8_t* record = out + kHeader;
+    uint8_t* textOut = record + written * kRecord;
+    uint32_t textOffset = 0;
+    for (uint64_t i = first; i < last; i++, record += kRecord) {
+        const Line& line = lines[i & (lines.size() - 1)];
+        putWord(record, static_cast<uint32_t>(line.nodeIndex));
+        putWord(record + 4, static_cast<uint32_t>(line.speaker));
+        putWord(record + 8, textOffset);
+        putWord(record + 12, line.textLength);
+        copyText(line.textStart, line.textLength, textOut + textOffset);
+        textOffset += line.textLength;
+    }
+    return kHeader + written * kRecord + textBytes;
+}
+
+int32_t Backlog::internSpeaker(const std::string& name) {
+    auto it = speakerIds.find(name);
+    if (it != speakerIds.end()) {
+        return it->second;
+    }
+
+    int32_t id = static_cast<int32_t>(speakerNames.size());
+    speakerNames.push_back(name);
+    speakerIds.emplace(name, id);
+    return id;
+}
+
+const std::string& Backlog::getSpeakerName(int32_t id) const {
+    static const std::string kEmpty;
+    if (id < 0 || id >= static_cast<int32_t>(speakerNames.size())) {
+        return kEmpty;
+    }
+    return speakerNames[id];
+}
+
+void Backlog::clear() {
+    head = 0;
+    tail = 0;
+    textHead = 0;
+}
+
+void Backlog::copyText(uint64_t start, uint32_t length, uint8_t* out) const {
+    const size_t textCapacity = text.size();
+    size_t at = static_cast<size_t>(start & (textCapacity - 1));
+    size_t first = length < textCapacity - at ? length : textCapacity - at;
+    std::memcpy(out, &text[at], first);
+    std::memcpy(out + first, &text[0], length - first);
+}
+
+} // namespace avg
@@ -0,0 +1,76 @@
+#ifndef BACKLOG_H
+#define BACKLOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace avg {
+
+// Log of the lines shown this session, for the backlog (history) screen.
+//
+// Lines are a ring of (node index, speaker id, text span) records; their
+// text is copied into a byte ring, so lines stay as shown even if the
+// script or locale changes later. The oldest lines are dropped when either
+// ring is full. Speaker names are interned, and ids are stable for the
+// engine's lifetime.
+//
+// page() copies a range of lines into a caller buffer in one go, so the UI
+// reads only the page it shows and no per-line strings are built here:
+//
+//   uint32 count, uint32 textBytes
+//   count x { int32 nodeIndex, int32 speaker, uint32 textOffset, uint32 textLength }
+//   textBytes of UTF-8, textOffset relative to its start
+class Backlog {
+public:
+    static const size_t kDefaultLines = 2048;
+    static const size_t kDefaultTextBytes = 256 * 1024;
+
+    Backlog();
+
+    // Clears the log; sizes are rounded up to powers of two
+    void setCapacity(size_t lines, size_t textBytes);
+
+    void push(int nodeIndex, const std::string& speaker, const std::string& text);
+    size_t size() const { return static_cast<size_t>(head - tail); }
+    // Node index of the newest line, or -1
+    int newestNode() const;
+
+    // Lines [size - offset - count, size - offset), i.e. offset counts back
+    // from the newest line, oldest first. When the buffer is too small the
+    // oldest lines of the range are left out. Returns the bytes written (0
+    // when not even the header fits).
+    size_t page(size_t offset, size_t count, uint8_t* out, size_t outBytes) const;
+
+    int32_t internSpeaker(const std::string& name);
+    // "" for -1 (no speaker) and unknown ids
+    const std::string& getSpeakerName(int32_t id) const;
+
+    void clear();
+
+private:
+    struct Line {
+        int32_t nodeIndex;
+        int32_t speaker;
+        uint64_t textStart;   // position in the text stream, see textHead
+        uint32_t textLength;
+    };
+
+    std::vector<Line> lines;
+    std::vector<char> text;
+    // Free-running counters: lines [tail, head) and text bytes up to textHead;
+    // ring positions are (counter & (capacity - 1))
+    uint64_t head;
+    uint64_t tail;
+    uint64_t textHead;
+    std::vector<std::string> speakerNames;
+    std::unordered_map<std::string, int32_t> speakerIds;
+
+    void copyText(uint64_t start, uint32_t length, uint8_t* out) const;
+};
+
+} // namespace avg
+
+#endif // BACKLOG_H
@@ -0,0 +1,595 @@
+#include "compiled_script.h"
+#include "game_state.h"
+#include "../utils/hash.h"
+#include "../utils/trace.h"
+#include <cstring>
+
+namespace avg {
+
+namespace {
+
+class Writer {
+public:
+    explicit Writer(std::vector<uint8_t>& out) : out(out) {}
+
+    void varint(uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    void fixed64(uint64_t value) {
+        for (int i = 0; i < 8; i++) {
+            out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    void str(const std::string& value) {
+        varint(value.size());
+        out.insert(out.end(), value.begin(), value.end());
+    }
+
+private:
+    std::vector<uint8_t>& out;
+};
+
+// Bounds-checked reader; any overrun latches ok = false
+class Reader {
+public:
+    Reader(const uint8_t* data, size_t size) : p(data), end(data + size), ok(true) {}
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p >= end) {
+                ok = false;
+                return 0;
+            }
+            uint8_t byte = *p++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+
+    int index() {
+        uint64_t value = varint();
+        if (value > 0x7fffffff) {
+            ok = false;
+            return 0;
+        }
+        return static_cast<int>(value);
+    }
+
+    uint64_t fixed64() {
+        if (end - p < 8) {
+            ok = false;
+            return 0;
+        }
+        uint64_t value = 0;
+        for (int i = 0; i < 8; i++) {
+            value |= static_cast<uint64_t>(p[i]) << (8 * i);
+        }
+        p += 8;
+        return value;
+    }
+
+    void str(std::string& value) {
+        uint64_t length = varint();
+        if (!ok || length > static_cast<uint64_t>(end - p)) {
+            ok = false;
+            return;
+        }
+        value.assign(reinterpret_cast<const char*>(p), static_cast<size_t>(length));
+        p += length;
+    }
+
+    void bytes(uint8_t* out, size_t length) {
+        if (length > static_cast<size_t>(end - p)) {
+            ok = false;
+            return;
+        }
+        std::memcpy(out, p, length);
+        p += length;
+    }
+
+    // Element counts are bounded by the remaining bytes (each element
+    // takes at least one), which keeps corrupt blobs from huge reserves
+    size_t count() {
+        uint64_t value = varint();
+        if (value > static_cast<uint64_t>(end - p)) {
+            ok = false;
+            return 0;
+        }
+        return static_cast<size_t>(value);
+    }
+
+    bool magic() {
+        if (end - p < 4 || p[0] != 'A' || p[1] != 'V' || p[2] != 'G' || p[3] != 'C') {
+            ok = false;
+            return false;
+        }
+        p += 4;
+        return true;
+    }
+
+    bool good() const { return ok; }
+
+private:
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok;
+};
+
+// Markup spans of a text and the strings they name
+void writeSpans(Writer& w, const std::vector<TextSpan>& spans, const std::string& strings) {
+    w.varint(spans.size());
+    for (const auto& span : spans) {
+        w.varint(static_cast<uint64_t>(span.type));
+        w.varint(span.style);
+        w.varint(span.start);
+        w.varint(span.length);
+        w.varint(span.color);
+        w.varint(span.value);
+    }
+    w.str(strings);
+}
+
+bool readSpans(Reader& r, std::vector<TextSpan>& spans, std::string& strings) {
+    spans.resize(r.count());
+    for (auto& span : spans) {
+        uint64_t spanType = r.varint();
+        if (spanType < static_cast<uint64_t>(TextSpanType::Text) ||
+            spanType > static_cast<uint64_t>(TextSpanType::Variable)) {
+            return false;
+        }
+        span.type = static_cast<TextSpanType>(spanType);
+        span.style = static_cast<uint16_t>(r.varint());
+        span.start = static_cast<uint32_t>(r.varint());
+        span.length = static_cast<uint32_t>(r.varint());
+        span.color = static_cast<uint32_t>(r.varint());
+        span.value = static_cast<uint32_t>(r.varint());
+    }
+    r.str(strings);
+    for (const auto& span : spans) {
+        bool named = span.type == TextSpanType::Ruby || span.type == TextSpanType::Variable;
+        if (named && span.value >= strings.size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool validEntry(uint32_t entry, const ScriptCode& code) {
+    return entry == script_code::kNone || entry < code.words.size();
+}
+
+bool validScript(const DialogueNode& node) {
+    std::vector<std::string> names;
+    script_code::getNames(node.script, names);
+    if (!script_code::verify(node.script, static_cast<uint32_t>(names.size())) ||
+        !validEntry(node.effects, node.script)) {
+        return false;
+    }
+    for (const auto& choice : node.choices) {
+        if (!validEntry(choice.condition, node.script) || !validEntry(choice.effects, node.script)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+uint64_t CompiledScript::hashSource(const char* jsonData, size_t length) {
+    return hash::hash64(jsonData, length);
+}
+
+void CompiledScript::write(const GameState& state, uint64_t sourceHash, std::vector<uint8_t>& out) {
+    AVG_TRACE_SCOPE("CompiledScript::write");
+
+    out.clear();
+    out.push_back('A');
+    out.push_back('V');
+    out.push_back('G');
+    out.push_back('C');
+
+    Writer w(out);
+    w.varint(kVersion);
+    w.fixed64(sourceHash);
+
+    w.varint(state.nodeSlots.size());
+    for (size_t i = 0; i < state.nodeSlots.size(); i++) {
+        int slot = state.nodeSlots[i];
+        // Module nodes come from their module files
+        if (slot < 0 || state.getModuleForIndex(static_cast<int>(i)) >= 0) {
+            w.varint(0);
+            continue;
+        }
+
+        const DialogueNode& node = state.nodes[slot];
+        w.varint(1);
+        w.fixed64(state.nodeHashes[i]);
+        w.varint(static_cast<uint64_t>(node.type));
+        w.str(node.id);
+        w.str(node.speaker);
+        w.str(state.getNodeText(static_cast<int>(i)));
+        writeSpans(w, node.textSpans, node.spanStrings);
+        w.str(node.nextNodeId);
+        w.varint(node.choices.size());
+        // Entries are stored + 1 so kNone is 0
+        for (const auto& choice : node.choices) {
+            w.str(choice.text);
+            writeSpans(w, choice.textSpans, choice.spanStrings);
+            w.str(choice.nextNodeId);
+            w.varint(static_cast<uint32_t>(choice.condition + 1));
+            w.varint(static_cast<uint32_t>(choice.effects + 1));
+        }
+        w.varint(node.script.words.size());
+        for (uint32_t word : node.script.words) {
+            w.varint(word);
+        }
+        w.str(node.script.names);
+        w.varint(static_cast<uint32_t>(node.effects + 1));
+        w.str(node.background);
+        w.str(node.character);
+        w.str(node.characterExpression);
+        w.varint(static_cast<uint32_t>(node.characterSlot));
+        w.str(node.bgm);
+        w.str(node.soundEffect);
+        w.str(node.chapter);
+        w.varint(static_cast<uint64_t>(node.soundEffectDelayMs));
+        w.varint(static_cast<uint64_t>(node.choiceTimeoutMs));
+        w.varint(static_cast<uint32_t>(node.timeoutChoice));
+    }
+
+    w.varint(state.chapters.size());
+    for (const auto& chapter : state.chapters) {
+        w.str(chapter.name);
+        w.varint(static_cast<uint64_t>(chapter.begin));
+        w.varint(static_cast<uint64_t>(chapter.end));
+    }
+
+    w.varint(state.modules.size());
+    for (const auto& module : state.modules) {
+        w.str(module.id);
+        w.varint(static_cast<uint64_t>(module.begin));
+        w.varint(static_cast<uint64_t>(module.end));
+        w.varint(module.loadedOnce ? 1 : 0);
+    }
+
+    w.varint(state.reservedIndices.size());
+    for (const auto& entry : state.reservedIndices) {
+        w.fixed64(entry.first);
+        w.varint(static_cast<uint64_t>(entry.second));
+    }
+
+    w.varint(state.unresolvedLinks.size());
+    for (const auto& link : state.unresolvedLinks) {
+        w.str(link);
+    }
+
+    w.str(state.startNodeId);
+
+    // Node id table, so importing skips the rebuild, plus the ids it misses
+    const NodeIdTable& table = state.idTable;
+    w.fixed64(table.seed);
+    w.varint(table.slotCount);
+    w.varint(table.pilots.size());
+    for (uint16_t pilot : table.pilots) {
+        w.varint(pilot);
+    }
+    w.varint(table.remap.size());
+    for (uint32_t position : table.remap) {
+        w.varint(position);
+    }
+    w.varint(table.values.size());
+    for (int value : table.values) {
+        w.varint(static_cast<uint64_t>(value + 1));
+    }
+    w.varint(state.nodeIndices.size());
+    for (const auto& entry : state.nodeIndices) {
+        w.varint(static_cast<uint64_t>(entry.second));
+    }
+
+    // Offsets as deltas; postings are already varints
+    const SearchIndex& index = state.searchIndex;
+    bool withIndex = state.searchIndexCurrent && !index.empty();
+    w.varint(withIndex ? 1 : 0);
+    if (withIndex) {
+        w.str(index.terms);
+        w.varint(index.termOffsets.size());
+        for (size_t i = 1; i < index.termOffsets.size(); i++) {
+            w.varint(index.termOffsets[i] - index.termOffsets[i - 1]);
+            w.varint(index.postingOffsets[i] - index.postingOffsets[i - 1]);
+        }
+        w.varint(index.postings.size());
+        out.insert(out.end(), index.postings.begin(), index.postings.end());
+    }
+
+    const FlagSet& flags = state.flags;
+    w.varint(flags.size());
+    for (size_t i = 0; i < flags.size(); i++) {
+        w.str(flags.getName(static_cast<int>(i)));
+    }
+    w.varint(flags.groups.size());
+    for (const auto& group : flags.groups) {
+        w.str(flags.names.c_str() + group.nameOffset);
+        w.varint(group.firstWord);
+        w.varint(group.mask.size());
+        for (uint64_t word : group.mask) {
+            w.fixed64(word);
+        }
+    }
+}
+
+bool CompiledScript::peekHash(const uint8_t* data, size_t size, uint64_t& sourceHash) {
+    if (!data) {
+        return false;
+    }
+
+    Reader r(data, size);
+    if (!r.magic() || r.varint() != kVersion) {
+        return false;
+    }
+
+    sourceHash = r.fixed64();
+    return r.good();
+}
+
+bool CompiledScript::read(const uint8_t* data, size_t size, GameState& state, uint64_t* sourceHash) {
+    AVG_TRACE_SCOPE("CompiledScript::read");
+
+    if (!data) {
+        return false;
+    }
+
+    Reader r(data, size);
+    if (!r.magic() || r.varint() != kVersion) {
+        return false;
+    }
+
+    uint64_t hash = r.fixed64();
+
+    // Decode into a scratch state so a bad blob leaves the target untouched
+    GameState loaded;
+    size_t indexCount = r.count();
+    loaded.nodeSlots.assign(indexCount, -1);
+    loaded.nodeHashes.assign(indexCount, 0);
+    // Not stored: the first reload after an import parses every node
+    loaded.sourceHashes.assign(indexCount, 0);
+
+    for (size_t i = 0; i < indexCount && r.good(); i++) {
+        if (r.varint() == 0) {
+            continue;
+        }
+
+        uint64_t nodeHash = r.fixed64();
+        DialogueNode node;
+        uint64_t type = r.varint();
+        if (type > static_cast<uint64_t>(NodeType::END)) {
+            return false;
+        }
+        node.type = static_cast<NodeType>(type);
+        r.str(node.id);
+        r.str(node.speaker);
+        r.str(node.text);
+        if (!readSpans(r, node.textSpans, node.spanStrings)) {
+            return false;
+        }
+        r.str(node.nextNodeId);
+        size_t choiceCount = r.count();
+        node.choices.resize(choiceCount);
+        for (auto& choice : node.choices) {
+            r.str(choice.text);
+            if (!readSpans(r, choice.textSpans, choice.spanStrings)) {
+                return false;
+            }
+            r.str(choice.nextNodeId);
+            choice.condition = static_cast<uint32_t>(r.varint()) - 1;
+            choice.effects = static_cast<uint32_t>(r.varint()) - 1;
+        }
+        node.script.words.resize(r.count());
+        for (auto& word : node.script.words) {
+            word = static_cast<uint32_t>(r.varint());
+        }
+        r.str(node.script.names);
+        node.effects = static_cast<uint32_t>(r.varint()) - 1;
+        if (!validScript(node)) {
+            return false;
+        }
+        r.str(node.background);
+        r.str(node.character);
+        r.str(node.characterExpression);
+        node.characterSlot = static_cast<int32_t>(static_cast<uint32_t>(r.varint()));
+        r.str(node.bgm);
+        r.str(node.soundEffect);
+        r.str(node.chapter);
+        node.soundEffectDelayMs = r.index();
+        node.choiceTimeoutMs = r.index();
+        node.timeoutChoice = static_cast<int32_t>(static_cast<uint32_t>(r.varint()));
+
+        loaded.nodeSlots[i] = static_cast<int>(loaded.nodes.size());
+        loaded.nodeHashes[i] = nodeHash;
+        loaded.nodes.push_back(std::move(node));
+    }
+
+    size_t chapterCount = r.count();
+    for (size_t i = 0; i < chapterCount && r.good(); i++) {
+        ChapterRange chapter;
+        r.str(chapter.name);
+        chapter.begin = r.index();
+        chapter.end = r.index();
+        loaded.chapters.push_back(chapter);
+    }
+
+    size_t moduleCount = r.count();
+    for (size_t i = 0; i < moduleCount && r.good(); i++) {
+        ScriptModule module;
+        r.str(module.id);
+        module.begin = r.index();
+        module.end = r.index();
+        module.loadedOnce = r.varint() != 0;
+        module.resident = false;
+        module.residentBytes = 0;
+        module.lastUsed = 0;
+        if (module.begin > module.end || static_cast<size_t>(module.end) > indexCount) {
+            return false;
+        }
+        loaded.modules.push_back(module);
+    }
+
+    size_t reservedCount = r.count();
+    loaded.reservedIndices.reserve(reservedCount);
+    for (size_t i = 0; i < reservedCount && r.good(); i++) {
+        uint64_t idHash = r.fixed64();
+        int index = r.index();
+        if (static_cast<size_t>(index) >= indexCount) {
+            return false;
+        }
+        loaded.reservedIndices.push_back({idHash, index});
+    }
+
+    size_t linkCount = r.count();
+    loaded.unresolvedLinks.resize(linkCount);
+    for (auto& link : loaded.unresolvedLinks) {
+        r.str(link);
+    }
+
+    r.str(loaded.startNodeId);
+
+    NodeIdTable& table = loaded.idTable;
+    table.seed = r.fixed64();
+    table.slotCount = r.varint();
+    table.pilots.resize(r.count());
+    for (auto& pilot : table.pilots) {
+        uint64_t value = r.varint();
+        if (value > 0xffff) {
+            return false;
+        }
+        pilot = static_cast<uint16_t>(value);
+    }
+    table.remap.resize(r.count());
+    for (auto& position : table.remap) {
+        position = static_cast<uint32_t>(r.index());
+    }
+    table.values.resize(r.count());
+    for (auto& value : table.values) {
+        value = r.index() - 1;
+        if (value < -1 || static_cast<size_t>(value + 1) > indexCount) {
+            return false;
+        }
+    }
+
+    // Every position a lookup can produce must stay inside values
+    size_t keyCount = table.values.size();
+    if (keyCount > 0) {
+        if (table.pilots.empty() || table.slotCount < keyCount ||
+            table.remap.size() != table.slotCount - keyCount) {
+            return false;
+        }
+        for (uint32_t position : table.remap) {
+            if (position >= keyCount) {
+                return false;
+            }
+        }
+    }
+
+    size_t overflowCount = r.count();
+    for (size_t i = 0; i < overflowCount && r.good(); i++) {
+        int index = r.index();
+        if (static_cast<size_t>(index) >= indexCount || loaded.nodeSlots[index] < 0) {
+            return false;
+        }
+        loaded.nodeIndices[loaded.nodes[loaded.nodeSlots[index]].id] = index;
+    }
+
+    SearchIndex& searchIndex = loaded.searchIndex;
+    bool withIndex = r.varint() != 0;
+    if (withIndex) {
+        r.str(searchIndex.terms);
+        size_t termCount = r.count();
+        if (termCount == 0) {
+            return false;
+        }
+        searchIndex.termOffsets.assign(1, 0);
+        searchIndex.postingOffsets.assign(1, 0);
+        for (size_t i = 1; i < termCount && r.good(); i++) {
+            searchIndex.termOffsets.push_back(searchIndex.termOffsets.back() + static_cast<uint32_t>(r.varint()));
+            searchIndex.postingOffsets.push_back(searchIndex.postingOffsets.back() +
+                                                 static_cast<uint32_t>(r.varint()));
+        }
+        size_t postingBytes = r.count();
+        if (!r.good() || searchIndex.termOffsets.back() != searchIndex.terms.size() ||
+            searchIndex.postingOffsets.back() != postingBytes) {
+            return false;
+        }
+        searchIndex.postings.resize(postingBytes);
+        r.bytes(searchIndex.postings.data(), postingBytes);
+        if (!r.good() || !searchIndex.valid(static_cast<int>(indexCount))) {
+            return false;
+        }
+    }
+
+    FlagSet& flags = loaded.flags;
+    size_t flagCount = r.count();
+    std::string name;
+    for (size_t i = 0; i < flagCount && r.good(); i++) {
+        r.str(name);
+        if (flags.declare(name) != static_cast<int>(i)) {
+            return false;
+        }
+    }
+    size_t groupCount = r.count();
+    for (size_t i = 0; i < groupCount && r.good(); i++) {
+        r.str(name);
+        if (flags.declareGroup(name) != static_cast<int>(i)) {
+            return false;
+        }
+        FlagSet::Group& group = flags.groups[i];
+        group.firstWord = static_cast<uint32_t>(r.varint());
+        group.mask.resize(r.count());
+        for (auto& word : group.mask) {
+            word = r.fixed64();
+        }
+        if (group.firstWord > flags.words.size() || group.mask.size() > flags.words.size() - group.firstWord) {
+            return false;
+        }
+    }
+
+    if (!r.good()) {
+        return false;
+    }
+
+    state.clearScript();
+    state.nodes.swap(loaded.nodes);
+    state.nodeSlots.swap(loaded.nodeSlots);
+    state.nodeHashes.swap(loaded.nodeHashes);
+    state.sourceHashes.swap(loaded.sourceHashes);
+    state.idTable = std::move(loaded.idTable);
+    state.nodeIndices.swap(loaded.nodeIndices);
+    state.chapters.swap(loaded.chapters);
+    state.modules.swap(loaded.modules);
+    state.reservedIndices.swap(loaded.reservedIndices);
+    state.unresolvedLinks.swap(loaded.unresolvedLinks);
+    state.startNodeId.swap(loaded.startNodeId);
+    state.currentNodeId = state.startNodeId;
+    state.searchIndex = std::move(loaded.searchIndex);
+    state.searchIndexCurrent = withIndex;
+    state.flags = std::move(loaded.flags);
+    for (auto& node : state.nodes) {
+        state.bindVariables(node);
+    }
+
+    if (sourceHash) {
+        *sourceHash = hash;
+    }
+    return true;
+}
+
+} // namespace avg
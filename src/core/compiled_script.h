@@ -0,0 +1,46 @@
+#ifndef COMPILED_SCRIPT_H
+#define COMPILED_SCRIPT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace avg {
+
+class GameState;
+
+// Compiled script blob: the fully linked script graph (node index layout,
+// nodes, chapters, module registry, unresolved links) in a position
+// independent byte format, so a host can cache it and skip parsing.
+//
+// Layout: magic "AVGC", varint version, 8-byte little-endian source hash,
+// then varints: node index count and one record per index (0 = empty slot,
+// or 1 + content hash + node fields; strings are varint length + bytes,
+// script code as words and names, with variable slots bound on read),
+// chapters, modules, reserved module node hashes, unresolved links, the
+// start node id, the node id table with the indices it does not cover, and
+// the search index when it is current (flag, terms, offsets, postings) and
+// the story flag declarations (names, then groups with their masks).
+// Module node content is not included; modules are loaded on demand from
+// their own files as usual.
+class CompiledScript {
+public:
+    static const uint32_t kVersion = 9;
+
+    // Content hash of script source text; the cache key for compiled blobs
+    static uint64_t hashSource(const char* jsonData, size_t length);
+
+    static void write(const GameState& state, uint64_t sourceHash, std::vector<uint8_t>& out);
+
+    // Replace the script graph of state with the blob's. The session
+    // (current node, variables, history) is reset. Fails without touching
+    // state if the blob is truncated or from another format version.
+    static bool read(const uint8_t* data, size_t size, GameState& state, uint64_t* sourceHash = nullptr);
+
+    // Source hash stored in a blob, without decoding the rest
+    static bool peekHash(const uint8_t* data, size_t size, uint64_t& sourceHash);
+};
+
+} // namespace avg
+
+#endif // COMPILED_SCRIPT_H
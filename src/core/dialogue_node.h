@@ -1,8 +1,11 @@
 #ifndef DIALOGUE_NODE_H
 #define DIALOGUE_NODE_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
+#include "script_code.h"
+#include "text_markup.h"
 
 namespace avg {
 
@@ -14,30 +17,54 @@ enum class NodeType {
 };
 
 struct Choice {
-    std::string text;
+    std::string text;          // markup removed, see text_markup.h
+    std::vector<TextSpan> textSpans;   // empty for text without markup
+    std::string spanStrings;   // ruby annotations and variable names
     std::string nextNodeId;
+    // Entries into the node's script code ("if" and "set"), or
+    // script_code::kNone
+    uint32_t condition;
+    uint32_t effects;
 
-    Choice() = default;
+    Choice() : condition(script_code::kNone), effects(script_code::kNone) {}
     Choice(const std::string& t, const std::string& next)
-        : text(t), nextNodeId(next) {}
+        : text(t), nextNodeId(next), condition(script_code::kNone), effects(script_code::kNone) {}
 };
 
 struct DialogueNode {
     std::string id;
     NodeType type;
     std::string speaker;
-    std::string text;
+    std::string text;          // markup removed, see text_markup.h
+    std::vector<TextSpan> textSpans;   // empty for text without markup
+    std::string spanStrings;   // ruby annotations and variable names
     std::string nextNodeId;
     std::vector<Choice> choices;
 
+    // Compiled "if"/"set" of the node and its choices; effects is the
+    // entry of the node's own "set", run when navigation enters it
+    ScriptCode script;
+    uint32_t effects;
+
     // Scene information
     std::string background;
     std::string character;
     std::string characterExpression;
+    int characterSlot;  // stage position, see SceneState::kCharacterSlots
     std::string bgm;
     std::string soundEffect;
 
-    DialogueNode() : type(NodeType::DIALOGUE) {}
+    // Timing, in milliseconds (0 = none): sound effect delay after entering
+    // the node; for choices, time limit after which timeoutChoice is taken
+    int soundEffectDelayMs;
+    int choiceTimeoutMs;
+    int timeoutChoice;
+
+    // Optional chapter/route tag used for completion statistics
+    std::string chapter;
+
+    DialogueNode()
+        : type(NodeType::DIALOGUE), effects(script_code::kNone), characterSlot(0), soundEffectDelayMs(0), choiceTimeoutMs(0), timeoutChoice(0) {}
 };
 
 } // namespace avg
@@ -0,0 +1,280 @@
+#include "flag_set.h"
+#include "../utils/hash.h"
+#include "../utils/string_utils.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace avg {
+
+static inline int popcount64(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(value);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    return static_cast<int>(__popcnt64(value));
+#else
+    value = value - ((value >> 1) & 0x5555555555555555ULL);
+    value = (value & 0x3333333333333333ULL) + ((value >> 2) & 0x3333333333333333ULL);
+    value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<int>((value * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+FlagSet::FlagSet() : tableUsed(0) {
+}
+
+int FlagSet::declare(const std::string& name) {
+    int flag = find(name);
+    if (flag >= 0) {
+        return flag;
+    }
+
+    flag = static_cast<int>(nameOffsets.size());
+    nameOffsets.push_back(addName(name));
+    if (words.size() * 64 < nameOffsets.size()) {
+        words.push_back(0);
+    }
+    insert(flag << 1, name);
+    return flag;
+}
+
+int FlagSet::find(const std::string& name) const {
+    return lookup(name, 0);
+}
+
+const char* FlagSet::getName(int flag) const {
+    if (flag < 0 || static_cast<size_t>(flag) >= size()) {
+        return nullptr;
+    }
+    return names.c_str() + nameOffsets[flag];
+}
+
+int FlagSet::declareGroup(const std::string& name) {
+    int group = findGroup(name);
+    if (group >= 0) {
+        return group;
+    }
+
+    group = static_cast<int>(groups.size());
+    Group entry;
+    entry.nameOffset = addName(name);
+    entry.firstWord = 0;
+    groups.push_back(entry);
+    insert(group << 1 | 1, name);
+    return group;
+}
+
+int FlagSet::findGroup(const std::string& name) const {
+    return lookup(name, 1);
+}
+
+void FlagSet::addToGroup(int group, int flag) {
+    if (group < 0 || static_cast<size_t>(group) >= groups.size() || flag < 0 ||
+        static_cast<size_t>(flag) >= size()) {
+        return;
+    }
+
+    Group& entry = groups[group];
+    uint32_t word = static_cast<uint32_t>(flag) >> 6;
+    if (entry.mask.empty()) {
+        entry.firstWord = word;
+        entry.mask.push_back(0);
+    } else if (word < entry.firstWord) {
+        entry.mask.insert(entry.mask.begin(), entry.firstWord - word, 0);
+        entry.firstWord = word;
+    } else if (word >= entry.firstWord + entry.mask.size()) {
+        entry.mask.resize(word - entry.firstWord + 1, 0);
+    }
+    entry.mask[word - entry.firstWord] |= uint64_t(1) << (flag & 63);
+}
+
+bool FlagSet::any(int group) const {
+    if (group < 0 || static_cast<size_t>(group) >= groups.size()) {
+        return false;
+    }
+
+    const Group& entry = groups[group];
+    const uint64_t* bits = words.data() + entry.firstWord;
+    for (size_t i = 0; i < entry.mask.size(); i++) {
+        if (bits[i] & entry.mask[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FlagSet::all(int group) const {
+    if (group < 0 || static_cast<size_t>(group) >= groups.size() || groups[group].mask.empty()) {
+        return false;
+    }
+
+    const Group& entry = groups[group];
+    const uint64_t* bits = words.data() + entry.firstWord;
+    for (size_t i = 0; i < entry.mask.size(); i++) {
+        if ((bits[i] & entry.mask[i]) != entry.mask[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int FlagSet::count(int group) const {
+    if (group < 0 || static_cast<size_t>(group) >= groups.size()) {
+        return 0;
+    }
+
+    const Group& entry = groups[group];
+    const uint64_t* bits = words.data() + entry.firstWord;
+    int result = 0;
+    for (size_t i = 0; i < entry.mask.size(); i++) {
+        result += popcount64(bits[i] & entry.mask[i]);
+    }
+    return result;
+}
+
+void FlagSet::setGroup(int group, bool value) {
+    if (group < 0 || static_cast<size_t>(group) >= groups.size()) {
+        return;
+    }
+
+    const Group& entry = groups[group];
+    uint64_t* bits = words.data() + entry.firstWord;
+    for (size_t i = 0; i < entry.mask.size(); i++) {
+        bits[i] = value ? (bits[i] | entry.mask[i]) : (bits[i] & ~entry.mask[i]);
+    }
+}
+
+void FlagSet::reset() {
+    std::fill(words.begin(), words.end(), 0);
+}
+
+void FlagSet::clear() {
+    std::vector<uint64_t>().swap(words);
+    std::string().swap(names);
+    std::vector<uint32_t>().swap(nameOffsets);
+    std::vector<Group>().swap(groups);
+    std::vector<int32_t>().swap(table);
+    tableUsed = 0;
+}
+
+size_t FlagSet::getMemoryBytes() const {
+    size_t bytes = words.capacity() * sizeof(uint64_t) + names.capacity() +
+                   nameOffsets.capacity() * sizeof(uint32_t) + table.capacity() * sizeof(int32_t) +
+                   groups.capacity() * sizeof(Group);
+    for (const auto& group : groups) {
+        bytes += group.mask.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
+
+void FlagSet::assignWords(const void* source, size_t count) {
+    size_t usable = std::min(count, size());
+    size_t wordCount = (usable + 63) / 64;
+    if (wordCount > 0) {
+        std::memcpy(words.data(), source, wordCount * sizeof(uint64_t));
+    }
+    std::fill(words.begin() + wordCount, words.end(), 0);
+    if (usable & 63) {
+        words[wordCount - 1] &= (uint64_t(1) << (usable & 63)) - 1;
+    }
+}
+
+std::string FlagSet::serialize() const {
+    return serialize(words.data(), size());
+}
+
+std::string FlagSet::serialize(const uint64_t* source, size_t count) {
+    // Little-endian bytes, so the format is platform independent
+    std::vector<unsigned char> bytes((count + 7) / 8);
+    for (size_t i = 0; i < bytes.size(); i++) {
+        bytes[i] = static_cast<unsigned char>(source[i >> 3] >> ((i & 7) * 8));
+    }
+    while (!bytes.empty() && bytes.back() == 0) {
+        bytes.pop_back();
+    }
+
+    std::string result = "{\"count\":";
+    result += std::to_string(count);
+    result += ",\"bits\":\"";
+    string_utils::appendBase64(result, bytes.data(), bytes.size());
+    result += "\"}";
+    return result;
+}
+
+bool FlagSet::deserialize(int count, const std::string& bits) {
+    std::vector<unsigned char> bytes;
+    if (count < 0 || !string_utils::base64Decode(bits, bytes)) {
+        return false;
+    }
+
+    reset();
+    size_t usable = std::min(static_cast<size_t>(count), size());
+    size_t byteCount = std::min(bytes.size(), (usable + 7) / 8);
+    for (size_t i = 0; i < byteCount; i++) {
+        words[i >> 3] |= static_cast<uint64_t>(bytes[i]) << ((i & 7) * 8);
+    }
+
+    // Drop bits past the saved count (and past the declared flags)
+    for (size_t flag = usable; flag < byteCount * 8; flag++) {
+        words[flag >> 6] &= ~(uint64_t(1) << (flag & 63));
+    }
+    return true;
+}
+
+int FlagSet::lookup(const std::string& name, int kind) const {
+    if (table.empty()) {
+        return -1;
+    }
+
+    size_t mask = table.size() - 1;
+    for (size_t i = hash::fnv1a64(name.data(), name.size()) & mask;; i = (i + 1) & mask) {
+        int32_t entry = table[i];
+        if (entry < 0) {
+            return -1;
+        }
+        if ((entry & 1) == kind && name == nameOf(entry)) {
+            return entry >> 1;
+        }
+    }
+}
+
+void FlagSet::insert(int32_t entry, const std::string& name) {
+    // Keep the load factor at or below one half
+    if ((tableUsed + 1) * 2 > table.size()) {
+        std::vector<int32_t> old;
+        old.swap(table);
+        table.assign(old.empty() ? 64 : old.size() * 2, -1);
+        tableUsed = 0;
+        for (int32_t existing : old) {
+            if (existing >= 0) {
+                const char* existingName = nameOf(existing);
+                insert(existing, std::string(existingName));
+            }
+        }
+    }
+
+    size_t mask = table.size() - 1;
+    size_t i = hash::fnv1a64(name.data(), name.size()) & mask;
+    while (table[i] >= 0) {
+        i = (i + 1) & mask;
+    }
+    table[i] = entry;
+    tableUsed++;
+}
+
+const char* FlagSet::nameOf(int32_t entry) const {
+    uint32_t offset = (entry & 1) ? groups[entry >> 1].nameOffset : nameOffsets[entry >> 1];
+    return names.c_str() + offset;
+}
+
+uint32_t FlagSet::addName(const std::string& name) {
+    uint32_t offset = static_cast<uint32_t>(names.size());
+    names += name;
+    names.push_back('\0');
+    return offset;
+}
+
+} // namespace avg
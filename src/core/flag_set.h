@@ -0,0 +1,105 @@
+#ifndef FLAG_SET_H
+#define FLAG_SET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace avg {
+
+// Story flags: named booleans kept as one bit each.
+//
+// Flags are declared by the script (top-level "flags", see ScriptLoader)
+// and get indices in declaration order. Names live in one pool with an
+// open-addressed index, so thousands of flags cost a few bytes of state
+// each plus their names. Groups are masks over the bitset for bulk
+// set/clear and any/all/count tests; a group only spans the words between
+// its first and last flag.
+//
+// Saved as {"count":N,"bits":"<base64>"} with trailing zero bytes left
+// out. Indices are positional, so a script update must keep the order of
+// existing flags and add new ones at the end.
+class FlagSet {
+public:
+    FlagSet();
+
+    // Index of name, declaring it (unset) on first use
+    int declare(const std::string& name);
+    // Index of name, or -1
+    int find(const std::string& name) const;
+    const char* getName(int flag) const;
+    size_t size() const { return nameOffsets.size(); }
+
+    // Group index of name, declaring it (empty) on first use
+    int declareGroup(const std::string& name);
+    int findGroup(const std::string& name) const;
+    void addToGroup(int group, int flag);
+    size_t getGroupCount() const { return groups.size(); }
+
+    bool test(int flag) const {
+        return flag >= 0 && static_cast<size_t>(flag) < size() &&
+               ((words[static_cast<size_t>(flag) >> 6] >> (flag & 63)) & 1) != 0;
+    }
+
+    void set(int flag, bool value) {
+        if (flag < 0 || static_cast<size_t>(flag) >= size()) {
+            return;
+        }
+        uint64_t bit = uint64_t(1) << (flag & 63);
+        uint64_t& word = words[static_cast<size_t>(flag) >> 6];
+        word = value ? (word | bit) : (word & ~bit);
+    }
+
+    // Bulk operations over a group; an unknown group is empty
+    bool any(int group) const;
+    bool all(int group) const;
+    int count(int group) const;
+    void setGroup(int group, bool value);
+
+    // Flag bits, little-endian within 64-bit words
+    const uint64_t* getWords() const { return words.data(); }
+    size_t getWordCount() const { return words.size(); }
+    // Replace the bits with count flags' worth of words copied from source
+    // (native byte order, any alignment); flags past count are unset
+    void assignWords(const void* source, size_t count);
+    // Unset every flag; declarations stay
+    void reset();
+    // Drop declarations and bits
+    void clear();
+    size_t getMemoryBytes() const;
+
+    std::string serialize() const;
+    // serialize() for count flags held in source
+    static std::string serialize(const uint64_t* source, size_t count);
+    // From the saved count and bits; flags past the saved count are unset
+    bool deserialize(int count, const std::string& bits);
+
+private:
+    // Compiled script blobs read and write declarations directly
+    friend class CompiledScript;
+
+    struct Group {
+        uint32_t nameOffset;
+        uint32_t firstWord;   // mask covers words [firstWord, firstWord + mask.size())
+        std::vector<uint64_t> mask;
+    };
+
+    std::vector<uint64_t> words;
+    std::string names;                  // NUL-terminated flag and group names
+    std::vector<uint32_t> nameOffsets;  // per flag
+    std::vector<Group> groups;
+    // Open-addressed index over flags (kind 0) and groups (kind 1): entries
+    // are index << 1 | kind, -1 when empty; capacity is a power of two
+    std::vector<int32_t> table;
+    size_t tableUsed;
+
+    int lookup(const std::string& name, int kind) const;
+    void insert(int32_t entry, const std::string& name);
+    const char* nameOf(int32_t entry) const;
+    uint32_t addName(const std::string& name);
+};
+
+} // namespace avg
+
+#endif // FLAG_SET_H
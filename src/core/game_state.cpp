@@ -1,10 +1,16 @@
 #include "game_state.h"
+#include "script_loader.h"
+#include "../utils/hash.h"
 #include "../utils/simple_json.h"
+#include "../utils/string_utils.h"
+#include "../utils/trace.h"
+#include <algorithm>
 #include <cstring>
 
 namespace avg {
 
-GameState::GameState() {
+GameState::GameState()
+    : searchIndexCurrent(false), lookupStage(LookupStage::Idle), lookupCursor(0), sceneDirty(0), sceneGeneration(0) {
 }
 
 GameState::~GameState() {
@@ -19,91 +25,907 @@ std::string GameState::getCurrentNodeId() const {
 }
 
 const DialogueNode* GameState::getCurrentNode() const {
-    auto it = nodes.find(currentNodeId);
-    if (it != nodes.end()) {
-        return &it->second;
-    }
-    return nullptr;
+    return getNode(currentNodeId);
+}
+
+int GameState::getCurrentNodeIndex() const {
+    return getNodeIndex(currentNodeId);
 }
 
 bool GameState::loadScript(const char* jsonData) {
     return parseScript(jsonData);
 }
 
+void GameState::clearScript() {
+    reset();
+    startNodeId.clear();
+    nodes.clear();
+    nodeSlots.clear();
+    freeSlots.clear();
+    nodeHashes.clear();
+    sourceHashes.clear();
+    textStore.clear();
+    locale.clear();
+    baseStrings.clear();
+    searchIndex.clear();
+    searchIndexCurrent = false;
+    flags.clear();
+    idTable.clear();
+    nodeIndices.clear();
+    lookupStage = LookupStage::Idle;
+    lookupBuilder = NodeIdTable::Builder();
+    retiredIndices.clear();
+    chapters.clear();
+    modules.clear();
+    reservedIndices.clear();
+    unresolvedLinks.clear();
+}
+
 bool GameState::addNode(const DialogueNode& node) {
-    nodes[node.id] = node;
+    return addNode(DialogueNode(node));
+}
+
+uint64_t GameState::hashNode(const DialogueNode& node) {
+    uint64_t h = hash::fnv1a64(nullptr, 0);
+    auto mix = [&h](const std::string& field) {
+        // Length prefix keeps adjacent fields from running into each other
+        uint32_t length = static_cast<uint32_t>(field.size());
+        h = hash::fnv1a64(reinterpret_cast<const char*>(&length), sizeof(length), h);
+        h = hash::fnv1a64(field.data(), field.size(), h);
+    };
+
+    auto mixSpans = [&h, &mix](const std::vector<TextSpan>& spans, const std::string& strings) {
+        for (const auto& span : spans) {
+            uint32_t words[5] = {static_cast<uint32_t>(span.type) | static_cast<uint32_t>(span.style) << 16,
+                                 span.start, span.length, span.color, span.value};
+            h = hash::fnv1a64(reinterpret_cast<const char*>(words), sizeof(words), h);
+        }
+        mix(strings);
+    };
+
+    int type = static_cast<int>(node.type);
+    h = hash::fnv1a64(reinterpret_cast<const char*>(&type), sizeof(type), h);
+    mix(node.id);
+    mix(node.speaker);
+    mix(node.text);
+    mixSpans(node.textSpans, node.spanStrings);
+    mix(node.nextNodeId);
+    for (const auto& choice : node.choices) {
+        mix(choice.text);
+        mixSpans(choice.textSpans, choice.spanStrings);
+        mix(choice.nextNodeId);
+        uint32_t entries[2] = {choice.condition, choice.effects};
+        h = hash::fnv1a64(reinterpret_cast<const char*>(entries), sizeof(entries), h);
+    }
+    h = hash::fnv1a64(reinterpret_cast<const char*>(node.script.words.data()),
+                      node.script.words.size() * sizeof(uint32_t), h);
+    mix(node.script.names);
+    h = hash::fnv1a64(reinterpret_cast<const char*>(&node.effects), sizeof(node.effects), h);
+    mix(node.background);
+    mix(node.character);
+    mix(node.characterExpression);
+    mix(node.bgm);
+    mix(node.soundEffect);
+    mix(node.chapter);
+    int numbers[4] = {node.characterSlot, node.soundEffectDelayMs, node.choiceTimeoutMs, node.timeoutChoice};
+    h = hash::fnv1a64(reinterpret_cast<const char*>(numbers), sizeof(numbers), h);
+    // Never 0, which marks "not resident"
+    return h ? h : 1;
+}
+
+bool GameState::addNode(DialogueNode&& node) {
+    uint64_t contentHash = hashNode(node);
+    return addNode(std::move(node), contentHash);
+}
+
+bool GameState::addNode(DialogueNode&& node, uint64_t contentHash, uint64_t sourceHash) {
+    int index = lookupIndex(node.id, false);
+    if (isNodeResident(index)) {
+        nodeHashes[index] = contentHash;
+        sourceHashes[index] = sourceHash;
+        textStore.forget(index);
+        searchIndexCurrent = false;
+        localizeNode(index, node);
+        bindVariables(node);
+        nodes[nodeSlots[index]] = std::move(node);
+        return true;
+    }
+
+    // Nodes of a registered module go to their reserved index
+    if (index >= 0) {
+        int moduleIndex = getModuleForIndex(index);
+        if (moduleIndex >= 0 && !modules[moduleIndex].loadedOnce) {
+            addChapterNode(node.chapter, index);
+        }
+        placeNode(index, std::move(node), contentHash, sourceHash);
+        return true;
+    }
+
+    index = static_cast<int>(nodeSlots.size());
+    nodeSlots.push_back(-1);
+    nodeHashes.push_back(0);
+    sourceHashes.push_back(0);
+    addChapterNode(node.chapter, index);
+    placeNode(index, std::move(node), contentHash, sourceHash);
     return true;
 }
 
+void GameState::reserveNodes(size_t count) {
+    nodes.reserve(nodes.size() + count);
+    nodeSlots.reserve(nodeSlots.size() + count);
+    nodeHashes.reserve(nodeHashes.size() + count);
+    sourceHashes.reserve(sourceHashes.size() + count);
+    // Until the next optimizeNodeLookup new ids go to the overflow map
+    nodeIndices.reserve(nodeIndices.size() + count);
+}
+
+void GameState::placeNode(int index, DialogueNode&& node, uint64_t contentHash, uint64_t sourceHash) {
+    // Hashes cover the script's own strings, so reloading an unchanged file
+    // finds nothing to do whatever the locale
+    nodeHashes[index] = contentHash;
+    sourceHashes[index] = sourceHash;
+    textStore.forget(index);
+    baseStrings.erase(index);
+    searchIndexCurrent = false;
+    localizeNode(index, node);
+    bindVariables(node);
+
+    int slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+        nodes[slot] = std::move(node);
+    } else {
+        slot = static_cast<int>(nodes.size());
+        nodes.push_back(std::move(node));
+    }
+
+    nodeSlots[index] = slot;
+
+    // Module nodes are found through reservedIndices; the others go to the
+    // overflow map unless the id table already resolves them
+    if (getModuleForIndex(index) < 0 && lookupIndex(nodes[slot].id, true) != index) {
+        nodeIndices[nodes[slot].id] = index;
+    }
+}
+
+void GameState::releaseNode(int index) {
+    int slot = nodeSlots[index];
+    if (slot < 0) {
+        return;
+    }
+
+    nodeIndices.erase(nodes[slot].id);
+    textStore.forget(index);
+    baseStrings.erase(index);
+    // Assigning a fresh node releases the strings' heap buffers
+    nodes[slot] = DialogueNode();
+    freeSlots.push_back(slot);
+    nodeSlots[index] = -1;
+    nodeHashes[index] = 0;
+    sourceHashes[index] = 0;
+}
+
+GameState::ReloadResult GameState::reloadNode(DialogueNode&& node) {
+    uint64_t contentHash = hashNode(node);
+    return reloadNode(std::move(node), contentHash);
+}
+
+GameState::ReloadResult GameState::reloadNode(DialogueNode&& node, uint64_t contentHash, uint64_t sourceHash) {
+    int index = lookupIndex(node.id, true);
+    if (index < 0) {
+        addNode(std::move(node), contentHash, sourceHash);
+        return ReloadResult::Added;
+    }
+
+    // Edits that parse to the same node (whitespace, key order) still move
+    // the source hash to the new bytes
+    sourceHashes[index] = sourceHash;
+    if (nodeHashes[index] == contentHash) {
+        return ReloadResult::Unchanged;
+    }
+
+    nodeHashes[index] = contentHash;
+    textStore.forget(index);
+    baseStrings.erase(index);
+    searchIndexCurrent = false;
+    localizeNode(index, node);
+    bindVariables(node);
+    nodes[nodeSlots[index]] = std::move(node);
+    return ReloadResult::Changed;
+}
+
+std::string GameState::getNodeText(int index) const {
+    std::string text;
+    if (!isNodeResident(index)) {
+        return text;
+    }
+    if (!textStore.read(index, text)) {
+        text = nodes[nodeSlots[index]].text;
+    }
+    return text;
+}
+
+void GameState::compactText() {
+    if (textStore.wasteful()) {
+        expandText();
+    }
+
+    std::vector<std::pair<int, const std::string*>> texts;
+    for (int i = 0; i < static_cast<int>(nodeSlots.size()); i++) {
+        int slot = nodeSlots[i];
+        if (slot >= 0 && !nodes[slot].text.empty()) {
+            texts.push_back({i, &nodes[slot].text});
+        }
+    }
+    if (texts.empty()) {
+        return;
+    }
+
+    if (textStore.empty()) {
+        std::vector<const std::string*> samples;
+        samples.reserve(texts.size());
+        for (const auto& entry : texts) {
+            samples.push_back(entry.second);
+        }
+        textStore.train(samples);
+    }
+    textStore.add(texts);
+
+    for (const auto& entry : texts) {
+        std::string().swap(nodes[nodeSlots[entry.first]].text);
+    }
+}
+
+void GameState::expandText() {
+    for (int i = 0; i < static_cast<int>(nodeSlots.size()); i++) {
+        if (nodeSlots[i] >= 0 && textStore.contains(i)) {
+            textStore.read(i, nodes[nodeSlots[i]].text);
+        }
+    }
+    textStore.clear();
+}
+
+int GameState::loadLocale(const char* jsonData) {
+    AVG_TRACE_SCOPE("GameState::loadLocale");
+
+    SimpleJSON json;
+    if (!jsonData || !json.parse(jsonData)) {
+        return -1;
+    }
+
+    // Drop the previous table first so only one is ever resident; nodes go
+    // back to the script's strings and the new table applies over those
+    std::vector<uint8_t> changed(nodeSlots.size(), 0);
+    for (int i = 0; i < static_cast<int>(nodeSlots.size()); i++) {
+        if (nodeSlots[i] >= 0 && restoreNode(i, nodes[nodeSlots[i]])) {
+            changed[i] = 1;
+        }
+    }
+    locale.clear();
+    locale.setLocale(json.getString("locale"));
+
+    std::vector<std::string> choices;
+    for (int i = 0;; i++) {
+        std::string entryKey = "strings[" + std::to_string(i) + "]";
+        std::string nodeId = json.getString(entryKey + ".id");
+        if (nodeId.empty()) {
+            break;
+        }
+
+        int index = getNodeIndex(nodeId);
+        if (index < 0) {
+            continue;
+        }
+
+        std::string text = json.getString(entryKey + ".text");
+        std::string speaker = json.getString(entryKey + ".speaker");
+        choices.clear();
+        for (int j = 0;; j++) {
+            std::string choiceKey = entryKey + ".choices[" + std::to_string(j) + "]";
+            if (!json.hasKey(choiceKey)) {
+                break;
+            }
+            choices.push_back(json.getString(choiceKey));
+        }
+        locale.add(index, json.hasKey(entryKey + ".text") ? &text : nullptr,
+                   json.hasKey(entryKey + ".speaker") ? &speaker : nullptr, choices);
+    }
+
+    int changedCount = 0;
+    for (int i = 0; i < static_cast<int>(nodeSlots.size()); i++) {
+        if (nodeSlots[i] >= 0 && localizeNode(i, nodes[nodeSlots[i]])) {
+            changed[i] = 1;
+        }
+        changedCount += changed[i];
+    }
+    return changedCount;
+}
+
+int GameState::unloadLocale() {
+    int restored = 0;
+    for (int i = 0; i < static_cast<int>(nodeSlots.size()); i++) {
+        if (nodeSlots[i] >= 0 && restoreNode(i, nodes[nodeSlots[i]])) {
+            restored++;
+        }
+    }
+    locale.clear();
+    return restored;
+}
+
+bool GameState::localizeNode(int index, DialogueNode& node) {
+    if (!locale.contains(index)) {
+        return false;
+    }
+
+    BaseStrings& base = baseStrings[index];
+    base.speaker = node.speaker;
+    if (!textStore.read(index, base.text)) {
+        base.text = node.text;
+    }
+    base.textSpans = node.textSpans;
+    base.spanStrings = node.spanStrings;
+    base.choices = node.choices;
+
+    searchIndexCurrent = false;
+    if (const char* text = locale.getText(index)) {
+        textStore.forget(index);
+        text_markup::tokenize(text, node.text, node.textSpans, node.spanStrings);
+    }
+    if (const char* speaker = locale.getSpeaker(index)) {
+        node.speaker = speaker;
+    }
+    // Choices are matched by position; extra translations are ignored
+    int choiceCount = std::min(locale.getChoiceCount(index), static_cast<int>(node.choices.size()));
+    for (int i = 0; i < choiceCount; i++) {
+        Choice& choice = node.choices[i];
+        text_markup::tokenize(locale.getChoice(index, i), choice.text, choice.textSpans, choice.spanStrings);
+    }
+    return true;
+}
+
+bool GameState::restoreNode(int index, DialogueNode& node) {
+    auto it = baseStrings.find(index);
+    if (it == baseStrings.end()) {
+        return false;
+    }
+
+    BaseStrings& base = it->second;
+    searchIndexCurrent = false;
+    textStore.forget(index);
+    node.speaker = std::move(base.speaker);
+    node.text = std::move(base.text);
+    node.textSpans = std::move(base.textSpans);
+    node.spanStrings = std::move(base.spanStrings);
+    for (size_t i = 0; i < node.choices.size() && i < base.choices.size(); i++) {
+        node.choices[i].text = std::move(base.choices[i].text);
+        node.choices[i].textSpans = std::move(base.choices[i].textSpans);
+        node.choices[i].spanStrings = std::move(base.choices[i].spanStrings);
+    }
+    baseStrings.erase(it);
+    return true;
+}
+
+void GameState::buildSearchIndex() {
+    searchIndex.build(*this);
+    searchIndexCurrent = true;
+}
+
+void GameState::clearSearchIndex() {
+    searchIndex.clear();
+    searchIndexCurrent = false;
+}
+
+void GameState::optimizeNodeLookup() {
+    if (beginNodeLookup()) {
+        while (!stepNodeLookup(SIZE_MAX)) {
+        }
+    }
+}
+
+bool GameState::beginNodeLookup() {
+    // Small batches (DLC links, hot reload additions) stay in the map
+    const size_t kMinRebuild = 32;
+    if (nodeIndices.size() < kMinRebuild || nodeIndices.size() * 8 < idTable.size()) {
+        return false;
+    }
+
+    lookupBuilder = NodeIdTable::Builder();
+    lookupBuilder.reserve(nodes.size());
+    lookupCursor = 0;
+    lookupStage = LookupStage::Collect;
+    return true;
+}
+
+bool GameState::stepNodeLookup(size_t maxWork) {
+    size_t work = 0;
+
+    if (lookupStage == LookupStage::Collect) {
+        for (; lookupCursor < nodeSlots.size() && work < maxWork; lookupCursor++, work++) {
+            int i = static_cast<int>(lookupCursor);
+            if (nodeSlots[i] >= 0 && getModuleForIndex(i) < 0) {
+                lookupBuilder.add(hash::hashString(nodes[nodeSlots[i]].id), i);
+            }
+        }
+        if (lookupCursor < nodeSlots.size()) {
+            return false;
+        }
+        lookupStage = LookupStage::Build;
+    }
+
+    if (lookupStage == LookupStage::Build) {
+        if (work >= maxWork || !lookupBuilder.step(maxWork - work)) {
+            return false;
+        }
+
+        std::vector<int> rejected;
+        lookupBuilder.finish(idTable, rejected);
+        std::unordered_map<std::string, int> overflow;
+        for (int index : rejected) {
+            overflow[nodes[nodeSlots[index]].id] = index;
+        }
+        nodeIndices.swap(overflow);
+        // Freeing every id string of the old map at once would be the
+        // longest part of the rebuild
+        retiredIndices.swap(overflow);
+        lookupStage = LookupStage::Release;
+        return false;
+    }
+
+    if (lookupStage == LookupStage::Release) {
+        for (; !retiredIndices.empty() && work < maxWork; work++) {
+            retiredIndices.erase(retiredIndices.begin());
+        }
+        if (!retiredIndices.empty()) {
+            return false;
+        }
+        std::unordered_map<std::string, int>().swap(retiredIndices);
+        lookupStage = LookupStage::Idle;
+    }
+    return true;
+}
+
+int GameState::retireMissingNodes(const std::string& nameSpace, const std::vector<char>& seen) {
+    std::string prefix = nameSpace.empty() ? std::string() : nameSpace + ":";
+    auto inScope = [&](const std::string& id) {
+        return prefix.empty() ? id.find(':') == std::string::npos : id.compare(0, prefix.size(), prefix) == 0;
+    };
+
+    int retired = 0;
+    for (int i = 0; i < static_cast<int>(nodeSlots.size()); i++) {
+        if (nodeSlots[i] < 0 || (static_cast<size_t>(i) < seen.size() && seen[i])) {
+            continue;
+        }
+
+        // Module nodes belong to their module file, not to this one
+        const std::string& id = nodes[nodeSlots[i]].id;
+        if (!inScope(id) || getModuleForIndex(i) >= 0 || id == currentNodeId || inHistory(id)) {
+            continue;
+        }
+
+        releaseNode(i);
+        retired++;
+    }
+    return retired;
+}
+
+uint64_t GameState::getNodeHash(int index) const {
+    if (index < 0 || index >= static_cast<int>(nodeHashes.size())) {
+        return 0;
+    }
+    return nodeHashes[index];
+}
+
+uint64_t GameState::getNodeSourceHash(int index) const {
+    if (index < 0 || index >= static_cast<int>(sourceHashes.size())) {
+        return 0;
+    }
+    return sourceHashes[index];
+}
+
 const DialogueNode* GameState::getNode(const std::string& nodeId) const {
-    auto it = nodes.find(nodeId);
-    if (it != nodes.end()) {
-        return &it->second;
+    return getNodeByIndex(getNodeIndex(nodeId));
+}
+
+int GameState::getNodeIndex(const std::string& nodeId) const {
+    return lookupIndex(nodeId, false);
+}
+
+int GameState::lookupIndex(const std::string& nodeId, bool residentOnly) const {
+    // One hash of the id serves the id table and the reserved module ids
+    uint64_t idHash = hash::hashString(nodeId);
+
+    int index = idTable.find(idHash);
+    if (index >= 0) {
+        int slot = nodeSlots[index];
+        if (slot >= 0 && nodes[slot].id == nodeId) {
+            return index;
+        }
+    }
+
+    if (!nodeIndices.empty()) {
+        auto it = nodeIndices.find(nodeId);
+        if (it != nodeIndices.end()) {
+            return it->second;
+        }
+    }
+
+    index = findReservedIndex(idHash);
+    if (residentOnly && index >= 0 && (nodeSlots[index] < 0 || nodes[nodeSlots[index]].id != nodeId)) {
+        return -1;
     }
-    return nullptr;
+    return index;
+}
+
+const DialogueNode* GameState::getNodeByIndex(int index) const {
+    if (index < 0 || index >= static_cast<int>(nodeSlots.size())) {
+        return nullptr;
+    }
+
+    int slot = nodeSlots[index];
+    return slot >= 0 ? &nodes[slot] : nullptr;
+}
+
+void GameState::getNodeIdHashes(std::vector<uint64_t>& out) const {
+    out.assign(nodeSlots.size(), 0);
+    for (size_t i = 0; i < nodeSlots.size(); i++) {
+        if (nodeSlots[i] >= 0) {
+            out[i] = hash::hashString(nodes[nodeSlots[i]].id);
+        }
+    }
+    for (const auto& entry : reservedIndices) {
+        out[entry.second] = entry.first;
+    }
+}
+
+int GameState::findReservedIndex(uint64_t idHash) const {
+    if (reservedIndices.empty()) {
+        return -1;
+    }
+
+    auto it = std::lower_bound(reservedIndices.begin(), reservedIndices.end(),
+                               std::make_pair(idHash, -1));
+    if (it == reservedIndices.end() || it->first != idHash) {
+        return -1;
+    }
+    return it->second;
+}
+
+void GameState::updateUnresolvedLinks(const std::vector<std::string>& newRefs) {
+    auto resolved = [this](const std::string& ref) { return getNodeIndex(ref) >= 0; };
+
+    unresolvedLinks.erase(std::remove_if(unresolvedLinks.begin(), unresolvedLinks.end(), resolved),
+                          unresolvedLinks.end());
+    for (const auto& ref : newRefs) {
+        if (!resolved(ref) && std::find(unresolvedLinks.begin(), unresolvedLinks.end(), ref) == unresolvedLinks.end()) {
+            unresolvedLinks.push_back(ref);
+        }
+    }
+}
+
+int GameState::registerModule(const std::string& moduleId, const std::vector<std::string>& nodeIds) {
+    if (moduleId.empty() || nodeIds.empty() || findModule(moduleId) >= 0) {
+        return -1;
+    }
+
+    // Ids must be new; a 64-bit hash collision is treated like a duplicate
+    std::vector<std::pair<uint64_t, int>> added;
+    added.reserve(nodeIds.size());
+    int begin = static_cast<int>(nodeSlots.size());
+    for (size_t i = 0; i < nodeIds.size(); i++) {
+        if (getNodeIndex(nodeIds[i]) >= 0) {
+            return -1;
+        }
+        added.push_back({hash::hashString(nodeIds[i]), begin + static_cast<int>(i)});
+    }
+
+    std::sort(added.begin(), added.end());
+    for (size_t i = 1; i < added.size(); i++) {
+        if (added[i].first == added[i - 1].first) {
+            return -1;
+        }
+    }
+
+    size_t oldSize = reservedIndices.size();
+    reservedIndices.insert(reservedIndices.end(), added.begin(), added.end());
+    std::inplace_merge(reservedIndices.begin(), reservedIndices.begin() + static_cast<std::ptrdiff_t>(oldSize),
+                       reservedIndices.end());
+
+    nodeSlots.resize(nodeSlots.size() + nodeIds.size(), -1);
+    nodeHashes.resize(nodeSlots.size(), 0);
+    sourceHashes.resize(nodeSlots.size(), 0);
+
+    ScriptModule module;
+    module.id = moduleId;
+    module.begin = begin;
+    module.end = static_cast<int>(nodeSlots.size());
+    module.resident = false;
+    module.loadedOnce = false;
+    module.residentBytes = 0;
+    module.lastUsed = 0;
+    modules.push_back(module);
+    return static_cast<int>(modules.size()) - 1;
+}
+
+int GameState::findModule(const std::string& moduleId) const {
+    for (size_t i = 0; i < modules.size(); i++) {
+        if (modules[i].id == moduleId) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+int GameState::getModuleForIndex(int index) const {
+    // Modules are registered in index order
+    auto it = std::upper_bound(modules.begin(), modules.end(), index,
+                               [](int value, const ScriptModule& module) { return value < module.begin; });
+    if (it == modules.begin()) {
+        return -1;
+    }
+    --it;
+    return index < it->end ? static_cast<int>(it - modules.begin()) : -1;
+}
+
+bool GameState::isNodeResident(int index) const {
+    return index >= 0 && index < static_cast<int>(nodeSlots.size()) && nodeSlots[index] >= 0;
+}
+
+namespace {
+
+size_t estimateNodeBytes(const DialogueNode& node) {
+    size_t bytes = sizeof(DialogueNode) + node.id.capacity() + node.speaker.capacity() +
+                   node.text.capacity() + node.nextNodeId.capacity() + node.background.capacity() +
+                   node.character.capacity() + node.characterExpression.capacity() +
+                   node.bgm.capacity() + node.soundEffect.capacity() + node.chapter.capacity();
+    bytes += node.choices.capacity() * sizeof(Choice);
+    for (const auto& choice : node.choices) {
+        bytes += choice.text.capacity() + choice.textSpans.capacity() * sizeof(TextSpan) +
+                 choice.spanStrings.capacity() + choice.nextNodeId.capacity();
+    }
+    bytes += node.script.words.capacity() * sizeof(uint32_t) + node.script.names.capacity() +
+             node.script.slots.capacity() * sizeof(int32_t);
+    // reservedIndices entry
+    bytes += sizeof(std::pair<uint64_t, int>);
+    return bytes;
+}
+
+} // namespace
+
+bool GameState::loadModule(int moduleIndex, const char* jsonData) {
+    if (moduleIndex < 0 || moduleIndex >= static_cast<int>(modules.size())) {
+        return false;
+    }
+    return parseScript(jsonData, moduleIndex);
+}
+
+size_t GameState::markModuleResident(int moduleIndex) {
+    if (moduleIndex < 0 || moduleIndex >= static_cast<int>(modules.size())) {
+        return 0;
+    }
+
+    ScriptModule& module = modules[moduleIndex];
+    size_t bytes = 0;
+    for (int i = module.begin; i < module.end; i++) {
+        if (nodeSlots[i] >= 0) {
+            bytes += estimateNodeBytes(nodes[nodeSlots[i]]);
+        }
+    }
+
+    module.resident = true;
+    module.loadedOnce = true;
+    module.residentBytes = bytes;
+    return bytes;
+}
+
+void GameState::touchModule(int moduleIndex, uint64_t tick) {
+    if (moduleIndex >= 0 && moduleIndex < static_cast<int>(modules.size())) {
+        modules[moduleIndex].lastUsed = tick;
+    }
+}
+
+size_t GameState::evictModule(int moduleIndex) {
+    if (moduleIndex < 0 || moduleIndex >= static_cast<int>(modules.size())) {
+        return 0;
+    }
+
+    ScriptModule& module = modules[moduleIndex];
+    for (int i = module.begin; i < module.end; i++) {
+        releaseNode(i);
+    }
+
+    size_t released = module.residentBytes;
+    module.resident = false;
+    module.residentBytes = 0;
+    return released;
+}
+
+void GameState::addChapterNode(const std::string& chapter, int index) {
+    if (chapter.empty()) {
+        return;
+    }
+
+    // Extend the last range when the chapter continues, otherwise open a new one
+    if (!chapters.empty() && chapters.back().name == chapter && chapters.back().end == index) {
+        chapters.back().end = index + 1;
+        return;
+    }
+
+    chapters.push_back({chapter, index, index + 1});
 }
 
 void GameState::setVariable(const std::string& name, int value) {
-    variables[name] = value;
+    int flag = flags.find(name);
+    if (flag >= 0) {
+        flags.set(flag, value != 0);
+        return;
+    }
+
+    int slot = internVariable(name);
+    variableValues[slot] = value;
+    variableSet[slot] = 1;
 }
 
 int GameState::getVariable(const std::string& name) const {
-    auto it = variables.find(name);
-    if (it != variables.end()) {
-        return it->second;
+    int flag = flags.find(name);
+    if (flag >= 0) {
+        return flags.test(flag) ? 1 : 0;
+    }
+
+    auto it = variableSlots.find(name);
+    if (it != variableSlots.end()) {
+        return variableValues[it->second];
     }
     return 0;
 }
 
 bool GameState::hasVariable(const std::string& name) const {
-    return variables.find(name) != variables.end();
+    if (flags.find(name) >= 0) {
+        return true;
+    }
+
+    auto it = variableSlots.find(name);
+    return it != variableSlots.end() && variableSet[it->second];
+}
+
+int GameState::internVariable(const std::string& name) {
+    auto it = variableSlots.find(name);
+    if (it != variableSlots.end()) {
+        return it->second;
+    }
+
+    int slot = static_cast<int>(variableNames.size());
+    variableSlots.emplace(name, slot);
+    variableNames.push_back(name);
+    variableValues.push_back(0);
+    variableSet.push_back(0);
+    return slot;
+}
+
+void GameState::declareFlags(const std::string& group, const std::vector<std::string>& names) {
+    // Bound code refers to a group it did not find as -1
+    bool rebind = !group.empty() && flags.findGroup(group) < 0;
+    int groupIndex = group.empty() ? -1 : flags.declareGroup(group);
+    for (const auto& name : names) {
+        bool isNew = flags.find(name) < 0;
+        int flag = flags.declare(name);
+        if (groupIndex >= 0) {
+            flags.addToGroup(groupIndex, flag);
+        }
+
+        auto it = isNew ? variableSlots.find(name) : variableSlots.end();
+        if (it != variableSlots.end()) {
+            // The slot stays allocated but unnamed, so nothing reaches it
+            flags.set(flag, variableValues[it->second] != 0);
+            variableSet[it->second] = 0;
+            variableSlots.erase(it);
+            rebind = true;
+        }
+    }
+
+    if (rebind) {
+        for (auto& node : nodes) {
+            bindVariables(node);
+        }
+    }
+}
+
+bool GameState::testCondition(const DialogueNode& node, uint32_t entry) const {
+    return script_code::evaluate(node.script, entry, variableValues.data(), flags) != 0;
+}
+
+void GameState::runEffects(const DialogueNode& node, uint32_t entry) {
+    script_code::execute(node.script, entry, variableValues.data(), variableSet.data(), flags);
+}
+
+void GameState::clearVariables() {
+    std::fill(variableValues.begin(), variableValues.end(), 0);
+    std::fill(variableSet.begin(), variableSet.end(), 0);
+    flags.reset();
+}
+
+void GameState::bindVariables(DialogueNode& node) {
+    node.script.slots.clear();
+    if (node.script.names.empty()) {
+        return;
+    }
+
+    std::vector<std::string> names;
+    script_code::getNames(node.script, names);
+    node.script.slots.reserve(names.size());
+    for (const auto& name : names) {
+        if (!name.empty() && name[0] == '@') {
+            node.script.slots.push_back(flags.findGroup(name.substr(1)));
+            continue;
+        }
+        int flag = flags.find(name);
+        node.script.slots.push_back(flag >= 0 ? ~flag : internVariable(name));
+    }
 }
 
 void GameState::pushHistory(const std::string& nodeId) {
-    history.push_back(nodeId);
+    historyOffsets.push_back(static_cast<uint32_t>(historyIds.size()));
+    historyIds += nodeId;
+    historyIds.push_back('\0');
 }
 
 std::string GameState::popHistory() {
-    if (history.empty()) {
+    if (historyOffsets.empty()) {
         return "";
     }
-    std::string nodeId = history.back();
-    history.pop_back();
+    uint32_t offset = historyOffsets.back();
+    historyOffsets.pop_back();
+    std::string nodeId(historyIds.c_str() + offset);
+    historyIds.resize(offset);
     return nodeId;
 }
 
 bool GameState::canGoBack() const {
-    return !history.empty();
+    return !historyOffsets.empty();
 }
 
-std::string GameState::serialize() const {
-    // Simple serialization format
-    std::string result = "{";
-    result += "\"currentNode\":\"" + currentNodeId + "\",";
-    result += "\"variables\":{";
+bool GameState::inHistory(const std::string& nodeId) const {
+    for (uint32_t offset : historyOffsets) {
+        if (nodeId == historyIds.c_str() + offset) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    bool first = true;
-    for (const auto& pair : variables) {
-        if (!first) result += ",";
-        result += "\"" + pair.first + "\":" + std::to_string(pair.second);
-        first = false;
+uint32_t GameState::applyScene(const DialogueNode& node) {
+    uint32_t changed = scene.apply(node);
+    if (changed) {
+        sceneDirty |= changed;
+        sceneGeneration++;
     }
-    result += "},";
+    return changed;
+}
 
-    result += "\"history\":[";
-    first = true;
-    for (const auto& nodeId : history) {
-        if (!first) result += ",";
-        result += "\"" + nodeId + "\"";
-        first = false;
+void GameState::setScene(const SceneState& newScene) {
+    uint32_t changed = scene.diff(newScene);
+    if (changed) {
+        scene = newScene;
+        sceneDirty |= changed;
+        sceneGeneration++;
     }
-    result += "]";
-    result += "}";
+}
 
-    return result;
+uint32_t GameState::takeSceneDirty() {
+    uint32_t dirty = sceneDirty;
+    sceneDirty = 0;
+    return dirty;
+}
+
+std::string GameState::serialize() const {
+    std::vector<uint8_t> record;
+    takeSnapshot(record);
+    return serializeSnapshot(record.data(), record.size());
 }
 
 bool GameState::deserialize(const char* data) {
+    AVG_TRACE_SCOPE("GameState::deserialize");
+
     // Parse JSON and restore state
     SimpleJSON json;
     if (!json.parse(data)) {
@@ -117,91 +939,325 @@ bool GameState::deserialize(const char* data) {
     }
 
     // Restore variables - they are stored as "variables.varName": value
-    variables.clear();
+    clearVariables();
     std::vector<std::string> varKeys = json.getObjectKeys("variables");
+    std::string fullKey = "variables.";
+    const size_t prefixLength = fullKey.length();
     for (const auto& varName : varKeys) {
-        std::string fullKey = "variables." + varName;
+        fullKey.resize(prefixLength);
+        fullKey += varName;
         int value = json.getInt(fullKey);
-        variables[varName] = value;
+        setVariable(varName, value);
+    }
+    if (json.hasKey("flags.count")) {
+        flags.deserialize(json.getInt("flags.count"), json.getString("flags.bits"));
     }
 
     // Restore history array
-    history.clear();
+    historyIds.clear();
+    historyOffsets.clear();
     int historyCount = json.getArraySize("history");
     for (int i = 0; i < historyCount; i++) {
         std::string historyKey = "history[" + std::to_string(i) + "]";
         std::string historyNode = json.getString(historyKey);
         if (!historyNode.empty()) {
-            history.push_back(historyNode);
+            pushHistory(historyNode);
         }
     }
 
+    // Restore the scene as saved; older saves without one rebuild it by
+    // replaying the scene fields of the visited nodes still resident
+    SceneState saved;
+    if (!json.getObjectKeys("scene").empty()) {
+        saved.background = json.getString("scene.background");
+        saved.bgm = json.getString("scene.bgm");
+        for (int slot = 0; slot < SceneState::kCharacterSlots; slot++) {
+            std::string slotKey = "scene.characters[" + std::to_string(slot) + "]";
+            saved.characters[slot].character = json.getString(slotKey + ".name");
+            saved.characters[slot].expression = json.getString(slotKey + ".expression");
+        }
+    } else {
+        for (uint32_t offset : historyOffsets) {
+            const DialogueNode* node = getNode(historyIds.c_str() + offset);
+            if (node) {
+                saved.apply(*node);
+            }
+        }
+        const DialogueNode* node = getNode(currentNodeId);
+        if (node) {
+            saved.apply(*node);
+        }
+    }
+    setScene(saved);
+
     return true;
 }
 
-void GameState::reset() {
-    currentNodeId.clear();
-    variables.clear();
-    history.clear();
+// Session record layout: the header, then flag words, variable values,
+// history offsets, variable set bytes, the current node and scene strings
+// (NUL-terminated, in a fixed order) and the history ids. Every section's
+// size follows from the header, so the record holds no offsets of its own.
+namespace {
+
+const uint32_t kSnapshotMagic = 0x31535641;   // "AVS1"
+const int kSnapshotStrings = 3 + 2 * SceneState::kCharacterSlots;
+
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t variableCount;
+    uint32_t flagCount;
+    uint32_t historyCount;
+    uint32_t historyBytes;
+    uint32_t stringBytes;
+    uint32_t reserved;
+};
+
+// Section pointers into a checked record
+struct SnapshotView {
+    SnapshotHeader header;
+    const uint8_t* flagWords;
+    const uint8_t* values;
+    const uint8_t* historyOffsets;
+    const uint8_t* set;
+    const char* strings[kSnapshotStrings];
+    const char* historyIds;
+};
+
+uint64_t snapshotSize(uint64_t variables, uint64_t flagsCount, uint64_t historyCount, uint64_t historyBytes,
+                      uint64_t stringBytes) {
+    return sizeof(SnapshotHeader) + (flagsCount + 63) / 64 * sizeof(uint64_t) + variables * sizeof(int32_t) +
+           historyCount * sizeof(uint32_t) + variables + stringBytes + historyBytes;
 }
 
-bool GameState::parseScript(const char* jsonData) {
-    SimpleJSON json;
-    if (!json.parse(jsonData)) {
+bool viewSnapshot(const uint8_t* data, size_t size, SnapshotView& view) {
+    if (!data || size < sizeof(SnapshotHeader)) {
         return false;
     }
 
-    // Parse nodes array
-    int nodeCount = json.getArraySize("nodes");
-    for (int i = 0; i < nodeCount; i++) {
-        DialogueNode node;
-
-        // Get node object
-        std::string nodeKey = "nodes[" + std::to_string(i) + "]";
+    SnapshotHeader& h = view.header;
+    std::memcpy(&h, data, sizeof(h));
+    if (h.magic != kSnapshotMagic || h.size != size ||
+        snapshotSize(h.variableCount, h.flagCount, h.historyCount, h.historyBytes, h.stringBytes) != size ||
+        (h.historyCount == 0) != (h.historyBytes == 0)) {
+        return false;
+    }
 
-        node.id = json.getString(nodeKey + ".id");
-        std::string typeStr = json.getString(nodeKey + ".type");
+    const uint8_t* p = data + sizeof(h);
+    view.flagWords = p;
+    p += (static_cast<size_t>(h.flagCount) + 63) / 64 * sizeof(uint64_t);
+    view.values = p;
+    p += static_cast<size_t>(h.variableCount) * sizeof(int32_t);
+    view.historyOffsets = p;
+    p += static_cast<size_t>(h.historyCount) * sizeof(uint32_t);
+    view.set = p;
+    p += h.variableCount;
 
-        if (typeStr == "dialogue") {
-            node.type = NodeType::DIALOGUE;
-        } else if (typeStr == "choice") {
-            node.type = NodeType::CHOICE;
-        } else if (typeStr == "scene") {
-            node.type = NodeType::SCENE;
-        } else if (typeStr == "end") {
-            node.type = NodeType::END;
+    const char* text = reinterpret_cast<const char*>(p);
+    const char* textEnd = text + h.stringBytes;
+    for (int i = 0; i < kSnapshotStrings; i++) {
+        const void* nul = text < textEnd ? std::memchr(text, '\0', textEnd - text) : nullptr;
+        if (!nul) {
+            return false;
         }
+        view.strings[i] = text;
+        text = static_cast<const char*>(nul) + 1;
+    }
+    if (text != textEnd) {
+        return false;
+    }
 
-        node.speaker = json.getString(nodeKey + ".speaker");
-        node.text = json.getString(nodeKey + ".text");
-        node.nextNodeId = json.getString(nodeKey + ".next");
+    view.historyIds = textEnd;
+    if (h.historyBytes > 0 && view.historyIds[h.historyBytes - 1] != '\0') {
+        return false;
+    }
 
-        // Parse choices if present
-        int choiceCount = json.getArraySize(nodeKey + ".choices");
-        for (int j = 0; j < choiceCount; j++) {
-            std::string choiceKey = nodeKey + ".choices[" + std::to_string(j) + "]";
-            Choice choice;
-            choice.text = json.getString(choiceKey + ".text");
-            choice.nextNodeId = json.getString(choiceKey + ".next");
-            node.choices.push_back(choice);
+    // Each offset starts an id: the first at 0, the rest right after a NUL
+    for (uint32_t i = 0; i < h.historyCount; i++) {
+        uint32_t offset;
+        std::memcpy(&offset, view.historyOffsets + i * sizeof(uint32_t), sizeof(offset));
+        if (i == 0 ? offset != 0
+                   : (offset == 0 || offset >= h.historyBytes || view.historyIds[offset - 1] != '\0')) {
+            return false;
         }
+    }
+    return true;
+}
 
-        // Scene data
-        node.background = json.getString(nodeKey + ".background");
-        node.character = json.getString(nodeKey + ".character");
-        node.characterExpression = json.getString(nodeKey + ".expression");
-        node.bgm = json.getString(nodeKey + ".bgm");
-        node.soundEffect = json.getString(nodeKey + ".se");
+void appendString(std::vector<uint8_t>& out, const std::string& value) {
+    out.insert(out.end(), value.begin(), value.end());
+    out.push_back(0);
+}
 
-        addNode(node);
+void appendBytes(std::vector<uint8_t>& out, const void* data, size_t size) {
+    if (size > 0) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        out.insert(out.end(), bytes, bytes + size);
+    }
+}
 
-        // Set first node as current if not set
-        if (currentNodeId.empty() && i == 0) {
-            currentNodeId = node.id;
-        }
+} // namespace
+
+void GameState::takeSnapshot(std::vector<uint8_t>& out) const {
+    AVG_TRACE_SCOPE("GameState::takeSnapshot");
+
+    SnapshotHeader h;
+    h.magic = kSnapshotMagic;
+    h.variableCount = static_cast<uint32_t>(variableValues.size());
+    h.flagCount = static_cast<uint32_t>(flags.size());
+    h.historyCount = static_cast<uint32_t>(historyOffsets.size());
+    h.historyBytes = static_cast<uint32_t>(historyIds.size());
+    h.stringBytes = static_cast<uint32_t>(currentNodeId.size() + scene.background.size() + scene.bgm.size() +
+                                          kSnapshotStrings);
+    for (const auto& slot : scene.characters) {
+        h.stringBytes += static_cast<uint32_t>(slot.character.size() + slot.expression.size());
     }
+    h.reserved = 0;
+    h.size = static_cast<uint32_t>(
+        snapshotSize(h.variableCount, h.flagCount, h.historyCount, h.historyBytes, h.stringBytes));
 
+    // Reuses out's capacity, so retaking a slot does not allocate
+    out.clear();
+    out.reserve(h.size);
+    appendBytes(out, &h, sizeof(h));
+    appendBytes(out, flags.getWords(), (static_cast<size_t>(h.flagCount) + 63) / 64 * sizeof(uint64_t));
+    appendBytes(out, variableValues.data(), variableValues.size() * sizeof(int32_t));
+    appendBytes(out, historyOffsets.data(), historyOffsets.size() * sizeof(uint32_t));
+    appendBytes(out, variableSet.data(), variableSet.size());
+    appendString(out, currentNodeId);
+    appendString(out, scene.background);
+    appendString(out, scene.bgm);
+    for (const auto& slot : scene.characters) {
+        appendString(out, slot.character);
+        appendString(out, slot.expression);
+    }
+    appendBytes(out, historyIds.data(), historyIds.size());
+}
+
+bool GameState::restoreSnapshot(const uint8_t* data, size_t size) {
+    AVG_TRACE_SCOPE("GameState::restoreSnapshot");
+
+    SnapshotView view;
+    if (!viewSnapshot(data, size, view)) {
+        return false;
+    }
+    const SnapshotHeader& h = view.header;
+
+    currentNodeId = view.strings[0];
+
+    // Slots only ever grow, so a record covers a prefix of them
+    size_t variables = std::min<size_t>(h.variableCount, variableValues.size());
+    if (variables > 0) {
+        std::memcpy(variableValues.data(), view.values, variables * sizeof(int32_t));
+        std::memcpy(variableSet.data(), view.set, variables);
+    }
+    std::fill(variableValues.begin() + variables, variableValues.end(), 0);
+    std::fill(variableSet.begin() + variables, variableSet.end(), 0);
+    flags.assignWords(view.flagWords, h.flagCount);
+
+    historyIds.assign(view.historyIds, h.historyBytes);
+    historyOffsets.resize(h.historyCount);
+    if (h.historyCount > 0) {
+        std::memcpy(historyOffsets.data(), view.historyOffsets, h.historyCount * sizeof(uint32_t));
+    }
+
+    SceneState saved;
+    saved.background = view.strings[1];
+    saved.bgm = view.strings[2];
+    for (int slot = 0; slot < SceneState::kCharacterSlots; slot++) {
+        saved.characters[slot].character = view.strings[3 + slot * 2];
+        saved.characters[slot].expression = view.strings[4 + slot * 2];
+    }
+    setScene(saved);
     return true;
 }
 
+std::string GameState::serializeSnapshot(const uint8_t* data, size_t size) const {
+    SnapshotView view;
+    if (!viewSnapshot(data, size, view)) {
+        return "";
+    }
+    const SnapshotHeader& h = view.header;
+
+    // Simple serialization format, appended in place
+    std::string result;
+    result.reserve(256 + h.historyBytes + h.historyCount * 3 + h.stringBytes + h.variableCount * 24);
+    result += "{\"currentNode\":\"";
+    string_utils::appendJsonEscaped(result, view.strings[0]);
+    result += "\",\"variables\":{";
+
+    bool first = true;
+    size_t variables = std::min<size_t>(h.variableCount, variableNames.size());
+    for (size_t slot = 0; slot < variables; slot++) {
+        if (!view.set[slot]) continue;
+        int32_t value;
+        std::memcpy(&value, view.values + slot * sizeof(int32_t), sizeof(value));
+        if (!first) result += ",";
+        result += '"';
+        string_utils::appendJsonEscaped(result, variableNames[slot]);
+        result += "\":";
+        result += std::to_string(value);
+        first = false;
+    }
+    result += "},";
+    if (h.flagCount > 0) {
+        std::vector<uint64_t> words((static_cast<size_t>(h.flagCount) + 63) / 64);
+        std::memcpy(words.data(), view.flagWords, words.size() * sizeof(uint64_t));
+        result += "\"flags\":" + FlagSet::serialize(words.data(), h.flagCount) + ",";
+    }
+
+    result += "\"history\":[";
+    first = true;
+    for (uint32_t i = 0; i < h.historyCount; i++) {
+        uint32_t offset;
+        std::memcpy(&offset, view.historyOffsets + i * sizeof(uint32_t), sizeof(offset));
+        if (!first) result += ",";
+        result += '"';
+        string_utils::appendJsonEscaped(result, view.historyIds + offset);
+        result += '"';
+        first = false;
+    }
+    result += "],";
+
+    result += "\"scene\":{\"background\":\"";
+    string_utils::appendJsonEscaped(result, view.strings[1]);
+    result += "\",\"bgm\":\"";
+    string_utils::appendJsonEscaped(result, view.strings[2]);
+    result += "\",\"characters\":[";
+    for (int slot = 0; slot < SceneState::kCharacterSlots; slot++) {
+        if (slot > 0) result += ",";
+        result += "{\"name\":\"";
+        string_utils::appendJsonEscaped(result, view.strings[3 + slot * 2]);
+        result += "\",\"expression\":\"";
+        string_utils::appendJsonEscaped(result, view.strings[4 + slot * 2]);
+        result += "\"}";
+    }
+    result += "]}";
+    result += "}";
+
+    return result;
+}
+
+void GameState::reset() {
+    currentNodeId.clear();
+    clearVariables();
+    historyIds.clear();
+    historyOffsets.clear();
+    setScene(SceneState());
+}
+
+bool GameState::parseScript(const char* jsonData, int moduleIndex) {
+    AVG_TRACE_SCOPE("GameState::parseScript");
+
+    // Same path as incremental loading, run to completion in one go
+    ScriptLoader loader;
+    ScriptLoader::Options options;
+    options.module = moduleIndex;
+    if (!loader.begin(jsonData, false, options)) {
+        return false;
+    }
+
+    return loader.step(*this, -1) == ScriptLoader::Status::Done;
+}
+
 } // namespace avg
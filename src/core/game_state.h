@@ -1,13 +1,41 @@
 #ifndef GAME_STATE_H
 #define GAME_STATE_H
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include "dialogue_node.h"
+#include "flag_set.h"
+#include "node_id_table.h"
+#include "scene_state.h"
+#include "search_index.h"
+#include "string_table.h"
+#include "text_store.h"
 
 namespace avg {
 
+// Contiguous run of nodes sharing the same "chapter" tag, in script order
+struct ChapterRange {
+    std::string name;
+    int begin;
+    int end;
+};
+
+// Script module (e.g. a chapter file) that is loaded on demand. Registering
+// a module reserves index range [begin, end) for its nodes so indices stay
+// stable while the module's content is loaded and evicted.
+struct ScriptModule {
+    std::string id;
+    int begin;
+    int end;
+    bool resident;
+    bool loadedOnce;
+    size_t residentBytes;
+    uint64_t lastUsed;
+};
+
 class GameState {
 public:
     GameState();
@@ -17,36 +45,250 @@ public:
     void setCurrentNode(const std::string& nodeId);
     std::string getCurrentNodeId() const;
     const DialogueNode* getCurrentNode() const;
+    int getCurrentNodeIndex() const;
 
     // Script management
     bool loadScript(const char* jsonData);
+    // Drop the whole script graph (nodes, modules, chapters) and session
+    void clearScript();
+    const std::string& getStartNodeId() const { return startNodeId; }
+    void setStartNodeId(const std::string& nodeId) { startNodeId = nodeId; }
     bool addNode(const DialogueNode& node);
+    bool addNode(DialogueNode&& node);
+    // contentHash is hashNode(node), computed by the caller (the script
+    // loader hashes nodes on its worker threads). sourceHash identifies the
+    // JSON the node was parsed from (0 = unknown); see getNodeSourceHash.
+    bool addNode(DialogueNode&& node, uint64_t contentHash, uint64_t sourceHash = 0);
+    // Room for count more nodes before a bulk add
+    void reserveNodes(size_t count);
+    // Content hash of everything a node displays or links to (never 0)
+    static uint64_t hashNode(const DialogueNode& node);
     const DialogueNode* getNode(const std::string& nodeId) const;
 
-    // Variables (for game logic)
+    // Node indices are assigned in load order and stay stable for the
+    // lifetime of the script (re-adding an existing id keeps its index)
+    int getNodeIndex(const std::string& nodeId) const;
+    const DialogueNode* getNodeByIndex(int index) const;
+    int getNodeCount() const { return static_cast<int>(nodeSlots.size()); }
+    // Id hash (hash::hashString) per node index: resident nodes and the
+    // reserved ones of every module, loaded or not; 0 for retired indices
+    void getNodeIdHashes(std::vector<uint64_t>& out) const;
+    const std::vector<ChapterRange>& getChapters() const { return chapters; }
+
+    // Rebuild the perfect-hash id table once enough nodes were added since
+    // the last build (always true for a fresh script). Called after loads.
+    void optimizeNodeLookup();
+    // Incremental form for the script loader: beginNodeLookup starts a
+    // rebuild if one is due (false otherwise), then stepNodeLookup advances
+    // it by about maxWork keys until it returns true. Lookups keep working
+    // in between; the graph must not change until the rebuild is done.
+    bool beginNodeLookup();
+    bool stepNodeLookup(size_t maxWork);
+    const NodeIdTable& getNodeIdTable() const { return idTable; }
+
+    // Hot reload. reloadNode replaces a node only when its content hash
+    // differs; indices of existing nodes never change.
+    enum class ReloadResult {
+        Added,
+        Changed,
+        Unchanged
+    };
+    ReloadResult reloadNode(DialogueNode&& node);
+    ReloadResult reloadNode(DialogueNode&& node, uint64_t contentHash, uint64_t sourceHash = 0);
+    // Retire resident nodes of nameSpace ("" = ids without a namespace) whose
+    // index is not marked in seen, except the current node and history
+    // entries. Returns the number retired; their indices are not reused.
+    int retireMissingNodes(const std::string& nameSpace, const std::vector<char>& seen);
+    uint64_t getNodeHash(int index) const;
+    // Hash of the raw JSON a resident node was loaded from, so a reload can
+    // skip elements whose bytes did not change without parsing them. 0 when
+    // unknown (nodes added directly or imported from a compiled blob).
+    uint64_t getNodeSourceHash(int index) const;
+
+    // References from linked files that name no known node yet. Updated
+    // incrementally: each link adds its own dangling references and drops
+    // the ones its nodes now satisfy.
+    void updateUnresolvedLinks(const std::vector<std::string>& newRefs);
+    const std::vector<std::string>& getUnresolvedLinks() const { return unresolvedLinks; }
+
+    // Script modules. Nodes of a module that is not resident still have an
+    // index (getNodeIndex) but getNode/getNodeByIndex return nullptr.
+    int registerModule(const std::string& moduleId, const std::vector<std::string>& nodeIds);
+    int findModule(const std::string& moduleId) const;
+    int getModuleForIndex(int index) const;
+    const std::vector<ScriptModule>& getModules() const { return modules; }
+    bool isNodeResident(int index) const;
+    // Load a module's script; fails without changes if a node's id is not
+    // one the module registered
+    bool loadModule(int moduleIndex, const char* jsonData);
+    // Mark a module as loaded after its nodes were added; returns its size
+    size_t markModuleResident(int moduleIndex);
+    void touchModule(int moduleIndex, uint64_t tick);
+    // Drop the content of a module's nodes; returns the bytes released
+    size_t evictModule(int moduleIndex);
+
+    // Dialogue text of a node. With compression on, resident texts live in
+    // textStore and node.text is empty; this decodes them.
+    std::string getNodeText(int index) const;
+    // Move texts not yet stored into compressed blocks, retraining from
+    // scratch once dead texts (replaced or evicted nodes) outweigh live ones
+    void compactText();
+    // Decompress every stored text back into its node
+    void expandText();
+    TextStore::Stats getTextStats() const { return textStore.getStats(); }
+
+    // Localised strings. loadLocale parses a locale table,
+    // {"locale":"ja","strings":[{"id":"start","speaker":"...","text":"...",
+    // "choices":["...", ...]}, ...]}, replaces the active one and applies it
+    // to resident nodes; nodes placed later (modules, reload) take their
+    // strings from it as well. Returns the number of resident nodes changed,
+    // or -1 if the table does not parse. The script's own strings of every
+    // localised node are kept aside: fields and nodes a table leaves out show
+    // them, and unloadLocale drops the table and puts them all back (it
+    // returns the number of nodes restored).
+    int loadLocale(const char* jsonData);
+    int unloadLocale();
+    const StringTable& getLocale() const { return locale; }
+
+    // Full-text index over resident nodes (see SearchIndex). It goes stale
+    // whenever a node's strings change; compiled blobs can carry it.
+    void buildSearchIndex();
+    void clearSearchIndex();
+    bool isSearchIndexCurrent() const { return searchIndexCurrent; }
+    const SearchIndex& getSearchIndex() const { return searchIndex; }
+
+    // Variables (for game logic). Each name gets a slot the first time a
+    // script or setVariable uses it; slots live as long as the state.
     void setVariable(const std::string& name, int value);
     int getVariable(const std::string& name) const;
     bool hasVariable(const std::string& name) const;
+    int internVariable(const std::string& name);
+
+    // Story flags (see FlagSet). The by-name variable calls above reach
+    // them too. declareFlags adds names to a group ("" for none); a
+    // variable of the same name becomes the flag, set if it was non-zero.
+    void declareFlags(const std::string& group, const std::vector<std::string>& names);
+    FlagSet& getFlags() { return flags; }
+    const FlagSet& getFlags() const { return flags; }
+
+    // Script conditions and effects (see script_code.h) of a resident node,
+    // run against the variable slots. testCondition is true for kNone.
+    bool testCondition(const DialogueNode& node, uint32_t entry) const;
+    void runEffects(const DialogueNode& node, uint32_t entry);
 
     // History
     void pushHistory(const std::string& nodeId);
     std::string popHistory();
     bool canGoBack() const;
 
-    // Save/Load state
+    // Effective scene (see SceneState). applyScene folds in a node entered
+    // by navigation; every change sets the layer's dirty bit and bumps the
+    // generation. takeSceneDirty returns the layers changed since the last
+    // call and clears them.
+    uint32_t applyScene(const DialogueNode& node);
+    void setScene(const SceneState& scene);
+    const SceneState& getScene() const { return scene; }
+    uint32_t getSceneDirty() const { return sceneDirty; }
+    uint32_t takeSceneDirty();
+    uint64_t getSceneGeneration() const { return sceneGeneration; }
+
+    // Save/Load state (the scene and flags are saved with the session)
     std::string serialize() const;
     bool deserialize(const char* data);
 
+    // Session snapshots: the session (current node, history, variables,
+    // flags, scene) as one flat record of counts, values and string bytes
+    // with no pointers, written and read with a few bulk copies. The record
+    // is in native byte order and refers to variable slots, so it belongs
+    // to this state; serializeSnapshot turns one into save JSON for storage.
+    // restoreSnapshot applies a record like deserialize applies a save.
+    void takeSnapshot(std::vector<uint8_t>& out) const;
+    bool restoreSnapshot(const uint8_t* data, size_t size);
+    std::string serializeSnapshot(const uint8_t* data, size_t size) const;
+
     // Reset
     void reset();
 
 private:
+    // Compiled script blobs read and write the graph directly
+    friend class CompiledScript;
+
     std::string currentNodeId;
-    std::unordered_map<std::string, DialogueNode> nodes;
-    std::unordered_map<std::string, int> variables;
-    std::vector<std::string> history;
+    std::string startNodeId;
+    // Resident node storage. nodeSlots maps a node index to its slot in
+    // nodes (-1 while the node's module is not loaded). Ids resolve through
+    // idTable (perfect hash over the nodes present at the last build), then
+    // nodeIndices (resident nodes added since), then reservedIndices.
+    std::vector<DialogueNode> nodes;
+    std::vector<int> nodeSlots;
+    std::vector<int> freeSlots;
+    // Content hash per node index (0 while not resident)
+    std::vector<uint64_t> nodeHashes;
+    // Source hash per node index (0 while not resident or unknown)
+    std::vector<uint64_t> sourceHashes;
+    TextStore textStore;
+    // Active locale, applied over the script's strings as nodes are placed
+    StringTable locale;
+    // The script's own strings of each node the locale changed, by node index
+    struct BaseStrings {
+        std::string speaker;
+        std::string text;
+        std::vector<TextSpan> textSpans;
+        std::string spanStrings;
+        std::vector<Choice> choices;
+    };
+    std::unordered_map<int, BaseStrings> baseStrings;
+    SearchIndex searchIndex;
+    bool searchIndexCurrent;
+    NodeIdTable idTable;
+    std::unordered_map<std::string, int> nodeIndices;
+    // Rebuild in progress (beginNodeLookup): ids are collected from
+    // lookupCursor on, then built; the map the new table replaces is freed a
+    // chunk per step
+    enum class LookupStage {
+        Idle,
+        Collect,
+        Build,
+        Release
+    };
+    LookupStage lookupStage;
+    size_t lookupCursor;
+    NodeIdTable::Builder lookupBuilder;
+    std::unordered_map<std::string, int> retiredIndices;
+    std::vector<ScriptModule> modules;
+    // (id hash, index) of every registered module node, sorted by hash
+    std::vector<std::pair<uint64_t, int>> reservedIndices;
+    std::vector<std::string> unresolvedLinks;
+    std::vector<ChapterRange> chapters;
+    // Variable slots; a slot counts as set once assigned this session
+    std::unordered_map<std::string, int> variableSlots;
+    std::vector<std::string> variableNames;
+    std::vector<int32_t> variableValues;
+    std::vector<uint8_t> variableSet;
+    FlagSet flags;
+    // History ids back to back (NUL-terminated) and the offset of each
+    std::string historyIds;
+    std::vector<uint32_t> historyOffsets;
+    SceneState scene;
+    uint32_t sceneDirty;
+    uint64_t sceneGeneration;
 
-    bool parseScript(const char* jsonData);
+    bool parseScript(const char* jsonData, int moduleIndex = -1);
+    void addChapterNode(const std::string& chapter, int index);
+    int findReservedIndex(uint64_t idHash) const;
+    int lookupIndex(const std::string& nodeId, bool residentOnly) const;
+    void placeNode(int index, DialogueNode&& node, uint64_t contentHash, uint64_t sourceHash);
+    void releaseNode(int index);
+    // Overwrite the node's strings with the active locale's, keeping the
+    // script's own in baseStrings; false if the locale has no entry for index
+    bool localizeNode(int index, DialogueNode& node);
+    // Put the script's own strings back; false if the node was not localised
+    bool restoreNode(int index, DialogueNode& node);
+    // Resolve the variable names of a node's script code to slots
+    void bindVariables(DialogueNode& node);
+    // Unset every variable; slots stay bound
+    void clearVariables();
+    bool inHistory(const std::string& nodeId) const;
 };
 
 } // namespace avg
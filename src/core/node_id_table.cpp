@@ -0,0 +1,296 @@
+#include "node_id_table.h"
+#include "../utils/hash.h"
+#include "../utils/trace.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace avg {
+
+namespace {
+
+// Average keys per bucket
+const uint64_t kBucketSize = 4;
+// Slots per key, as a fraction out of 100
+const uint64_t kSlotPercent = 101;
+const int kMaxSeeds = 16;
+const uint32_t kMaxPilot = 0xffff;
+
+} // namespace
+
+NodeIdTable::NodeIdTable() : seed(0), slotCount(0) {
+}
+
+void NodeIdTable::clear() {
+    seed = 0;
+    slotCount = 0;
+    pilots.clear();
+    remap.clear();
+    values.clear();
+}
+
+size_t NodeIdTable::memoryBytes() const {
+    return pilots.capacity() * sizeof(uint16_t) + remap.capacity() * sizeof(uint32_t) +
+           values.capacity() * sizeof(int);
+}
+
+// Ranges are reduced with a multiply-shift instead of a division; counts
+// stay below 2^32
+static inline uint64_t reduce(uint64_t h, uint64_t n) {
+    return ((h >> 32) * n) >> 32;
+}
+
+uint64_t NodeIdTable::mixOf(uint64_t idHash) const {
+    return hash::mix64(idHash ^ seed);
+}
+
+uint64_t NodeIdTable::bucketOf(uint64_t mixed) const {
+    return reduce(mixed, pilots.size());
+}
+
+uint64_t NodeIdTable::slotOf(uint64_t mixed, uint16_t pilot) const {
+    // The low half of the mixed hash picks the slot, scrambled per pilot
+    // with one multiply
+    uint64_t h = (mixed << 32) ^ ((static_cast<uint64_t>(pilot) + 1) * 0x9e3779b97f4a7c15ULL);
+    return reduce(h * 0xbf58476d1ce4e5b9ULL, slotCount);
+}
+
+size_t NodeIdTable::position(uint64_t idHash) const {
+    uint64_t mixed = mixOf(idHash);
+    uint64_t slot = slotOf(mixed, pilots[bucketOf(mixed)]);
+    return slot < values.size() ? static_cast<size_t>(slot) : remap[slot - values.size()];
+}
+
+bool NodeIdTable::build(std::vector<std::pair<uint64_t, int>> keys, std::vector<int>& rejected) {
+    AVG_TRACE_SCOPE("NodeIdTable::build");
+
+    Builder builder(std::move(keys));
+    while (!builder.step(SIZE_MAX)) {
+    }
+    return builder.finish(*this, rejected);
+}
+
+NodeIdTable::Builder::Builder(std::vector<std::pair<uint64_t, int>> keys)
+    : stage(Stage::Sort), keys(std::move(keys)), sortPass(0), attempt(0), bucketCount(0), placed(0) {
+}
+
+bool NodeIdTable::Builder::step(size_t maxWork) {
+    size_t work = 0;
+    while (work < maxWork) {
+        switch (stage) {
+            case Stage::Sort: work += sortStep(); break;
+            case Stage::Seed: work += seedStep(); break;
+            case Stage::Place: work += placeStep(maxWork - work); break;
+            case Stage::Fill: work += fillStep(); break;
+            default: return true;
+        }
+    }
+    return stage == Stage::Done || stage == Stage::Failed;
+}
+
+// Sort the keys by hash so equal hashes can be rejected; equal hashes can't
+// be separated by any pilot. Small sets are sorted in one go, large ones by
+// a stable radix sort of one 16-bit digit per call.
+size_t NodeIdTable::Builder::sortStep() {
+    const size_t kSmallSort = 4096;
+    const int kSortPasses = 4;
+    size_t n = keys.size();
+
+    if (n <= kSmallSort) {
+        std::stable_sort(keys.begin(), keys.end(),
+                         [](const std::pair<uint64_t, int>& a, const std::pair<uint64_t, int>& b) { return a.first < b.first; });
+        sortPass = kSortPasses;
+    } else {
+        int shift = 16 * sortPass;
+        std::vector<uint32_t> starts(65536 + 1, 0);
+        for (const auto& key : keys) {
+            starts[((key.first >> shift) & 0xffff) + 1]++;
+        }
+        for (size_t d = 0; d < 65536; d++) {
+            starts[d + 1] += starts[d];
+        }
+        scratch.resize(n);
+        for (const auto& key : keys) {
+            scratch[starts[(key.first >> shift) & 0xffff]++] = key;
+        }
+        keys.swap(scratch);
+        if (++sortPass < kSortPasses) {
+            return n;
+        }
+        std::vector<std::pair<uint64_t, int>>().swap(scratch);
+    }
+
+    // Of each run of equal hashes keep the lowest index, as a sort of the
+    // pairs would
+    size_t unique = 0;
+    for (size_t i = 0; i < n;) {
+        size_t run = i + 1;
+        size_t keep = i;
+        for (; run < n && keys[run].first == keys[i].first; run++) {
+            if (keys[run].second < keys[keep].second) {
+                keep = run;
+            }
+        }
+        for (size_t k = i; k < run; k++) {
+            if (k != keep) {
+                rejected.push_back(keys[k].second);
+            }
+        }
+        keys[unique++] = keys[keep];
+        i = run;
+    }
+    keys.resize(unique);
+
+    n = keys.size();
+    if (n == 0) {
+        stage = Stage::Done;
+        return 1;
+    }
+
+    bucketCount = static_cast<size_t>((n + kBucketSize - 1) / kBucketSize);
+    table.slotCount = std::max<uint64_t>(n, n * kSlotPercent / 100);
+    bucketStart.resize(bucketCount + 1);
+    mixed.resize(n);
+    order.resize(n);
+    bucketOrder.resize(bucketCount);
+    taken.resize(static_cast<size_t>(table.slotCount));
+    stage = Stage::Seed;
+    return n;
+}
+
+// Start an attempt with the next seed: bucket the keys and order the
+// buckets
+size_t NodeIdTable::Builder::seedStep() {
+    size_t n = keys.size();
+    table.seed = hash::mix64(static_cast<uint64_t>(attempt) + 1);
+    table.pilots.assign(bucketCount, 0);
+
+    for (size_t i = 0; i < n; i++) {
+        mixed[i] = table.mixOf(keys[i].first);
+    }
+
+    // Group keys by bucket (counting sort)
+    std::fill(bucketStart.begin(), bucketStart.end(), 0);
+    for (size_t i = 0; i < n; i++) {
+        bucketStart[table.bucketOf(mixed[i]) + 1]++;
+    }
+    for (size_t b = 0; b < bucketCount; b++) {
+        bucketStart[b + 1] += bucketStart[b];
+    }
+    std::vector<uint32_t> fill(bucketStart.begin(), bucketStart.end() - 1);
+    for (size_t i = 0; i < n; i++) {
+        order[fill[table.bucketOf(mixed[i])]++] = static_cast<uint32_t>(i);
+    }
+
+    // Largest buckets first, while most slots are still free; equal sizes
+    // keep bucket order (counting sort by size)
+    uint32_t largest = 0;
+    for (size_t b = 0; b < bucketCount; b++) {
+        largest = std::max(largest, bucketStart[b + 1] - bucketStart[b]);
+    }
+    std::vector<uint32_t> sizeStart(static_cast<size_t>(largest) + 2, 0);
+    for (size_t b = 0; b < bucketCount; b++) {
+        sizeStart[largest - (bucketStart[b + 1] - bucketStart[b]) + 1]++;
+    }
+    for (size_t i = 0; i + 1 < sizeStart.size(); i++) {
+        sizeStart[i + 1] += sizeStart[i];
+    }
+    for (size_t b = 0; b < bucketCount; b++) {
+        bucketOrder[sizeStart[largest - (bucketStart[b + 1] - bucketStart[b])]++] = static_cast<uint32_t>(b);
+    }
+
+    std::fill(taken.begin(), taken.end(), 0);
+    placed = 0;
+    stage = Stage::Place;
+    return 3 * n + bucketCount;
+}
+
+// Find a pilot for each bucket in turn; a bucket no pilot fits restarts
+// with the next seed
+size_t NodeIdTable::Builder::placeStep(size_t maxWork) {
+    size_t work = 1;
+    for (; placed < bucketOrder.size() && work < maxWork; placed++) {
+        uint32_t b = bucketOrder[placed];
+        uint32_t begin = bucketStart[b];
+        uint32_t end = bucketStart[b + 1];
+        if (begin == end) {
+            // Sizes only go down from here
+            placed = bucketOrder.size();
+            break;
+        }
+
+        bool fits = false;
+        for (uint32_t pilot = 0; pilot <= kMaxPilot && !fits; pilot++) {
+            slots.clear();
+            fits = true;
+            for (uint32_t k = begin; k < end; k++) {
+                work++;
+                uint64_t slot = table.slotOf(mixed[order[k]], static_cast<uint16_t>(pilot));
+                if (taken[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+                    fits = false;
+                    break;
+                }
+                slots.push_back(slot);
+            }
+            if (fits) {
+                table.pilots[b] = static_cast<uint16_t>(pilot);
+                for (uint64_t slot : slots) {
+                    taken[slot] = 1;
+                }
+            }
+        }
+
+        if (!fits) {
+            stage = ++attempt < kMaxSeeds ? Stage::Seed : Stage::Failed;
+            return work;
+        }
+    }
+
+    if (placed == bucketOrder.size()) {
+        stage = Stage::Fill;
+    }
+    return work;
+}
+
+size_t NodeIdTable::Builder::fillStep() {
+    size_t n = keys.size();
+
+    // Slots past n are remapped onto the holes below n
+    table.remap.assign(static_cast<size_t>(table.slotCount - n), 0);
+    size_t hole = 0;
+    for (uint64_t slot = n; slot < table.slotCount; slot++) {
+        if (!taken[slot]) {
+            continue;
+        }
+        while (taken[hole]) {
+            hole++;
+        }
+        table.remap[slot - n] = static_cast<uint32_t>(hole++);
+    }
+
+    table.values.assign(n, -1);
+    for (const auto& key : keys) {
+        table.values[table.position(key.first)] = key.second;
+    }
+    stage = Stage::Done;
+    return n + static_cast<size_t>(table.slotCount);
+}
+
+bool NodeIdTable::Builder::finish(NodeIdTable& result, std::vector<int>& rejectedOut) {
+    bool ok = stage == Stage::Done;
+    result.clear();
+    rejectedOut.swap(rejected);
+    rejected.clear();
+    if (ok) {
+        std::swap(result, table);
+    } else {
+        // Give up; the caller falls back to its map for every key
+        for (const auto& key : keys) {
+            rejectedOut.push_back(key.second);
+        }
+    }
+
+    *this = Builder();
+    return ok;
+}
+
+} // namespace avg
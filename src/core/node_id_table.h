@@ -0,0 +1,107 @@
+#ifndef NODE_ID_TABLE_H
+#define NODE_ID_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace avg {
+
+// Minimal perfect hash from node id hash to node index.
+//
+// Keys are spread over buckets of about four; each bucket stores a 16-bit
+// pilot chosen at build time so that its keys land on distinct free slots.
+// A lookup is one id hash, one pilot read and one slot read; the caller
+// verifies the candidate with a single id compare. Slots are sized slightly
+// above the key count to make building fast, and the few positions past the
+// end are remapped into the holes so the value array stays minimal.
+class NodeIdTable {
+public:
+    NodeIdTable();
+
+    // Build from (id hash, node index) pairs. Keys whose hash collides with
+    // another key are returned in rejected; the caller keeps those elsewhere.
+    bool build(std::vector<std::pair<uint64_t, int>> keys, std::vector<int>& rejected);
+    void clear();
+
+    class Builder;
+
+    // Candidate node index for an id hash, or -1. Ids that were not part of
+    // the build map to an arbitrary candidate, hence the caller's compare.
+    int find(uint64_t idHash) const {
+        if (values.empty()) {
+            return -1;
+        }
+        return values[position(idHash)];
+    }
+
+    size_t size() const { return values.size(); }
+    size_t memoryBytes() const;
+
+private:
+    friend class CompiledScript;
+
+    uint64_t seed;
+    uint64_t slotCount;
+    std::vector<uint16_t> pilots;
+    std::vector<uint32_t> remap;
+    std::vector<int> values;
+
+    size_t position(uint64_t idHash) const;
+    uint64_t mixOf(uint64_t idHash) const;
+    uint64_t bucketOf(uint64_t mixed) const;
+    uint64_t slotOf(uint64_t mixed, uint16_t pilot) const;
+};
+
+// Resumable form of NodeIdTable::build, so a load can spread the build over
+// frames: add the keys, call step() until it returns true, then finish().
+// The table comes out exactly as build() makes it.
+class NodeIdTable::Builder {
+public:
+    explicit Builder(std::vector<std::pair<uint64_t, int>> keys = std::vector<std::pair<uint64_t, int>>());
+
+    void reserve(size_t count) { keys.reserve(count); }
+    void add(uint64_t idHash, int index) { keys.push_back({idHash, index}); }
+
+    // Advance by roughly maxWork key operations; true once the build is over
+    bool step(size_t maxWork);
+    // Move the result into table. False if no seed worked; every key is
+    // then rejected and table is left empty.
+    bool finish(NodeIdTable& table, std::vector<int>& rejected);
+
+private:
+    enum class Stage {
+        Sort,
+        Seed,
+        Place,
+        Fill,
+        Done,
+        Failed
+    };
+
+    Stage stage;
+    NodeIdTable table;
+    std::vector<std::pair<uint64_t, int>> keys;
+    std::vector<std::pair<uint64_t, int>> scratch;
+    std::vector<int> rejected;
+    int sortPass;
+    int attempt;
+    size_t bucketCount;
+    size_t placed;      // entries of bucketOrder done in this attempt
+    std::vector<uint32_t> bucketStart;
+    std::vector<uint64_t> mixed;
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> bucketOrder;
+    std::vector<char> taken;
+    std::vector<uint64_t> slots;
+
+    size_t sortStep();
+    size_t seedStep();
+    size_t placeStep(size_t maxWork);
+    size_t fillStep();
+};
+
+} // namespace avg
+
+#endif // NODE_ID_TABLE_H
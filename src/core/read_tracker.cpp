@@ -0,0 +1,156 @@
+#include "read_tracker.h"
+#include "../utils/simple_json.h"
+#include "../utils/string_utils.h"
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace avg {
+
+static inline size_t popcount64(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_popcountll(value));
+#elif defined(_MSC_VER) && defined(_M_X64)
+    return static_cast<size_t>(__popcnt64(value));
+#else
+    value = value - ((value >> 1) & 0x5555555555555555ULL);
+    value = (value & 0x3333333333333333ULL) + ((value >> 2) & 0x3333333333333333ULL);
+    value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<size_t>((value * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+ReadTracker::ReadTracker() : bitCount(0) {
+}
+
+void ReadTracker::resize(size_t nodeCount) {
+    if (nodeCount <= bitCount) {
+        return;
+    }
+
+    bitCount = nodeCount;
+    words.resize((bitCount + 63) / 64, 0);
+}
+
+size_t ReadTracker::countRead(size_t begin, size_t end) const {
+    if (end > bitCount) {
+        end = bitCount;
+    }
+    if (begin >= end) {
+        return 0;
+    }
+
+    size_t firstWord = begin >> 6;
+    size_t lastWord = (end - 1) >> 6;
+    uint64_t headMask = ~uint64_t(0) << (begin & 63);
+    uint64_t tailMask = ~uint64_t(0) >> (63 - ((end - 1) & 63));
+
+    if (firstWord == lastWord) {
+        return popcount64(words[firstWord] & headMask & tailMask);
+    }
+
+    size_t count = popcount64(words[firstWord] & headMask);
+    for (size_t i = firstWord + 1; i < lastWord; i++) {
+        count += popcount64(words[i]);
+    }
+    count += popcount64(words[lastWord] & tailMask);
+    return count;
+}
+
+void ReadTracker::clear() {
+    std::fill(words.begin(), words.end(), 0);
+}
+
+std::string ReadTracker::serialize(const std::vector<uint64_t>& idHashes) const {
+    std::vector<uint64_t> read;
+    size_t count = std::min(bitCount, idHashes.size());
+    for (size_t i = 0; i < count; i++) {
+        if (isRead(i) && idHashes[i] != 0) {
+            read.push_back(idHashes[i]);
+        }
+    }
+    std::sort(read.begin(), read.end());
+    read.erase(std::unique(read.begin(), read.end()), read.end());
+
+    // Deltas of sorted hashes, 7 bits per byte, low groups first
+    std::vector<unsigned char> bytes;
+    bytes.reserve(read.size() * 8);
+    uint64_t previous = 0;
+    for (uint64_t hash : read) {
+        uint64_t delta = hash - previous;
+        previous = hash;
+        while (delta >= 0x80) {
+            bytes.push_back(static_cast<unsigned char>(delta | 0x80));
+            delta >>= 7;
+        }
+        bytes.push_back(static_cast<unsigned char>(delta));
+    }
+
+    std::string result = "{\"version\":2,\"ids\":\"";
+    string_utils::appendBase64(result, bytes.data(), bytes.size());
+    result += "\"}";
+    return result;
+}
+
+bool ReadTracker::deserialize(const char* data, const std::vector<uint64_t>& idHashes) {
+    SimpleJSON json;
+    if (!json.parse(data)) {
+        return false;
+    }
+
+    if (json.getInt("version") != 2) {
+        return false;
+    }
+
+    std::vector<unsigned char> bytes;
+    if (!string_utils::base64Decode(json.getString("ids"), bytes)) {
+        return false;
+    }
+
+    // Decode everything first so a bad record changes nothing
+    std::vector<uint64_t> read;
+    uint64_t previous = 0;
+    for (size_t i = 0; i < bytes.size();) {
+        uint64_t delta = 0;
+        int shift = 0;
+        while (true) {
+            if (i >= bytes.size() || shift > 63) {
+                return false;
+            }
+            unsigned char byte = bytes[i++];
+            delta |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            shift += 7;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        previous += delta;
+        read.push_back(previous);
+    }
+
+    std::vector<std::pair<uint64_t, size_t>> byHash;
+    byHash.reserve(idHashes.size());
+    for (size_t i = 0; i < idHashes.size(); i++) {
+        if (idHashes[i] != 0) {
+            byHash.push_back({idHashes[i], i});
+        }
+    }
+    std::sort(byHash.begin(), byHash.end());
+
+    resize(idHashes.size());
+    size_t next = 0;
+    for (uint64_t hash : read) {
+        while (next < byHash.size() && byHash[next].first < hash) {
+            next++;
+        }
+        for (size_t k = next; k < byHash.size() && byHash[k].first == hash; k++) {
+            markRead(byHash[k].second);
+        }
+    }
+
+    return true;
+}
+
+} // namespace avg
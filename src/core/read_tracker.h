@@ -0,0 +1,55 @@
+#ifndef READ_TRACKER_H
+#define READ_TRACKER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace avg {
+
+// Global "already read" bitset, one bit per node index.
+// It is independent of save slots: the host persists it separately with
+// serialize()/deserialize() so skip-read-only works across all saves. The
+// stored form names nodes by id, not index, so it survives script updates.
+class ReadTracker {
+public:
+    ReadTracker();
+
+    // Grow (never shrink) to cover nodeCount nodes, keeping existing bits
+    void resize(size_t nodeCount);
+    size_t size() const { return bitCount; }
+
+    void markRead(size_t index) {
+        if (index < bitCount) {
+            words[index >> 6] |= uint64_t(1) << (index & 63);
+        }
+    }
+
+    bool isRead(size_t index) const {
+        return index < bitCount && ((words[index >> 6] >> (index & 63)) & 1) != 0;
+    }
+
+    // Number of read nodes in [begin, end)
+    size_t countRead(size_t begin, size_t end) const;
+    size_t countRead() const { return countRead(0, bitCount); }
+
+    void clear();
+
+    // Persistence: {"version":2,"ids":"<base64>"}, the id hashes of the read
+    // nodes in ascending order as varint deltas. idHashes[i] is the id hash
+    // of node index i, 0 for none (see GameState::getNodeIdHashes).
+    std::string serialize(const std::vector<uint64_t>& idHashes) const;
+    // Marks the stored nodes read on top of the bits already set; ids the
+    // script no longer has are skipped. Version 1 records (bits by load
+    // order) are rejected, as are malformed ones, without changing anything.
+    bool deserialize(const char* data, const std::vector<uint64_t>& idHashes);
+
+private:
+    std::vector<uint64_t> words;
+    size_t bitCount;
+};
+
+} // namespace avg
+
+#endif // READ_TRACKER_H
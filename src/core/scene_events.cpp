@@ -0,0 +1,137 @@
+#include "scene_events.h"
+#include "dialogue_node.h"
+
+namespace avg {
+
+static_assert(sizeof(SceneEvent) == 16, "scene events are read as four 32-bit words");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "ring header is read as plain words");
+static_assert((SceneEventQueue::kCapacity & (SceneEventQueue::kCapacity - 1)) == 0, "capacity must be a power of two");
+
+SceneEventQueue::SceneEventQueue() {
+    buffer.head.store(0, std::memory_order_relaxed);
+    buffer.tail.store(0, std::memory_order_relaxed);
+    buffer.capacity = kCapacity;
+    buffer.dropped = 0;
+
+    shown.bgm = -1;
+    shown.background = -1;
+    for (int slot = 0; slot < SceneState::kCharacterSlots; slot++) {
+        shown.characters[slot] = -1;
+        shown.expressions[slot] = -1;
+    }
+    syncedGeneration = 0;
+}
+
+bool SceneEventQueue::push(SceneEventType type, int slot, int nodeIndex, int32_t asset, int32_t detail) {
+    uint32_t head = buffer.head.load(std::memory_order_relaxed);
+    uint32_t tail = buffer.tail.load(std::memory_order_acquire);
+    if (head - tail >= kCapacity) {
+        buffer.dropped++;
+        return false;
+    }
+
+    SceneEvent& event = buffer.events[head & (kCapacity - 1)];
+    event.type = type;
+    event.slot = static_cast<uint16_t>(slot);
+    event.nodeIndex = nodeIndex;
+    event.asset = asset;
+    event.detail = detail;
+    buffer.head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool SceneEventQueue::pop(SceneEvent& event) {
+    uint32_t tail = buffer.tail.load(std::memory_order_relaxed);
+    if (tail == buffer.head.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    event = buffer.events[tail & (kCapacity - 1)];
+    buffer.tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+size_t SceneEventQueue::pending() const {
+    return buffer.head.load(std::memory_order_acquire) - buffer.tail.load(std::memory_order_acquire);
+}
+
+int32_t SceneEventQueue::internAsset(const std::string& name) {
+    if (name.empty()) {
+        return -1;
+    }
+
+    auto it = assetIds.find(name);
+    if (it != assetIds.end()) {
+        return it->second;
+    }
+
+    int32_t id = static_cast<int32_t>(assetNames.size());
+    assetNames.push_back(name);
+    assetIds.emplace(name, id);
+    return id;
+}
+
+const std::string& SceneEventQueue::getAssetName(int32_t id) const {
+    static const std::string empty;
+    if (id < 0 || id >= static_cast<int32_t>(assetNames.size())) {
+        return empty;
+    }
+    return assetNames[id];
+}
+
+void SceneEventQueue::sync(int nodeIndex, const SceneState& scene, uint64_t generation) {
+    if (generation == syncedGeneration) {
+        return;
+    }
+    syncedGeneration = generation;
+
+    int32_t bgm = internAsset(scene.bgm);
+    if (bgm != shown.bgm) {
+        shown.bgm = bgm;
+        if (bgm >= 0) {
+            push(SceneEventType::BgmChange, 0, nodeIndex, bgm, 1);
+        } else {
+            push(SceneEventType::BgmStop, 0, nodeIndex, -1, 0);
+        }
+    }
+
+    int32_t background = internAsset(scene.background);
+    if (background != shown.background) {
+        shown.background = background;
+        push(SceneEventType::Background, 0, nodeIndex, background, 0);
+    }
+
+    for (int slot = 0; slot < SceneState::kCharacterSlots; slot++) {
+        int32_t character = internAsset(scene.characters[slot].character);
+        int32_t expression = character >= 0 ? internAsset(scene.characters[slot].expression) : -1;
+        int32_t& shownCharacter = shown.characters[slot];
+        int32_t& shownExpression = shown.expressions[slot];
+
+        if (character != shownCharacter) {
+            if (shownCharacter >= 0) {
+                push(SceneEventType::CharacterExit, slot, nodeIndex, shownCharacter, 0);
+            }
+            if (character >= 0) {
+                push(SceneEventType::CharacterEnter, slot, nodeIndex, character, expression);
+            }
+            shownCharacter = character;
+            shownExpression = expression;
+        } else if (character >= 0 && expression != shownExpression) {
+            shownExpression = expression;
+            push(SceneEventType::CharacterExpression, slot, nodeIndex, expression, character);
+        }
+    }
+}
+
+void SceneEventQueue::soundEffect(int nodeIndex, const DialogueNode& node) {
+    int32_t sound = internAsset(node.soundEffect);
+    if (sound >= 0) {
+        push(SceneEventType::SoundEffect, 0, nodeIndex, sound, 0);
+    }
+}
+
+void SceneEventQueue::choiceShown(int nodeIndex, int choiceCount) {
+    push(SceneEventType::ChoiceShown, 0, nodeIndex, -1, choiceCount);
+}
+
+} // namespace avg
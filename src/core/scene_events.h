@@ -0,0 +1,95 @@
+#ifndef SCENE_EVENTS_H
+#define SCENE_EVENTS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "scene_state.h"
+
+namespace avg {
+
+struct DialogueNode;
+
+enum class SceneEventType : uint16_t {
+    BgmChange = 1,            // asset = track
+    BgmStop = 2,
+    SoundEffect = 3,          // asset = sound
+    Background = 4,           // asset = image, -1 when cleared
+    CharacterEnter = 5,       // asset = character, detail = expression or -1
+    CharacterExit = 6,        // asset = character that left
+    CharacterExpression = 7,  // asset = expression, detail = character
+    ChoiceShown = 8           // detail = choice count
+};
+
+// One presentation change, four 32-bit words; type and character slot share
+// the first. File names are interned asset ids (see
+// SceneEventQueue::getAssetName), -1 for none.
+struct SceneEvent {
+    SceneEventType type;
+    uint16_t slot;
+    int32_t nodeIndex;
+    int32_t asset;
+    int32_t detail;
+};
+
+// Single-producer/single-consumer ring of scene events in linear memory.
+//
+// The engine is the producer; the host drains it once per frame by reading
+// events [tail, head) straight from the ring and then storing the new tail.
+// head and tail are free-running counters; a slot is (counter & (capacity
+// - 1)). When the ring is full new events are dropped and counted, and the
+// host should re-read the whole scene.
+class SceneEventQueue {
+public:
+    static const uint32_t kCapacity = 256;
+
+    // Layout shared with the host: 4 header words, then the events
+    struct Ring {
+        std::atomic<uint32_t> head;
+        std::atomic<uint32_t> tail;
+        uint32_t capacity;
+        uint32_t dropped;
+        SceneEvent events[kCapacity];
+    };
+
+    SceneEventQueue();
+
+    // Emit what changed between the scene the host was last told about and
+    // scene. Does nothing while generation matches the last sync.
+    void sync(int nodeIndex, const SceneState& scene, uint64_t generation);
+    void soundEffect(int nodeIndex, const DialogueNode& node);
+    void choiceShown(int nodeIndex, int choiceCount);
+
+    bool push(SceneEventType type, int slot, int nodeIndex, int32_t asset, int32_t detail);
+    // Consumer side for native hosts
+    bool pop(SceneEvent& event);
+    size_t pending() const;
+
+    const Ring* ring() const { return &buffer; }
+
+    // Asset ids are stable for the engine's lifetime
+    int32_t internAsset(const std::string& name);
+    const std::string& getAssetName(int32_t id) const;
+
+private:
+    // Scene as last emitted, in asset ids
+    struct Shown {
+        int32_t bgm;
+        int32_t background;
+        int32_t characters[SceneState::kCharacterSlots];
+        int32_t expressions[SceneState::kCharacterSlots];
+    };
+
+    Ring buffer;
+    Shown shown;
+    uint64_t syncedGeneration;
+    std::vector<std::string> assetNames;
+    std::unordered_map<std::string, int32_t> assetIds;
+};
+
+} // namespace avg
+
+#endif // SCENE_EVENTS_H
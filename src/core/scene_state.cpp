@@ -0,0 +1,65 @@
+#include "scene_state.h"
+#include "dialogue_node.h"
+
+namespace avg {
+
+uint32_t SceneState::apply(const DialogueNode& node) {
+    uint32_t changed = 0;
+
+    if (!node.background.empty() && node.background != background) {
+        background = node.background;
+        changed |= kBackground;
+    }
+
+    if (node.bgm == "none") {
+        if (!bgm.empty()) {
+            bgm.clear();
+            changed |= kBgm;
+        }
+    } else if (!node.bgm.empty() && node.bgm != bgm) {
+        bgm = node.bgm;
+        changed |= kBgm;
+    }
+
+    if (node.character.empty()) {
+        for (int slot = 0; slot < kCharacterSlots; slot++) {
+            if (!characters[slot].character.empty()) {
+                characters[slot] = CharacterSlot();
+                changed |= characterLayer(slot);
+            }
+        }
+        return changed;
+    }
+
+    int slot = node.characterSlot;
+    if (slot < 0 || slot >= kCharacterSlots) {
+        slot = 0;
+    }
+
+    CharacterSlot& target = characters[slot];
+    if (target.character != node.character || target.expression != node.characterExpression) {
+        target.character = node.character;
+        target.expression = node.characterExpression;
+        changed |= characterLayer(slot);
+    }
+    return changed;
+}
+
+uint32_t SceneState::diff(const SceneState& other) const {
+    uint32_t changed = 0;
+    if (background != other.background) {
+        changed |= kBackground;
+    }
+    if (bgm != other.bgm) {
+        changed |= kBgm;
+    }
+    for (int slot = 0; slot < kCharacterSlots; slot++) {
+        if (characters[slot].character != other.characters[slot].character ||
+            characters[slot].expression != other.characters[slot].expression) {
+            changed |= characterLayer(slot);
+        }
+    }
+    return changed;
+}
+
+} // namespace avg
@@ -0,0 +1,44 @@
+#ifndef SCENE_STATE_H
+#define SCENE_STATE_H
+
+#include <cstdint>
+#include <string>
+
+namespace avg {
+
+struct DialogueNode;
+
+// Effective scene: what is on screen after the nodes entered so far.
+//
+// Nodes carry deltas: a background or BGM left out keeps the current one
+// ("none" stops the BGM), a character goes into its slot, and a node
+// without a character clears the stage. Each layer has a dirty bit so a
+// renderer repaints only what changed.
+struct SceneState {
+    static const int kCharacterSlots = 4;
+
+    // Layer bits
+    static const uint32_t kBackground = 1u << 0;
+    static const uint32_t kBgm = 1u << 1;
+    static const uint32_t kAllLayers = (1u << (2 + kCharacterSlots)) - 1;
+    static uint32_t characterLayer(int slot) { return 1u << (2 + slot); }
+
+    struct CharacterSlot {
+        std::string character;
+        std::string expression;
+    };
+
+    std::string background;
+    std::string bgm;
+    CharacterSlot characters[kCharacterSlots];
+
+    // Fold in a node's scene fields; returns the layers that changed
+    uint32_t apply(const DialogueNode& node);
+
+    // Layers that differ from other
+    uint32_t diff(const SceneState& other) const;
+};
+
+} // namespace avg
+
+#endif // SCENE_STATE_H
@@ -0,0 +1,536 @@
+#include "script_code.h"
+#include <cstring>
+
+namespace avg {
+namespace script_code {
+
+namespace {
+
+enum Op : uint32_t {
+    kEnd,              // end of an effect list
+    kReturn,           // return r[a]
+    kConst,            // r[a] = next word
+    kLoad,             // r[a] = variable
+    kStore,            // variable = r[a]
+    kNot,              // r[a] = !r[b]
+    kNeg,              // r[a] = -r[b]
+    kBool,             // r[a] = r[b] != 0
+    kAdd,              // r[a] = r[b] op r[c], through kNotEqual
+    kSub,
+    kMul,
+    kDiv,
+    kMod,
+    kLess,
+    kLessEqual,
+    kGreater,
+    kGreaterEqual,
+    kEqual,
+    kNotEqual,
+    kJumpIfZero,       // if r[a] == 0, go to next word
+    kJumpIfNonZero,    // if r[a] != 0, go to next word
+    kAny,              // r[a] = any/all/count of the group operand
+    kAll,
+    kCount,
+    kFill,             // set the group operand's flags to r[a] != 0
+    kOpCount
+};
+
+const uint32_t kMaxNames = 0xFFFF;
+// Parentheses and unary operators nest at most this deep
+const int kMaxDepth = 64;
+
+struct BinaryOp {
+    const char* token;
+    int precedence;
+    Op op;    // kJumpIfZero / kJumpIfNonZero for && and ||
+};
+
+// Two-character tokens first so "<=" is not read as "<"
+const BinaryOp kBinaryOps[] = {
+    {"||", 1, kJumpIfNonZero}, {"&&", 2, kJumpIfZero},
+    {"==", 3, kEqual}, {"!=", 3, kNotEqual},
+    {"<=", 4, kLessEqual}, {">=", 4, kGreaterEqual}, {"<", 4, kLess}, {">", 4, kGreater},
+    {"+", 5, kAdd}, {"-", 5, kSub},
+    {"*", 6, kMul}, {"/", 6, kDiv}, {"%", 6, kMod},
+};
+
+bool isNameChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_' || c == '.';
+}
+
+bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool hasImmediate(uint32_t op) {
+    return op == kConst || op == kJumpIfZero || op == kJumpIfNonZero;
+}
+
+// Ops whose b and c bytes hold a name operand
+bool hasNameOperand(uint32_t op) {
+    return op == kLoad || op == kStore || (op >= kAny && op <= kFill);
+}
+
+struct GroupFunction {
+    const char* name;
+    Op op;
+};
+
+const GroupFunction kGroupTests[] = {{"any", kAny}, {"all", kAll}, {"count", kCount}};
+
+class Compiler {
+public:
+    Compiler(const std::string& source, ScriptCode& code)
+        : p(source.c_str()), end(source.c_str() + source.size()), code(code), depth(0), failed(false) {}
+
+    void condition() {
+        expression(0, 0);
+        emit(kReturn, 0);
+        skipSpace();
+        if (p != end) {
+            failed = true;
+        }
+    }
+
+    void effects() {
+        for (;;) {
+            skipSpace();
+            while (p != end && (*p == ';' || *p == ',')) {
+                p++;
+                skipSpace();
+            }
+            if (p == end || failed) {
+                break;
+            }
+            assignment();
+            skipSpace();
+            if (p != end && *p != ';' && *p != ',') {
+                failed = true;
+            }
+        }
+        emit(kEnd, 0);
+    }
+
+    bool ok() const { return !failed; }
+
+private:
+    const char* p;
+    const char* end;
+    ScriptCode& code;
+    int depth;
+    bool failed;
+
+    void skipSpace() {
+        while (p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            p++;
+        }
+    }
+
+    bool accept(const char* token) {
+        size_t length = std::strlen(token);
+        if (static_cast<size_t>(end - p) < length || std::memcmp(p, token, length) != 0) {
+            return false;
+        }
+        p += length;
+        return true;
+    }
+
+    bool name(std::string& out) {
+        const char* start = p;
+        while (p != end && isNameChar(*p)) {
+            p++;
+        }
+        out.assign(start, p);
+        return !out.empty() && !isDigit(out[0]);
+    }
+
+    // Operand index of a variable, adding its name on first use
+    uint32_t variable(const std::string& varName) {
+        uint32_t index = 0;
+        for (size_t at = 0; at < code.names.size(); index++) {
+            size_t length = std::strlen(code.names.c_str() + at);
+            if (code.names.compare(at, length, varName) == 0) {
+                return index;
+            }
+            at += length + 1;
+        }
+        if (index >= kMaxNames) {
+            failed = true;
+            return 0;
+        }
+        code.names += varName;
+        code.names.push_back('\0');
+        return index;
+    }
+
+    void emit(Op op, int a, int b = 0, int c = 0) {
+        code.words.push_back(op | static_cast<uint32_t>(a) << 8 | static_cast<uint32_t>(b) << 16 |
+                             static_cast<uint32_t>(c) << 24);
+    }
+
+    void emitVariable(Op op, int a, uint32_t var) {
+        code.words.push_back(op | static_cast<uint32_t>(a) << 8 | var << 16);
+    }
+
+    // "(group)" after a group function; the operand of the group
+    bool groupArgument(uint32_t& var) {
+        skipSpace();
+        std::string group;
+        if (!accept("(")) {
+            return false;
+        }
+        skipSpace();
+        if (!name(group)) {
+            return false;
+        }
+        skipSpace();
+        if (!accept(")")) {
+            return false;
+        }
+        var = variable("@" + group);
+        return true;
+    }
+
+    void assignment() {
+        std::string target;
+        if (!name(target) || target == "true" || target == "false") {
+            failed = true;
+            return;
+        }
+
+        skipSpace();
+        if ((target == "set" || target == "clear") && p != end && *p == '(') {
+            uint32_t var = 0;
+            if (!groupArgument(var)) {
+                failed = true;
+                return;
+            }
+            emit(kConst, 0);
+            code.words.push_back(target == "set" ? 1 : 0);
+            emitVariable(kFill, 0, var);
+            return;
+        }
+
+        Op op = kEnd;
+        if (accept("+=")) {
+            op = kAdd;
+        } else if (accept("-=")) {
+            op = kSub;
+        } else if (accept("*=")) {
+            op = kMul;
+        } else if (!accept("=") || (p != end && *p == '=')) {
+            failed = true;
+            return;
+        }
+
+        uint32_t var = variable(target);
+        if (op == kEnd) {
+            expression(0, 0);
+        } else {
+            emitVariable(kLoad, 0, var);
+            expression(1, 0);
+            emit(op, 0, 0, 1);
+        }
+        emitVariable(kStore, 0, var);
+    }
+
+    // Precedence climbing; the result goes to register reg and operands of
+    // binary operators use the registers above it
+    void expression(int reg, int minPrecedence) {
+        unary(reg);
+        while (!failed) {
+            skipSpace();
+            const BinaryOp* found = nullptr;
+            for (const auto& op : kBinaryOps) {
+                size_t length = std::strlen(op.token);
+                if (static_cast<size_t>(end - p) >= length && std::memcmp(p, op.token, length) == 0) {
+                    found = &op;
+                    break;
+                }
+            }
+            if (!found || found->precedence < minPrecedence) {
+                return;
+            }
+            p += std::strlen(found->token);
+
+            if (found->op == kJumpIfZero || found->op == kJumpIfNonZero) {
+                // Short circuit: the left value decides unless it is neutral
+                emit(kBool, reg, reg);
+                emit(found->op, reg);
+                size_t target = code.words.size();
+                code.words.push_back(0);
+                expression(reg, found->precedence + 1);
+                emit(kBool, reg, reg);
+                code.words[target] = static_cast<uint32_t>(code.words.size());
+                continue;
+            }
+
+            if (reg + 1 >= kRegisters) {
+                failed = true;
+                return;
+            }
+            expression(reg + 1, found->precedence + 1);
+            emit(found->op, reg, reg, reg + 1);
+        }
+    }
+
+    void unary(int reg) {
+        if (++depth > kMaxDepth) {
+            failed = true;
+            return;
+        }
+
+        skipSpace();
+        if (p == end) {
+            failed = true;
+        } else if (accept("!")) {
+            unary(reg);
+            emit(kNot, reg, reg);
+        } else if (accept("-")) {
+            unary(reg);
+            emit(kNeg, reg, reg);
+        } else if (accept("(")) {
+            expression(reg, 0);
+            skipSpace();
+            if (!accept(")")) {
+                failed = true;
+            }
+        } else if (isDigit(*p)) {
+            int64_t value = 0;
+            while (p != end && isDigit(*p) && value <= 0x7FFFFFFF) {
+                value = value * 10 + (*p++ - '0');
+            }
+            if (value > 0x7FFFFFFF || (p != end && isNameChar(*p))) {
+                failed = true;
+            }
+            emit(kConst, reg);
+            code.words.push_back(static_cast<uint32_t>(value));
+        } else {
+            std::string varName;
+            if (!name(varName)) {
+                failed = true;
+            } else if (varName == "true" || varName == "false") {
+                emit(kConst, reg);
+                code.words.push_back(varName == "true" ? 1 : 0);
+            } else {
+                const GroupFunction* function = nullptr;
+                for (const auto& test : kGroupTests) {
+                    if (varName == test.name) {
+                        function = &test;
+                    }
+                }
+                skipSpace();
+                uint32_t var = 0;
+                if (function && p != end && *p == '(') {
+                    if (!groupArgument(var)) {
+                        failed = true;
+                    }
+                    emitVariable(function->op, reg, var);
+                } else {
+                    emitVariable(kLoad, reg, variable(varName));
+                }
+            }
+        }
+        depth--;
+    }
+};
+
+bool isBlank(const std::string& source) {
+    for (char c : source) {
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <bool kEffects>
+bool compile(const std::string& source, ScriptCode& code, uint32_t& entry) {
+    entry = kNone;
+    if (isBlank(source)) {
+        return true;
+    }
+
+    size_t wordCount = code.words.size();
+    size_t nameBytes = code.names.size();
+    Compiler compiler(source, code);
+    if (kEffects) {
+        compiler.effects();
+    } else {
+        compiler.condition();
+    }
+    if (!compiler.ok()) {
+        code.words.resize(wordCount);
+        code.names.resize(nameBytes);
+        return false;
+    }
+
+    entry = static_cast<uint32_t>(wordCount);
+    return true;
+}
+
+int32_t wrap(int64_t value) {
+    return static_cast<int32_t>(static_cast<uint32_t>(value));
+}
+
+// One interpreter for both entry points; conditions skip stores
+template <bool kWrite>
+int32_t run(const ScriptCode& code, uint32_t entry, const int32_t* values, int32_t* out, uint8_t* assigned,
+            const FlagSet& flags, FlagSet* flagsOut) {
+    const uint32_t* words = code.words.data();
+    const size_t size = code.words.size();
+    const int32_t* slots = code.slots.data();
+    const uint32_t slotCount = static_cast<uint32_t>(code.slots.size());
+    int32_t r[kRegisters] = {};
+
+    for (size_t pc = entry; pc < size;) {
+        const uint32_t word = words[pc++];
+        const uint32_t a = (word >> 8) & (kRegisters - 1);
+        const int32_t lhs = r[(word >> 16) & (kRegisters - 1)];
+        const int32_t rhs = r[(word >> 24) & (kRegisters - 1)];
+        const uint32_t var = word >> 16;
+
+        switch (word & 0xFF) {
+            case kEnd: return 0;
+            case kReturn: return r[a];
+            case kConst:
+                if (pc >= size) {
+                    return 0;
+                }
+                r[a] = static_cast<int32_t>(words[pc++]);
+                break;
+            case kLoad:
+                if (var < slotCount) {
+                    int32_t slot = slots[var];
+                    r[a] = slot >= 0 ? values[slot] : flags.test(~slot);
+                } else {
+                    r[a] = 0;
+                }
+                break;
+            case kStore:
+                if (kWrite && var < slotCount) {
+                    int32_t slot = slots[var];
+                    if (slot >= 0) {
+                        out[slot] = r[a];
+                        assigned[slot] = 1;
+                    } else {
+                        flagsOut->set(~slot, r[a] != 0);
+                    }
+                }
+                break;
+            case kNot: r[a] = lhs == 0; break;
+            case kNeg: r[a] = wrap(-static_cast<int64_t>(lhs)); break;
+            case kBool: r[a] = lhs != 0; break;
+            case kAdd: r[a] = wrap(static_cast<int64_t>(lhs) + rhs); break;
+            case kSub: r[a] = wrap(static_cast<int64_t>(lhs) - rhs); break;
+            case kMul: r[a] = wrap(static_cast<int64_t>(lhs) * rhs); break;
+            case kDiv: r[a] = rhs == 0 ? 0 : wrap(static_cast<int64_t>(lhs) / rhs); break;
+            case kMod: r[a] = rhs == 0 ? 0 : wrap(static_cast<int64_t>(lhs) % rhs); break;
+            case kLess: r[a] = lhs < rhs; break;
+            case kLessEqual: r[a] = lhs <= rhs; break;
+            case kGreater: r[a] = lhs > rhs; break;
+            case kGreaterEqual: r[a] = lhs >= rhs; break;
+            case kEqual: r[a] = lhs == rhs; break;
+            case kNotEqual: r[a] = lhs != rhs; break;
+            case kJumpIfZero:
+            case kJumpIfNonZero:
+                if (pc >= size) {
+                    return 0;
+                }
+                // Forward only, so every run ends
+                if ((r[a] == 0) == ((word & 0xFF) == kJumpIfZero)) {
+                    pc = words[pc] > pc ? words[pc] : size;
+                } else {
+                    pc++;
+                }
+                break;
+            case kAny: r[a] = var < slotCount && flags.any(slots[var]); break;
+            case kAll: r[a] = var < slotCount && flags.all(slots[var]); break;
+            case kCount: r[a] = var < slotCount ? flags.count(slots[var]) : 0; break;
+            case kFill:
+                if (kWrite && var < slotCount) {
+                    flagsOut->setGroup(slots[var], r[a] != 0);
+                }
+                break;
+            default: return 0;
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+bool compileCondition(const std::string& source, ScriptCode& code, uint32_t& entry) {
+    return compile<false>(source, code, entry);
+}
+
+bool compileEffects(const std::string& source, ScriptCode& code, uint32_t& entry) {
+    return compile<true>(source, code, entry);
+}
+
+void getNames(const ScriptCode& code, std::vector<std::string>& names) {
+    names.clear();
+    for (size_t at = 0; at < code.names.size();) {
+        size_t length = std::strlen(code.names.c_str() + at);
+        names.emplace_back(code.names, at, length);
+        at += length + 1;
+    }
+}
+
+bool verify(const ScriptCode& code, uint32_t nameCount) {
+    const size_t size = code.words.size();
+    std::vector<char> starts(size + 1, 0);
+    starts[size] = 1;
+    for (size_t pc = 0; pc < size; pc++) {
+        starts[pc] = 1;
+        const uint32_t word = code.words[pc];
+        const uint32_t op = word & 0xFF;
+        const uint32_t a = (word >> 8) & 0xFF;
+        const uint32_t b = (word >> 16) & 0xFF;
+        const uint32_t c = word >> 24;
+        if (op >= kOpCount || a >= static_cast<uint32_t>(kRegisters)) {
+            return false;
+        }
+        if (hasNameOperand(op)) {
+            if ((word >> 16) >= nameCount) {
+                return false;
+            }
+        } else if (b >= static_cast<uint32_t>(kRegisters) || c >= static_cast<uint32_t>(kRegisters)) {
+            return false;
+        }
+        if (hasImmediate(op)) {
+            if (++pc >= size) {
+                return false;
+            }
+        }
+    }
+
+    for (size_t pc = 0; pc < size; pc += hasImmediate(code.words[pc] & 0xFF) ? 2 : 1) {
+        const uint32_t op = code.words[pc] & 0xFF;
+        if (op == kJumpIfZero || op == kJumpIfNonZero) {
+            uint32_t target = code.words[pc + 1];
+            if (target <= pc || target > size || !starts[target]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int32_t evaluate(const ScriptCode& code, uint32_t entry, const int32_t* values, const FlagSet& flags) {
+    if (entry == kNone) {
+        return 1;
+    }
+    return run<false>(code, entry, values, nullptr, nullptr, flags, nullptr);
+}
+
+void execute(const ScriptCode& code, uint32_t entry, int32_t* values, uint8_t* assigned, FlagSet& flags) {
+    if (entry == kNone) {
+        return;
+    }
+    run<true>(code, entry, values, values, assigned, flags, &flags);
+}
+
+} // namespace script_code
+} // namespace avg
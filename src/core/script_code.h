@@ -0,0 +1,72 @@
+#ifndef SCRIPT_CODE_H
+#define SCRIPT_CODE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "flag_set.h"
+
+namespace avg {
+
+// Conditions and effects written in the script, compiled once at load:
+//
+//   "if":  "trust >= 3 && !met_boss"     choice shown only when true
+//   "set": "trust += 1; met_boss = 1"    run when the node or choice is taken
+//
+// Expressions are 32-bit integer arithmetic over variables and literals
+// (true = 1, false = 0) with C precedence: ! - (unary), * / %, + -,
+// < <= > >=, == !=, && and || (short-circuit, yielding 0 or 1). Division
+// by zero yields 0. Effects are assignments (= += -= *=) separated by ;
+// or commas. Variable names use the same characters as [name] in text.
+//
+// A name declared as a story flag (see FlagSet) reads as 0 or 1 and
+// stores value != 0. Flag groups are used through functions:
+// any(group), all(group) and count(group) in expressions, and set(group)
+// and clear(group) as effects.
+//
+// A node keeps the code of its own "set" and of its choices in one
+// ScriptCode. Each instruction is one word, op | a << 8 | b << 16 | c << 24,
+// where a, b and c are registers or a 16-bit variable operand in b | c << 8;
+// constants and jump targets take the following word. Variable operands
+// index the node's names, which GameState binds to its variable slots (or
+// flags and groups) when the node is placed, so running code does no name
+// lookups.
+struct ScriptCode {
+    std::vector<uint32_t> words;
+    std::string names;            // NUL-terminated, operand order; groups start with '@'
+    // Bound per name: variable slot, ~flag index for a flag, group index
+    // (or -1) for a group
+    std::vector<int32_t> slots;
+
+    bool empty() const { return words.empty(); }
+};
+
+namespace script_code {
+
+// Entry point of an absent condition or effect list
+const uint32_t kNone = 0xFFFFFFFFu;
+const int kRegisters = 16;
+
+// Append the compiled source to code and set entry to its first word.
+// Empty source compiles to nothing (entry = kNone). On a syntax error, or
+// an expression too deeply nested for the registers, code is left as it
+// was and false is returned.
+bool compileCondition(const std::string& source, ScriptCode& code, uint32_t& entry);
+bool compileEffects(const std::string& source, ScriptCode& code, uint32_t& entry);
+
+// Names of code in operand order
+void getNames(const ScriptCode& code, std::vector<std::string>& names);
+
+// Opcodes, registers and operands are in bounds and jumps go forward to an
+// instruction, so any entry runs to an end (checked on compiled blob import)
+bool verify(const ScriptCode& code, uint32_t nameCount);
+
+// Value of the condition at entry (1 for kNone). values is indexed by slot.
+int32_t evaluate(const ScriptCode& code, uint32_t entry, const int32_t* values, const FlagSet& flags);
+// Run the effects at entry; stores set assigned[slot] to 1
+void execute(const ScriptCode& code, uint32_t entry, int32_t* values, uint8_t* assigned, FlagSet& flags);
+
+} // namespace script_code
+} // namespace avg
+
+#endif // SCRIPT_CODE_H
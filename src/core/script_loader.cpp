@@ -0,0 +1,855 @@
+#include "script_loader.h"
+#include "game_state.h"
+#include "../utils/hash.h"
+#include "../utils/simple_json.h"
+#include "../utils/trace.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace avg {
+
+namespace {
+
+// Work unit sizes between budget checks
+const size_t kScanChunkBytes = 64 * 1024;
+const size_t kParseChunkNodes = 32;
+// Chunks per pool thread in one budgeted parse batch
+const size_t kParseBatchChunks = 4;
+const size_t kCommitChunkNodes = 256;
+const size_t kLinkChunkNodes = 256;
+const size_t kIndexChunkKeys = 4096;
+
+// Progress weights of the three phases
+const float kScanWeight = 0.1f;
+const float kParseWeight = 0.8f;
+const float kIndexWeight = 0.02f;
+
+using Clock = std::chrono::steady_clock;
+
+// Run fn(begin, end, worker) over [0, count) in chunks of chunkSize on up
+// to threads threads, the calling thread being worker 0. Chunks are handed
+// out one at a time so uneven nodes still balance. False once fn fails or
+// stop is set.
+template <typename Fn>
+bool runChunks(size_t count, size_t chunkSize, int threads, const std::atomic<bool>& stop, Fn fn) {
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    auto work = [&](int worker) {
+        while (!failed.load(std::memory_order_relaxed) && !stop.load(std::memory_order_relaxed)) {
+            size_t begin = next.fetch_add(chunkSize, std::memory_order_relaxed);
+            if (begin >= count) {
+                return;
+            }
+            if (!fn(begin, std::min(begin + chunkSize, count), worker)) {
+                failed.store(true, std::memory_order_relaxed);
+                return;
+            }
+        }
+    };
+
+#if AVG_HAS_THREADS
+    size_t chunks = (count + chunkSize - 1) / chunkSize;
+    size_t helpers = std::min(static_cast<size_t>(threads), chunks);
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < helpers; i++) {
+        pool.emplace_back(work, static_cast<int>(i));
+    }
+    work(0);
+    for (auto& thread : pool) {
+        thread.join();
+    }
+#else
+    (void)threads;
+    work(0);
+#endif
+    return !failed.load() && !stop.load();
+}
+
+} // namespace
+
+ScriptLoader::ScriptLoader()
+    : input(nullptr), inputLength(0), status(Status::Idle), phase(static_cast<int>(Phase::Finished)),
+      cancelled(false), progressUnits(0), reloadStats(), threadCount(1) {
+    resetState();
+}
+
+ScriptLoader::~ScriptLoader() {
+    cancel();
+}
+
+void ScriptLoader::resetState() {
+    scanPos = 0;
+    depth = 0;
+    inString = false;
+    escaped = false;
+    afterColon = false;
+    inNodes = false;
+    flags = Range{0, 0};
+    stringStart = 0;
+    elementStart = 0;
+    lastKey.clear();
+    startNodeId.clear();
+    elements.clear();
+    sourceHashes.clear();
+    sourceSeed = 0;
+    parsed.clear();
+    hashes.clear();
+    parsedCount = 0;
+    committedCount = 0;
+    firstNodeId.clear();
+    externalRefs.clear();
+    reloadSeen.clear();
+    reuse.clear();
+    reusedLinks.clear();
+    reloadStats = ReloadStats();
+    progressUnits.store(0, std::memory_order_relaxed);
+}
+
+bool ScriptLoader::begin(const char* jsonData, bool copyInput, const Options& loadOptions) {
+    cancel();
+
+    if (!jsonData || loadOptions.nameSpace.find(':') != std::string::npos) {
+        status = Status::Failed;
+        return false;
+    }
+
+    resetState();
+    options = loadOptions;
+    sourceSeed = hash::hashString(options.link ? options.nameSpace : std::string());
+    threadCount = 1;
+#if AVG_HAS_THREADS
+    threadCount = options.threads > 0 ? options.threads : static_cast<int>(std::thread::hardware_concurrency());
+    threadCount = std::max(threadCount, 1);
+#endif
+    if (copyInput) {
+        ownedInput = jsonData;
+        input = ownedInput.c_str();
+        inputLength = ownedInput.length();
+    } else {
+        ownedInput.clear();
+        input = jsonData;
+        inputLength = std::char_traits<char>::length(jsonData);
+    }
+
+    // Scripts are always a JSON object at the top level
+    size_t first = 0;
+    while (first < inputLength && std::isspace(static_cast<unsigned char>(input[first]))) {
+        first++;
+    }
+    if (first >= inputLength || input[first] != '{') {
+        status = Status::Failed;
+        setPhase(Phase::Error);
+        return false;
+    }
+
+    scanPos = first;
+    cancelled.store(false);
+    status = Status::Running;
+    setPhase(Phase::Scan);
+    return true;
+}
+
+bool ScriptLoader::beginAsync(const char* jsonData, const Options& loadOptions) {
+#if AVG_HAS_THREADS
+    if (!begin(jsonData, true, loadOptions)) {
+        return false;
+    }
+
+    worker = std::thread([this]() {
+        AVG_TRACE_SCOPE("ScriptLoader::worker");
+
+        while (getPhase() == Phase::Scan && !cancelled.load(std::memory_order_relaxed)) {
+            if (!scanChunk(kScanChunkBytes)) {
+                setPhase(Phase::Error);
+                return;
+            }
+        }
+        while (getPhase() == Phase::Parse && !cancelled.load(std::memory_order_relaxed)) {
+            if (!(threadCount > 1 ? parseBatch(elements.size()) : parseElements(kParseChunkNodes))) {
+                setPhase(Phase::Error);
+                return;
+            }
+        }
+    });
+    return true;
+#else
+    (void)jsonData;
+    (void)loadOptions;
+    return false;
+#endif
+}
+
+void ScriptLoader::joinWorker() {
+#if AVG_HAS_THREADS
+    if (worker.joinable()) {
+        worker.join();
+    }
+#endif
+}
+
+void ScriptLoader::cancel() {
+    cancelled.store(true);
+    joinWorker();
+    if (status == Status::Running) {
+        status = Status::Idle;
+    }
+    setPhase(Phase::Finished);
+    ownedInput.clear();
+    ownedInput.shrink_to_fit();
+    input = nullptr;
+    inputLength = 0;
+    parsed.clear();
+    parsed.shrink_to_fit();
+    hashes.clear();
+    hashes.shrink_to_fit();
+    sourceHashes.clear();
+    sourceHashes.shrink_to_fit();
+    reuse.clear();
+    reuse.shrink_to_fit();
+}
+
+ScriptLoader::Status ScriptLoader::step(GameState& target, int64_t budgetMicros) {
+    AVG_TRACE_SCOPE("ScriptLoader::step");
+
+    if (status != Status::Running) {
+        return status;
+    }
+
+    const Clock::time_point start = Clock::now();
+    auto outOfTime = [&]() {
+        if (budgetMicros < 0) {
+            return false;
+        }
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count() >= budgetMicros;
+    };
+
+#if AVG_HAS_THREADS
+    bool threaded = worker.joinable();
+#else
+    bool threaded = false;
+#endif
+
+    while (true) {
+        Phase current = getPhase();
+
+        if (current == Phase::Error) {
+            joinWorker();
+            status = Status::Failed;
+            parsed.clear();
+            return status;
+        }
+
+        if (current == Phase::Scan || current == Phase::Parse) {
+            if (threaded) {
+                // The worker owns these phases; just report progress
+                return status;
+            }
+
+            bool ok;
+            if (current == Phase::Scan) {
+                ok = scanChunk(kScanChunkBytes);
+            } else {
+                if (options.reload && reuse.size() != elements.size()) {
+                    prepareReuse(target);
+                }
+                ok = threadCount > 1 ? parseBatch(budgetMicros < 0 ? elements.size() : parseBatchNodes())
+                                     : parseElements(kParseChunkNodes);
+            }
+            if (!ok) {
+                setPhase(Phase::Error);
+                continue;
+            }
+        } else if (current == Phase::Commit) {
+            joinWorker();
+            if (committedCount == 0 && ((options.link && !options.reload && hasConflicts(target)) ||
+                                        (options.module >= 0 && !fitsModule(target)))) {
+                setPhase(Phase::Error);
+                continue;
+            }
+            commitNodes(target, kCommitChunkNodes);
+            if (committedCount == parsed.size()) {
+                finishCommit(target);
+            }
+        } else if (current == Phase::Index) {
+            if (target.stepNodeLookup(kIndexChunkKeys)) {
+                finishLoad();
+                return status;
+            }
+        } else {
+            return status;
+        }
+
+        if (outOfTime()) {
+            return status;
+        }
+    }
+}
+
+float ScriptLoader::getProgress() const {
+    size_t units = progressUnits.load(std::memory_order_relaxed);
+
+    switch (getPhase()) {
+        case Phase::Scan:
+            return inputLength > 0 ? kScanWeight * static_cast<float>(units) / static_cast<float>(inputLength) : 0.0f;
+        case Phase::Parse:
+            return kScanWeight + (elements.empty() ? 0.0f :
+                kParseWeight * static_cast<float>(units) / static_cast<float>(elements.size()));
+        case Phase::Commit:
+            return kScanWeight + kParseWeight + (parsed.empty() ? 0.0f :
+                (1.0f - kScanWeight - kParseWeight - kIndexWeight) * static_cast<float>(committedCount) / static_cast<float>(parsed.size()));
+        case Phase::Index:
+            return 1.0f - kIndexWeight;
+        case Phase::Finished:
+            return status == Status::Done ? 1.0f : 0.0f;
+        default:
+            return 0.0f;
+    }
+}
+
+// Resumable structural scan. Tracks nesting depth and string state so it can
+// stop at any byte; only top-level keys and the "nodes" elements are recorded.
+bool ScriptLoader::scanChunk(size_t maxBytes) {
+    size_t end = scanPos + maxBytes < inputLength ? scanPos + maxBytes : inputLength;
+
+    for (; scanPos < end; scanPos++) {
+        if (inString) {
+            if (escaped) {
+                escaped = false;
+                continue;
+            }
+
+            // Jump to the next quote. It closes the string unless an odd run
+            // of backslashes precedes it; a run at the end of the chunk
+            // carries over as escaped.
+            const char* quote = static_cast<const char*>(std::memchr(input + scanPos, '"', end - scanPos));
+            size_t stop = quote ? static_cast<size_t>(quote - input) : end;
+            size_t run = 0;
+            while (stop - run > scanPos && input[stop - run - 1] == '\\') {
+                run++;
+            }
+            if (!quote) {
+                escaped = (run & 1) != 0;
+                scanPos = end - 1;
+                continue;
+            }
+            scanPos = stop;
+            if (run & 1) {
+                continue;
+            }
+
+            inString = false;
+            if (depth == 1) {
+                std::string value(input + stringStart, scanPos - stringStart);
+                if (!afterColon) {
+                    lastKey.swap(value);
+                } else if (lastKey == "startNode") {
+                    startNodeId.swap(value);
+                }
+            }
+            continue;
+        }
+
+        char c = input[scanPos];
+        switch (c) {
+            case '"':
+                inString = true;
+                stringStart = scanPos + 1;
+                break;
+            case ':':
+                if (depth == 1) {
+                    afterColon = true;
+                }
+                break;
+            case ',':
+                if (depth == 1) {
+                    afterColon = false;
+                }
+                break;
+            case '{':
+            case '[':
+                if (depth == 1 && c == '[' && afterColon && lastKey == "nodes") {
+                    inNodes = true;
+                } else if (depth == 1 && c == '[' && afterColon && lastKey == "flags") {
+                    flags.begin = scanPos;
+                } else if (depth == 2 && inNodes && c == '{') {
+                    elementStart = scanPos;
+                }
+                depth++;
+                break;
+            case '}':
+            case ']':
+                depth--;
+                if (depth < 0) {
+                    return false;
+                }
+                if (inNodes && depth == 2 && c == '}') {
+                    elements.push_back({elementStart, scanPos + 1});
+                    sourceHashes.push_back(hash::hash64(input + elementStart, scanPos + 1 - elementStart, sourceSeed));
+                } else if (inNodes && depth == 1 && c == ']') {
+                    inNodes = false;
+                } else if (depth == 1 && c == ']' && afterColon && lastKey == "flags") {
+                    flags.end = scanPos + 1;
+                }
+                if (depth == 0) {
+                    // End of the top-level object; anything after it is ignored
+                    scanPos = inputLength;
+                    // Nodes are constructed as they are parsed, so this
+                    // step stays short on large scripts
+                    parsed.reserve(elements.size());
+                    hashes.resize(elements.size());
+                    progressUnits.store(0, std::memory_order_relaxed);
+                    setPhase(Phase::Parse);
+                    return true;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (scanPos >= inputLength) {
+        // Ran out of input inside the top-level object
+        return false;
+    }
+
+    progressUnits.store(scanPos, std::memory_order_relaxed);
+    return true;
+}
+
+// Match the scanned elements against the source hashes of the resident
+// nodes. Runs on the calling thread before the first parse of a reload.
+void ScriptLoader::prepareReuse(const GameState& target) {
+    reuse.assign(elements.size(), -1);
+
+    std::unordered_map<uint64_t, int> bySource;
+    for (int i = 0; i < target.getNodeCount(); i++) {
+        uint64_t sourceHash = target.getNodeSourceHash(i);
+        if (sourceHash != 0) {
+            bySource.emplace(sourceHash, i);
+        }
+    }
+    if (bySource.empty()) {
+        return;
+    }
+
+    std::string prefix = options.nameSpace.empty() ? std::string() : options.nameSpace + ":";
+    for (size_t i = 0; i < elements.size(); i++) {
+        auto it = bySource.find(sourceHashes[i]);
+        const DialogueNode* node = it != bySource.end() ? target.getNodeByIndex(it->second) : nullptr;
+        if (!node) {
+            continue;
+        }
+
+        if (options.link) {
+            if (node->id.compare(0, prefix.size(), prefix) != 0) {
+                continue;
+            }
+            ReusedNode reusedNode;
+            reusedNode.element = i;
+            reusedNode.id = node->id.substr(prefix.size());
+            if (!node->nextNodeId.empty()) {
+                reusedNode.refs.push_back(node->nextNodeId);
+            }
+            for (const auto& choice : node->choices) {
+                if (!choice.nextNodeId.empty()) {
+                    reusedNode.refs.push_back(choice.nextNodeId);
+                }
+            }
+            reusedLinks.push_back(std::move(reusedNode));
+        }
+        reuse[i] = it->second;
+    }
+}
+
+bool ScriptLoader::parseElements(size_t maxCount) {
+    SimpleJSON json;
+    size_t end = parsedCount + maxCount < elements.size() ? parsedCount + maxCount : elements.size();
+    parsed.resize(end);
+
+    for (; parsedCount < end; parsedCount++) {
+        if (reused(parsedCount)) {
+            continue;
+        }
+        // SimpleJSON stops at the object's closing brace, so elements are
+        // parsed in place without copying them out of the input
+        if (!json.parse(input + elements[parsedCount].begin)) {
+            return false;
+        }
+        if (!parseNode(json, "", parsed[parsedCount])) {
+            return false;
+        }
+        // Linked nodes are hashed once their ids are qualified
+        if (!options.link) {
+            hashes[parsedCount] = GameState::hashNode(parsed[parsedCount]);
+        }
+    }
+
+    progressUnits.store(parsedCount, std::memory_order_relaxed);
+    if (parsedCount == elements.size()) {
+        return finishParse();
+    }
+    return true;
+}
+
+size_t ScriptLoader::parseBatchNodes() const {
+    return kParseChunkNodes * kParseBatchChunks * static_cast<size_t>(threadCount);
+}
+
+// Parse the next maxCount elements on the thread pool. Elements are
+// independent, so each worker fills its own slots of parsed and hashes.
+bool ScriptLoader::parseBatch(size_t maxCount) {
+    AVG_TRACE_SCOPE("ScriptLoader::parseBatch");
+
+    size_t first = parsedCount;
+    size_t count = std::min(maxCount, elements.size() - first);
+    parsed.resize(first + count);
+    bool hashNodes = !options.link;
+    bool ok = runChunks(count, kParseChunkNodes, threadCount, cancelled,
+        [this, hashNodes, first](size_t begin, size_t end, int) {
+            SimpleJSON json;
+            for (size_t i = first + begin; i < first + end; i++) {
+                if (reused(i)) {
+                    continue;
+                }
+                if (!json.parse(input + elements[i].begin) || !parseNode(json, "", parsed[i])) {
+                    return false;
+                }
+                if (hashNodes) {
+                    hashes[i] = GameState::hashNode(parsed[i]);
+                }
+            }
+            progressUnits.fetch_add(end - begin, std::memory_order_relaxed);
+            return true;
+        });
+    if (!ok) {
+        return false;
+    }
+
+    parsedCount = first + count;
+    if (parsedCount == elements.size()) {
+        return finishParse();
+    }
+    return true;
+}
+
+bool ScriptLoader::finishParse() {
+    if (options.link && !applyNamespace()) {
+        return false;
+    }
+    setPhase(Phase::Commit);
+    return true;
+}
+
+// Qualify the file's ids, resolve its references and hash the nodes. Runs
+// once all nodes of the file are parsed, since a reference may point
+// forward; the per-node work is split across the pool.
+bool ScriptLoader::applyNamespace() {
+    // The file may not define an id twice; hasConflicts only compares it
+    // with the nodes already in the graph
+    std::unordered_set<std::string> localIds;
+    localIds.reserve(parsed.size());
+    for (size_t i = 0; i < parsed.size(); i++) {
+        if (!reused(i) && !localIds.insert(parsed[i].id).second) {
+            return false;
+        }
+    }
+    for (const auto& node : reusedLinks) {
+        if (!localIds.insert(node.id).second) {
+            return false;
+        }
+    }
+
+    std::string prefix = options.nameSpace.empty() ? std::string() : options.nameSpace + ":";
+    // A reused node was resolved against the file's old ids. Parse it again
+    // if one of its references would now resolve the other way: a local one
+    // whose target left the file, or an outside one the file now defines.
+    if (!prefix.empty()) {
+        SimpleJSON json;
+        for (const auto& node : reusedLinks) {
+            bool moved = false;
+            for (const auto& ref : node.refs) {
+                if (ref.compare(0, prefix.size(), prefix) == 0) {
+                    moved = !localIds.count(ref.substr(prefix.size()));
+                } else {
+                    moved = ref.find(':') == std::string::npos && localIds.count(ref);
+                }
+                if (moved) {
+                    break;
+                }
+            }
+            if (!moved) {
+                continue;
+            }
+
+            reuse[node.element] = -1;
+            if (!json.parse(input + elements[node.element].begin) ||
+                !parseNode(json, "", parsed[node.element])) {
+                return false;
+            }
+        }
+    }
+    reusedLinks.clear();
+
+    // References leaving the file, one set per worker
+    std::vector<std::unordered_set<std::string>> external(static_cast<size_t>(threadCount));
+    bool ok = runChunks(parsed.size(), kLinkChunkNodes, threadCount, cancelled,
+        [&](size_t begin, size_t end, int worker) {
+            auto resolve = [&](std::string& ref) {
+                if (ref.empty()) {
+                    return;
+                }
+                if (ref.find(':') == std::string::npos && localIds.count(ref)) {
+                    ref.insert(0, prefix);
+                    return;
+                }
+                external[worker].insert(ref);
+            };
+
+            for (size_t i = begin; i < end; i++) {
+                if (reused(i)) {
+                    continue;
+                }
+                DialogueNode& node = parsed[i];
+                node.id.insert(0, prefix);
+                resolve(node.nextNodeId);
+                for (auto& choice : node.choices) {
+                    resolve(choice.nextNodeId);
+                }
+                hashes[i] = GameState::hashNode(node);
+            }
+            return true;
+        });
+    if (!ok) {
+        return false;
+    }
+
+    if (localIds.count(startNodeId)) {
+        startNodeId.insert(0, prefix);
+    }
+
+    for (size_t i = 1; i < external.size(); i++) {
+        external[0].insert(external[i].begin(), external[i].end());
+    }
+    // Ids qualified with the file's own namespace are local too
+    for (const auto& node : parsed) {
+        external[0].erase(node.id);
+    }
+    externalRefs.assign(external[0].begin(), external[0].end());
+    return true;
+}
+
+bool ScriptLoader::hasConflicts(const GameState& target) const {
+    for (const auto& node : parsed) {
+        if (target.getNodeIndex(node.id) >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// A module's nodes take the indices registered for it; any other id would
+// become a permanent node outside the module
+bool ScriptLoader::fitsModule(const GameState& target) const {
+    for (const auto& node : parsed) {
+        if (target.getModuleForIndex(target.getNodeIndex(node.id)) != options.module) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ScriptLoader::commitNodes(GameState& target, size_t maxCount) {
+    size_t end = committedCount + maxCount < parsed.size() ? committedCount + maxCount : parsed.size();
+
+    // Before any node, so their code binds flag names to flags
+    if (committedCount == 0) {
+        declareFlags(target);
+        target.reserveNodes(parsed.size());
+    }
+
+    for (; committedCount < end; committedCount++) {
+        DialogueNode& node = parsed[committedCount];
+        if (committedCount == 0) {
+            firstNodeId = node.id;
+        }
+
+        if (!options.reload) {
+            target.addNode(std::move(node), hashes[committedCount], sourceHashes[committedCount]);
+            continue;
+        }
+
+        size_t index;
+        if (reused(committedCount)) {
+            index = static_cast<size_t>(reuse[committedCount]);
+            reloadStats.unchanged++;
+        } else {
+            std::string id = node.id;
+            switch (target.reloadNode(std::move(node), hashes[committedCount], sourceHashes[committedCount])) {
+                case GameState::ReloadResult::Added: reloadStats.added++; break;
+                case GameState::ReloadResult::Changed: reloadStats.changed++; break;
+                default: reloadStats.unchanged++; break;
+            }
+            index = static_cast<size_t>(target.getNodeIndex(id));
+        }
+
+        if (index >= reloadSeen.size()) {
+            reloadSeen.resize(static_cast<size_t>(target.getNodeCount()), 0);
+        }
+        reloadSeen[index] = 1;
+    }
+}
+
+void ScriptLoader::finishCommit(GameState& target) {
+    if (options.reload) {
+        reloadStats.removed = target.retireMissingNodes(options.nameSpace, reloadSeen);
+        reloadSeen.clear();
+        reloadSeen.shrink_to_fit();
+    }
+
+    if (options.link) {
+        target.updateUnresolvedLinks(externalRefs);
+        externalRefs.clear();
+    }
+
+    // The first plain load decides the start node; later loads keep it and
+    // the current node
+    if (!options.link && !options.reload && target.getStartNodeId().empty()) {
+        if (!startNodeId.empty() && target.getNode(startNodeId)) {
+            target.setStartNodeId(startNodeId);
+        } else if (!firstNodeId.empty()) {
+            target.setStartNodeId(firstNodeId);
+        }
+    }
+    if (!options.link && target.getCurrentNodeId().empty()) {
+        target.setCurrentNode(target.getStartNodeId());
+    }
+
+    parsed.clear();
+    parsed.shrink_to_fit();
+    hashes.clear();
+    hashes.shrink_to_fit();
+    sourceHashes.clear();
+    sourceHashes.shrink_to_fit();
+    reuse.clear();
+    reuse.shrink_to_fit();
+    ownedInput.clear();
+    ownedInput.shrink_to_fit();
+    input = nullptr;
+    inputLength = 0;
+
+    // The id table is rebuilt in steps of its own
+    if (target.beginNodeLookup()) {
+        setPhase(Phase::Index);
+    } else {
+        finishLoad();
+    }
+}
+
+void ScriptLoader::finishLoad() {
+    status = Status::Done;
+    setPhase(Phase::Finished);
+}
+
+// "flags": [{"group": "endings", "names": ["ending_a", ...]}, ...], in
+// declaration order
+void ScriptLoader::declareFlags(GameState& target) {
+    if (flags.end <= flags.begin) {
+        return;
+    }
+
+    std::string wrapped = "{\"flags\":";
+    wrapped.append(input + flags.begin, flags.end - flags.begin);
+    wrapped += "}";
+    SimpleJSON json;
+    if (!json.parse(wrapped.c_str())) {
+        return;
+    }
+
+    std::vector<std::string> names;
+    for (int i = 0;; i++) {
+        std::string entryKey = "flags[" + std::to_string(i) + "]";
+        std::string namesKey = entryKey + ".names";
+        if (!json.hasKey(entryKey + ".group") && !json.hasKey(namesKey + "[0]")) {
+            break;
+        }
+        names.clear();
+        for (int j = 0;; j++) {
+            std::string nameKey = namesKey + "[" + std::to_string(j) + "]";
+            if (!json.hasKey(nameKey)) {
+                break;
+            }
+            names.push_back(json.getString(nameKey));
+        }
+        target.declareFlags(json.getString(entryKey + ".group"), names);
+    }
+}
+
+bool ScriptLoader::parseNode(const SimpleJSON& json, const std::string& prefix, DialogueNode& node) {
+    auto key = [&prefix](const char* name) {
+        return prefix.empty() ? std::string(name) : prefix + "." + name;
+    };
+
+    node.id = json.getString(key("id"));
+    std::string typeStr = json.getString(key("type"));
+
+    if (typeStr == "dialogue") {
+        node.type = NodeType::DIALOGUE;
+    } else if (typeStr == "choice") {
+        node.type = NodeType::CHOICE;
+    } else if (typeStr == "scene") {
+        node.type = NodeType::SCENE;
+    } else if (typeStr == "end") {
+        node.type = NodeType::END;
+    }
+
+    node.speaker = json.getString(key("speaker"));
+    text_markup::tokenize(json.getString(key("text")), node.text, node.textSpans, node.spanStrings);
+    node.nextNodeId = json.getString(key("next"));
+
+    // Conditions and effects compile into the node's code; a script with
+    // a malformed one does not load
+    node.script = ScriptCode();
+    if (!script_code::compileEffects(json.getString(key("set")), node.script, node.effects)) {
+        return false;
+    }
+
+    // Parse choices if present
+    std::string choicesKey = key("choices");
+    int choiceCount = json.getArraySize(choicesKey);
+    node.choices.clear();
+    node.choices.reserve(static_cast<size_t>(choiceCount));
+    for (int j = 0; j < choiceCount; j++) {
+        std::string choiceKey = choicesKey + "[" + std::to_string(j) + "]";
+        Choice choice;
+        text_markup::tokenize(json.getString(choiceKey + ".text"), choice.text, choice.textSpans,
+                              choice.spanStrings);
+        choice.nextNodeId = json.getString(choiceKey + ".next");
+        if (!script_code::compileCondition(json.getString(choiceKey + ".if"), node.script, choice.condition) ||
+            !script_code::compileEffects(json.getString(choiceKey + ".set"), node.script, choice.effects)) {
+            return false;
+        }
+        node.choices.push_back(std::move(choice));
+    }
+
+    // Scene data
+    node.background = json.getString(key("background"));
+    node.character = json.getString(key("character"));
+    node.characterExpression = json.getString(key("expression"));
+    node.characterSlot = json.getInt(key("slot"));
+    node.bgm = json.getString(key("bgm"));
+    node.soundEffect = json.getString(key("se"));
+    node.chapter = json.getString(key("chapter"));
+
+    // Timing
+    node.soundEffectDelayMs = std::max(0, json.getInt(key("seDelay")));
+    node.choiceTimeoutMs = std::max(0, json.getInt(key("timeout")));
+    node.timeoutChoice = json.getInt(key("timeoutChoice"));
+
+    return true;
+}
+
+} // namespace avg
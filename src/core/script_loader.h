@@ -0,0 +1,204 @@
+#ifndef SCRIPT_LOADER_H
+#define SCRIPT_LOADER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "dialogue_node.h"
+
+#if !defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+#define AVG_HAS_THREADS 1
+#include <thread>
+#else
+#define AVG_HAS_THREADS 0
+#endif
+
+namespace avg {
+
+class GameState;
+class SimpleJSON;
+
+// Incremental script loader.
+//
+// Loading is split into three resumable phases so the host can interleave
+// frames while a large script loads:
+//   Scan    - structural pass over the top-level object that records the byte
+//             range of every element of "nodes" (and "startNode", "flags")
+//   Parse   - each node element is parsed on its own into a DialogueNode
+//   Commit  - parsed nodes are linked into the GameState
+//   Index   - the GameState's id table is rebuilt (GameState::stepNodeLookup)
+// step() runs as much work as fits in the given time budget. When threads
+// are available, beginAsync() runs Scan and Parse on a worker thread and
+// step() only performs the Commit phase on the calling thread. With more
+// than one thread in Options, Parse (and the namespace/hash pass that ends
+// it) is split across a pool: a budgeted step parses one batch of a few
+// chunks per thread at a time and checks the budget between batches.
+class ScriptLoader {
+public:
+    enum class Status {
+        Idle,
+        Running,
+        Done,
+        Failed
+    };
+
+    ScriptLoader();
+    ~ScriptLoader();
+
+    ScriptLoader(const ScriptLoader&) = delete;
+    ScriptLoader& operator=(const ScriptLoader&) = delete;
+
+    struct Options {
+        // Link the file into the existing graph instead of loading it plainly:
+        // node ids become "<nameSpace>:<id>" (unchanged for an empty
+        // namespace), unqualified references resolve to the file's own nodes
+        // first and to the root namespace otherwise, and "other:id" names a
+        // node of another file. A link fails without changing anything if one
+        // of its ids already exists, and it never moves the current node.
+        bool link;
+        std::string nameSpace;
+        // Hot reload: nodes whose content hash changed are replaced in place,
+        // new ones are added and nodes of the same namespace that the file no
+        // longer contains are retired (unless current or in history).
+        // Elements whose bytes match the source of a resident node are not
+        // parsed at all (except on a beginAsync worker).
+        bool reload;
+        // Threads for Parse: 1 = the loading thread only, 0 = one per
+        // hardware thread. Builds without threads always use one.
+        int threads;
+        // Index of a registered module the file fills. Every node must have
+        // one of the module's reserved ids, or the load fails without
+        // changing anything. -1 for an ordinary script.
+        int module;
+
+        Options() : link(false), reload(false), threads(1), module(-1) {}
+    };
+
+    // Start loading. With copyInput false the caller keeps jsonData alive
+    // until the load finishes.
+    bool begin(const char* jsonData, bool copyInput = true, const Options& options = Options());
+
+    // Start loading with Scan/Parse on a worker thread. Returns false when
+    // threads are unavailable; the caller should fall back to begin().
+    bool beginAsync(const char* jsonData, const Options& options = Options());
+
+    // Advance the load by up to budgetMicros (negative = no limit).
+    Status step(GameState& target, int64_t budgetMicros);
+
+    void cancel();
+
+    Status getStatus() const { return status; }
+    // Overall progress in [0, 1]
+    float getProgress() const;
+    int getNodeCount() const { return static_cast<int>(elements.size()); }
+
+    // Outcome of the last reload
+    struct ReloadStats {
+        int added;
+        int changed;
+        int unchanged;
+        int removed;
+    };
+    const ReloadStats& getReloadStats() const { return reloadStats; }
+
+    // Parse a single node object (the element of "nodes") into node
+    static bool parseNode(const SimpleJSON& json, const std::string& prefix, DialogueNode& node);
+
+private:
+    enum class Phase : int {
+        Scan,
+        Parse,
+        Commit,
+        Index,
+        Finished,
+        Error
+    };
+
+    struct Range {
+        size_t begin;
+        size_t end;
+    };
+
+    std::string ownedInput;
+    const char* input;
+    size_t inputLength;
+    Status status;
+    std::atomic<int> phase;
+    std::atomic<bool> cancelled;
+    // Mirror of scanPos/parsedCount that is safe to read while a worker runs
+    std::atomic<size_t> progressUnits;
+
+    // Scan state
+    size_t scanPos;
+    int depth;
+    bool inString;
+    bool escaped;
+    bool afterColon;
+    bool inNodes;
+    Range flags;    // value of the top-level "flags", if any
+    size_t stringStart;
+    size_t elementStart;
+    std::string lastKey;
+    std::string startNodeId;
+    std::vector<Range> elements;
+    // Hash of each element's bytes, seeded with the namespace
+    std::vector<uint64_t> sourceHashes;
+    uint64_t sourceSeed;
+
+    Options options;
+    // References leaving the linked file, checked against the graph on commit
+    std::vector<std::string> externalRefs;
+    // Reload: node indices the file still contains
+    std::vector<char> reloadSeen;
+    // Reload: per element, the index of the resident node with the same
+    // source (kept as is, never parsed) or -1
+    std::vector<int> reuse;
+    // Linked reload: ids (without the namespace) and references of the
+    // reused nodes, to check that they still resolve the same way
+    struct ReusedNode {
+        size_t element;
+        std::string id;
+        std::vector<std::string> refs;
+    };
+    std::vector<ReusedNode> reusedLinks;
+    ReloadStats reloadStats;
+
+    // Parse/commit state
+    int threadCount;
+    std::vector<DialogueNode> parsed;
+    // Content hashes of the parsed nodes, computed while parsing
+    std::vector<uint64_t> hashes;
+    size_t parsedCount;
+    size_t committedCount;
+    std::string firstNodeId;
+
+#if AVG_HAS_THREADS
+    std::thread worker;
+#endif
+
+    void resetState();
+    bool scanChunk(size_t maxBytes);
+    void prepareReuse(const GameState& target);
+    bool reused(size_t element) const { return !reuse.empty() && reuse[element] >= 0; }
+    bool parseElements(size_t maxCount);
+    bool parseBatch(size_t maxCount);
+    size_t parseBatchNodes() const;
+    bool finishParse();
+    void commitNodes(GameState& target, size_t maxCount);
+    void finishCommit(GameState& target);
+    void finishLoad();
+    bool applyNamespace();
+    void declareFlags(GameState& target);
+    bool hasConflicts(const GameState& target) const;
+    bool fitsModule(const GameState& target) const;
+    void joinWorker();
+
+    Phase getPhase() const { return static_cast<Phase>(phase.load(std::memory_order_acquire)); }
+    void setPhase(Phase value) { phase.store(static_cast<int>(value), std::memory_order_release); }
+};
+
+} // namespace avg
+
+#endif // SCRIPT_LOADER_H
@@ -0,0 +1,546 @@
+#include "search_index.h"
+#include "game_state.h"
+#include "../utils/trace.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace avg {
+
+namespace {
+
+// Positions skipped between a node's fields
+const uint32_t kFieldGap = 1;
+// Longer words are indexed by their first kMaxTermBytes bytes
+const size_t kMaxTermBytes = 64;
+
+// ASCII base letter for U+00C0..U+017F, or 0 when the letter has none
+// (Æ, Ð, Þ, ß, Ĳ, Ŋ, Œ and friends fold to their lowercase form instead).
+// × and ÷ are separators and handled before the table.
+const char kLatinBase[] =
+    "aaaaaa\0ceeeeiiii"     // C0
+    "\0nooooo\0ouuuuy\0\0"   // D0
+    "aaaaaa\0ceeeeiiii"     // E0
+    "\0nooooo\0ouuuuy\0y"    // F0
+    "aaaaaaccccccccdd"      // 0100
+    "ddeeeeeeeeeegggg"      // 0110
+    "gggghhhhiiiiiiii"      // 0120
+    "ii\0\0jjkk\0lllllll"    // 0130
+    "lllnnnnnnn\0\0oooo"     // 0140
+    "oo\0\0rrrrrrssssss"     // 0150
+    "ssttttttuuuuuuuu"      // 0160
+    "uuuuwwyyyzzzzzzs";     // 0170
+
+uint32_t decodeUtf8(const char*& p, const char* end) {
+    unsigned char c = static_cast<unsigned char>(*p++);
+    if (c < 0x80) {
+        return c;
+    }
+
+    int extra = c >= 0xF0 ? 3 : (c >= 0xE0 ? 2 : (c >= 0xC0 ? 1 : 0));
+    uint32_t cp = c & (0x3F >> extra);
+    for (int i = 0; i < extra; i++) {
+        if (p >= end || (static_cast<unsigned char>(*p) & 0xC0) != 0x80) {
+            return 0xFFFD;
+        }
+        cp = (cp << 6) | (static_cast<unsigned char>(*p++) & 0x3F);
+    }
+    return extra ? cp : 0xFFFD;
+}
+
+void appendUtf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+// Case, width, diacritic and kana folding of one codepoint
+uint32_t fold(uint32_t cp) {
+    if (cp >= 0xFF01 && cp <= 0xFF5E) {
+        cp -= 0xFEE0;
+    }
+    if (cp < 0x80) {
+        return cp >= 'A' && cp <= 'Z' ? cp + 32 : cp;
+    }
+    if (cp >= 0xC0 && cp <= 0x17F && cp != 0xD7 && cp != 0xF7) {
+        char base = kLatinBase[cp - 0xC0];
+        if (base) {
+            return static_cast<unsigned char>(base);
+        }
+        if (cp <= 0xDE) {
+            return cp + 0x20;
+        }
+        // Upper case is the even codepoint of each pair; ĸ has no case
+        return cp >= 0x100 && cp != 0x138 && !(cp & 1) ? cp + 1 : cp;
+    }
+    if (cp >= 0x391 && cp <= 0x3A9 && cp != 0x3A2) {
+        return cp + 0x20;
+    }
+    if (cp >= 0x410 && cp <= 0x42F) {
+        return cp + 0x20;
+    }
+    if (cp >= 0x400 && cp <= 0x40F) {
+        return cp + 0x50;
+    }
+    if (cp >= 0x30A1 && cp <= 0x30F6) {
+        return cp - 0x60;
+    }
+    return cp;
+}
+
+enum class CharClass {
+    Separator,
+    Word,
+    Single,    // CJK: a token by itself
+    Ignored    // combining marks: dropped without ending the word
+};
+
+CharClass classify(uint32_t cp) {
+    if (cp < 0x80) {
+        bool alnum = (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z') || (cp >= '0' && cp <= '9');
+        return alnum ? CharClass::Word : CharClass::Separator;
+    }
+    if (cp >= 0x300 && cp <= 0x36F) {
+        return CharClass::Ignored;
+    }
+    if (cp < 0xC0 || cp == 0xD7 || cp == 0xF7 || (cp >= 0x2000 && cp <= 0x2BFF) ||
+        (cp >= 0x3000 && cp <= 0x303F) || (cp >= 0xFE30 && cp <= 0xFE4F) ||
+        (cp >= 0xFF61 && cp <= 0xFF65) || cp == 0xFFFD) {
+        return CharClass::Separator;
+    }
+    if ((cp >= 0x3040 && cp <= 0x30FF) || (cp >= 0x3400 && cp <= 0x4DBF) ||
+        (cp >= 0x4E00 && cp <= 0x9FFF) || (cp >= 0xF900 && cp <= 0xFAFF) || cp >= 0x20000) {
+        return CharClass::Single;
+    }
+    return CharClass::Word;
+}
+
+void putVarint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t getVarint(const uint8_t*& p) {
+    uint32_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t byte = *p++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+}
+
+// Entries of a whose entry + distance is in b (both sorted)
+void followedBy(std::vector<uint64_t>& a, const std::vector<uint64_t>& b, uint64_t distance) {
+    size_t kept = 0;
+    size_t j = 0;
+    for (uint64_t entry : a) {
+        uint64_t target = entry + distance;
+        while (j < b.size() && b[j] < target) {
+            j++;
+        }
+        if (j < b.size() && b[j] == target) {
+            a[kept++] = entry;
+        }
+    }
+    a.resize(kept);
+}
+
+} // namespace
+
+SearchIndex::SearchIndex() {
+}
+
+void SearchIndex::tokenize(const std::string& text, std::vector<std::string>& out) {
+    std::string term;
+    auto flush = [&]() {
+        if (!term.empty()) {
+            if (term.size() > kMaxTermBytes) {
+                size_t length = kMaxTermBytes;
+                while (length > 0 && (static_cast<unsigned char>(term[length]) & 0xC0) == 0x80) {
+                    length--;
+                }
+                term.resize(length);
+            }
+            out.push_back(term);
+            term.clear();
+        }
+    };
+
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        uint32_t cp = fold(decodeUtf8(p, end));
+        switch (classify(cp)) {
+            case CharClass::Word:
+                appendUtf8(term, cp);
+                break;
+            case CharClass::Single:
+                flush();
+                appendUtf8(term, cp);
+                flush();
+                break;
+            case CharClass::Separator:
+                flush();
+                break;
+            case CharClass::Ignored:
+                break;
+        }
+    }
+    flush();
+}
+
+void SearchIndex::build(const GameState& state) {
+    AVG_TRACE_SCOPE("SearchIndex::build");
+
+    clear();
+
+    // Occurrences in node then position order; term ids in first-seen order
+    struct Occurrence {
+        uint32_t term;
+        int32_t node;
+        uint32_t position;
+    };
+    std::vector<Occurrence> occurrences;
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<const std::string*> names;
+    std::vector<std::string> tokens;
+
+    for (int index = 0; index < state.getNodeCount(); index++) {
+        const DialogueNode* node = state.getNodeByIndex(index);
+        if (!node) {
+            continue;
+        }
+
+        uint32_t position = 0;
+        auto addField = [&](const std::string& field) {
+            tokens.clear();
+            tokenize(field, tokens);
+            for (const auto& token : tokens) {
+                auto it = ids.find(token);
+                if (it == ids.end()) {
+                    it = ids.emplace(token, static_cast<uint32_t>(names.size())).first;
+                    names.push_back(&it->first);
+                }
+                occurrences.push_back({it->second, index, position++});
+            }
+            position += kFieldGap;
+        };
+
+        addField(node->speaker);
+        addField(state.getNodeText(index));
+        for (const auto& choice : node->choices) {
+            addField(choice.text);
+        }
+    }
+
+    // Terms in byte order, then a counting sort of occurrences by rank that
+    // keeps node and position order within a term
+    std::vector<uint32_t> order(names.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return *names[a] < *names[b]; });
+    std::vector<uint32_t> rank(names.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        rank[order[i]] = i;
+    }
+
+    std::vector<uint32_t> start(names.size() + 1, 0);
+    for (const auto& occurrence : occurrences) {
+        start[rank[occurrence.term] + 1]++;
+    }
+    for (size_t i = 1; i < start.size(); i++) {
+        start[i] += start[i - 1];
+    }
+    std::vector<Occurrence> sorted(occurrences.size());
+    {
+        std::vector<uint32_t> next(start.begin(), start.end() - 1);
+        for (const auto& occurrence : occurrences) {
+            sorted[next[rank[occurrence.term]]++] = occurrence;
+        }
+    }
+    std::vector<Occurrence>().swap(occurrences);
+
+    termOffsets.reserve(order.size() + 1);
+    postingOffsets.reserve(order.size() + 1);
+    for (uint32_t r = 0; r < order.size(); r++) {
+        termOffsets.push_back(static_cast<uint32_t>(terms.size()));
+        postingOffsets.push_back(static_cast<uint32_t>(postings.size()));
+        terms += *names[order[r]];
+
+        uint32_t begin = start[r];
+        uint32_t end = start[r + 1];
+        uint32_t documents = 0;
+        for (uint32_t i = begin; i < end; i++) {
+            if (i == begin || sorted[i].node != sorted[i - 1].node) {
+                documents++;
+            }
+        }
+
+        putVarint(postings, documents);
+        int32_t lastNode = 0;
+        for (uint32_t i = begin; i < end;) {
+            uint32_t j = i;
+            while (j < end && sorted[j].node == sorted[i].node) {
+                j++;
+            }
+            putVarint(postings, static_cast<uint32_t>(sorted[i].node - lastNode));
+            putVarint(postings, j - i);
+            uint32_t lastPosition = 0;
+            for (uint32_t k = i; k < j; k++) {
+                putVarint(postings, sorted[k].position - lastPosition);
+                lastPosition = sorted[k].position;
+            }
+            lastNode = sorted[i].node;
+            i = j;
+        }
+    }
+    termOffsets.push_back(static_cast<uint32_t>(terms.size()));
+    postingOffsets.push_back(static_cast<uint32_t>(postings.size()));
+
+    terms.shrink_to_fit();
+    postings.shrink_to_fit();
+}
+
+size_t SearchIndex::getMemoryBytes() const {
+    return terms.capacity() + (termOffsets.capacity() + postingOffsets.capacity()) * sizeof(uint32_t) +
+           postings.capacity();
+}
+
+void SearchIndex::search(const std::string& query, size_t maxResults, std::vector<SearchHit>& hits) const {
+    AVG_TRACE_SCOPE("SearchIndex::search");
+
+    hits.clear();
+    if (empty()) {
+        return;
+    }
+
+    // Split into groups: quoted phrases and whitespace-separated words
+    struct Group {
+        std::string text;
+        bool prefix;
+    };
+    std::vector<Group> groups;
+    size_t i = 0;
+    while (i < query.size()) {
+        char c = query[i];
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            i++;
+            continue;
+        }
+        size_t end;
+        if (c == '"') {
+            i++;
+            end = query.find('"', i);
+            if (end == std::string::npos) {
+                end = query.size();
+            }
+        } else {
+            end = query.find_first_of(" \t\n\r\"", i);
+            if (end == std::string::npos) {
+                end = query.size();
+            }
+        }
+        Group group;
+        group.text = query.substr(i, end - i);
+        group.prefix = !group.text.empty() && group.text.back() == '*';
+        groups.push_back(group);
+        i = end < query.size() && query[end] == '"' ? end + 1 : end;
+    }
+
+    // (node, first position) per group, intersected across groups
+    std::vector<std::pair<int32_t, uint32_t>> matches;
+    bool first = true;
+    std::vector<std::string> tokens;
+    std::vector<uint64_t> phrase;
+    std::vector<uint64_t> next;
+
+    for (const auto& group : groups) {
+        tokens.clear();
+        tokenize(group.text, tokens);
+        if (tokens.empty()) {
+            continue;
+        }
+
+        lookup(tokens[0], group.prefix && tokens.size() == 1, phrase);
+        for (size_t t = 1; t < tokens.size() && !phrase.empty(); t++) {
+            lookup(tokens[t], group.prefix && t + 1 == tokens.size(), next);
+            followedBy(phrase, next, t);
+        }
+
+        // Entries are sorted, so the first of each node is its earliest match
+        std::vector<std::pair<int32_t, uint32_t>> groupMatches;
+        for (size_t k = 0; k < phrase.size(); k++) {
+            int32_t node = static_cast<int32_t>(phrase[k] >> 32);
+            if (k == 0 || node != groupMatches.back().first) {
+                groupMatches.push_back({node, static_cast<uint32_t>(phrase[k])});
+            }
+        }
+
+        if (first) {
+            matches.swap(groupMatches);
+            first = false;
+        } else {
+            size_t kept = 0;
+            size_t j = 0;
+            for (const auto& match : matches) {
+                while (j < groupMatches.size() && groupMatches[j].first < match.first) {
+                    j++;
+                }
+                if (j < groupMatches.size() && groupMatches[j].first == match.first) {
+                    matches[kept++] = {match.first, std::max(match.second, groupMatches[j].second)};
+                }
+            }
+            matches.resize(kept);
+        }
+        if (matches.empty()) {
+            return;
+        }
+    }
+
+    hits.reserve(matches.size());
+    for (const auto& match : matches) {
+        hits.push_back({match.first, match.second});
+    }
+    auto earlier = [](const SearchHit& a, const SearchHit& b) {
+        return a.position < b.position || (a.position == b.position && a.nodeIndex < b.nodeIndex);
+    };
+    if (maxResults > 0 && maxResults < hits.size()) {
+        std::partial_sort(hits.begin(), hits.begin() + maxResults, hits.end(), earlier);
+        hits.resize(maxResults);
+    } else {
+        std::sort(hits.begin(), hits.end(), earlier);
+    }
+}
+
+void SearchIndex::clear() {
+    std::string().swap(terms);
+    std::vector<uint32_t>().swap(termOffsets);
+    std::vector<uint32_t>().swap(postingOffsets);
+    std::vector<uint8_t>().swap(postings);
+}
+
+bool SearchIndex::valid(int nodeCount) const {
+    // Bounds-checked varint; false past end or beyond 32 bits
+    auto read = [](const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (p >= end) {
+                return false;
+            }
+            uint8_t byte = *p++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return value <= 0xffffffffu;
+            }
+        }
+        return false;
+    };
+
+    for (size_t term = 0; term < getTermCount(); term++) {
+        if (termOffsets[term] > termOffsets[term + 1] || postingOffsets[term] > postingOffsets[term + 1]) {
+            return false;
+        }
+        const uint8_t* p = postings.data() + postingOffsets[term];
+        const uint8_t* end = postings.data() + postingOffsets[term + 1];
+        uint64_t documents = 0;
+        uint64_t node = 0;
+        if (!read(p, end, documents)) {
+            return false;
+        }
+        for (uint64_t d = 0; d < documents; d++) {
+            uint64_t delta = 0;
+            uint64_t count = 0;
+            if (!read(p, end, delta) || !read(p, end, count)) {
+                return false;
+            }
+            node += delta;
+            if (node >= static_cast<uint64_t>(nodeCount)) {
+                return false;
+            }
+            uint64_t position = 0;
+            for (uint64_t k = 0; k < count; k++) {
+                uint64_t step = 0;
+                if (!read(p, end, step)) {
+                    return false;
+                }
+                position += step;
+            }
+            if (position > 0xffffffffu) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void SearchIndex::decodeTerm(size_t term, std::vector<uint64_t>& out) const {
+    const uint8_t* p = postings.data() + postingOffsets[term];
+    uint32_t documents = getVarint(p);
+    uint64_t node = 0;
+    for (uint32_t d = 0; d < documents; d++) {
+        node += getVarint(p);
+        uint32_t count = getVarint(p);
+        uint32_t position = 0;
+        for (uint32_t k = 0; k < count; k++) {
+            position += getVarint(p);
+            out.push_back(node << 32 | position);
+        }
+    }
+}
+
+void SearchIndex::lookup(const std::string& term, bool prefix, std::vector<uint64_t>& out) const {
+    out.clear();
+    size_t count = getTermCount();
+
+    // First term not less than term
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (terms.compare(termOffsets[mid], termOffsets[mid + 1] - termOffsets[mid], term) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    size_t decoded = 0;
+    for (size_t k = low; k < count; k++) {
+        size_t length = termOffsets[k + 1] - termOffsets[k];
+        bool matches = prefix ? length >= term.size() && terms.compare(termOffsets[k], term.size(), term) == 0
+                              : length == term.size() && terms.compare(termOffsets[k], length, term) == 0;
+        if (!matches) {
+            break;
+        }
+        decodeTerm(k, out);
+        decoded++;
+        if (!prefix) {
+            break;
+        }
+    }
+
+    // Postings of several terms interleave
+    if (decoded > 1) {
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+}
+
+} // namespace avg
@@ -0,0 +1,71 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace avg {
+
+class GameState;
+
+struct SearchHit {
+    int32_t nodeIndex;
+    uint32_t position;    // token position where the query is first satisfied
+};
+
+// Full-text index over the speaker, text and choice texts of resident nodes.
+//
+// Text is folded before tokenising: case, Latin diacritics (precomposed or
+// combining), full-width ASCII and katakana to hiragana. Words are runs of
+// letters and digits; CJK characters are one token each, so a word typed in
+// Japanese or Chinese is matched as a phrase of characters.
+//
+// Terms are kept sorted in one buffer, which makes prefix queries a range
+// scan. Each term's postings are varints: document count, then per node the
+// index delta, position count and position deltas. A node's positions run
+// through its speaker, text and choices in that order, with a gap between
+// fields so phrases never span two of them.
+//
+// Query syntax: words are ANDed, "quoted words" form a phrase, a trailing *
+// makes the last word a prefix (fore* or "the fore*"). Text without spaces
+// is a phrase of its tokens. Hits are ranked by the position at which every
+// part of the query has matched, earliest first, then by node index.
+class SearchIndex {
+public:
+    SearchIndex();
+
+    void build(const GameState& state);
+    bool empty() const { return termOffsets.size() <= 1; }
+    size_t getTermCount() const { return termOffsets.empty() ? 0 : termOffsets.size() - 1; }
+    size_t getMemoryBytes() const;
+
+    // Up to maxResults hits (0 = all)
+    void search(const std::string& query, size_t maxResults, std::vector<SearchHit>& hits) const;
+
+    void clear();
+
+    // Folded terms of text, in order (exposed for tools and queries)
+    static void tokenize(const std::string& text, std::vector<std::string>& terms);
+
+private:
+    // Compiled script blobs read and write the index directly
+    friend class CompiledScript;
+
+    std::string terms;
+    std::vector<uint32_t> termOffsets;      // term i is [termOffsets[i], termOffsets[i + 1])
+    std::vector<uint32_t> postingOffsets;   // same for postings
+    std::vector<uint8_t> postings;
+
+    // Every posting list decodes within bounds to node indices below
+    // nodeCount (checked on compiled blob import)
+    bool valid(int nodeCount) const;
+    // (node index << 32 | position), sorted
+    void decodeTerm(size_t term, std::vector<uint64_t>& out) const;
+    void lookup(const std::string& term, bool prefix, std::vector<uint64_t>& out) const;
+};
+
+} // namespace avg
+
+#endif // SEARCH_INDEX_H
@@ -0,0 +1,198 @@
+#include "session_recorder.h"
+#include "game_state.h"
+#include <cstring>
+
+namespace avg {
+
+static const uint32_t kLogVersion = 1;
+
+SessionRecorder::SessionRecorder() : recording(false), depth(0), nowMicros(0), lastMicros(0) {
+}
+
+void SessionRecorder::start(uint64_t scriptHash, const std::string& state) {
+    log.clear();
+    log.push_back('A');
+    log.push_back('V');
+    log.push_back('G');
+    log.push_back('R');
+    writeVarint(kLogVersion);
+
+    recording = true;
+    lastMicros = nowMicros;
+    if (scriptHash != 0) {
+        recordScript(scriptHash);
+    }
+    if (!state.empty()) {
+        recordLoad(state.c_str());
+    }
+}
+
+void SessionRecorder::recordScript(uint64_t scriptHash) {
+    beginEvent(SessionOp::Script);
+    for (int i = 0; i < 8; i++) {
+        log.push_back(static_cast<uint8_t>(scriptHash >> (i * 8)));
+    }
+}
+
+void SessionRecorder::recordGoto(const GameState& state, const char* nodeId) {
+    beginEvent(SessionOp::Goto);
+
+    // Resident nodes go by index; anything else (unknown ids, nodes of an
+    // unloaded module) by id
+    int index = state.getNodeIndex(nodeId);
+    const DialogueNode* node = state.getNodeByIndex(index);
+    if (node && node->id == nodeId) {
+        writeVarint(static_cast<uint64_t>(index) + 1);
+        return;
+    }
+    writeVarint(0);
+    writeString(nodeId, std::strlen(nodeId));
+}
+
+void SessionRecorder::recordChoice(int choiceIndex) {
+    beginEvent(SessionOp::Choice);
+    writeVarint(static_cast<uint32_t>(choiceIndex));
+}
+
+void SessionRecorder::recordSetVariable(const char* name, int value) {
+    beginEvent(SessionOp::SetVariable);
+    writeString(name, std::strlen(name));
+    int64_t wide = value;
+    writeVarint((static_cast<uint64_t>(wide) << 1) ^ static_cast<uint64_t>(wide >> 63));
+}
+
+void SessionRecorder::recordLoad(const char* saveData) {
+    beginEvent(SessionOp::Load);
+    writeString(saveData, std::strlen(saveData));
+}
+
+void SessionRecorder::recordSlot(SessionOp op, int slot) {
+    beginEvent(op);
+    writeVarint(static_cast<uint32_t>(slot));
+}
+
+void SessionRecorder::recordEvent(SessionOp op) {
+    beginEvent(op);
+}
+
+void SessionRecorder::beginEvent(SessionOp op) {
+    // Host clocks may step back (a reset page clock); never go negative
+    uint64_t delta = nowMicros > lastMicros ? nowMicros - lastMicros : 0;
+    lastMicros = nowMicros > lastMicros ? nowMicros : lastMicros;
+    log.push_back(static_cast<uint8_t>(op));
+    writeVarint(delta);
+}
+
+void SessionRecorder::writeVarint(uint64_t value) {
+    while (value >= 0x80) {
+        log.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    log.push_back(static_cast<uint8_t>(value));
+}
+
+void SessionRecorder::writeString(const char* value, size_t length) {
+    writeVarint(length);
+    log.insert(log.end(), value, value + length);
+}
+
+static bool readVarint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end) {
+            return false;
+        }
+        uint8_t byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool readString(const uint8_t*& p, const uint8_t* end, std::string& value) {
+    uint64_t length;
+    if (!readVarint(p, end, length) || length > static_cast<uint64_t>(end - p)) {
+        return false;
+    }
+    value.assign(reinterpret_cast<const char*>(p), static_cast<size_t>(length));
+    p += length;
+    return true;
+}
+
+bool SessionRecorder::decode(const uint8_t* data, size_t size, std::vector<SessionEvent>& events) {
+    events.clear();
+    if (!data || size < 4 || std::memcmp(data, "AVGR", 4) != 0) {
+        return false;
+    }
+
+    const uint8_t* p = data + 4;
+    const uint8_t* end = data + size;
+    uint64_t version;
+    if (!readVarint(p, end, version) || version != kLogVersion) {
+        return false;
+    }
+
+    uint64_t time = 0;
+    while (p < end) {
+        SessionEvent event;
+        event.op = static_cast<SessionOp>(*p++);
+        event.value = -1;
+        event.hash = 0;
+
+        uint64_t delta;
+        if (!readVarint(p, end, delta)) {
+            return false;
+        }
+        time += delta;
+        event.timeMicros = time;
+
+        uint64_t value = 0;
+        bool ok = true;
+        switch (event.op) {
+            case SessionOp::Script:
+                if (end - p < 8) {
+                    return false;
+                }
+                for (int i = 0; i < 8; i++) {
+                    event.hash |= static_cast<uint64_t>(*p++) << (i * 8);
+                }
+                break;
+            case SessionOp::Goto:
+                ok = readVarint(p, end, value);
+                if (ok && value == 0) {
+                    ok = readString(p, end, event.text);
+                } else {
+                    event.value = static_cast<int64_t>(value - 1);
+                }
+                break;
+            case SessionOp::Choice:
+            case SessionOp::SnapshotTake:
+            case SessionOp::SnapshotRestore:
+                ok = readVarint(p, end, value) && value <= 0x7FFFFFFF;
+                event.value = static_cast<int64_t>(value);
+                break;
+            case SessionOp::SetVariable:
+                ok = readString(p, end, event.text) && readVarint(p, end, value);
+                event.value = static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+                break;
+            case SessionOp::Load:
+                ok = readString(p, end, event.text);
+                break;
+            case SessionOp::Back:
+            case SessionOp::Save:
+            case SessionOp::Reset:
+                break;
+            default:
+                return false;
+        }
+        if (!ok) {
+            return false;
+        }
+        events.push_back(std::move(event));
+    }
+    return true;
+}
+
+} // namespace avg
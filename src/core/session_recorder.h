@@ -0,0 +1,109 @@
+#ifndef SESSION_RECORDER_H
+#define SESSION_RECORDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace avg {
+
+class GameState;
+
+enum class SessionOp : uint8_t {
+    Script = 1,
+    Goto,
+    Choice,
+    Back,
+    SetVariable,
+    Save,
+    Load,
+    SnapshotTake,
+    SnapshotRestore,
+    Reset
+};
+
+// One decoded log entry
+struct SessionEvent {
+    SessionOp op;
+    uint64_t timeMicros;    // host time since the recording started
+    int64_t value;          // node index, choice index, slot or variable value (-1 if unused)
+    uint64_t hash;          // Script: source hash
+    std::string text;       // Goto by id, variable name or save data
+};
+
+// Input log of a play session, for replaying it against the library (see
+// tests/cpp/replay). While recording, the engine appends each host call
+// that changes the session. Calls the engine makes on its own behalf
+// inside another call (a choice entering its target, a module finishing
+// a pending jump) are left out; timeline auto-advance and choice timeouts
+// are kept, since the log has no ticks. Time comes from the host
+// (setTime), like NodeAnalytics.
+//
+// Log format (integers LEB128 varints unless noted):
+//   "AVGR"                magic, 4 bytes
+//   version               currently 1
+//   events:
+//     op                  SessionOp
+//     delta               micros since the previous event
+//     payload             by op:
+//       Script            source hash, 8 bytes little-endian
+//       Goto              node index + 1, or 0 and the id as a string
+//       Choice            choice index
+//       SetVariable       name string, zigzag value
+//       Load              save data string
+//       SnapshotTake,
+//       SnapshotRestore   slot
+//       Back, Save, Reset nothing
+// Strings are a byte length followed by the bytes.
+class SessionRecorder {
+public:
+    SessionRecorder();
+
+    // Starting a recording drops the previous log; the first events are
+    // the script hash (0 = none loaded yet) and, when a session is running,
+    // its state as a Load
+    void start(uint64_t scriptHash, const std::string& state);
+    void stop() { recording = false; }
+    bool isRecording() const { return recording; }
+
+    void setTime(uint64_t micros) { nowMicros = micros; }
+    const std::vector<uint8_t>& getLog() const { return log; }
+
+    // Marks an engine call; only the outermost call of a nest is recorded
+    class Scope {
+    public:
+        explicit Scope(SessionRecorder& recorder) : owner(recorder) { owner.depth++; }
+        ~Scope() { owner.depth--; }
+        bool recording() const { return owner.recording && owner.depth == 1; }
+
+    private:
+        SessionRecorder& owner;
+    };
+
+    void recordScript(uint64_t scriptHash);
+    void recordGoto(const GameState& state, const char* nodeId);
+    void recordChoice(int choiceIndex);
+    void recordSetVariable(const char* name, int value);
+    void recordLoad(const char* saveData);
+    void recordSlot(SessionOp op, int slot);
+    void recordEvent(SessionOp op);
+
+    // Decode a log; false if it is malformed
+    static bool decode(const uint8_t* data, size_t size, std::vector<SessionEvent>& events);
+
+private:
+    std::vector<uint8_t> log;
+    bool recording;
+    int depth;
+    uint64_t nowMicros;
+    uint64_t lastMicros;
+
+    void beginEvent(SessionOp op);
+    void writeVarint(uint64_t value);
+    void writeString(const char* value, size_t length);
+};
+
+} // namespace avg
+
+#endif // SESSION_RECORDER_H
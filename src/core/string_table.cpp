@@ -0,0 +1,89 @@
+#include "string_table.h"
+
+namespace avg {
+
+StringTable::StringTable() {
+}
+
+void StringTable::add(int index, const std::string* text, const std::string* speaker,
+                      const std::vector<std::string>& choices) {
+    if (index < 0) {
+        return;
+    }
+
+    if (index >= static_cast<int>(slots.size())) {
+        slots.resize(static_cast<size_t>(index) + 1, -1);
+    }
+
+    // A repeated index replaces the earlier entry; its strings stay in the
+    // pool until the table is rebuilt
+    if (slots[index] < 0) {
+        slots[index] = static_cast<int32_t>(entries.size());
+        entries.push_back(Entry());
+    }
+
+    Entry& entry = entries[slots[index]];
+    entry.text = text ? addString(*text) : kNone;
+    entry.speaker = speaker ? addString(*speaker) : kNone;
+    entry.firstChoice = static_cast<uint32_t>(choiceOffsets.size());
+    entry.choiceCount = static_cast<uint32_t>(choices.size());
+    for (const auto& choice : choices) {
+        choiceOffsets.push_back(addString(choice));
+    }
+}
+
+bool StringTable::contains(int index) const {
+    return find(index) != nullptr;
+}
+
+const char* StringTable::getText(int index) const {
+    const Entry* entry = find(index);
+    return entry ? at(entry->text) : nullptr;
+}
+
+const char* StringTable::getSpeaker(int index) const {
+    const Entry* entry = find(index);
+    return entry ? at(entry->speaker) : nullptr;
+}
+
+int StringTable::getChoiceCount(int index) const {
+    const Entry* entry = find(index);
+    return entry ? static_cast<int>(entry->choiceCount) : 0;
+}
+
+const char* StringTable::getChoice(int index, int choice) const {
+    const Entry* entry = find(index);
+    if (!entry || choice < 0 || choice >= static_cast<int>(entry->choiceCount)) {
+        return nullptr;
+    }
+    return at(choiceOffsets[entry->firstChoice + choice]);
+}
+
+void StringTable::clear() {
+    locale.clear();
+    std::vector<int32_t>().swap(slots);
+    std::vector<Entry>().swap(entries);
+    std::vector<uint32_t>().swap(choiceOffsets);
+    std::string().swap(pool);
+}
+
+size_t StringTable::getMemoryBytes() const {
+    return slots.capacity() * sizeof(int32_t) + entries.capacity() * sizeof(Entry) +
+           choiceOffsets.capacity() * sizeof(uint32_t) + pool.capacity();
+}
+
+uint32_t StringTable::addString(const std::string& value) {
+    uint32_t offset = static_cast<uint32_t>(pool.size());
+    pool += value;
+    pool.push_back('\0');
+    return offset;
+}
+
+const StringTable::Entry* StringTable::find(int index) const {
+    if (index < 0 || index >= static_cast<int>(slots.size()) || slots[index] < 0) {
+        return nullptr;
+    }
+    return &entries[slots[index]];
+}
+
+} // namespace avg
@@ -0,0 +1,60 @@
+#ifndef STRING_TABLE_H
+#define STRING_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace avg {
+
+// Localised strings of one locale (text, speaker, choice texts), keyed by
+// node index. Strings are stored as written, markup included, NUL-terminated
+// in a single buffer; an entry is three offsets and a choice range.
+class StringTable {
+public:
+    StringTable();
+
+    void setLocale(const std::string& name) { locale = name; }
+    const std::string& getLocale() const { return locale; }
+
+    // Strings for a node index; null fields are not localised
+    void add(int index, const std::string* text, const std::string* speaker,
+             const std::vector<std::string>& choices);
+
+    bool empty() const { return entries.empty(); }
+    bool contains(int index) const;
+    // nullptr when the entry does not exist or leaves the field out
+    const char* getText(int index) const;
+    const char* getSpeaker(int index) const;
+    int getChoiceCount(int index) const;
+    const char* getChoice(int index, int choice) const;
+
+    void clear();
+    size_t getMemoryBytes() const;
+
+private:
+    struct Entry {
+        uint32_t text;
+        uint32_t speaker;
+        uint32_t firstChoice;    // into choiceOffsets
+        uint32_t choiceCount;
+    };
+
+    static const uint32_t kNone = 0xffffffffu;
+
+    std::string locale;
+    // Entry per node index, or -1
+    std::vector<int32_t> slots;
+    std::vector<Entry> entries;
+    std::vector<uint32_t> choiceOffsets;
+    std::string pool;
+
+    uint32_t addString(const std::string& value);
+    const Entry* find(int index) const;
+    const char* at(uint32_t offset) const { return offset == kNone ? nullptr : pool.c_str() + offset; }
+};
+
+} // namespace avg
+
+#endif // STRING_TABLE_H
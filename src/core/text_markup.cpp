@@ -0,0 +1,312 @@
+#include "text_markup.h"
+
+namespace avg {
+namespace text_markup {
+
+namespace {
+
+struct NamedColor {
+    const char* name;
+    uint32_t rgb;
+};
+
+const NamedColor kNamedColors[] = {
+    {"black", 0x000000}, {"white", 0xffffff}, {"red", 0xff0000},
+    {"green", 0x00ff00}, {"blue", 0x0000ff}, {"yellow", 0xffff00},
+    {"cyan", 0x00ffff}, {"magenta", 0xff00ff}, {"orange", 0xffa500},
+    {"gray", 0x808080}, {"grey", 0x808080}, {"pink", 0xffc0cb},
+};
+
+int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// #rgb, #rrggbb or a name from kNamedColors
+bool parseColor(const std::string& value, uint32_t& rgb) {
+    if (!value.empty() && value[0] == '#') {
+        size_t digits = value.size() - 1;
+        if (digits != 3 && digits != 6) {
+            return false;
+        }
+        uint32_t result = 0;
+        for (size_t i = 1; i < value.size(); i++) {
+            int digit = hexDigit(value[i]);
+            if (digit < 0) {
+                return false;
+            }
+            result = (result << 4) | static_cast<uint32_t>(digit);
+            if (digits == 3) {
+                result = (result << 4) | static_cast<uint32_t>(digit);
+            }
+        }
+        rgb = result;
+        return true;
+    }
+
+    for (const auto& color : kNamedColors) {
+        if (value == color.name) {
+            rgb = color.rgb;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseMillis(const std::string& value, uint32_t& millis) {
+    if (value.empty() || value.size() > 9) {
+        return false;
+    }
+    uint32_t result = 0;
+    for (char c : value) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        result = result * 10 + static_cast<uint32_t>(c - '0');
+    }
+    millis = result;
+    return true;
+}
+
+bool isVariableName(const std::string& name) {
+    if (name.empty()) {
+        return false;
+    }
+    for (char c : name) {
+        bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                  (c >= '0' && c <= '9') || c == '_' || c == '.';
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+class Tokenizer {
+public:
+    Tokenizer(std::string& plain, std::vector<TextSpan>& spans, std::string& strings)
+        : plain(plain), spans(spans), strings(strings), pos(0), runStart(0), style(0), color(0), merge(true) {}
+
+    void run(const std::string& source) {
+        size_t i = 0;
+        while (i < source.size()) {
+            char c = source[i];
+            if ((c == '{' || c == '[') && i + 1 < source.size() && source[i + 1] == c) {
+                literal(c);
+                i += 2;
+                continue;
+            }
+
+            char close = c == '{' ? '}' : (c == '[' ? ']' : 0);
+            if (close) {
+                size_t end = source.find(close, i + 1);
+                if (end != std::string::npos) {
+                    std::string body = source.substr(i + 1, end - i - 1);
+                    if (c == '{' ? tag(body) : variable(body)) {
+                        i = end + 1;
+                        continue;
+                    }
+                }
+            }
+
+            literal(c);
+            i++;
+        }
+
+        flushRun();
+        for (const auto& open : stack) {
+            if (open.ruby >= 0) {
+                spans[open.ruby].length = pos - spans[open.ruby].start;
+            }
+        }
+    }
+
+private:
+    struct Open {
+        std::string name;
+        uint16_t style;
+        uint32_t color;
+        int ruby;    // index of the ruby span, or -1
+    };
+
+    std::string& plain;
+    std::vector<TextSpan>& spans;
+    std::string& strings;
+    std::vector<Open> stack;
+    uint32_t pos;
+    uint32_t runStart;
+    uint16_t style;
+    uint32_t color;
+    bool merge;    // false right after a ruby, so runs do not span its end
+
+    void literal(char c) {
+        plain.push_back(c);
+        if ((static_cast<unsigned char>(c) & 0xC0) != 0x80) {
+            pos++;
+        }
+    }
+
+    TextSpan& emit(TextSpanType type) {
+        TextSpan span;
+        span.type = type;
+        span.style = style;
+        span.start = pos;
+        span.length = 0;
+        span.color = color;
+        span.value = 0;
+        spans.push_back(span);
+        return spans.back();
+    }
+
+    uint32_t addString(const std::string& value) {
+        uint32_t offset = static_cast<uint32_t>(strings.size());
+        strings += value;
+        strings.push_back('\0');
+        return offset;
+    }
+
+    // Close the text run before a style change or command
+    void flushRun() {
+        if (pos == runStart) {
+            return;
+        }
+
+        TextSpan* last = spans.empty() ? nullptr : &spans.back();
+        if (merge && last && last->type == TextSpanType::Text && last->style == style &&
+            last->color == color && last->start + last->length == runStart) {
+            last->length += pos - runStart;
+        } else {
+            TextSpan& span = emit(TextSpanType::Text);
+            span.start = runStart;
+            span.length = pos - runStart;
+        }
+        runStart = pos;
+        merge = true;
+    }
+
+    void push(const std::string& name, int ruby) {
+        Open open;
+        open.name = name;
+        open.style = style;
+        open.color = color;
+        open.ruby = ruby;
+        stack.push_back(open);
+    }
+
+    bool tag(const std::string& body) {
+        if (!body.empty() && body[0] == '/') {
+            if (stack.empty() || stack.back().name != body.substr(1)) {
+                return false;
+            }
+            flushRun();
+            const Open& open = stack.back();
+            if (open.ruby >= 0) {
+                spans[open.ruby].length = pos - spans[open.ruby].start;
+                merge = false;
+            }
+            style = open.style;
+            color = open.color;
+            stack.pop_back();
+            return true;
+        }
+
+        size_t equals = body.find('=');
+        std::string name = body.substr(0, equals);
+        std::string value = equals == std::string::npos ? std::string() : body.substr(equals + 1);
+
+        if ((name == "b" || name == "i") && equals == std::string::npos) {
+            flushRun();
+            push(name, -1);
+            style |= name == "b" ? kStyleBold : kStyleItalic;
+            return true;
+        }
+
+        if (name == "color") {
+            uint32_t rgb = 0;
+            if (!parseColor(value, rgb)) {
+                return false;
+            }
+            flushRun();
+            push(name, -1);
+            style |= kStyleColor;
+            color = rgb;
+            return true;
+        }
+
+        if (name == "w") {
+            uint32_t millis = 0;
+            if (!parseMillis(value, millis)) {
+                return false;
+            }
+            flushRun();
+            emit(TextSpanType::Pause).value = millis;
+            return true;
+        }
+
+        if (name == "ruby" && !value.empty()) {
+            flushRun();
+            emit(TextSpanType::Ruby).value = addString(value);
+            push(name, static_cast<int>(spans.size() - 1));
+            return true;
+        }
+
+        return false;
+    }
+
+    bool variable(const std::string& name) {
+        if (!isVariableName(name)) {
+            return false;
+        }
+        flushRun();
+        emit(TextSpanType::Variable).value = addString(name);
+        return true;
+    }
+};
+
+} // namespace
+
+void tokenize(const std::string& source, std::string& plain,
+              std::vector<TextSpan>& spans, std::string& strings) {
+    spans.clear();
+    strings.clear();
+
+    if (source.find_first_of("{[") == std::string::npos) {
+        plain = source;
+        return;
+    }
+
+    std::string text;
+    text.reserve(source.size());
+    Tokenizer(text, spans, strings).run(source);
+
+    // Escapes alone leave one plain run, which needs no spans
+    if (spans.size() == 1 && spans[0].type == TextSpanType::Text && spans[0].style == 0) {
+        spans.clear();
+    }
+    plain = std::move(text);
+}
+
+uint32_t countCodepoints(const std::string& text) {
+    uint32_t count = 0;
+    for (unsigned char c : text) {
+        if ((c & 0xC0) != 0x80) {
+            count++;
+        }
+    }
+    return count;
+}
+
+int64_t pauseMillis(const std::vector<TextSpan>& spans) {
+    int64_t total = 0;
+    for (const auto& span : spans) {
+        if (span.type == TextSpanType::Pause) {
+            total += span.value;
+        }
+    }
+    return total;
+}
+
+} // namespace text_markup
+} // namespace avg
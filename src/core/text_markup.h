@@ -0,0 +1,62 @@
+#ifndef TEXT_MARKUP_H
+#define TEXT_MARKUP_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace avg {
+
+// Inline markup in dialogue text, tokenised once at load:
+//
+//   {b}bold{/b}  {i}italic{/i}  {color=#ff8000}...{/color}  {color=red}
+//   {w=500}                  pause the typewriter for 500 ms
+//   {ruby=かんじ}漢字{/ruby}  ruby annotation over the enclosed text
+//   [trust]                  value of a variable
+//   {{  [[                   literal { and [
+//
+// The node keeps the text with the markup removed plus a span array. A tag
+// that is not recognised stays in the text as written.
+enum class TextSpanType : uint16_t {
+    Text = 1,       // run of plain text in one style
+    Pause = 2,      // value = milliseconds
+    Ruby = 3,       // annotation (value) over [start, start + length)
+    Variable = 4    // insert the variable named by value at start
+};
+
+// Style bits
+enum TextStyle : uint16_t {
+    kStyleBold = 1u << 0,
+    kStyleItalic = 1u << 1,
+    kStyleColor = 1u << 2    // color is set
+};
+
+// Five 32-bit words. Offsets and lengths count codepoints of the node's
+// plain text; strings are NUL-terminated at a byte offset into the node's
+// spanStrings.
+struct TextSpan {
+    TextSpanType type;
+    uint16_t style;
+    uint32_t start;
+    uint32_t length;
+    uint32_t color;    // 0xRRGGBB when style has kStyleColor
+    uint32_t value;    // pause milliseconds or string offset
+};
+
+namespace text_markup {
+
+// Tokenise source into plain text, spans and the strings they refer to.
+// Text without markup yields no spans, and plain is then the source.
+void tokenize(const std::string& source, std::string& plain,
+              std::vector<TextSpan>& spans, std::string& strings);
+
+// Codepoints in UTF-8 text
+uint32_t countCodepoints(const std::string& text);
+
+// Total typewriter pause time in spans
+int64_t pauseMillis(const std::vector<TextSpan>& spans);
+
+} // namespace text_markup
+} // namespace avg
+
+#endif // TEXT_MARKUP_H
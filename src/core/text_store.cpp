@@ -0,0 +1,670 @@
+#include "text_store.h"
+#include <algorithm>
+#include <cstring>
+
+namespace avg {
+
+namespace {
+
+const int kHashBits = 14;
+const size_t kMinMatch = 4;
+const size_t kMaxOffset = 65535;
+const int kMaxChain = 32;
+const int kMaxCodeBits = 12;
+
+// Dictionary training: segments of kSegment bytes scored by how common
+// their kDmer-byte substrings are across the script
+const size_t kDmer = 8;
+const size_t kSegment = 64;
+const int kCountBits = 18;
+
+inline uint32_t read32(const char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint32_t hash4(const char* p) {
+    return (read32(p) * 2654435761u) >> (32 - kHashBits);
+}
+
+inline uint32_t hashDmer(const char* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return static_cast<uint32_t>((value * 0x9E3779B97F4A7C15ull) >> (64 - kCountBits));
+}
+
+// Least significant bit first
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out(out), bits(0), count(0) {}
+
+    void put(uint32_t code, int length) {
+        bits |= static_cast<uint64_t>(code) << count;
+        count += length;
+        while (count >= 8) {
+            out.push_back(static_cast<uint8_t>(bits));
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+
+    void flush() {
+        if (count > 0) {
+            out.push_back(static_cast<uint8_t>(bits));
+        }
+        bits = 0;
+        count = 0;
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    uint64_t bits;
+    int count;
+};
+
+// Past the end it reads zeros; the decoder's size checks catch an overrun
+class BitReader {
+public:
+    BitReader(const uint8_t* next, const uint8_t* end) : next(next), end(end), bits(0), count(0) {}
+
+    uint8_t symbol(const std::vector<uint16_t>& table) {
+        if (count < kMaxCodeBits) {
+            while (count <= 56) {
+                uint64_t byte = next < end ? *next++ : 0;
+                bits |= byte << count;
+                count += 8;
+            }
+        }
+        uint16_t entry = table[bits & ((1u << kMaxCodeBits) - 1)];
+        int length = entry >> 8;
+        bits >>= length;
+        count -= length;
+        return static_cast<uint8_t>(entry & 0xff);
+    }
+
+private:
+    const uint8_t* next;
+    const uint8_t* end;
+    uint64_t bits;
+    int count;
+};
+
+// Extra length bytes after a nibble of 15, as in LZ4
+template <typename Put>
+void putLength(size_t length, Put put) {
+    while (length >= 255) {
+        put(255);
+        length -= 255;
+    }
+    put(static_cast<uint8_t>(length));
+}
+
+void countLength(std::vector<uint32_t>& counts, size_t length) {
+    putLength(length, [&](uint8_t byte) { counts[byte]++; });
+}
+
+} // namespace
+
+TextStore::TextStore() : liveBytes(0), deadBytes(0), cacheClock(0) {
+    for (auto& entry : cache) {
+        entry.block = -1;
+        entry.lastUsed = 0;
+    }
+}
+
+void TextStore::train(const std::vector<const std::string*>& samples) {
+    dictionary.clear();
+
+    std::string corpus;
+    for (const std::string* sample : samples) {
+        corpus += *sample;
+    }
+
+    // Too little text to be worth a dictionary
+    size_t target = corpus.size() / 8;
+    if (target > kMaxDictionaryBytes) {
+        target = kMaxDictionaryBytes;
+    }
+    if (target < kSegment * 4) {
+        return;
+    }
+
+    std::vector<uint32_t> counts(size_t(1) << kCountBits, 0);
+    size_t dmers = corpus.size() - kDmer + 1;
+    for (size_t i = 0; i < dmers; i++) {
+        counts[hashDmer(&corpus[i])]++;
+    }
+
+    // One segment per epoch of the corpus, so the dictionary covers the
+    // whole script instead of its most repetitive corner
+    struct Segment {
+        uint64_t score;
+        size_t begin;
+    };
+    std::vector<Segment> chosen;
+    size_t segmentCount = target / kSegment;
+    size_t epoch = corpus.size() / segmentCount;
+    const size_t window = kSegment - kDmer + 1;
+
+    for (size_t e = 0; e < segmentCount; e++) {
+        size_t begin = e * epoch;
+        size_t end = std::min(begin + epoch, corpus.size());
+        if (end - begin < kSegment) {
+            continue;
+        }
+
+        uint64_t score = 0;
+        for (size_t i = begin; i < begin + window; i++) {
+            score += counts[hashDmer(&corpus[i])];
+        }
+        Segment best = {score, begin};
+        for (size_t i = begin + 1; i + kSegment <= end; i++) {
+            score -= counts[hashDmer(&corpus[i - 1])];
+            score += counts[hashDmer(&corpus[i + window - 1])];
+            if (score > best.score) {
+                best.score = score;
+                best.begin = i;
+            }
+        }
+
+        // Substrings seen once are not worth dictionary space
+        if (best.score <= window) {
+            continue;
+        }
+        for (size_t i = best.begin; i < best.begin + window; i++) {
+            counts[hashDmer(&corpus[i])] = 0;
+        }
+        chosen.push_back(best);
+    }
+
+    // Best segments last, nearest to the text being compressed
+    std::stable_sort(chosen.begin(), chosen.end(),
+                     [](const Segment& a, const Segment& b) { return a.score < b.score; });
+    for (const auto& segment : chosen) {
+        dictionary.append(corpus, segment.begin, kSegment);
+    }
+    dictionary.shrink_to_fit();
+}
+
+void TextStore::add(const std::vector<std::pair<int, const std::string*>>& texts) {
+    // Hash chains over the dictionary, the starting point of every block's
+    Chains chains;
+    chains.head.assign(size_t(1) << kHashBits, -1);
+    chains.prev.assign(dictionary.size(), -1);
+    for (size_t i = 0; i + kMinMatch <= dictionary.size(); i++) {
+        uint32_t h = hash4(&dictionary[i]);
+        chains.prev[i] = chains.head[h];
+        chains.head[h] = static_cast<int32_t>(i);
+    }
+
+    // Parse every block first: the codes are built from the symbols the
+    // first batch actually leaves after matching
+    std::vector<Parsed> parsed;
+    std::string raw;
+    auto flush = [&]() {
+        if (!raw.empty()) {
+            parsed.emplace_back();
+            parseBlock(raw, chains, parsed.back());
+            raw.clear();
+        }
+    };
+
+    for (const auto& entry : texts) {
+        int index = entry.first;
+        const std::string& text = *entry.second;
+        if (index < 0 || text.empty()) {
+            continue;
+        }
+
+        forget(index);
+        if (index >= static_cast<int>(locations.size())) {
+            locations.resize(static_cast<size_t>(index) + 1, Location{kNone, 0, 0});
+        }
+
+        if (!raw.empty() && raw.size() + text.size() > kBlockBytes) {
+            flush();
+        }
+        Location& location = locations[index];
+        location.block = static_cast<uint32_t>(blocks.size() + parsed.size());
+        location.offset = static_cast<uint32_t>(raw.size());
+        location.length = static_cast<uint32_t>(text.size());
+        raw += text;
+        liveBytes += text.size();
+    }
+    flush();
+
+    if (literalCode.lengths.empty()) {
+        buildCodes(parsed);
+    }
+
+    for (const auto& block : parsed) {
+        blocks.emplace_back();
+        encodeBlock(block, blocks.back());
+    }
+}
+
+bool TextStore::contains(int index) const {
+    return index >= 0 && index < static_cast<int>(locations.size()) && locations[index].block != kNone;
+}
+
+bool TextStore::read(int index, std::string& out) const {
+    if (!contains(index)) {
+        return false;
+    }
+
+    const Location& location = locations[index];
+    const std::string* text = decodedBlock(location.block);
+    if (!text || location.offset + location.length > text->size()) {
+        out.clear();
+        return false;
+    }
+    out.assign(*text, location.offset, location.length);
+    return true;
+}
+
+void TextStore::forget(int index) {
+    if (!contains(index)) {
+        return;
+    }
+
+    Location& location = locations[index];
+    liveBytes -= location.length;
+    deadBytes += location.length;
+    location.block = kNone;
+}
+
+void TextStore::clear() {
+    std::string().swap(dictionary);
+    tokenCode = HuffmanCode();
+    literalCode = HuffmanCode();
+    offsetCode = HuffmanCode();
+    blocks.clear();
+    locations.clear();
+    liveBytes = 0;
+    deadBytes = 0;
+    for (auto& entry : cache) {
+        entry.block = -1;
+        entry.lastUsed = 0;
+        std::string().swap(entry.text);
+    }
+}
+
+TextStore::Stats TextStore::getStats() const {
+    Stats stats;
+    stats.textBytes = liveBytes;
+    stats.compressedBytes = 0;
+    for (const auto& block : blocks) {
+        stats.compressedBytes += block.data.size();
+    }
+    stats.dictionaryBytes = dictionary.size();
+    stats.blocks = blocks.size();
+    return stats;
+}
+
+// Canonical Huffman code over byte symbols, at most kMaxCodeBits long so
+// one table lookup decodes a symbol. Codes are stored bit-reversed because
+// the bit stream is read least significant bit first.
+void TextStore::buildCode(std::vector<uint32_t> counts, HuffmanCode& code) {
+    std::vector<uint8_t>& lengths = code.lengths;
+    lengths.assign(256, 0);
+    for (;;) {
+        // Huffman tree over (count, node); leaves are 0..255
+        std::vector<std::pair<uint64_t, int>> heap;
+        std::vector<int> parent(512, -1);
+        for (int symbol = 0; symbol < 256; symbol++) {
+            heap.push_back({counts[symbol], symbol});
+        }
+        auto greater = [](const std::pair<uint64_t, int>& a, const std::pair<uint64_t, int>& b) {
+            return a.first > b.first || (a.first == b.first && a.second > b.second);
+        };
+        std::make_heap(heap.begin(), heap.end(), greater);
+        int node = 256;
+        while (heap.size() > 1) {
+            std::pop_heap(heap.begin(), heap.end(), greater);
+            std::pair<uint64_t, int> a = heap.back();
+            heap.pop_back();
+            std::pop_heap(heap.begin(), heap.end(), greater);
+            std::pair<uint64_t, int> b = heap.back();
+            heap.pop_back();
+            parent[a.second] = node;
+            parent[b.second] = node;
+            heap.push_back({a.first + b.first, node++});
+            std::push_heap(heap.begin(), heap.end(), greater);
+        }
+
+        int longest = 0;
+        for (int symbol = 0; symbol < 256; symbol++) {
+            int length = 0;
+            for (int at = symbol; parent[at] >= 0; at = parent[at]) {
+                length++;
+            }
+            lengths[symbol] = static_cast<uint8_t>(length);
+            longest = std::max(longest, length);
+        }
+        if (longest <= kMaxCodeBits) {
+            break;
+        }
+        // Flatten the distribution until the code fits
+        for (auto& count : counts) {
+            count = (count + 1) / 2;
+        }
+    }
+
+    // Canonical codes: by length, then symbol
+    code.codes.assign(256, 0);
+    uint32_t next = 0;
+    for (int length = 1; length <= kMaxCodeBits; length++) {
+        for (int symbol = 0; symbol < 256; symbol++) {
+            if (lengths[symbol] != length) {
+                continue;
+            }
+            uint32_t reversed = 0;
+            for (int bit = 0; bit < length; bit++) {
+                reversed |= ((next >> bit) & 1u) << (length - 1 - bit);
+            }
+            code.codes[symbol] = static_cast<uint16_t>(reversed);
+            next++;
+        }
+        next <<= 1;
+    }
+
+    // Every kMaxCodeBits-bit window whose low bits are a code maps to it
+    code.table.assign(size_t(1) << kMaxCodeBits, 0);
+    for (int symbol = 0; symbol < 256; symbol++) {
+        int length = lengths[symbol];
+        for (uint32_t high = 0; high < (1u << (kMaxCodeBits - length)); high++) {
+            uint32_t window = code.codes[symbol] | (high << length);
+            code.table[window] = static_cast<uint16_t>(symbol | (length << 8));
+        }
+    }
+}
+
+// Symbol counts of the first batch, +1 so later text always has a code
+void TextStore::buildCodes(const std::vector<Parsed>& parsed) {
+    std::vector<uint32_t> tokens(256, 1);
+    std::vector<uint32_t> literals(256, 1);
+    std::vector<uint32_t> offsets(256, 1);
+    for (const auto& block : parsed) {
+        for (const auto& sequence : block.sequences) {
+            size_t matchLength = sequence.length ? sequence.length - kMinMatch : 0;
+            tokens[std::min<size_t>(sequence.literals, 15) << 4 | std::min<size_t>(matchLength, 15)]++;
+            if (sequence.literals >= 15) {
+                countLength(tokens, sequence.literals - 15);
+            }
+            if (sequence.length) {
+                offsets[sequence.offset >> 8]++;
+                if (matchLength >= 15) {
+                    countLength(tokens, matchLength - 15);
+                }
+            }
+        }
+        for (unsigned char c : block.literals) {
+            literals[c]++;
+        }
+    }
+    buildCode(tokens, tokenCode);
+    buildCode(literals, literalCode);
+    buildCode(offsets, offsetCode);
+}
+
+// LZ77 parse against dictionary + raw into (literal run, offset, length)
+// sequences; the last one has literals only. Offsets reaching back past the
+// start of the block continue into the end of the dictionary.
+void TextStore::parseBlock(const std::string& raw, const Chains& chains, Parsed& parsed) const {
+    const size_t base = dictionary.size();
+    std::string buffer;
+    buffer.reserve(base + raw.size());
+    buffer += dictionary;
+    buffer += raw;
+    const size_t size = buffer.size();
+
+    std::vector<int32_t> head(chains.head);
+    std::vector<int32_t> prev(size, -1);
+    std::copy(chains.prev.begin(), chains.prev.end(), prev.begin());
+
+    auto insert = [&](size_t pos) {
+        if (pos + kMinMatch <= size) {
+            uint32_t h = hash4(&buffer[pos]);
+            prev[pos] = head[h];
+            head[h] = static_cast<int32_t>(pos);
+        }
+    };
+
+    auto find = [&](size_t pos, size_t& offset) -> size_t {
+        if (pos + kMinMatch > size) {
+            return 0;
+        }
+        size_t best = 0;
+        int32_t candidate = head[hash4(&buffer[pos])];
+        for (int depth = 0; candidate >= 0 && depth < kMaxChain; depth++) {
+            size_t distance = pos - static_cast<size_t>(candidate);
+            if (distance > kMaxOffset) {
+                break;
+            }
+            size_t length = 0;
+            while (pos + length < size && buffer[candidate + length] == buffer[pos + length]) {
+                length++;
+            }
+            if (length > best) {
+                best = length;
+                offset = distance;
+            }
+            candidate = prev[candidate];
+        }
+        return best >= kMinMatch ? best : 0;
+    };
+
+    parsed.sequences.clear();
+    parsed.literals.clear();
+    parsed.rawSize = static_cast<uint32_t>(raw.size());
+
+    auto emit = [&](size_t literalBegin, size_t literalEnd, size_t offset, size_t length) {
+        Sequence sequence;
+        sequence.literals = static_cast<uint32_t>(literalEnd - literalBegin);
+        sequence.offset = static_cast<uint32_t>(offset);
+        sequence.length = static_cast<uint32_t>(length);
+        parsed.sequences.push_back(sequence);
+        parsed.literals.append(buffer, literalBegin, literalEnd - literalBegin);
+    };
+
+    size_t anchor = base;
+    size_t pos = base;
+    while (pos < size) {
+        size_t offset = 0;
+        size_t length = find(pos, offset);
+        if (length == 0) {
+            insert(pos++);
+            continue;
+        }
+
+        // Lazy matching: a longer match one byte on wins
+        size_t nextOffset = 0;
+        size_t nextLength = find(pos + 1, nextOffset);
+        if (nextLength > length) {
+            insert(pos++);
+            length = nextLength;
+            offset = nextOffset;
+        }
+
+        emit(anchor, pos, offset, length);
+        for (size_t end = pos + length; pos < end; pos++) {
+            insert(pos);
+        }
+        anchor = pos;
+    }
+    if (anchor < size) {
+        emit(anchor, size, 0, 0);
+    }
+}
+
+// Block: varint match count, the low offset bytes (close to uniform, so
+// stored as is), then one bit stream in decode order. Per sequence: token
+// (literal count << 4 | match length - 4, nibbles saturating at 15) and
+// extra literal count bytes in the token code, the literals, then for a
+// match its offset high byte and extra match length bytes.
+void TextStore::encodeBlock(const Parsed& parsed, Block& block) const {
+    std::vector<uint8_t>& out = block.data;
+    out.clear();
+
+    size_t matches = 0;
+    for (const auto& sequence : parsed.sequences) {
+        matches += sequence.length ? 1 : 0;
+    }
+    for (size_t value = matches; ; value >>= 7) {
+        if (value < 0x80) {
+            out.push_back(static_cast<uint8_t>(value));
+            break;
+        }
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+    }
+    for (const auto& sequence : parsed.sequences) {
+        if (sequence.length) {
+            out.push_back(static_cast<uint8_t>(sequence.offset));
+        }
+    }
+
+    BitWriter writer(out);
+    auto token = [&](uint8_t symbol) { writer.put(tokenCode.codes[symbol], tokenCode.lengths[symbol]); };
+    const unsigned char* literal = reinterpret_cast<const unsigned char*>(parsed.literals.data());
+
+    for (const auto& sequence : parsed.sequences) {
+        size_t matchLength = sequence.length ? sequence.length - kMinMatch : 0;
+        token(static_cast<uint8_t>(std::min<size_t>(sequence.literals, 15) << 4 |
+                                   std::min<size_t>(matchLength, 15)));
+        if (sequence.literals >= 15) {
+            putLength(sequence.literals - 15, token);
+        }
+        for (uint32_t i = 0; i < sequence.literals; i++, literal++) {
+            writer.put(literalCode.codes[*literal], literalCode.lengths[*literal]);
+        }
+        if (sequence.length) {
+            uint8_t high = static_cast<uint8_t>(sequence.offset >> 8);
+            writer.put(offsetCode.codes[high], offsetCode.lengths[high]);
+            if (matchLength >= 15) {
+                putLength(matchLength - 15, token);
+            }
+        }
+    }
+    writer.flush();
+
+    out.shrink_to_fit();
+    block.rawSize = parsed.rawSize;
+}
+
+bool TextStore::decompressBlock(const Block& block, std::string& out) const {
+    const uint8_t* p = block.data.data();
+    const uint8_t* end = p + block.data.size();
+
+    size_t matches = 0;
+    for (int shift = 0;; shift += 7) {
+        if (p >= end || shift > 28) {
+            return false;
+        }
+        uint8_t byte = *p++;
+        matches |= static_cast<size_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    if (matches > static_cast<size_t>(end - p)) {
+        return false;
+    }
+    const uint8_t* offsetLow = p;
+    const uint8_t* offsetLowEnd = p + matches;
+    BitReader reader(offsetLowEnd, end);
+
+    auto length = [&](size_t& value) {
+        uint8_t byte;
+        do {
+            byte = reader.symbol(tokenCode.table);
+            value += byte;
+        } while (byte == 255 && value <= block.rawSize);
+    };
+
+    const size_t dictionarySize = dictionary.size();
+    const size_t rawSize = block.rawSize;
+    out.resize(rawSize);
+    char* dst = &out[0];
+    size_t pos = 0;
+
+    while (pos < rawSize) {
+        uint8_t token = reader.symbol(tokenCode.table);
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            length(literals);
+        }
+        if (literals > rawSize - pos) {
+            return false;
+        }
+        for (size_t i = 0; i < literals; i++) {
+            dst[pos++] = static_cast<char>(reader.symbol(literalCode.table));
+        }
+        // Only the last sequence ends the block on literals
+        if (pos == rawSize) {
+            break;
+        }
+
+        if (offsetLow == offsetLowEnd) {
+            return false;
+        }
+        size_t offset = static_cast<size_t>(*offsetLow++) |
+                        static_cast<size_t>(reader.symbol(offsetCode.table)) << 8;
+        size_t matchLength = token & 15;
+        if (matchLength == 15) {
+            length(matchLength);
+        }
+        matchLength += kMinMatch;
+        if (offset == 0 || offset > pos + dictionarySize || matchLength > rawSize - pos) {
+            return false;
+        }
+
+        if (offset > pos) {
+            size_t back = offset - pos;
+            size_t fromDictionary = std::min(matchLength, back);
+            std::memcpy(dst + pos, dictionary.data() + dictionarySize - back, fromDictionary);
+            pos += fromDictionary;
+            matchLength -= fromDictionary;
+        }
+
+        if (matchLength == 0) {
+            continue;
+        }
+        const char* src = dst + pos - offset;
+        if (offset >= matchLength) {
+            std::memcpy(dst + pos, src, matchLength);
+        } else {
+            // Overlapping copy repeats the last offset bytes
+            for (size_t i = 0; i < matchLength; i++) {
+                dst[pos + i] = src[i];
+            }
+        }
+        pos += matchLength;
+    }
+
+    return pos == rawSize && offsetLow == offsetLowEnd;
+}
+
+const std::string* TextStore::decodedBlock(uint32_t block) const {
+    CacheEntry* victim = &cache[0];
+    for (auto& entry : cache) {
+        if (entry.block == static_cast<int>(block)) {
+            entry.lastUsed = ++cacheClock;
+            return &entry.text;
+        }
+        if (entry.lastUsed < victim->lastUsed) {
+            victim = &entry;
+        }
+    }
+
+    if (block >= blocks.size() || !decompressBlock(blocks[block], victim->text)) {
+        victim->block = -1;
+        victim->lastUsed = 0;
+        return nullptr;
+    }
+    victim->block = static_cast<int>(block);
+    victim->lastUsed = ++cacheClock;
+    return &victim->text;
+}
+
+} // namespace avg
@@ -0,0 +1,126 @@
+#ifndef TEXT_STORE_H
+#define TEXT_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace avg {
+
+// Dialogue text kept in compressed blocks (optional, see
+// AVGEngine::setTextCompression).
+//
+// Texts of consecutive node indices are packed into blocks of about
+// kBlockBytes and compressed with an LZ77 codec whose window starts with a
+// dictionary trained on the script itself, so even short lines find
+// matches. Sequences are LZ4-like (token, literals, offset, lengths); the
+// tokens, literals and offset high bytes use static Huffman codes built from
+// the same script. Reading a text decodes its block once; a small LRU of
+// decoded blocks makes reading along the script cost a copy per line.
+class TextStore {
+public:
+    static const size_t kBlockBytes = 4096;
+    static const size_t kCacheBlocks = 4;
+    static const size_t kMaxDictionaryBytes = 32 * 1024;
+
+    struct Stats {
+        size_t textBytes;         // live texts, uncompressed
+        size_t compressedBytes;   // all blocks, including dead texts
+        size_t dictionaryBytes;
+        size_t blocks;
+    };
+
+    TextStore();
+
+    // Train the dictionary on sample texts. Blocks decode against the
+    // dictionary they were compressed with, so only call this when empty.
+    void train(const std::vector<const std::string*>& samples);
+    bool empty() const { return blocks.empty(); }
+
+    // Compress texts (node index, text) into new blocks, in the given order
+    void add(const std::vector<std::pair<int, const std::string*>>& texts);
+
+    bool contains(int index) const;
+    // Decoded text of a stored index; false if it is not stored
+    bool read(int index, std::string& out) const;
+    // The node's text changed or was released; its bytes become dead
+    void forget(int index);
+    // True when dead texts outweigh live ones and a rebuild would pay off
+    bool wasteful() const { return deadBytes > liveBytes; }
+
+    void clear();
+    Stats getStats() const;
+
+private:
+    struct Location {
+        uint32_t block;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct Block {
+        std::vector<uint8_t> data;
+        uint32_t rawSize;
+    };
+
+    // Literal run followed by a match; length 0 for the last run
+    struct Sequence {
+        uint32_t literals;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    // A block after matching, before it is entropy coded
+    struct Parsed {
+        std::vector<Sequence> sequences;
+        std::string literals;
+        uint32_t rawSize;
+    };
+
+    // Canonical Huffman code over byte symbols with a one-lookup decode table
+    struct HuffmanCode {
+        std::vector<uint8_t> lengths;
+        std::vector<uint16_t> codes;
+        std::vector<uint16_t> table;
+    };
+
+    struct CacheEntry {
+        int block;
+        uint64_t lastUsed;
+        std::string text;
+    };
+
+    // Match finder state: newest position per hash, then older ones
+    struct Chains {
+        std::vector<int32_t> head;
+        std::vector<int32_t> prev;
+    };
+
+    std::string dictionary;
+    // Static codes, fixed by the first batch of text
+    HuffmanCode tokenCode;     // tokens and length extension bytes
+    HuffmanCode literalCode;
+    HuffmanCode offsetCode;    // high byte of match offsets
+    std::vector<Block> blocks;
+    // Per node index; block == kNone when not stored
+    std::vector<Location> locations;
+    size_t liveBytes;
+    size_t deadBytes;
+
+    mutable CacheEntry cache[kCacheBlocks];
+    mutable uint64_t cacheClock;
+
+    static const uint32_t kNone = 0xffffffffu;
+
+    static void buildCode(std::vector<uint32_t> counts, HuffmanCode& code);
+    void buildCodes(const std::vector<Parsed>& parsed);
+    void parseBlock(const std::string& raw, const Chains& chains, Parsed& parsed) const;
+    void encodeBlock(const Parsed& parsed, Block& block) const;
+    bool decompressBlock(const Block& block, std::string& out) const;
+    const std::string* decodedBlock(uint32_t block) const;
+};
+
+} // namespace avg
+
+#endif // TEXT_STORE_H
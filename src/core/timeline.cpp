@@ -0,0 +1,197 @@
+#include "timeline.h"
+#include "dialogue_node.h"
+#include <string>
+
+namespace avg {
+
+namespace {
+
+bool isAction(TimelineEventType type) {
+    return type == TimelineEventType::AutoAdvance || type == TimelineEventType::ChoiceTimeout;
+}
+
+} // namespace
+
+Timeline::Timeline()
+    : now(0),
+      textCharMicros(50000),
+      autoBaseMicros(1000000),
+      autoCharMicros(40000),
+      autoMode(false) {
+}
+
+void Timeline::setAutoDelay(int64_t baseMicros, int64_t charMicros) {
+    autoBaseMicros = baseMicros < 0 ? 0 : baseMicros;
+    autoCharMicros = charMicros < 0 ? 0 : charMicros;
+}
+
+void Timeline::setAutoMode(bool enabled) {
+    if (autoMode == enabled) {
+        return;
+    }
+
+    autoMode = enabled;
+
+    // Text waiting for auto mode starts its reading time; text being read
+    // goes back to waiting
+    for (auto& task : tasks) {
+        if (task.kind == TaskKind::Text &&
+            (task.state == kTextWaitAuto || task.state == kTextReading)) {
+            task.wakeAt = now;
+        }
+    }
+}
+
+void Timeline::enterNode(int nodeIndex, const DialogueNode* node, const std::string& text) {
+    tasks.clear();
+    if (!node) {
+        return;
+    }
+
+    if (node->type == NodeType::DIALOGUE || node->type == NodeType::CHOICE) {
+        // Only dialogue with a successor auto advances; a choice question
+        // or a dead end stops after its reveal
+        bool advances = node->type == NodeType::DIALOGUE && !node->nextNodeId.empty();
+
+        Task task;
+        task.kind = TaskKind::Text;
+        task.state = advances ? kTextRevealing : kTextRevealingOnly;
+        task.nodeIndex = nodeIndex;
+        // Typewriter and reading time go by characters, not UTF-8 bytes;
+        // {w=...} pauses in the text hold the reveal
+        task.value = static_cast<int32_t>(text_markup::countCodepoints(text));
+        task.wakeAt = now + task.value * textCharMicros + text_markup::pauseMillis(node->textSpans) * 1000;
+        tasks.push_back(task);
+    }
+
+    if (!node->soundEffect.empty()) {
+        Task task;
+        task.kind = TaskKind::SoundEffect;
+        task.state = 0;
+        task.nodeIndex = nodeIndex;
+        task.wakeAt = now + static_cast<int64_t>(node->soundEffectDelayMs) * 1000;
+        task.value = 0;
+        tasks.push_back(task);
+    }
+
+    if (node->type == NodeType::CHOICE && node->choiceTimeoutMs > 0 && !node->choices.empty()) {
+        int choice = node->timeoutChoice;
+        if (choice < 0 || choice >= static_cast<int>(node->choices.size())) {
+            choice = 0;
+        }
+
+        Task task;
+        task.kind = TaskKind::ChoiceTimer;
+        task.state = 0;
+        task.nodeIndex = nodeIndex;
+        task.wakeAt = now + static_cast<int64_t>(node->choiceTimeoutMs) * 1000;
+        task.value = choice;
+        tasks.push_back(task);
+    }
+}
+
+void Timeline::clear() {
+    tasks.clear();
+    fired.clear();
+}
+
+void Timeline::completeText() {
+    for (auto& task : tasks) {
+        if (task.kind == TaskKind::Text &&
+            (task.state == kTextRevealing || task.state == kTextRevealingOnly) && task.wakeAt > now) {
+            task.wakeAt = now;
+        }
+    }
+}
+
+void Timeline::emit(TimelineEventType type, int nodeIndex, int32_t value) {
+    TimelineEvent event;
+    event.type = type;
+    event.nodeIndex = nodeIndex;
+    event.value = value;
+    fired.push_back(event);
+}
+
+bool Timeline::resume(Task& task) {
+    switch (task.kind) {
+        case TaskKind::Text:
+            switch (task.state) {
+                case kTextRevealing:
+                    emit(TimelineEventType::TextRevealed, task.nodeIndex, task.value);
+                    task.state = kTextWaitAuto;
+                    // fall through
+                case kTextWaitAuto:
+                    if (!autoMode) {
+                        task.wakeAt = kNever;   // until setAutoMode(true)
+                        return false;
+                    }
+                    task.state = kTextReading;
+                    task.wakeAt = now + autoBaseMicros + task.value * autoCharMicros;
+                    return false;
+                case kTextReading:
+                    if (!autoMode) {
+                        task.state = kTextWaitAuto;
+                        task.wakeAt = kNever;
+                        return false;
+                    }
+                    emit(TimelineEventType::AutoAdvance, task.nodeIndex, 0);
+                    return true;
+                default:
+                    emit(TimelineEventType::TextRevealed, task.nodeIndex, task.value);
+                    return true;
+            }
+
+        case TaskKind::SoundEffect:
+            emit(TimelineEventType::SoundEffect, task.nodeIndex, 0);
+            return true;
+
+        case TaskKind::ChoiceTimer:
+            emit(TimelineEventType::ChoiceTimeout, task.nodeIndex, task.value);
+            return true;
+    }
+    return true;
+}
+
+bool Timeline::runUntil(int64_t target) {
+    for (;;) {
+        // Earliest task first; ties keep scheduling order
+        size_t next = tasks.size();
+        for (size_t i = 0; i < tasks.size(); i++) {
+            if (tasks[i].wakeAt <= target && (next == tasks.size() || tasks[i].wakeAt < tasks[next].wakeAt)) {
+                next = i;
+            }
+        }
+
+        if (next == tasks.size()) {
+            if (target > now) {
+                now = target;
+            }
+            return false;
+        }
+
+        // Resume at the task's own time, not the end of the tick
+        if (tasks[next].wakeAt > now) {
+            now = tasks[next].wakeAt;
+        }
+
+        size_t before = fired.size();
+        if (resume(tasks[next])) {
+            tasks.erase(tasks.begin() + static_cast<std::ptrdiff_t>(next));
+        }
+
+        if (fired.size() > before && isAction(fired.back().type)) {
+            return true;
+        }
+    }
+}
+
+int64_t Timeline::getChoiceTimeRemaining() const {
+    for (const auto& task : tasks) {
+        if (task.kind == TaskKind::ChoiceTimer) {
+            return task.wakeAt > now ? task.wakeAt - now : 0;
+        }
+    }
+    return -1;
+}
+
+} // namespace avg
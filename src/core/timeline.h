@@ -0,0 +1,105 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace avg {
+
+struct DialogueNode;
+
+enum class TimelineEventType : int32_t {
+    TextRevealed = 1,   // typewriter time for the node's text has elapsed
+    AutoAdvance = 2,    // auto mode reading time elapsed; engine moved to next
+    SoundEffect = 3,    // play the node's sound effect now
+    ChoiceTimeout = 4   // timed choice expired; value = choice taken
+};
+
+// Fired event, three 32-bit words so the host can read the list straight
+// out of linear memory
+struct TimelineEvent {
+    TimelineEventType type;
+    int32_t nodeIndex;
+    int32_t value;
+};
+
+// Deterministic per-node scheduler driven only by host time deltas.
+//
+// Entering a node cancels the previous node's tasks and starts new ones.
+// Each task is a small resumable state machine: resume() runs it from its
+// saved state until it either finishes or suspends with a wake-up time
+// (kNever while it waits for a signal, e.g. auto mode being switched on).
+// Tasks run in wake-up order at their own logical time, so the result of a
+// tick does not depend on how time was split into frames.
+class Timeline {
+public:
+    static const int64_t kNever = INT64_MAX;
+
+    Timeline();
+
+    // Typewriter speed (per character) and auto mode reading time
+    // (base + per character), all in microseconds
+    void setTextSpeed(int64_t charMicros) { textCharMicros = charMicros < 0 ? 0 : charMicros; }
+    void setAutoDelay(int64_t baseMicros, int64_t charMicros);
+    void setAutoMode(bool enabled);
+    bool isAutoMode() const { return autoMode; }
+
+    // Replace all tasks with the ones for node (nullptr just clears). text
+    // is the node's dialogue text, which may be stored apart from the node.
+    void enterNode(int nodeIndex, const DialogueNode* node, const std::string& text);
+    void clear();
+
+    // The host finished (or skipped) the text reveal
+    void completeText();
+
+    // Run tasks due up to target time. Returns true when it stopped early on
+    // an event the engine must act on (AutoAdvance, ChoiceTimeout); the
+    // event is events().back() and the clock is at its time. Call again
+    // after acting to continue towards target.
+    bool runUntil(int64_t target);
+
+    int64_t getTime() const { return now; }
+    // Time until the pending choice timeout, or -1
+    int64_t getChoiceTimeRemaining() const;
+
+    void clearEvents() { fired.clear(); }
+    const std::vector<TimelineEvent>& events() const { return fired; }
+
+private:
+    enum class TaskKind {
+        Text,
+        SoundEffect,
+        ChoiceTimer
+    };
+
+    // Text task states
+    static const int kTextRevealing = 0;      // typewriter running
+    static const int kTextWaitAuto = 1;       // revealed, auto mode off
+    static const int kTextReading = 2;        // auto mode reading time
+    static const int kTextRevealingOnly = 3;  // typewriter, no auto advance
+
+    struct Task {
+        TaskKind kind;
+        int state;          // resume point
+        int nodeIndex;
+        int64_t wakeAt;
+        int32_t value;      // text length in characters / choice index
+    };
+
+    int64_t now;
+    int64_t textCharMicros;
+    int64_t autoBaseMicros;
+    int64_t autoCharMicros;
+    bool autoMode;
+    std::vector<Task> tasks;
+    std::vector<TimelineEvent> fired;
+
+    bool resume(Task& task);
+    void emit(TimelineEventType type, int nodeIndex, int32_t value);
+};
+
+} // namespace avg
+
+#endif // TIMELINE_H
@@ -1,17 +1,90 @@
 #include "wasm_exports.h"
 #include "../core/avg_engine.h"
+#include "../utils/string_utils.h"
+#include "../utils/trace.h"
 #include <cstring>
 #include <cstdlib>
 
+#ifdef AVG_WASM_BENCHMARK
+#include <malloc.h>
+#include <new>
+#endif
+
 using namespace avg;
 
 // Global engine instance
 static AVGEngine* g_engine = nullptr;
 
-// Global audio callbacks
-static AudioPlayBGMCallback g_audio_play_bgm = nullptr;
-static AudioPlaySECallback g_audio_play_se = nullptr;
-static AudioStopBGMCallback g_audio_stop_bgm = nullptr;
+#ifdef AVG_WASM_BENCHMARK
+// Live operator new bytes and their high-water mark, so the runner can report
+// the real peak of an operation rather than what is left allocated after it.
+// Sizes come from malloc_usable_size, so no header is needed and aligned
+// blocks from aligned_alloc are counted the same way.
+static size_t g_heapLive = 0;
+static size_t g_heapPeak = 0;
+
+static void* trackedAlloc(size_t size, size_t alignment = 0) {
+    if (size == 0) {
+        size = 1;
+    }
+    void* ptr = alignment > alignof(std::max_align_t)
+        ? aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+        : malloc(size);
+    if (ptr) {
+        g_heapLive += malloc_usable_size(ptr);
+        if (g_heapLive > g_heapPeak) {
+            g_heapPeak = g_heapLive;
+        }
+    }
+    return ptr;
+}
+
+static void* trackedNew(size_t size, size_t alignment = 0) {
+    void* ptr = trackedAlloc(size, alignment);
+    if (!ptr) {
+        // Built without exceptions, so there is no bad_alloc to throw
+        abort();
+    }
+    return ptr;
+}
+
+static void trackedFree(void* ptr) {
+    if (ptr) {
+        g_heapLive -= malloc_usable_size(ptr);
+        free(ptr);
+    }
+}
+
+static size_t alignmentOf(std::align_val_t alignment) {
+    return static_cast<size_t>(alignment);
+}
+
+void* operator new(size_t size) { return trackedNew(size); }
+void* operator new[](size_t size) { return trackedNew(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return trackedAlloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return trackedAlloc(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return trackedNew(size, alignmentOf(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return trackedNew(size, alignmentOf(alignment)); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return trackedAlloc(size, alignmentOf(alignment));
+}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return trackedAlloc(size, alignmentOf(alignment));
+}
+
+void operator delete(void* ptr) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, size_t) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { trackedFree(ptr); }
+#endif
 
 // Helper to allocate and copy string
 static char* allocateString(const std::string& str) {
@@ -52,6 +125,292 @@ int avg_load_script(const char* jsonData) {
     return g_engine->loadScript(jsonData) ? 1 : 0;
 }
 
+int avg_load_script_begin(const char* jsonData) {
+    if (!g_engine || !jsonData) {
+        return 0;
+    }
+
+    return g_engine->beginLoadScript(jsonData, false) ? 1 : 0;
+}
+
+int avg_load_script_begin_async(const char* jsonData) {
+#if AVG_HAS_THREADS
+    if (!g_engine || !jsonData) {
+        return 0;
+    }
+
+    return g_engine->beginLoadScript(jsonData, true) ? 1 : 0;
+#else
+    (void)jsonData;
+    return 0;
+#endif
+}
+
+int avg_load_script_step(int budgetMicros) {
+    if (!g_engine) {
+        return -1;
+    }
+
+    switch (g_engine->stepLoadScript(budgetMicros)) {
+        case ScriptLoader::Status::Done: return 1;
+        case ScriptLoader::Status::Running: return 0;
+        default: return -1;
+    }
+}
+
+double avg_load_script_progress() {
+    if (!g_engine) {
+        return 0.0;
+    }
+
+    return static_cast<double>(g_engine->getLoadProgress());
+}
+
+// 64-bit hashes don't fit a JS number, so they cross as hex strings
+static std::string hashToHex(uint64_t hash) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; i--) {
+        hex[i] = digits[hash & 0xf];
+        hash >>= 4;
+    }
+    return hex;
+}
+
+const char* avg_hash_script(const char* jsonData) {
+    if (!jsonData) {
+        return nullptr;
+    }
+
+    static std::string hash;
+    hash = hashToHex(AVGEngine::hashScript(jsonData));
+    return hash.c_str();
+}
+
+const char* avg_get_script_hash() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    static std::string hash;
+    hash = hashToHex(g_engine->getScriptHash());
+    return hash.c_str();
+}
+
+// Blob stays valid until the next avg_export_compiled call
+static std::vector<uint8_t> g_compiled_blob;
+
+const unsigned char* avg_export_compiled() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    g_engine->exportCompiled(g_compiled_blob);
+    return g_compiled_blob.data();
+}
+
+int avg_export_compiled_size() {
+    return static_cast<int>(g_compiled_blob.size());
+}
+
+int avg_import_compiled(const unsigned char* data, int size) {
+    if (!g_engine || !data || size <= 0) {
+        return 0;
+    }
+
+    return g_engine->importCompiled(data, static_cast<size_t>(size)) ? 1 : 0;
+}
+
+int avg_link_script(const char* nameSpace, const char* jsonData) {
+    if (!g_engine || !nameSpace || !jsonData) {
+        return 0;
+    }
+
+    return g_engine->linkScript(nameSpace, jsonData) ? 1 : 0;
+}
+
+int avg_link_script_begin(const char* nameSpace, const char* jsonData, int useWorker) {
+    if (!g_engine || !nameSpace || !jsonData) {
+        return 0;
+    }
+
+    return g_engine->beginLinkScript(nameSpace, jsonData, useWorker != 0) ? 1 : 0;
+}
+
+const char* avg_get_unresolved_links() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    static std::string links;
+    links = "[";
+    bool first = true;
+    for (const auto& ref : g_engine->getUnresolvedLinks()) {
+        if (!first) links += ",";
+        links += '"';
+        string_utils::appendJsonEscaped(links, ref);
+        links += '"';
+        first = false;
+    }
+    links += "]";
+    return links.c_str();
+}
+
+int avg_reload_script(const char* jsonData) {
+    if (!g_engine || !jsonData) {
+        return 0;
+    }
+
+    return g_engine->reloadScript(jsonData) ? 1 : 0;
+}
+
+int avg_reload_linked_script(const char* nameSpace, const char* jsonData) {
+    if (!g_engine || !nameSpace || !jsonData) {
+        return 0;
+    }
+
+    return g_engine->reloadScript(jsonData, nameSpace) ? 1 : 0;
+}
+
+const char* avg_get_reload_stats() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    const ScriptLoader::ReloadStats& stats = g_engine->getReloadStats();
+    static std::string result;
+    result = "{\"added\":" + std::to_string(stats.added) +
+             ",\"changed\":" + std::to_string(stats.changed) +
+             ",\"unchanged\":" + std::to_string(stats.unchanged) +
+             ",\"removed\":" + std::to_string(stats.removed) + "}";
+    return result.c_str();
+}
+
+int avg_register_modules(const char* manifestJson) {
+    if (!g_engine || !manifestJson) {
+        return 0;
+    }
+
+    return g_engine->registerModules(manifestJson) ? 1 : 0;
+}
+
+int avg_load_module(const char* moduleId, const char* jsonData) {
+    if (!g_engine || !moduleId || !jsonData) {
+        return 0;
+    }
+
+    return g_engine->loadModule(moduleId, jsonData) ? 1 : 0;
+}
+
+int avg_unload_module(const char* moduleId) {
+    if (!g_engine || !moduleId) {
+        return 0;
+    }
+
+    return g_engine->unloadModule(moduleId) ? 1 : 0;
+}
+
+int avg_is_module_loaded(const char* moduleId) {
+    if (!g_engine || !moduleId) {
+        return 0;
+    }
+
+    return g_engine->isModuleLoaded(moduleId) ? 1 : 0;
+}
+
+const char* avg_get_pending_module() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    static std::string moduleId;
+    moduleId = g_engine->getPendingModule();
+    return moduleId.c_str();
+}
+
+const char* avg_next_prefetch_module() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    static std::string moduleId;
+    moduleId = g_engine->popPrefetchModule();
+    return moduleId.c_str();
+}
+
+void avg_set_module_budget(int bytes) {
+    if (!g_engine) {
+        return;
+    }
+
+    g_engine->setModuleMemoryBudget(bytes > 0 ? static_cast<size_t>(bytes) : 0);
+}
+
+void avg_set_module_prefetch_depth(int depth) {
+    if (!g_engine) {
+        return;
+    }
+
+    g_engine->setModulePrefetchDepth(depth);
+}
+
+int avg_get_module_resident_bytes() {
+    if (!g_engine) {
+        return 0;
+    }
+
+    return static_cast<int>(g_engine->getModuleResidentBytes());
+}
+
+void avg_set_text_compression(int enabled) {
+    if (!g_engine) {
+        return;
+    }
+
+    g_engine->setTextCompression(enabled != 0);
+}
+
+const char* avg_get_text_stats() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    TextStore::Stats stats = g_engine->getGameState().getTextStats();
+    static std::string result;
+    result = "{\"enabled\":" + std::string(g_engine->isTextCompressed() ? "true" : "false") +
+             ",\"textBytes\":" + std::to_string(stats.textBytes) +
+             ",\"compressedBytes\":" + std::to_string(stats.compressedBytes) +
+             ",\"dictionaryBytes\":" + std::to_string(stats.dictionaryBytes) +
+             ",\"blocks\":" + std::to_string(stats.blocks) + "}";
+    return result.c_str();
+}
+
+int avg_load_locale(const char* jsonData) {
+    if (!g_engine || !jsonData) {
+        return 0;
+    }
+
+    return g_engine->loadLocale(jsonData) ? 1 : 0;
+}
+
+void avg_unload_locale() {
+    if (!g_engine) {
+        return;
+    }
+
+    g_engine->unloadLocale();
+}
+
+const char* avg_get_locale() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    static std::string result;
+    result = g_engine->getLocale();
+    return result.c_str();
+}
+
 int avg_goto_node(const char* nodeId) {
     if (!g_engine || !nodeId) {
         return 0;
@@ -73,28 +432,289 @@ int avg_go_back() {
         return 0;
     }
 
-    return g_engine->goBack() ? 1 : 0;
+    return g_engine->goBack() ? 1 : 0;
+}
+
+int avg_can_go_back() {
+    if (!g_engine) {
+        return 0;
+    }
+
+    return g_engine->canGoBack() ? 1 : 0;
+}
+
+static_assert(sizeof(TimelineEvent) == 3 * sizeof(int), "timeline events cross as int triples");
+
+// Ring header followed by the events; see SceneEventQueue
+const void* avg_get_scene_events() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    return g_engine->getSceneEvents().ring();
+}
+
+const char* avg_get_asset_name(int assetId) {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    return g_engine->getSceneEvents().getAssetName(assetId).c_str();
+}
+
+// Reading the scene clears its dirty layers
+const char* avg_get_scene_state() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    GameState& state = g_engine->getGameState();
+    const SceneState& scene = state.getScene();
+    // Asset names come from the script, so they are escaped
+    static std::string result;
+    result = "{\"generation\":" + std::to_string(state.getSceneGeneration()) +
+             ",\"dirty\":" + std::to_string(state.takeSceneDirty()) + ",\"background\":\"";
+    string_utils::appendJsonEscaped(result, scene.background);
+    result += "\",\"bgm\":\"";
+    string_utils::appendJsonEscaped(result, scene.bgm);
+    result += "\",\"characters\":[";
+    for (int slot = 0; slot < SceneState::kCharacterSlots; slot++) {
+        if (slot > 0) result += ",";
+        result += "{\"name\":\"";
+        string_utils::appendJsonEscaped(result, scene.characters[slot].character);
+        result += "\",\"expression\":\"";
+        string_utils::appendJsonEscaped(result, scene.characters[slot].expression);
+        result += "\"}";
+    }
+    result += "]}";
+    return result.c_str();
+}
+
+int avg_backlog_size() {
+    if (!g_engine) {
+        return 0;
+    }
+
+    return static_cast<int>(g_engine->getBacklog().size());
+}
+
+int avg_backlog_page(int offset, int count, void* buffer, int bufferBytes) {
+    if (!g_engine || !buffer || offset < 0 || count < 0 || bufferBytes <= 0) {
+        return 0;
+    }
+
+    return static_cast<int>(g_engine->getBacklog().page(static_cast<size_t>(offset), static_cast<size_t>(count),
+                                                        static_cast<uint8_t*>(buffer),
+                                                        static_cast<size_t>(bufferBytes)));
+}
+
+const char* avg_backlog_speaker(int speakerId) {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    return g_engine->getBacklog().getSpeakerName(speakerId).c_str();
+}
+
+static std::vector<SearchHit> g_search_hits;
+static std::vector<int32_t> g_search_results;
+
+void avg_set_search_indexing(int enabled) {
+    if (!g_engine) {
+        return;
+    }
+
+    g_engine->setSearchIndexing(enabled != 0);
+}
+
+int avg_search(const char* query, int maxResults) {
+    g_search_results.clear();
+    if (!g_engine || !query) {
+        return 0;
+    }
+
+    g_engine->search(query, maxResults > 0 ? static_cast<size_t>(maxResults) : 0, g_search_hits);
+    g_search_results.reserve(g_search_hits.size() * 2);
+    for (const auto& hit : g_search_hits) {
+        g_search_results.push_back(hit.nodeIndex);
+        g_search_results.push_back(static_cast<int32_t>(hit.position));
+    }
+    return static_cast<int>(g_search_hits.size());
+}
+
+const int* avg_get_search_results() {
+    return g_search_results.data();
+}
+
+const char* avg_get_node_id(int index) {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    const DialogueNode* node = g_engine->getGameState().getNodeByIndex(index);
+    return node ? node->id.c_str() : nullptr;
+}
+
+// Events stay valid until the next avg_tick call
+int avg_tick(int deltaMicros) {
+    if (!g_engine) {
+        return 0;
+    }
+
+    return static_cast<int>(g_engine->tick(deltaMicros).size());
+}
+
+const int* avg_get_tick_events() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    return reinterpret_cast<const int*>(g_engine->getTickEvents().data());
+}
+
+void avg_set_auto_mode(int enabled) {
+    if (!g_engine) {
+        return;
+    }
+
+    g_engine->setAutoMode(enabled != 0);
+}
+
+int avg_get_auto_mode() {
+    if (!g_engine) {
+        return 0;
+    }
+
+    return g_engine->isAutoMode() ? 1 : 0;
+}
+
+void avg_set_text_speed(int charMicros) {
+    if (!g_engine) {
+        return;
+    }
+
+    g_engine->setTextSpeed(charMicros);
+}
+
+void avg_set_auto_delay(int baseMicros, int charMicros) {
+    if (!g_engine) {
+        return;
+    }
+
+    g_engine->setAutoDelay(baseMicros, charMicros);
+}
+
+void avg_complete_text() {
+    if (!g_engine) {
+        return;
+    }
+
+    g_engine->completeText();
+}
+
+int avg_get_choice_time_remaining() {
+    if (!g_engine) {
+        return -1;
+    }
+
+    return static_cast<int>(g_engine->getChoiceTimeRemaining());
+}
+
+const char* avg_get_current_node_id() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    static std::string nodeId;
+    nodeId = g_engine->getCurrentNodeId();
+    return nodeId.c_str();
+}
+
+const char* avg_get_node_type() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    const DialogueNode* node = g_engine->getCurrentNode();
+    if (!node) {
+        return nullptr;
+    }
+
+    switch (node->type) {
+        case NodeType::DIALOGUE: return "dialogue";
+        case NodeType::CHOICE: return "choice";
+        case NodeType::SCENE: return "scene";
+        case NodeType::END: return "end";
+        default: return "unknown";
+    }
+}
+
+const char* avg_get_speaker() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    const DialogueNode* node = g_engine->getCurrentNode();
+    if (!node) {
+        return nullptr;
+    }
+
+    return node->speaker.c_str();
+}
+
+const char* avg_get_text() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    if (!g_engine->getCurrentNode()) {
+        return nullptr;
+    }
+
+    // The text may be decoded from a compressed block
+    static std::string text;
+    text = g_engine->getCurrentText();
+    return text.c_str();
+}
+
+static_assert(sizeof(TextSpan) == 5 * sizeof(uint32_t), "text spans cross as five 32-bit words");
+
+const void* avg_get_text_spans() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    const DialogueNode* node = g_engine->getCurrentNode();
+    if (!node || node->textSpans.empty()) {
+        return nullptr;
+    }
+
+    return node->textSpans.data();
 }
 
-int avg_can_go_back() {
+int avg_get_text_span_count() {
     if (!g_engine) {
         return 0;
     }
 
-    return g_engine->canGoBack() ? 1 : 0;
+    const DialogueNode* node = g_engine->getCurrentNode();
+    return node ? static_cast<int>(node->textSpans.size()) : 0;
 }
 
-const char* avg_get_current_node_id() {
+const char* avg_get_span_string(int offset) {
     if (!g_engine) {
         return nullptr;
     }
 
-    static std::string nodeId;
-    nodeId = g_engine->getCurrentNodeId();
-    return nodeId.c_str();
+    const DialogueNode* node = g_engine->getCurrentNode();
+    if (!node || offset < 0 || offset >= static_cast<int>(node->spanStrings.size())) {
+        return nullptr;
+    }
+
+    return node->spanStrings.c_str() + offset;
 }
 
-const char* avg_get_node_type() {
+const char* avg_get_next_node_id() {
     if (!g_engine) {
         return nullptr;
     }
@@ -104,68 +724,63 @@ const char* avg_get_node_type() {
         return nullptr;
     }
 
-    switch (node->type) {
-        case NodeType::DIALOGUE: return "dialogue";
-        case NodeType::CHOICE: return "choice";
-        case NodeType::SCENE: return "scene";
-        case NodeType::END: return "end";
-        default: return "unknown";
-    }
+    return node->nextNodeId.c_str();
 }
 
-const char* avg_get_speaker() {
+int avg_get_choice_count() {
     if (!g_engine) {
-        return nullptr;
+        return 0;
     }
 
     const DialogueNode* node = g_engine->getCurrentNode();
     if (!node) {
-        return nullptr;
+        return 0;
     }
 
-    return node->speaker.c_str();
+    return static_cast<int>(node->choices.size());
 }
 
-const char* avg_get_text() {
+const char* avg_get_choice_text(int index) {
     if (!g_engine) {
         return nullptr;
     }
 
     const DialogueNode* node = g_engine->getCurrentNode();
-    if (!node) {
+    if (!node || index < 0 || index >= static_cast<int>(node->choices.size())) {
         return nullptr;
     }
 
-    return node->text.c_str();
+    return node->choices[index].text.c_str();
 }
 
-const char* avg_get_next_node_id() {
+const void* avg_get_choice_spans(int index) {
     if (!g_engine) {
         return nullptr;
     }
 
     const DialogueNode* node = g_engine->getCurrentNode();
-    if (!node) {
+    if (!node || index < 0 || index >= static_cast<int>(node->choices.size()) ||
+        node->choices[index].textSpans.empty()) {
         return nullptr;
     }
 
-    return node->nextNodeId.c_str();
+    return node->choices[index].textSpans.data();
 }
 
-int avg_get_choice_count() {
+int avg_get_choice_span_count(int index) {
     if (!g_engine) {
         return 0;
     }
 
     const DialogueNode* node = g_engine->getCurrentNode();
-    if (!node) {
+    if (!node || index < 0 || index >= static_cast<int>(node->choices.size())) {
         return 0;
     }
 
-    return static_cast<int>(node->choices.size());
+    return static_cast<int>(node->choices[index].textSpans.size());
 }
 
-const char* avg_get_choice_text(int index) {
+const char* avg_get_choice_span_string(int index, int offset) {
     if (!g_engine) {
         return nullptr;
     }
@@ -175,7 +790,12 @@ const char* avg_get_choice_text(int index) {
         return nullptr;
     }
 
-    return node->choices[index].text.c_str();
+    const std::string& strings = node->choices[index].spanStrings;
+    if (offset < 0 || offset >= static_cast<int>(strings.size())) {
+        return nullptr;
+    }
+
+    return strings.c_str() + offset;
 }
 
 const char* avg_get_choice_next(int index) {
@@ -191,6 +811,17 @@ const char* avg_get_choice_next(int index) {
     return node->choices[index].nextNodeId.c_str();
 }
 
+static std::vector<uint8_t> g_choice_visibility;
+
+const void* avg_get_choice_visibility() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    g_engine->getChoiceVisibility(g_choice_visibility);
+    return g_choice_visibility.data();
+}
+
 const char* avg_get_background() {
     if (!g_engine) {
         return nullptr;
@@ -272,6 +903,86 @@ int avg_get_variable(const char* name) {
     return g_engine->getVariable(name);
 }
 
+int avg_get_flag_index(const char* name) {
+    if (!g_engine || !name) {
+        return -1;
+    }
+
+    return g_engine->getGameState().getFlags().find(name);
+}
+
+int avg_get_flag(int index) {
+    if (!g_engine) {
+        return 0;
+    }
+
+    return g_engine->getGameState().getFlags().test(index) ? 1 : 0;
+}
+
+void avg_set_flag(int index, int value) {
+    if (!g_engine) {
+        return;
+    }
+
+    g_engine->getGameState().getFlags().set(index, value != 0);
+}
+
+int avg_get_flag_group(const char* name) {
+    if (!g_engine || !name) {
+        return -1;
+    }
+
+    return g_engine->getGameState().getFlags().findGroup(name);
+}
+
+int avg_flag_group_any(int group) {
+    if (!g_engine) {
+        return 0;
+    }
+
+    return g_engine->getGameState().getFlags().any(group) ? 1 : 0;
+}
+
+int avg_flag_group_all(int group) {
+    if (!g_engine) {
+        return 0;
+    }
+
+    return g_engine->getGameState().getFlags().all(group) ? 1 : 0;
+}
+
+int avg_flag_group_count(int group) {
+    if (!g_engine) {
+        return 0;
+    }
+
+    return g_engine->getGameState().getFlags().count(group);
+}
+
+void avg_set_flag_group(int group, int value) {
+    if (!g_engine) {
+        return;
+    }
+
+    g_engine->getGameState().getFlags().setGroup(group, value != 0);
+}
+
+int avg_get_flag_count() {
+    if (!g_engine) {
+        return 0;
+    }
+
+    return static_cast<int>(g_engine->getGameState().getFlags().size());
+}
+
+const void* avg_get_flag_words() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    return g_engine->getGameState().getFlags().getWords();
+}
+
 const char* avg_save_state() {
     if (!g_engine) {
         return nullptr;
@@ -290,51 +1001,241 @@ int avg_load_state(const char* saveData) {
     return g_engine->loadState(saveData) ? 1 : 0;
 }
 
-void avg_reset() {
+int avg_snapshot_take(int slot) {
+    if (!g_engine) {
+        return 0;
+    }
+
+    return g_engine->takeSnapshot(slot) ? 1 : 0;
+}
+
+int avg_snapshot_restore(int slot) {
+    if (!g_engine) {
+        return 0;
+    }
+
+    return g_engine->restoreSnapshot(slot) ? 1 : 0;
+}
+
+int avg_snapshot_has(int slot) {
+    if (!g_engine) {
+        return 0;
+    }
+
+    return g_engine->hasSnapshot(slot) ? 1 : 0;
+}
+
+const char* avg_snapshot_save(int slot) {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    static std::string saveData;
+    saveData = g_engine->saveSnapshot(slot);
+    return saveData.c_str();
+}
+
+void avg_snapshot_clear(int slot) {
     if (!g_engine) {
         return;
     }
 
-    g_engine->reset();
+    g_engine->clearSnapshot(slot);
 }
 
-void avg_free_string(char* str) {
-    if (str) {
-        free(str);
+int avg_is_node_read(const char* nodeId) {
+    if (!g_engine || !nodeId) {
+        return 0;
+    }
+
+    return g_engine->isNodeRead(nodeId) ? 1 : 0;
+}
+
+int avg_is_current_node_read() {
+    if (!g_engine) {
+        return 0;
+    }
+
+    return g_engine->isCurrentNodeRead() ? 1 : 0;
+}
+
+int avg_get_node_count() {
+    if (!g_engine) {
+        return 0;
+    }
+
+    return g_engine->getGameState().getNodeCount();
+}
+
+int avg_get_read_count() {
+    if (!g_engine) {
+        return 0;
+    }
+
+    return g_engine->getReadCount();
+}
+
+int avg_get_chapter_node_count(const char* chapter) {
+    if (!g_engine || !chapter) {
+        return 0;
+    }
+
+    return g_engine->getChapterNodeCount(chapter);
+}
+
+int avg_get_chapter_read_count(const char* chapter) {
+    if (!g_engine || !chapter) {
+        return 0;
     }
+
+    return g_engine->getChapterReadCount(chapter);
 }
 
-void avg_set_audio_play_bgm_callback(AudioPlayBGMCallback callback) {
-    g_audio_play_bgm = callback;
+const char* avg_save_read_state() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    static std::string readData;
+    readData = g_engine->saveReadState();
+    return readData.c_str();
 }
 
-void avg_set_audio_play_se_callback(AudioPlaySECallback callback) {
-    g_audio_play_se = callback;
+int avg_load_read_state(const char* readData) {
+    if (!g_engine || !readData) {
+        return 0;
+    }
+
+    return g_engine->loadReadState(readData) ? 1 : 0;
 }
 
-void avg_set_audio_stop_bgm_callback(AudioStopBGMCallback callback) {
-    g_audio_stop_bgm = callback;
+void avg_clear_read_state() {
+    if (!g_engine) {
+        return;
+    }
+
+    g_engine->clearReadState();
 }
 
-void avg_trigger_audio_from_node() {
+void avg_analytics_enable(int enabled) {
     if (!g_engine) {
         return;
     }
 
-    const DialogueNode* node = g_engine->getCurrentNode();
-    if (!node) {
+    g_engine->setAnalyticsEnabled(enabled != 0);
+}
+
+void avg_analytics_set_time(double micros) {
+    if (!g_engine || micros < 0) {
+        return;
+    }
+
+    g_engine->setAnalyticsTime(static_cast<uint64_t>(micros));
+}
+
+// Blob stays valid until the next avg_analytics_export call
+static std::vector<uint8_t> g_analytics_blob;
+
+const unsigned char* avg_analytics_export() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    g_analytics_blob = g_engine->getAnalytics().exportBlob();
+    return g_analytics_blob.data();
+}
+
+int avg_analytics_export_size() {
+    return static_cast<int>(g_analytics_blob.size());
+}
+
+void avg_analytics_reset() {
+    if (!g_engine) {
+        return;
+    }
+
+    g_engine->getAnalytics().reset();
+}
+
+int avg_get_node_visit_count(const char* nodeId) {
+    if (!g_engine || !nodeId) {
+        return 0;
+    }
+
+    int index = g_engine->getGameState().getNodeIndex(nodeId);
+    return static_cast<int>(g_engine->getAnalytics().getVisitCount(index));
+}
+
+void avg_session_record(int enabled) {
+    if (!g_engine) {
+        return;
+    }
+
+    g_engine->setSessionRecording(enabled != 0);
+}
+
+void avg_session_set_time(double micros) {
+    if (!g_engine || micros < 0) {
         return;
     }
 
-    // Trigger BGM playback if BGM is set
-    if (!node->bgm.empty() && g_audio_play_bgm) {
-        g_audio_play_bgm(node->bgm.c_str(), 1); // 1 = loop enabled
+    g_engine->setSessionTime(static_cast<uint64_t>(micros));
+}
+
+const unsigned char* avg_session_log() {
+    if (!g_engine) {
+        return nullptr;
+    }
+
+    return g_engine->getSessionLog().data();
+}
+
+int avg_session_log_size() {
+    if (!g_engine) {
+        return 0;
+    }
+
+    return static_cast<int>(g_engine->getSessionLog().size());
+}
+
+const char* avg_dump_trace() {
+    static std::string traceData;
+    traceData = avg::trace::dumpJson();
+    return traceData.c_str();
+}
+
+void avg_clear_trace() {
+    avg::trace::clear();
+}
+
+void avg_reset() {
+    if (!g_engine) {
+        return;
     }
 
-    // Trigger sound effect playback if SE is set
-    if (!node->soundEffect.empty() && g_audio_play_se) {
-        g_audio_play_se(node->soundEffect.c_str());
+    g_engine->reset();
+}
+
+void avg_free_string(char* str) {
+    if (str) {
+        free(str);
     }
 }
 
+#ifdef AVG_WASM_BENCHMARK
+int avg_get_heap_used() {
+    struct mallinfo info = mallinfo();
+    return static_cast<int>(info.uordblks);
+}
+
+int avg_get_heap_peak() {
+    return static_cast<int>(g_heapPeak);
+}
+
+int avg_reset_heap_peak() {
+    g_heapPeak = g_heapLive;
+    return static_cast<int>(g_heapLive);
+}
+#endif
+
 } // extern "C"
@@ -19,21 +19,99 @@ WASM_EXPORT void avg_shutdown();
 // Script loading
 WASM_EXPORT int avg_load_script(const char* jsonData);
 
+// Incremental script loading
+// avg_load_script_step returns 1 when done, 0 while still loading, -1 on failure.
+// avg_load_script_begin_async returns 0 if the build has no thread support.
+WASM_EXPORT int avg_load_script_begin(const char* jsonData);
+WASM_EXPORT int avg_load_script_begin_async(const char* jsonData);
+WASM_EXPORT int avg_load_script_step(int budgetMicros);
+WASM_EXPORT double avg_load_script_progress();
+
+// Compiled script cache (hashes are 16 hex digits)
+WASM_EXPORT const char* avg_hash_script(const char* jsonData);
+WASM_EXPORT const char* avg_get_script_hash();
+WASM_EXPORT const unsigned char* avg_export_compiled();
+WASM_EXPORT int avg_export_compiled_size();
+WASM_EXPORT int avg_import_compiled(const unsigned char* data, int size);
+
+// Multi-file linking (namespaced ids, existing nodes never replaced).
+// avg_link_script_begin is advanced with avg_load_script_step.
+WASM_EXPORT int avg_link_script(const char* nameSpace, const char* jsonData);
+WASM_EXPORT int avg_link_script_begin(const char* nameSpace, const char* jsonData, int useWorker);
+// JSON array of references that do not name any node yet
+WASM_EXPORT const char* avg_get_unresolved_links();
+
+// Hot reload (keeps current node, variables and history)
+WASM_EXPORT int avg_reload_script(const char* jsonData);
+WASM_EXPORT int avg_reload_linked_script(const char* nameSpace, const char* jsonData);
+// {"added":n,"changed":n,"unchanged":n,"removed":n} for the last reload
+WASM_EXPORT const char* avg_get_reload_stats();
+
+// Script modules (chapters loaded on demand)
+WASM_EXPORT int avg_register_modules(const char* manifestJson);
+WASM_EXPORT int avg_load_module(const char* moduleId, const char* jsonData);
+WASM_EXPORT int avg_unload_module(const char* moduleId);
+WASM_EXPORT int avg_is_module_loaded(const char* moduleId);
+WASM_EXPORT const char* avg_get_pending_module();
+WASM_EXPORT const char* avg_next_prefetch_module();
+WASM_EXPORT void avg_set_module_budget(int bytes);
+WASM_EXPORT void avg_set_module_prefetch_depth(int depth);
+WASM_EXPORT int avg_get_module_resident_bytes();
+
+// Compressed dialogue text (off by default)
+WASM_EXPORT void avg_set_text_compression(int enabled);
+// {"enabled","textBytes","compressedBytes","dictionaryBytes","blocks"}
+WASM_EXPORT const char* avg_get_text_stats();
+
+// Localised string tables; loading one replaces the active locale
+WASM_EXPORT int avg_load_locale(const char* jsonData);
+WASM_EXPORT void avg_unload_locale();
+WASM_EXPORT const char* avg_get_locale();
+
 // Navigation
 WASM_EXPORT int avg_goto_node(const char* nodeId);
 WASM_EXPORT int avg_select_choice(int choiceIndex);
 WASM_EXPORT int avg_go_back();
 WASM_EXPORT int avg_can_go_back();
 
+// Timeline (auto mode, delayed sound effects, timed choices). avg_tick
+// advances it by deltaMicros and returns the number of fired events; they
+// are read from avg_get_tick_events() as int32 triples (type, node index,
+// value), valid until the next tick. Types: 1 text revealed, 2 auto
+// advance, 3 sound effect, 4 choice timeout (value = choice taken).
+WASM_EXPORT int avg_tick(int deltaMicros);
+WASM_EXPORT const int* avg_get_tick_events();
+WASM_EXPORT void avg_set_auto_mode(int enabled);
+WASM_EXPORT int avg_get_auto_mode();
+WASM_EXPORT void avg_set_text_speed(int charMicros);
+WASM_EXPORT void avg_set_auto_delay(int baseMicros, int charMicros);
+WASM_EXPORT void avg_complete_text();
+// Microseconds left on the current timed choice, or -1
+WASM_EXPORT int avg_get_choice_time_remaining();
+
 // Current node access
 WASM_EXPORT const char* avg_get_current_node_id();
 WASM_EXPORT const char* avg_get_node_type();
 WASM_EXPORT const char* avg_get_speaker();
 WASM_EXPORT const char* avg_get_text();
+// Markup spans of the current node's text (see text_markup.h): count records
+// of five 32-bit words (type | style << 16, start, length, color, value).
+// Null when the text has no markup.
+WASM_EXPORT const void* avg_get_text_spans();
+WASM_EXPORT int avg_get_text_span_count();
+// Ruby annotation or variable name at a span's string offset
+WASM_EXPORT const char* avg_get_span_string(int offset);
 WASM_EXPORT const char* avg_get_next_node_id();
 WASM_EXPORT int avg_get_choice_count();
 WASM_EXPORT const char* avg_get_choice_text(int index);
+// Markup spans of a choice's text, laid out as for avg_get_text_spans
+WASM_EXPORT const void* avg_get_choice_spans(int index);
+WASM_EXPORT int avg_get_choice_span_count(int index);
+WASM_EXPORT const char* avg_get_choice_span_string(int index, int offset);
 WASM_EXPORT const char* avg_get_choice_next(int index);
+// Visibility of the current node's choices from their "if" conditions, one
+// byte each (avg_get_choice_count of them), evaluated in one call
+WASM_EXPORT const void* avg_get_choice_visibility();
 
 // Scene data
 WASM_EXPORT const char* avg_get_background();
@@ -42,29 +120,112 @@ WASM_EXPORT const char* avg_get_expression();
 WASM_EXPORT const char* avg_get_bgm();
 WASM_EXPORT const char* avg_get_sound_effect();
 
+// Scene events: single-producer/single-consumer ring in linear memory.
+// Header words: head, tail, capacity, dropped; then capacity events of four
+// 32-bit words (type | slot << 16, node index, asset id, detail). The host
+// reads [tail, head) once per frame and writes the new tail back. Types:
+// 1 BGM change, 2 BGM stop, 3 sound effect, 4 background (asset -1 clears),
+// 5 character enter, 6 character exit, 7 character expression, 8 choice
+// shown.
+WASM_EXPORT const void* avg_get_scene_events();
+// File name for an asset id in a scene event (ids never change)
+WASM_EXPORT const char* avg_get_asset_name(int assetId);
+// Effective scene as JSON: generation, dirty layer bits (1 background, 2 BGM,
+// 4 << slot characters), background, bgm and per-slot characters. Clears the
+// dirty bits.
+WASM_EXPORT const char* avg_get_scene_state();
+
+// Backlog of lines shown this session. avg_backlog_page writes lines
+// counting back offset from the newest into buffer (layout in backlog.h)
+// and returns the bytes written.
+WASM_EXPORT int avg_backlog_size();
+WASM_EXPORT int avg_backlog_page(int offset, int count, void* buffer, int bufferBytes);
+WASM_EXPORT const char* avg_backlog_speaker(int speakerId);
+
+// Full-text search over dialogue, speakers and choices (indexing is off by
+// default). avg_search returns the hit count; hits are read from
+// avg_get_search_results() as int32 pairs (node index, position), valid
+// until the next search.
+WASM_EXPORT void avg_set_search_indexing(int enabled);
+WASM_EXPORT int avg_search(const char* query, int maxResults);
+WASM_EXPORT const int* avg_get_search_results();
+// Id of a resident node by index, or null
+WASM_EXPORT const char* avg_get_node_id(int index);
+
 // Variables
 WASM_EXPORT void avg_set_variable(const char* name, int value);
 WASM_EXPORT int avg_get_variable(const char* name);
 
+// Story flags declared by the script's "flags" list (the variable calls
+// reach them by name too). Look indices up once; avg_get_flag_words points
+// at the bitset, avg_get_flag_count bits in little-endian 64-bit words.
+WASM_EXPORT int avg_get_flag_index(const char* name);
+WASM_EXPORT int avg_get_flag(int index);
+WASM_EXPORT void avg_set_flag(int index, int value);
+WASM_EXPORT int avg_get_flag_group(const char* name);
+WASM_EXPORT int avg_flag_group_any(int group);
+WASM_EXPORT int avg_flag_group_all(int group);
+WASM_EXPORT int avg_flag_group_count(int group);
+WASM_EXPORT void avg_set_flag_group(int group, int value);
+WASM_EXPORT int avg_get_flag_count();
+WASM_EXPORT const void* avg_get_flag_words();
+
 // Save/Load
 WASM_EXPORT const char* avg_save_state();
 WASM_EXPORT int avg_load_state(const char* saveData);
 
+// In-memory snapshot slots (0-15) for instant quick save/load. Persist a
+// slot later with avg_snapshot_save, which returns avg_save_state JSON.
+WASM_EXPORT int avg_snapshot_take(int slot);
+WASM_EXPORT int avg_snapshot_restore(int slot);
+WASM_EXPORT int avg_snapshot_has(int slot);
+WASM_EXPORT const char* avg_snapshot_save(int slot);
+WASM_EXPORT void avg_snapshot_clear(int slot);
+
+// Read tracking (global, persisted separately from save slots)
+WASM_EXPORT int avg_is_node_read(const char* nodeId);
+WASM_EXPORT int avg_is_current_node_read();
+WASM_EXPORT int avg_get_node_count();
+WASM_EXPORT int avg_get_read_count();
+WASM_EXPORT int avg_get_chapter_node_count(const char* chapter);
+WASM_EXPORT int avg_get_chapter_read_count(const char* chapter);
+WASM_EXPORT const char* avg_save_read_state();
+WASM_EXPORT int avg_load_read_state(const char* readData);
+WASM_EXPORT void avg_clear_read_state();
+
+// Play analytics (per-node visits, choice picks, dwell-time histograms)
+WASM_EXPORT void avg_analytics_enable(int enabled);
+WASM_EXPORT void avg_analytics_set_time(double micros);
+WASM_EXPORT const unsigned char* avg_analytics_export();
+WASM_EXPORT int avg_analytics_export_size();
+WASM_EXPORT void avg_analytics_reset();
+WASM_EXPORT int avg_get_node_visit_count(const char* nodeId);
+
+// Session recording for the native replay tool; the log pointer stays
+// valid until the next recorded call
+WASM_EXPORT void avg_session_record(int enabled);
+WASM_EXPORT void avg_session_set_time(double micros);
+WASM_EXPORT const unsigned char* avg_session_log();
+WASM_EXPORT int avg_session_log_size();
+
+// Tracing (empty trace unless built with AVG_ENABLE_TRACE)
+WASM_EXPORT const char* avg_dump_trace();
+WASM_EXPORT void avg_clear_trace();
+
 // Reset
 WASM_EXPORT void avg_reset();
 
 // Memory management
 WASM_EXPORT void avg_free_string(char* str);
 
-// Audio callbacks
-typedef void (*AudioPlayBGMCallback)(const char* url, int loop);
-typedef void (*AudioPlaySECallback)(const char* url);
-typedef void (*AudioStopBGMCallback)();
-
-WASM_EXPORT void avg_set_audio_play_bgm_callback(AudioPlayBGMCallback callback);
-WASM_EXPORT void avg_set_audio_play_se_callback(AudioPlaySECallback callback);
-WASM_EXPORT void avg_set_audio_stop_bgm_callback(AudioStopBGMCallback callback);
-WASM_EXPORT void avg_trigger_audio_from_node();
+#ifdef AVG_WASM_BENCHMARK
+// Bytes currently allocated from the malloc heap (benchmark builds only)
+WASM_EXPORT int avg_get_heap_used();
+// High-water mark of live operator new bytes since the last reset
+WASM_EXPORT int avg_get_heap_peak();
+// Restarts the high-water mark at the current live bytes and returns them
+WASM_EXPORT int avg_reset_heap_peak();
+#endif
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,65 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace avg {
+namespace hash {
+
+// 64-bit FNV-1a. Not cryptographic; used for node id lookup tables.
+inline uint64_t fnv1a64(const char* data, size_t length, uint64_t seed = 14695981039346656037ULL) {
+    uint64_t h = seed;
+    for (size_t i = 0; i < length; i++) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+inline uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Word-at-a-time hash for large inputs (whole scripts). Several times faster
+// than FNV-1a on long data; same result on every platform.
+inline uint64_t hash64(const void* data, size_t length, uint64_t seed = 0) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const uint64_t k = 0x9e3779b97f4a7c15ULL;
+    uint64_t h = seed ^ (length * k);
+
+    while (length >= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        h = (h ^ mix64(word * k)) * k;
+        h ^= h >> 29;
+        p += 8;
+        length -= 8;
+    }
+
+    uint64_t tail = 0;
+    for (size_t i = 0; i < length; i++) {
+        tail |= static_cast<uint64_t>(p[i]) << (8 * i);
+    }
+    h = (h ^ mix64(tail * k)) * k;
+    return mix64(h);
+}
+
+inline uint64_t hashString(const std::string& str) {
+    return fnv1a64(str.data(), str.size());
+}
+
+} // namespace hash
+} // namespace avg
+
+#endif // HASH_H
@@ -1,4 +1,6 @@
 #include "simple_json.h"
+#include "string_utils.h"
+#include "trace.h"
 #include <cstring>
 #include <cctype>
 
@@ -11,6 +13,8 @@ SimpleJSON::~SimpleJSON() {
 }
 
 bool SimpleJSON::parse(const char* jsonString) {
+    AVG_TRACE_SCOPE("SimpleJSON::parse");
+
     if (!jsonString) {
         return false;
     }
@@ -23,7 +27,8 @@ bool SimpleJSON::parse(const char* jsonString) {
         return false;
     }
 
-    return parseObject(ptr, "");
+    std::string path;
+    return parseObject(ptr, path);
 }
 
 std::string SimpleJSON::getString(const std::string& key) const {
@@ -72,64 +77,69 @@ bool SimpleJSON::getBool(const std::string& key) const {
 
 int SimpleJSON::getArraySize(const std::string& key) const {
     int count = 0;
-    std::string prefix = key + "[";
     for (const auto& pair : data) {
-        if (pair.first.find(prefix) == 0) {
-            // Only count direct array elements, not nested properties
-            std::string suffix = pair.first.substr(prefix.length());
-            // Check if this is a direct element (ends with ] or has ]. after the index)
-            size_t bracketPos = suffix.find(']');
-            if (bracketPos != std::string::npos) {
-                std::string indexStr = suffix.substr(0, bracketPos);
-                // Verify it's a number
-                bool isNumber = !indexStr.empty();
-                for (char c : indexStr) {
-                    if (!std::isdigit(c)) {
-                        isNumber = false;
-                        break;
-                    }
-                }
-                if (isNumber) {
-                    int index = std::stoi(indexStr);
-                    if (index >= count) {
-                        count = index + 1;
-                    }
-                }
+        // Only direct elements count: "<key>[<digits>]", maybe followed by
+        // the path of a nested value
+        std::string_view name = pair.first;
+        if (name.length() <= key.length() || name[key.length()] != '[' ||
+            !string_utils::startsWith(name, key)) {
+            continue;
+        }
+
+        std::string_view index = name.substr(key.length() + 1);
+        size_t bracketPos = index.find(']');
+        if (bracketPos == std::string_view::npos || bracketPos == 0) {
+            continue;
+        }
+        index = index.substr(0, bracketPos);
+
+        int value = 0;
+        bool isNumber = true;
+        for (char c : index) {
+            if (c < '0' || c > '9') {
+                isNumber = false;
+                break;
             }
+            value = value * 10 + (c - '0');
+        }
+        if (isNumber && value >= count) {
+            count = value + 1;
         }
     }
     return count;
 }
 
+bool SimpleJSON::hasKey(const std::string& key) const {
+    return data.find(key) != data.end();
+}
+
 std::vector<std::string> SimpleJSON::getObjectKeys(const std::string& prefix) const {
     std::vector<std::string> keys;
-    std::string searchPrefix = prefix.empty() ? "" : prefix + ".";
+    size_t skip = prefix.empty() ? 0 : prefix.length() + 1;
 
     for (const auto& pair : data) {
-        if (searchPrefix.empty() || pair.first.find(searchPrefix) == 0) {
-            std::string keyPart = pair.first.substr(searchPrefix.length());
-            // Extract just the first key part (before any . or [)
-            size_t dotPos = keyPart.find('.');
-            size_t bracketPos = keyPart.find('[');
-            size_t endPos = std::min(dotPos, bracketPos);
-            if (endPos == std::string::npos) {
-                endPos = keyPart.length();
-            }
-            std::string key = keyPart.substr(0, endPos);
-
-            // Only add if it's a direct child and not already in the list
-            if (!key.empty()) {
-                bool found = false;
-                for (const auto& k : keys) {
-                    if (k == key) {
-                        found = true;
-                        break;
-                    }
-                }
-                if (!found) {
-                    keys.push_back(key);
+        std::string_view name = pair.first;
+        if (!prefix.empty() && (name.length() < skip || name[prefix.length()] != '.' ||
+                                !string_utils::startsWith(name, prefix))) {
+            continue;
+        }
+
+        // Extract just the first key part (before any . or [)
+        std::string_view keyPart = name.substr(skip);
+        std::string_view key = keyPart.substr(0, keyPart.find_first_of(".["));
+
+        // Only add if it's a direct child and not already in the list
+        if (!key.empty()) {
+            bool found = false;
+            for (const auto& k : keys) {
+                if (k == key) {
+                    found = true;
+                    break;
                 }
             }
+            if (!found) {
+                keys.emplace_back(key);
+            }
         }
     }
 
@@ -146,7 +156,7 @@ void SimpleJSON::skipWhitespace(const char*& ptr) {
     }
 }
 
-bool SimpleJSON::parseObject(const char*& ptr, const std::string& prefix) {
+bool SimpleJSON::parseObject(const char*& ptr, std::string& path) {
     if (*ptr != '{') {
         return false;
     }
@@ -154,11 +164,12 @@ bool SimpleJSON::parseObject(const char*& ptr, const std::string& prefix) {
 
     skipWhitespace(ptr);
 
+    const size_t base = path.length();
+    std::string key;
     while (*ptr && *ptr != '}') {
         skipWhitespace(ptr);
 
         // Parse key
-        std::string key;
         if (!parseString(ptr, key)) {
             return false;
         }
@@ -173,15 +184,18 @@ bool SimpleJSON::parseObject(const char*& ptr, const std::string& prefix) {
         skipWhitespace(ptr);
 
         // Build full key path
-        std::string fullKey = prefix.empty() ? key : prefix + "." + key;
+        if (base > 0) {
+            path += '.';
+        }
+        path += key;
 
         // Parse value
         if (*ptr == '{') {
-            if (!parseObject(ptr, fullKey)) {
+            if (!parseObject(ptr, path)) {
                 return false;
             }
         } else if (*ptr == '[') {
-            if (!parseArray(ptr, fullKey)) {
+            if (!parseArray(ptr, path)) {
                 return false;
             }
         } else {
@@ -189,8 +203,9 @@ bool SimpleJSON::parseObject(const char*& ptr, const std::string& prefix) {
             if (!parseValue(ptr, value)) {
                 return false;
             }
-            data[fullKey] = value;
+            data[path] = std::move(value);
         }
+        path.resize(base);
 
         skipWhitespace(ptr);
 
@@ -209,7 +224,7 @@ bool SimpleJSON::parseObject(const char*& ptr, const std::string& prefix) {
     return true;
 }
 
-bool SimpleJSON::parseArray(const char*& ptr, const std::string& prefix) {
+bool SimpleJSON::parseArray(const char*& ptr, std::string& path) {
     if (*ptr != '[') {
         return false;
     }
@@ -217,18 +232,21 @@ bool SimpleJSON::parseArray(const char*& ptr, const std::string& prefix) {
 
     skipWhitespace(ptr);
 
+    const size_t base = path.length();
     int index = 0;
     while (*ptr && *ptr != ']') {
         skipWhitespace(ptr);
 
-        std::string indexKey = prefix + "[" + std::to_string(index) + "]";
+        path += '[';
+        path += std::to_string(index);
+        path += ']';
 
         if (*ptr == '{') {
-            if (!parseObject(ptr, indexKey)) {
+            if (!parseObject(ptr, path)) {
                 return false;
             }
         } else if (*ptr == '[') {
-            if (!parseArray(ptr, indexKey)) {
+            if (!parseArray(ptr, path)) {
                 return false;
             }
         } else {
@@ -236,8 +254,9 @@ bool SimpleJSON::parseArray(const char*& ptr, const std::string& prefix) {
             if (!parseValue(ptr, value)) {
                 return false;
             }
-            data[indexKey] = value;
+            data[path] = std::move(value);
         }
+        path.resize(base);
 
         index++;
         skipWhitespace(ptr);
@@ -289,6 +308,13 @@ bool SimpleJSON::parseString(const char*& ptr, std::string& value) {
 
     value.clear();
     while (*ptr && *ptr != '"') {
+        // Copy the run up to the next quote or escape at once
+        const char* run = ptr;
+        while (*ptr && *ptr != '"' && *ptr != '\\') {
+            ptr++;
+        }
+        value.append(run, static_cast<size_t>(ptr - run));
+
         if (*ptr == '\\') {
             ptr++;
             if (!*ptr) return false;
@@ -304,10 +330,8 @@ bool SimpleJSON::parseString(const char*& ptr, std::string& value) {
                 case 't': value += '\t'; break;
                 default: value += *ptr; break;
             }
-        } else {
-            value += *ptr;
+            ptr++;
         }
-        ptr++;
     }
 
     if (*ptr != '"') {
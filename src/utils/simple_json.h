@@ -20,6 +20,8 @@ public:
     int getInt(const std::string& key) const;
     bool getBool(const std::string& key) const;
     int getArraySize(const std::string& key) const;
+    // True if key holds a value (string, number, bool or null)
+    bool hasKey(const std::string& key) const;
     std::vector<std::string> getObjectKeys(const std::string& prefix) const;
 
     void clear();
@@ -28,8 +30,10 @@ private:
     std::unordered_map<std::string, std::string> data;
 
     void skipWhitespace(const char*& ptr);
-    bool parseObject(const char*& ptr, const std::string& prefix);
-    bool parseArray(const char*& ptr, const std::string& prefix);
+    // path holds the key of the value being parsed; nested keys are
+    // appended to it and removed again, so keys are built without temporaries
+    bool parseObject(const char*& ptr, std::string& path);
+    bool parseArray(const char*& ptr, std::string& path);
     bool parseValue(const char*& ptr, std::string& value);
     bool parseString(const char*& ptr, std::string& value);
     bool parseNumber(const char*& ptr, std::string& value);
@@ -1,47 +1,109 @@
 #include "string_utils.h"
-#include <algorithm>
-#include <cctype>
-#include <sstream>
+#include <cstdint>
+#include <cstring>
 
 namespace avg {
 namespace string_utils {
 
-std::string trim(const std::string& str) {
-    size_t start = 0;
-    size_t end = str.length();
-
-    while (start < end && std::isspace(str[start])) {
-        start++;
+namespace {
+
+// Per-byte lookup tables, built at compile time
+struct CharTables {
+    unsigned char lower[256];
+    unsigned char upper[256];
+    bool space[256];
+    bool unreserved[256];       // URL characters that are copied as they are
+    unsigned char hexValue[256];    // 0 for anything that is not a hex digit
+    signed char base64[256];    // -1 invalid, -2 padding
+    char jsonEscape[256];       // letter after the backslash, 0 if copied as is
+
+    constexpr CharTables()
+        : lower(), upper(), space(), unreserved(), hexValue(), base64(), jsonEscape() {
+        for (int c = 0; c < 256; c++) {
+            bool isUpper = c >= 'A' && c <= 'Z';
+            bool isLower = c >= 'a' && c <= 'z';
+            bool isDigit = c >= '0' && c <= '9';
+            lower[c] = static_cast<unsigned char>(isUpper ? c + 32 : c);
+            upper[c] = static_cast<unsigned char>(isLower ? c - 32 : c);
+            space[c] = c == ' ' || (c >= '\t' && c <= '\r');
+            unreserved[c] = isUpper || isLower || isDigit || c == '-' || c == '_' || c == '.' || c == '~';
+            hexValue[c] = static_cast<unsigned char>(isDigit ? c - '0' :
+                                                     (c >= 'A' && c <= 'F') ? c - 'A' + 10 :
+                                                     (c >= 'a' && c <= 'f') ? c - 'a' + 10 : 0);
+            base64[c] = static_cast<signed char>(isUpper ? c - 'A' : isLower ? c - 'a' + 26 :
+                                                 isDigit ? c - '0' + 52 : c == '+' ? 62 :
+                                                 c == '/' ? 63 : c == '=' ? -2 : -1);
+            jsonEscape[c] = 0;
+        }
+        jsonEscape[static_cast<unsigned char>('"')] = '"';
+        jsonEscape[static_cast<unsigned char>('\\')] = '\\';
+        jsonEscape[static_cast<unsigned char>('\b')] = 'b';
+        jsonEscape[static_cast<unsigned char>('\f')] = 'f';
+        jsonEscape[static_cast<unsigned char>('\n')] = 'n';
+        jsonEscape[static_cast<unsigned char>('\r')] = 'r';
+        jsonEscape[static_cast<unsigned char>('\t')] = 't';
     }
+};
 
-    while (end > start && std::isspace(str[end - 1])) {
-        end--;
+constexpr CharTables kTables;
+
+const char kHexDigits[] = "0123456789ABCDEF";
+const char kBase64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+const uint64_t kOnes = 0x0101010101010101ULL;
+const uint64_t kHighBits = 0x8080808080808080ULL;
+
+// Toggle the case bit (0x20) of the bytes of word in [first, last], eight
+// at a time. The sums run on the low seven bits so they never carry into
+// the next byte; bytes with the high bit set (UTF-8) are left alone.
+inline uint64_t flipCase(uint64_t word, unsigned char first, unsigned char last) {
+    uint64_t low = word & ~kHighBits;
+    uint64_t atLeastFirst = low + kOnes * (0x80 - first);
+    uint64_t pastLast = low + kOnes * (0x80 - last - 1);
+    uint64_t inRange = atLeastFirst & ~pastLast & ~word & kHighBits;
+    return word ^ (inRange >> 2);
+}
+
+void mapCase(char* data, size_t length, unsigned char first, unsigned char last, const unsigned char* table) {
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        word = flipCase(word, first, last);
+        std::memcpy(data + i, &word, sizeof(word));
+    }
+    for (; i < length; i++) {
+        data[i] = static_cast<char>(table[static_cast<unsigned char>(data[i])]);
     }
+}
 
-    return str.substr(start, end - start);
+} // namespace
+
+std::string trim(const std::string& str) {
+    return std::string(trimView(str));
 }
 
 std::string toLower(const std::string& str) {
     std::string result = str;
-    std::transform(result.begin(), result.end(), result.begin(),
-                   [](unsigned char c) { return std::tolower(c); });
+    toLowerInPlace(result);
     return result;
 }
 
 std::string toUpper(const std::string& str) {
     std::string result = str;
-    std::transform(result.begin(), result.end(), result.begin(),
-                   [](unsigned char c) { return std::toupper(c); });
+    toUpperInPlace(result);
     return result;
 }
 
 std::vector<std::string> split(const std::string& str, char delimiter) {
     std::vector<std::string> result;
-    std::stringstream ss(str);
-    std::string item;
+    for (std::string_view field : splitView(str, delimiter)) {
+        result.emplace_back(field);
+    }
 
-    while (std::getline(ss, item, delimiter)) {
-        result.push_back(item);
+    // Like std::getline, a trailing delimiter does not start another field
+    if (!result.empty() && result.back().empty()) {
+        result.pop_back();
     }
 
     return result;
@@ -49,22 +111,10 @@ std::vector<std::string> split(const std::string& str, char delimiter) {
 
 std::vector<std::string> split(const std::string& str, const std::string& delimiter) {
     std::vector<std::string> result;
-
-    if (delimiter.empty()) {
-        result.push_back(str);
-        return result;
-    }
-
-    size_t start = 0;
-    size_t end = str.find(delimiter);
-
-    while (end != std::string::npos) {
-        result.push_back(str.substr(start, end - start));
-        start = end + delimiter.length();
-        end = str.find(delimiter, start);
+    for (std::string_view field : splitView(str, std::string_view(delimiter))) {
+        result.emplace_back(field);
     }
 
-    result.push_back(str.substr(start));
     return result;
 }
 
@@ -73,30 +123,33 @@ std::string join(const std::vector<std::string>& strings, const std::string& del
         return "";
     }
 
-    std::string result = strings[0];
+    size_t length = delimiter.length() * (strings.size() - 1);
+    for (const auto& str : strings) {
+        length += str.length();
+    }
+
+    std::string result;
+    result.reserve(length);
+    result += strings[0];
     for (size_t i = 1; i < strings.size(); i++) {
-        result += delimiter + strings[i];
+        result += delimiter;
+        result += strings[i];
     }
 
     return result;
 }
 
-bool startsWith(const std::string& str, const std::string& prefix) {
-    if (prefix.length() > str.length()) {
-        return false;
-    }
-    return str.compare(0, prefix.length(), prefix) == 0;
+bool startsWith(std::string_view str, std::string_view prefix) {
+    return prefix.length() <= str.length() && str.compare(0, prefix.length(), prefix) == 0;
 }
 
-bool endsWith(const std::string& str, const std::string& suffix) {
-    if (suffix.length() > str.length()) {
-        return false;
-    }
-    return str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0;
+bool endsWith(std::string_view str, std::string_view suffix) {
+    return suffix.length() <= str.length() &&
+           str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0;
 }
 
-bool contains(const std::string& str, const std::string& substr) {
-    return str.find(substr) != std::string::npos;
+bool contains(std::string_view str, std::string_view substr) {
+    return str.find(substr) != std::string_view::npos;
 }
 
 std::string replace(const std::string& str, const std::string& from, const std::string& to) {
@@ -111,65 +164,228 @@ std::string replace(const std::string& str, const std::string& from, const std::
 }
 
 std::string replaceAll(const std::string& str, const std::string& from, const std::string& to) {
-    std::string result = str;
-    size_t pos = 0;
+    std::string result;
+    appendReplaced(result, str, from, to);
+    return result;
+}
 
-    while ((pos = result.find(from, pos)) != std::string::npos) {
-        result.replace(pos, from.length(), to);
-        pos += to.length();
-    }
+std::string urlEncode(const std::string& str) {
+    std::string result;
+    appendUrlEncoded(result, str);
+    return result;
+}
 
+std::string urlDecode(const std::string& str) {
+    std::string result;
+    appendUrlDecoded(result, str);
     return result;
 }
 
-std::string urlEncode(const std::string& str) {
+std::string base64Encode(const unsigned char* data, size_t length) {
     std::string result;
+    appendBase64(result, data, length);
+    return result;
+}
+
+bool base64Decode(std::string_view str, std::vector<unsigned char>& out) {
+    out.clear();
+    out.reserve(str.length() / 4 * 3);
+
+    unsigned int buffer = 0;
+    int bits = 0;
 
     for (char c : str) {
-        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
-            result += c;
-        } else if (c == ' ') {
-            result += '+';
-        } else {
-            result += '%';
-            char hex[3];
-            hex[0] = "0123456789ABCDEF"[(c >> 4) & 0xF];
-            hex[1] = "0123456789ABCDEF"[c & 0xF];
-            hex[2] = '\0';
-            result += hex;
+        int value = kTables.base64[static_cast<unsigned char>(c)];
+        if (value == -2) {
+            break;
+        }
+        if (value < 0) {
+            return false;
+        }
+
+        buffer = (buffer << 6) | static_cast<unsigned int>(value);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<unsigned char>((buffer >> bits) & 0xFF));
         }
     }
 
-    return result;
+    return true;
 }
 
-std::string urlDecode(const std::string& str) {
-    std::string result;
+std::string_view trimView(std::string_view str) {
+    size_t start = 0;
+    size_t end = str.length();
+
+    while (start < end && kTables.space[static_cast<unsigned char>(str[start])]) {
+        start++;
+    }
+
+    while (end > start && kTables.space[static_cast<unsigned char>(str[end - 1])]) {
+        end--;
+    }
+
+    return str.substr(start, end - start);
+}
+
+void trimInPlace(std::string& str) {
+    std::string_view trimmed = trimView(str);
+    size_t start = static_cast<size_t>(trimmed.data() - str.data());
+    str.erase(start + trimmed.length());
+    str.erase(0, start);
+}
+
+void toLowerInPlace(std::string& str) {
+    mapCase(&str[0], str.length(), 'A', 'Z', kTables.lower);
+}
+
+void toUpperInPlace(std::string& str) {
+    mapCase(&str[0], str.length(), 'a', 'z', kTables.upper);
+}
+
+void appendLower(std::string& out, std::string_view str) {
+    size_t start = out.length();
+    out.append(str.data(), str.length());
+    mapCase(&out[start], str.length(), 'A', 'Z', kTables.lower);
+}
+
+void appendUpper(std::string& out, std::string_view str) {
+    size_t start = out.length();
+    out.append(str.data(), str.length());
+    mapCase(&out[start], str.length(), 'a', 'z', kTables.upper);
+}
+
+void appendReplaced(std::string& out, std::string_view str, std::string_view from, std::string_view to) {
+    if (from.empty()) {
+        out.append(str.data(), str.length());
+        return;
+    }
+
+    size_t start = 0;
+    size_t pos;
+    while ((pos = str.find(from, start)) != std::string_view::npos) {
+        out.append(str.data() + start, pos - start);
+        out.append(to.data(), to.length());
+        start = pos + from.length();
+    }
+    out.append(str.data() + start, str.length() - start);
+}
+
+void appendUrlEncoded(std::string& out, std::string_view str) {
+    out.reserve(out.length() + str.length());
+
+    size_t i = 0;
+    while (i < str.length()) {
+        // Copy a run of unreserved characters at once
+        size_t run = i;
+        while (run < str.length() && kTables.unreserved[static_cast<unsigned char>(str[run])]) {
+            run++;
+        }
+        out.append(str.data() + i, run - i);
+        if (run == str.length()) {
+            break;
+        }
+
+        unsigned char c = static_cast<unsigned char>(str[run]);
+        if (c == ' ') {
+            out += '+';
+        } else {
+            char escaped[3] = {'%', kHexDigits[c >> 4], kHexDigits[c & 0xF]};
+            out.append(escaped, sizeof(escaped));
+        }
+        i = run + 1;
+    }
+}
+
+void appendUrlDecoded(std::string& out, std::string_view str) {
+    out.reserve(out.length() + str.length());
 
     for (size_t i = 0; i < str.length(); i++) {
         if (str[i] == '+') {
-            result += ' ';
+            out += ' ';
         } else if (str[i] == '%' && i + 2 < str.length()) {
-            int value = 0;
-            for (int j = 0; j < 2; j++) {
-                char c = str[i + 1 + j];
-                value = value * 16;
-                if (c >= '0' && c <= '9') {
-                    value += c - '0';
-                } else if (c >= 'A' && c <= 'F') {
-                    value += c - 'A' + 10;
-                } else if (c >= 'a' && c <= 'f') {
-                    value += c - 'a' + 10;
-                }
-            }
-            result += static_cast<char>(value);
+            int value = kTables.hexValue[static_cast<unsigned char>(str[i + 1])] * 16 +
+                        kTables.hexValue[static_cast<unsigned char>(str[i + 2])];
+            out += static_cast<char>(value);
             i += 2;
         } else {
-            result += str[i];
+            out += str[i];
+        }
+    }
+}
+
+void appendBase64(std::string& out, const unsigned char* data, size_t length) {
+    size_t start = out.length();
+    out.resize(start + (length + 2) / 3 * 4);
+    char* p = &out[start];
+
+    size_t i = 0;
+    for (; i + 2 < length; i += 3) {
+        unsigned int triple = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        *p++ = kBase64Alphabet[(triple >> 18) & 0x3F];
+        *p++ = kBase64Alphabet[(triple >> 12) & 0x3F];
+        *p++ = kBase64Alphabet[(triple >> 6) & 0x3F];
+        *p++ = kBase64Alphabet[triple & 0x3F];
+    }
+
+    if (i < length) {
+        unsigned int triple = data[i] << 16;
+        if (i + 1 < length) {
+            triple |= data[i + 1] << 8;
         }
+        *p++ = kBase64Alphabet[(triple >> 18) & 0x3F];
+        *p++ = kBase64Alphabet[(triple >> 12) & 0x3F];
+        *p++ = (i + 1 < length) ? kBase64Alphabet[(triple >> 6) & 0x3F] : '=';
+        *p++ = '=';
     }
+}
 
-    return result;
+void appendJsonEscaped(std::string& out, std::string_view str) {
+    size_t i = 0;
+    while (i < str.length()) {
+        size_t run = i;
+        while (run < str.length() && !kTables.jsonEscape[static_cast<unsigned char>(str[run])]) {
+            run++;
+        }
+        out.append(str.data() + i, run - i);
+        if (run == str.length()) {
+            break;
+        }
+
+        char escaped[2] = {'\\', kTables.jsonEscape[static_cast<unsigned char>(str[run])]};
+        out.append(escaped, sizeof(escaped));
+        i = run + 1;
+    }
+}
+
+SplitView::iterator SplitView::begin() const {
+    iterator it;
+    it.source = *this;
+    it.done = false;
+    it.settle(0);
+    return it;
+}
+
+SplitView::iterator& SplitView::iterator::operator++() {
+    if (fieldEnd == std::string_view::npos) {
+        done = true;
+        field = std::string_view();
+        return *this;
+    }
+
+    settle(fieldEnd + (source.byChar ? 1 : source.delimiter.length()));
+    return *this;
+}
+
+void SplitView::iterator::settle(size_t start) {
+    const std::string_view& text = source.text;
+    if (source.byChar) {
+        fieldEnd = text.find(source.delimiterChar, start);
+    } else {
+        fieldEnd = source.delimiter.empty() ? std::string_view::npos : text.find(source.delimiter, start);
+    }
+    field = text.substr(start, fieldEnd == std::string_view::npos ? std::string_view::npos : fieldEnd - start);
 }
 
 } // namespace string_utils
@@ -1,7 +1,9 @@
 #ifndef STRING_UTILS_H
 #define STRING_UTILS_H
 
+#include <cstddef>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace avg {
@@ -20,9 +22,9 @@ std::vector<std::string> split(const std::string& str, const std::string& delimi
 std::string join(const std::vector<std::string>& strings, const std::string& delimiter);
 
 // String checking
-bool startsWith(const std::string& str, const std::string& prefix);
-bool endsWith(const std::string& str, const std::string& suffix);
-bool contains(const std::string& str, const std::string& substr);
+bool startsWith(std::string_view str, std::string_view prefix);
+bool endsWith(std::string_view str, std::string_view suffix);
+bool contains(std::string_view str, std::string_view substr);
 
 // String replacement
 std::string replace(const std::string& str, const std::string& from, const std::string& to);
@@ -31,6 +33,85 @@ std::string replaceAll(const std::string& str, const std::string& from, const st
 // Encoding/Decoding
 std::string urlEncode(const std::string& str);
 std::string urlDecode(const std::string& str);
+std::string base64Encode(const unsigned char* data, size_t length);
+bool base64Decode(std::string_view str, std::vector<unsigned char>& out);
+
+// Allocation-free forms. Views point into the argument; the append forms
+// write to the end of out (reusing its capacity) and the in-place forms
+// modify str. Case mapping is ASCII only, like the functions above in the
+// "C" locale, so UTF-8 sequences pass through unchanged.
+std::string_view trimView(std::string_view str);
+void trimInPlace(std::string& str);
+void toLowerInPlace(std::string& str);
+void toUpperInPlace(std::string& str);
+void appendLower(std::string& out, std::string_view str);
+void appendUpper(std::string& out, std::string_view str);
+// Every occurrence of from (none if from is empty)
+void appendReplaced(std::string& out, std::string_view str, std::string_view from, std::string_view to);
+void appendUrlEncoded(std::string& out, std::string_view str);
+void appendUrlDecoded(std::string& out, std::string_view str);
+void appendBase64(std::string& out, const unsigned char* data, size_t length);
+// Quotes and backslashes escaped, plus the control characters SimpleJSON
+// reads back (\b \f \n \r \t); no surrounding quotes
+void appendJsonEscaped(std::string& out, std::string_view str);
+
+// Lazy split: for (std::string_view field : splitView(path, '/')) ...
+// Yields every field between delimiters, so n delimiters give n + 1 fields
+// (split(str, char) drops a trailing empty one). An empty delimiter yields
+// the whole string.
+class SplitView {
+public:
+    class iterator;
+
+    SplitView(std::string_view str, std::string_view delimiter)
+        : text(str), delimiter(delimiter), delimiterChar(0), byChar(false) {}
+    SplitView(std::string_view str, char delimiter)
+        : text(str), delimiter(), delimiterChar(delimiter), byChar(true) {}
+
+    iterator begin() const;
+    iterator end() const;
+
+private:
+    std::string_view text;
+    std::string_view delimiter;
+    char delimiterChar;
+    bool byChar;
+};
+
+class SplitView::iterator {
+public:
+    iterator() : source(std::string_view(), '\0'), fieldEnd(0), field(), done(true) {}
+
+    std::string_view operator*() const { return field; }
+    const std::string_view* operator->() const { return &field; }
+    iterator& operator++();
+    iterator operator++(int) {
+        iterator previous = *this;
+        ++*this;
+        return previous;
+    }
+
+    bool operator==(const iterator& other) const {
+        return done == other.done && (done || field.data() == other.field.data());
+    }
+    bool operator!=(const iterator& other) const { return !(*this == other); }
+
+private:
+    friend class SplitView;
+
+    // Copied, so iterators stay valid after the SplitView is gone
+    SplitView source;
+    size_t fieldEnd;    // offset of the delimiter ending field (npos for the last)
+    std::string_view field;
+    bool done;
+
+    void settle(size_t start);
+};
+
+inline SplitView::iterator SplitView::end() const { return iterator(); }
+
+inline SplitView splitView(std::string_view str, std::string_view delimiter) { return SplitView(str, delimiter); }
+inline SplitView splitView(std::string_view str, char delimiter) { return SplitView(str, delimiter); }
 
 } // namespace string_utils
 } // namespace avg
@@ -0,0 +1,140 @@
+#include "trace.h"
+
+#if AVG_ENABLE_TRACE
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+// On x86 the time stamp counter is far cheaper than steady_clock; ticks are
+// converted to nanoseconds at dump time by calibrating against steady_clock.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <x86intrin.h>
+#define AVG_TRACE_USE_TSC 1
+#else
+#define AVG_TRACE_USE_TSC 0
+#endif
+#endif
+
+namespace avg {
+namespace trace {
+
+#if AVG_ENABLE_TRACE
+
+static_assert((AVG_TRACE_BUFFER_SIZE & (AVG_TRACE_BUFFER_SIZE - 1)) == 0,
+              "AVG_TRACE_BUFFER_SIZE must be a power of two");
+
+namespace {
+
+struct Event {
+    const char* name;
+    uint64_t ticks;
+    uint32_t threadId;
+    Phase phase;
+};
+
+// Writers claim a slot with a single relaxed fetch_add; there is no lock.
+// A dump taken while other threads are recording may see a torn slot at the
+// head of the ring, which is acceptable for a diagnostic log.
+Event g_events[AVG_TRACE_BUFFER_SIZE];
+std::atomic<uint64_t> g_writeIndex{0};
+std::atomic<uint32_t> g_nextThreadId{1};
+
+inline uint64_t readTicks() {
+#if AVG_TRACE_USE_TSC
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+const std::chrono::steady_clock::time_point g_epochTime = std::chrono::steady_clock::now();
+const uint64_t g_epochTicks = readTicks();
+
+// Nanoseconds per tick, measured over the whole lifetime of the trace
+double nanosecondsPerTick() {
+#if AVG_TRACE_USE_TSC
+    uint64_t ticks = readTicks() - g_epochTicks;
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - g_epochTime).count();
+    return ticks > 0 ? ns / static_cast<double>(ticks) : 0.0;
+#else
+    return 1.0;
+#endif
+}
+
+uint32_t currentThreadId() {
+    thread_local uint32_t id = g_nextThreadId.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+} // namespace
+
+void record(const char* name, Phase phase) {
+    uint64_t index = g_writeIndex.fetch_add(1, std::memory_order_relaxed);
+    Event& event = g_events[index & (AVG_TRACE_BUFFER_SIZE - 1)];
+    event.name = name;
+    event.ticks = readTicks();
+    event.threadId = currentThreadId();
+    event.phase = phase;
+}
+
+std::string dumpJson() {
+    uint64_t end = g_writeIndex.load(std::memory_order_acquire);
+    uint64_t begin = end > AVG_TRACE_BUFFER_SIZE ? end - AVG_TRACE_BUFFER_SIZE : 0;
+
+    std::string result;
+    result.reserve(static_cast<size_t>(end - begin) * 80 + 64);
+    result += "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+    const double nsPerTick = nanosecondsPerTick();
+    char buffer[64];
+    bool first = true;
+    for (uint64_t i = begin; i < end; i++) {
+        const Event& event = g_events[i & (AVG_TRACE_BUFFER_SIZE - 1)];
+        if (!event.name) {
+            continue;
+        }
+
+        if (!first) result += ",";
+        first = false;
+
+        // Names are engine literals and never need escaping
+        result += "{\"name\":\"";
+        result += event.name;
+        result += "\",\"cat\":\"avg\",\"ph\":\"";
+        result += static_cast<char>(event.phase);
+        // Trace Event Format timestamps are in microseconds
+        std::snprintf(buffer, sizeof(buffer), "\",\"ts\":%.3f,\"pid\":1,\"tid\":%u",
+                      static_cast<double>(event.ticks - g_epochTicks) * nsPerTick / 1000.0,
+                      event.threadId);
+        result += buffer;
+        if (event.phase == Phase::Instant) {
+            result += ",\"s\":\"t\"";
+        }
+        result += "}";
+    }
+
+    result += "]}";
+    return result;
+}
+
+void clear() {
+    for (Event& event : g_events) {
+        event.name = nullptr;
+    }
+    g_writeIndex.store(0, std::memory_order_release);
+}
+
+#else
+
+std::string dumpJson() {
+    return "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[]}";
+}
+
+void clear() {
+}
+
+#endif
+
+} // namespace trace
+} // namespace avg
@@ -0,0 +1,74 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Hot-path tracing into a fixed-size ring buffer, exported as Chrome Trace
+// Event Format JSON (load the dump in chrome://tracing or Perfetto).
+//
+// Tracing is compiled in only when AVG_ENABLE_TRACE is defined to 1
+// (CMake option AVG_ENABLE_TRACE). Otherwise the macros expand to nothing.
+// Event names must be string literals: only the pointer is recorded.
+
+#ifndef AVG_ENABLE_TRACE
+#define AVG_ENABLE_TRACE 0
+#endif
+
+// Number of events kept; older events are overwritten. Must be a power of two.
+#ifndef AVG_TRACE_BUFFER_SIZE
+#define AVG_TRACE_BUFFER_SIZE 16384
+#endif
+
+namespace avg {
+namespace trace {
+
+enum class Phase : char {
+    Begin = 'B',
+    End = 'E',
+    Instant = 'i'
+};
+
+#if AVG_ENABLE_TRACE
+
+void record(const char* name, Phase phase);
+
+// Emits a begin event now and the matching end event when it goes out of scope
+class Scope {
+public:
+    explicit Scope(const char* eventName) : name(eventName) { record(name, Phase::Begin); }
+    ~Scope() { record(name, Phase::End); }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const char* name;
+};
+
+#endif
+
+// Chrome Trace Event Format JSON of the buffered events, oldest first.
+// Returns an empty trace when tracing is compiled out.
+std::string dumpJson();
+void clear();
+
+} // namespace trace
+} // namespace avg
+
+#if AVG_ENABLE_TRACE
+#define AVG_TRACE_CONCAT_INNER(a, b) a##b
+#define AVG_TRACE_CONCAT(a, b) AVG_TRACE_CONCAT_INNER(a, b)
+#define AVG_TRACE_SCOPE(name) ::avg::trace::Scope AVG_TRACE_CONCAT(avgTraceScope_, __LINE__)(name)
+#define AVG_TRACE_BEGIN(name) ::avg::trace::record(name, ::avg::trace::Phase::Begin)
+#define AVG_TRACE_END(name) ::avg::trace::record(name, ::avg::trace::Phase::End)
+#define AVG_TRACE_INSTANT(name) ::avg::trace::record(name, ::avg::trace::Phase::Instant)
+#else
+#define AVG_TRACE_SCOPE(name) ((void)0)
+#define AVG_TRACE_BEGIN(name) ((void)0)
+#define AVG_TRACE_END(name) ((void)0)
+#define AVG_TRACE_INSTANT(name) ((void)0)
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,440 @@
+// Native benchmark suite for the AVG engine core.
+//
+// Generates a synthetic script of the requested shape and measures parsing,
+// script loading, navigation throughput, save/load and heap high-water marks.
+// Results are written as JSON so runs can be compared between versions.
+
+#include "script_generator.h"
+#include "core/avg_engine.h"
+#include "core/game_state.h"
+#include "utils/simple_json.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Heap tracking: every allocation carries a small header with its size so the
+// suite can report live bytes and the peak reached during each measurement.
+// Every replaceable form of new/delete goes through here (the standard
+// library's nothrow and over-aligned ones included, e.g. std::stable_sort's
+// temporary buffer), so a pointer is always freed with its own header.
+
+namespace {
+
+std::atomic<size_t> g_liveBytes{0};
+std::atomic<size_t> g_peakBytes{0};
+
+constexpr size_t kHeader = alignof(std::max_align_t);
+
+size_t headerSize(size_t alignment) {
+    return alignment > kHeader ? alignment : kHeader;
+}
+
+// nullptr on failure; the throwing forms turn that into bad_alloc
+void* trackedAlloc(size_t size, size_t alignment = kHeader) {
+    size_t header = headerSize(alignment);
+    void* raw;
+    if (alignment > kHeader) {
+        // aligned_alloc wants a multiple of the alignment
+        size_t total = (size + header + alignment - 1) / alignment * alignment;
+        raw = std::aligned_alloc(alignment, total);
+    } else {
+        raw = std::malloc(size + header);
+    }
+    if (!raw) {
+        return nullptr;
+    }
+    // The size sits right before the returned pointer
+    void* ptr = static_cast<char*>(raw) + header;
+    *(static_cast<size_t*>(ptr) - 1) = size;
+
+    size_t live = g_liveBytes.fetch_add(size) + size;
+    size_t peak = g_peakBytes.load();
+    while (live > peak && !g_peakBytes.compare_exchange_weak(peak, live)) {
+    }
+    return ptr;
+}
+
+void* trackedNew(size_t size, size_t alignment = kHeader) {
+    void* ptr = trackedAlloc(size, alignment);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void trackedFree(void* ptr, size_t alignment = kHeader) {
+    if (!ptr) {
+        return;
+    }
+    g_liveBytes.fetch_sub(*(static_cast<size_t*>(ptr) - 1));
+    std::free(static_cast<char*>(ptr) - headerSize(alignment));
+}
+
+size_t alignmentOf(std::align_val_t alignment) {
+    return static_cast<size_t>(alignment);
+}
+
+} // namespace
+
+void* operator new(size_t size) { return trackedNew(size); }
+void* operator new[](size_t size) { return trackedNew(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return trackedAlloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return trackedAlloc(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return trackedNew(size, alignmentOf(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return trackedNew(size, alignmentOf(alignment)); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return trackedAlloc(size, alignmentOf(alignment));
+}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return trackedAlloc(size, alignmentOf(alignment));
+}
+
+void operator delete(void* ptr) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, size_t) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, std::align_val_t alignment) noexcept { trackedFree(ptr, alignmentOf(alignment)); }
+void operator delete[](void* ptr, std::align_val_t alignment) noexcept { trackedFree(ptr, alignmentOf(alignment)); }
+void operator delete(void* ptr, size_t, std::align_val_t alignment) noexcept { trackedFree(ptr, alignmentOf(alignment)); }
+void operator delete[](void* ptr, size_t, std::align_val_t alignment) noexcept { trackedFree(ptr, alignmentOf(alignment)); }
+void operator delete(void* ptr, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    trackedFree(ptr, alignmentOf(alignment));
+}
+void operator delete[](void* ptr, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    trackedFree(ptr, alignmentOf(alignment));
+}
+
+// ---------------------------------------------------------------------------
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    avg::bench::ScriptShape shape;
+    int iterations = 100000;   // navigation operations
+    int historyLength = 1000;  // history entries for serialize/deserialize
+    int repeat = 3;            // best-of-N for whole-script phases
+    int threads = 0;           // parse threads for load_script_parallel (0 = all cores)
+    const char* outPath = nullptr;
+    const char* scriptPath = nullptr;  // dump the generated script here
+};
+
+struct Result {
+    std::string name;
+    long long operations;
+    double totalMs;
+    size_t bytes;              // input bytes processed (0 if not applicable)
+    size_t peakHeapBytes;      // peak live heap above the baseline
+};
+
+class Measure {
+public:
+    Measure() : start(Clock::now()), baseline(g_liveBytes.load()) {
+        g_peakBytes.store(baseline);
+    }
+
+    double elapsedMs() const {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    size_t peak() const {
+        size_t p = g_peakBytes.load();
+        return p > baseline ? p - baseline : 0;
+    }
+
+private:
+    Clock::time_point start;
+    size_t baseline;
+};
+
+void printUsage() {
+    std::printf(
+        "Usage: avg_bench [options]\n"
+        "  --nodes N          number of nodes (default 1000)\n"
+        "  --branch N         choices per choice node (default 3)\n"
+        "  --choice-ratio F   fraction of choice nodes (default 0.1)\n"
+        "  --text-min N       minimum line length (default 20)\n"
+        "  --text-max N       maximum line length (default 200)\n"
+        "  --uniform-text     uniform instead of short-skewed line lengths\n"
+        "  --unicode F        fraction of non-ASCII characters (default 0)\n"
+        "  --seed N           generator seed (default 1)\n"
+        "  --iterations N     navigation operations (default 100000)\n"
+        "  --history N        history length for save/load (default 1000)\n"
+        "  --repeat N         repetitions of whole-script phases (default 3)\n"
+        "  --threads N        parse threads for the parallel load (default: all cores)\n"
+        "  --out PATH         write JSON results to PATH instead of stdout\n"
+        "  --emit-script PATH also write the generated script to PATH\n");
+}
+
+bool parseArgs(int argc, char** argv, Options& opts) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (std::strcmp(arg, "--uniform-text") == 0) {
+            opts.shape.skewedLengths = false;
+            continue;
+        }
+        if (std::strcmp(arg, "--help") == 0 || std::strcmp(arg, "-h") == 0) {
+            printUsage();
+            std::exit(0);
+        }
+        if (!value) {
+            std::fprintf(stderr, "Missing value for %s\n", arg);
+            return false;
+        }
+
+        if (std::strcmp(arg, "--nodes") == 0) opts.shape.nodeCount = std::atoi(value);
+        else if (std::strcmp(arg, "--branch") == 0) opts.shape.branchFactor = std::atoi(value);
+        else if (std::strcmp(arg, "--choice-ratio") == 0) opts.shape.choiceRatio = std::atof(value);
+        else if (std::strcmp(arg, "--text-min") == 0) opts.shape.textMin = std::atoi(value);
+        else if (std::strcmp(arg, "--text-max") == 0) opts.shape.textMax = std::atoi(value);
+        else if (std::strcmp(arg, "--unicode") == 0) opts.shape.unicodeRatio = std::atof(value);
+        else if (std::strcmp(arg, "--seed") == 0) opts.shape.seed = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--iterations") == 0) opts.iterations = std::atoi(value);
+        else if (std::strcmp(arg, "--history") == 0) opts.historyLength = std::atoi(value);
+        else if (std::strcmp(arg, "--repeat") == 0) opts.repeat = std::atoi(value);
+        else if (std::strcmp(arg, "--threads") == 0) opts.threads = std::atoi(value);
+        else if (std::strcmp(arg, "--out") == 0) opts.outPath = value;
+        else if (std::strcmp(arg, "--emit-script") == 0) opts.scriptPath = value;
+        else {
+            std::fprintf(stderr, "Unknown option %s\n", arg);
+            return false;
+        }
+        i++;
+    }
+
+    if (opts.shape.nodeCount < 2 || opts.repeat < 1 || opts.iterations < 1 || opts.threads < 0) {
+        std::fprintf(stderr, "Invalid options\n");
+        return false;
+    }
+    return true;
+}
+
+// Keep the best (fastest) of several runs of a whole-script phase
+void keepBest(std::vector<Result>& results, const Result& r) {
+    for (auto& existing : results) {
+        if (existing.name == r.name) {
+            if (r.totalMs < existing.totalMs) existing = r;
+            return;
+        }
+    }
+    results.push_back(r);
+}
+
+void benchParse(const std::string& script, std::vector<Result>& results) {
+    Measure m;
+    avg::SimpleJSON json;
+    bool ok = json.parse(script.c_str());
+    keepBest(results, {"json_parse", 1, m.elapsedMs(), script.size(), m.peak()});
+    if (!ok) std::fprintf(stderr, "json_parse failed\n");
+}
+
+void benchLoad(const std::string& script, std::vector<Result>& results) {
+    Measure m;
+    {
+        avg::GameState state;
+        bool ok = state.loadScript(script.c_str());
+        if (!ok) std::fprintf(stderr, "load_script failed\n");
+        keepBest(results, {"load_script", 1, m.elapsedMs(), script.size(), m.peak()});
+    }
+}
+
+void benchParallelLoad(const std::string& script, int threads, std::vector<Result>& results) {
+    Measure m;
+    {
+        avg::GameState state;
+        avg::ScriptLoader::Options options;
+        options.threads = threads;
+        avg::ScriptLoader loader;
+        bool ok = loader.begin(script.c_str(), false, options) &&
+                  loader.step(state, -1) == avg::ScriptLoader::Status::Done;
+        if (!ok) std::fprintf(stderr, "load_script_parallel failed\n");
+        keepBest(results, {"load_script_parallel", 1, m.elapsedMs(), script.size(), m.peak()});
+    }
+}
+
+void benchNavigation(const std::string& script, const std::vector<std::string>& ids,
+                     const Options& opts, std::vector<Result>& results) {
+    avg::AVGEngine engine;
+    engine.init();
+    engine.loadScript(script.c_str());
+
+    // Random jumps by id (external entry points: deep links, debug jumps)
+    avg::bench::Random rng(opts.shape.seed + 1);
+    std::vector<const char*> targets(static_cast<size_t>(opts.iterations));
+    for (auto& t : targets) {
+        t = ids[rng.next() % ids.size()].c_str();
+    }
+
+    {
+        Measure m;
+        for (const char* t : targets) {
+            engine.gotoNode(t);
+        }
+        results.push_back({"goto_node", opts.iterations, m.elapsedMs(), 0, m.peak()});
+    }
+
+    // Play through the graph the way a player would
+    engine.reset();
+    engine.gotoNode(ids.front().c_str());
+    {
+        Measure m;
+        long long steps = 0;
+        for (int i = 0; i < opts.iterations; i++) {
+            const avg::DialogueNode* node = engine.getCurrentNode();
+            bool moved;
+            if (!node || node->type == avg::NodeType::END) {
+                moved = engine.gotoNode(ids.front().c_str());
+            } else if (!node->choices.empty()) {
+                moved = engine.selectChoice(static_cast<int>(rng.next() % node->choices.size()));
+            } else {
+                moved = engine.gotoNode(node->nextNodeId.c_str());
+            }
+            if (moved) steps++;
+        }
+        results.push_back({"play_through", steps, m.elapsedMs(), 0, m.peak()});
+    }
+}
+
+void benchSaveLoad(const std::string& script, const std::vector<std::string>& ids,
+                   const Options& opts, std::vector<Result>& results) {
+    avg::AVGEngine engine;
+    engine.init();
+    engine.loadScript(script.c_str());
+
+    avg::bench::Random rng(opts.shape.seed + 2);
+    for (int i = 0; i < opts.historyLength; i++) {
+        engine.gotoNode(ids[rng.next() % ids.size()].c_str());
+    }
+    for (int i = 0; i < 64; i++) {
+        engine.setVariable(("var" + std::to_string(i)).c_str(), i);
+    }
+
+    const int rounds = 100;
+    std::string saved;
+    {
+        Measure m;
+        for (int i = 0; i < rounds; i++) {
+            saved = engine.saveState();
+        }
+        results.push_back({"serialize", rounds, m.elapsedMs(), saved.size() * rounds, m.peak()});
+    }
+    {
+        Measure m;
+        for (int i = 0; i < rounds; i++) {
+            engine.loadState(saved.c_str());
+        }
+        results.push_back({"deserialize", rounds, m.elapsedMs(), saved.size() * rounds, m.peak()});
+    }
+}
+
+void writeString(std::FILE* out, const char* s) {
+    std::fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') std::fputc('\\', out);
+        std::fputc(*s, out);
+    }
+    std::fputc('"', out);
+}
+
+void writeResults(std::FILE* out, const Options& opts, size_t scriptBytes,
+                  size_t residentBytes, const std::vector<Result>& results) {
+    const avg::bench::ScriptShape& s = opts.shape;
+    std::fprintf(out, "{\n  \"suite\": \"avg_bench\",\n  \"engineVersion\": ");
+    writeString(out, AVG_ENGINE_VERSION);
+    std::fprintf(out,
+        ",\n  \"config\": {\"nodes\": %d, \"branch\": %d, \"choiceRatio\": %g, "
+        "\"textMin\": %d, \"textMax\": %d, \"skewedLengths\": %s, \"unicode\": %g, "
+        "\"seed\": %llu, \"iterations\": %d, \"history\": %d, \"repeat\": %d, \"threads\": %d},\n",
+        s.nodeCount, s.branchFactor, s.choiceRatio, s.textMin, s.textMax,
+        s.skewedLengths ? "true" : "false", s.unicodeRatio,
+        static_cast<unsigned long long>(s.seed), opts.iterations, opts.historyLength, opts.repeat, opts.threads);
+    std::fprintf(out, "  \"scriptBytes\": %zu,\n  \"residentScriptBytes\": %zu,\n  \"results\": [\n",
+                 scriptBytes, residentBytes);
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        double nsPerOp = r.operations > 0 ? r.totalMs * 1e6 / static_cast<double>(r.operations) : 0.0;
+        double mbPerSec = (r.bytes > 0 && r.totalMs > 0.0)
+            ? static_cast<double>(r.bytes) / (1024.0 * 1024.0) / (r.totalMs / 1000.0) : 0.0;
+
+        std::fprintf(out, "    {\"name\": ");
+        writeString(out, r.name.c_str());
+        std::fprintf(out,
+            ", \"operations\": %lld, \"totalMs\": %.3f, \"nsPerOp\": %.1f, "
+            "\"mbPerSec\": %.2f, \"peakHeapBytes\": %zu}%s\n",
+            r.operations, r.totalMs, nsPerOp, mbPerSec, r.peakHeapBytes,
+            i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    if (!parseArgs(argc, argv, opts)) {
+        printUsage();
+        return 1;
+    }
+
+    std::vector<std::string> ids;
+    std::string script = avg::bench::generateScript(opts.shape, &ids);
+
+    if (opts.scriptPath) {
+        std::FILE* f = std::fopen(opts.scriptPath, "wb");
+        if (!f) {
+            std::fprintf(stderr, "Cannot open %s\n", opts.scriptPath);
+            return 1;
+        }
+        std::fwrite(script.data(), 1, script.size(), f);
+        std::fclose(f);
+    }
+
+    std::vector<Result> results;
+    for (int i = 0; i < opts.repeat; i++) {
+        benchParse(script, results);
+        benchLoad(script, results);
+        benchParallelLoad(script, opts.threads, results);
+    }
+    benchNavigation(script, ids, opts, results);
+    benchSaveLoad(script, ids, opts, results);
+
+    // Steady-state heap held by a loaded engine (what stays resident in WASM)
+    size_t residentBytes;
+    {
+        size_t before = g_liveBytes.load();
+        avg::AVGEngine engine;
+        engine.init();
+        engine.loadScript(script.c_str());
+        size_t after = g_liveBytes.load();
+        residentBytes = after > before ? after - before : 0;
+    }
+
+    std::FILE* out = stdout;
+    if (opts.outPath) {
+        out = std::fopen(opts.outPath, "w");
+        if (!out) {
+            std::fprintf(stderr, "Cannot open %s\n", opts.outPath);
+            return 1;
+        }
+    }
+
+    writeResults(out, opts, script.size(), residentBytes, results);
+
+    if (out != stdout) {
+        std::fclose(out);
+    }
+    return 0;
+}
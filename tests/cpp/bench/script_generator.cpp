@@ -0,0 +1,131 @@
+#include "script_generator.h"
+#include <algorithm>
+
+namespace avg {
+namespace bench {
+
+static const char* kSpeakers[] = {"Narrator", "Protagonist", "Aoi", "Mira", "Kenji", "Stranger"};
+static const char* kBackgrounds[] = {"room.jpg", "street.jpg", "school.jpg", "night.jpg"};
+static const char* kBgm[] = {"main_theme.mp3", "calm.mp3", "tension.mp3"};
+
+static const char* kWords[] = {
+    "the", "a", "door", "window", "light", "quiet", "morning", "remember",
+    "never", "should", "together", "strange", "room", "voice", "maybe", "again"
+};
+
+// Mixed-width non-ASCII samples: Latin-1, CJK (3 bytes), emoji (4 bytes)
+static const char* kUnicode[] = {"\xC3\xA9", "\xE3\x81\x82", "\xE6\xBC\xA2", "\xE5\xAD\x97", "\xF0\x9F\x99\x82"};
+
+static int pickTextLength(const ScriptShape& shape, Random& rng) {
+    if (!shape.skewedLengths) {
+        return rng.range(shape.textMin, shape.textMax);
+    }
+
+    // Squaring a uniform sample biases towards short lines, like real scripts
+    double u = rng.unit();
+    return shape.textMin + static_cast<int>(u * u * (shape.textMax - shape.textMin));
+}
+
+static void appendText(std::string& out, int length, const ScriptShape& shape, Random& rng) {
+    int written = 0;
+    while (written < length) {
+        if (written > 0) {
+            out += ' ';
+            written++;
+        }
+
+        if (shape.unicodeRatio > 0.0 && rng.unit() < shape.unicodeRatio) {
+            out += kUnicode[rng.next() % (sizeof(kUnicode) / sizeof(kUnicode[0]))];
+            written++;
+        } else {
+            const char* word = kWords[rng.next() % (sizeof(kWords) / sizeof(kWords[0]))];
+            out += word;
+            written += static_cast<int>(std::char_traits<char>::length(word));
+        }
+    }
+
+    // Exercise escape handling now and then
+    if (rng.next() % 16 == 0) {
+        out += " \\\"quoted\\\"";
+    }
+}
+
+static std::string nodeId(int index) {
+    return "n" + std::to_string(index);
+}
+
+std::string generateScript(const ScriptShape& shape, std::vector<std::string>* nodeIds) {
+    Random rng(shape.seed);
+    std::string out;
+    out.reserve(static_cast<size_t>(shape.nodeCount) * static_cast<size_t>(shape.textMax / 2 + 120));
+
+    out += "{\"title\":\"Synthetic\",\"version\":\"1.0.0\",\"nodes\":[";
+
+    if (nodeIds) {
+        nodeIds->clear();
+        nodeIds->reserve(static_cast<size_t>(shape.nodeCount));
+    }
+
+    for (int i = 0; i < shape.nodeCount; i++) {
+        if (i > 0) out += ',';
+
+        bool last = i == shape.nodeCount - 1;
+        bool choice = !last && shape.branchFactor > 0 && rng.unit() < shape.choiceRatio;
+        std::string id = nodeId(i);
+        if (nodeIds) nodeIds->push_back(id);
+
+        out += "{\"id\":\"" + id + "\",\"type\":\"";
+        out += last ? "end" : (choice ? "choice" : "dialogue");
+        out += "\"";
+
+        if (!choice) {
+            out += ",\"speaker\":\"";
+            out += kSpeakers[rng.next() % (sizeof(kSpeakers) / sizeof(kSpeakers[0]))];
+            out += "\"";
+        }
+
+        out += ",\"text\":\"";
+        appendText(out, pickTextLength(shape, rng), shape, rng);
+        out += "\"";
+
+        if (shape.chapterSize > 0) {
+            out += ",\"chapter\":\"ch" + std::to_string(i / shape.chapterSize) + "\"";
+        }
+
+        if (rng.next() % 8 == 0) {
+            out += ",\"background\":\"";
+            out += kBackgrounds[rng.next() % (sizeof(kBackgrounds) / sizeof(kBackgrounds[0]))];
+            out += "\"";
+        }
+        if (rng.next() % 32 == 0) {
+            out += ",\"bgm\":\"";
+            out += kBgm[rng.next() % (sizeof(kBgm) / sizeof(kBgm[0]))];
+            out += "\"";
+        }
+
+        if (choice) {
+            out += ",\"choices\":[";
+            for (int c = 0; c < shape.branchFactor; c++) {
+                if (c > 0) out += ',';
+                // Mostly forward jumps with the occasional loop back
+                int target = rng.next() % 10 == 0
+                    ? rng.range(0, i)
+                    : rng.range(i + 1, std::min(shape.nodeCount - 1, i + 50));
+                out += "{\"text\":\"";
+                appendText(out, rng.range(8, 40), shape, rng);
+                out += "\",\"next\":\"" + nodeId(target) + "\"}";
+            }
+            out += "]";
+        } else if (!last) {
+            out += ",\"next\":\"" + nodeId(i + 1) + "\"";
+        }
+
+        out += "}";
+    }
+
+    out += "]}";
+    return out;
+}
+
+} // namespace bench
+} // namespace avg
@@ -0,0 +1,56 @@
+#ifndef SCRIPT_GENERATOR_H
+#define SCRIPT_GENERATOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace avg {
+namespace bench {
+
+// Shape of a synthetic script
+struct ScriptShape {
+    int nodeCount = 1000;
+    int branchFactor = 3;          // choices per choice node
+    double choiceRatio = 0.1;      // fraction of nodes that are choices
+    int textMin = 20;              // dialogue length in characters
+    int textMax = 200;
+    bool skewedLengths = true;     // most lines short, few long
+    double unicodeRatio = 0.0;     // fraction of non-ASCII characters
+    int chapterSize = 1000;        // nodes per "chapter" tag (0 = none)
+    uint64_t seed = 1;
+};
+
+// Deterministic xorshift generator so results are reproducible across runs
+class Random {
+public:
+    explicit Random(uint64_t seed) : state(seed ? seed : 0x9E3779B97F4A7C15ULL) {}
+
+    uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    int range(int lo, int hi) {
+        if (hi <= lo) return lo;
+        return lo + static_cast<int>(next() % static_cast<uint64_t>(hi - lo + 1));
+    }
+
+    double unit() {
+        return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+private:
+    uint64_t state;
+};
+
+// Generate a script in the engine's JSON format. Node ids are "n<index>";
+// ids of all generated nodes are written to nodeIds when non-null.
+std::string generateScript(const ScriptShape& shape, std::vector<std::string>* nodeIds = nullptr);
+
+} // namespace bench
+} // namespace avg
+
+#endif // SCRIPT_GENERATOR_H
@@ -0,0 +1,42 @@
+// Minimal assertion helpers for the behaviour checks.
+//
+// Each check is a plain executable registered with ctest: CHECK reports the
+// failing expression with its location and keeps going, so one run lists
+// every broken case, and checkResult() turns the count into the exit code.
+
+#ifndef AVG_CHECK_H
+#define AVG_CHECK_H
+
+#include <cstdio>
+
+namespace avg {
+namespace check {
+
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+inline bool report(bool ok, const char* expression, const char* file, int line) {
+    if (!ok) {
+        std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expression);
+        failures()++;
+    }
+    return ok;
+}
+
+inline int checkResult(const char* name) {
+    if (failures() > 0) {
+        std::fprintf(stderr, "%s: %d check(s) failed\n", name, failures());
+        return 1;
+    }
+    std::printf("%s: all checks passed\n", name);
+    return 0;
+}
+
+} // namespace check
+} // namespace avg
+
+#define CHECK(expression) ::avg::check::report(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
+
+#endif // AVG_CHECK_H
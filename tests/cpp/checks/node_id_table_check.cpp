@@ -0,0 +1,173 @@
+// NodeIdTable lookups: every key built into the table maps back to its
+// index, ids outside it give -1 or a candidate the caller's compare
+// rejects, colliding hashes are handed back, and a Builder stepped in small
+// slices produces the same table as build(). GameState's id lookup is
+// checked on top of it.
+
+#include "check.h"
+#include "core/game_state.h"
+#include "core/node_id_table.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+using avg::NodeIdTable;
+using Keys = std::vector<std::pair<uint64_t, int>>;
+
+Keys randomKeys(std::mt19937_64& rng, size_t count, std::unordered_set<uint64_t>& used) {
+    Keys keys;
+    while (keys.size() < count) {
+        uint64_t key = rng();
+        if (used.insert(key).second) {
+            keys.push_back({key, static_cast<int>(keys.size())});
+        }
+    }
+    return keys;
+}
+
+// A miss may land on any slot, but never outside the index range
+bool validMiss(const NodeIdTable& table, const Keys& keys, uint64_t probe) {
+    int candidate = table.find(probe);
+    return candidate == -1 ||
+           (candidate >= 0 && static_cast<size_t>(candidate) < keys.size() &&
+            keys[static_cast<size_t>(candidate)].first != probe);
+}
+
+void checkTable(size_t count, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::unordered_set<uint64_t> used;
+    Keys keys = randomKeys(rng, count, used);
+
+    NodeIdTable table;
+    std::vector<int> rejected;
+    CHECK(table.build(keys, rejected));
+    CHECK(rejected.empty());
+    CHECK(table.size() == count);
+    for (const auto& key : keys) {
+        if (!CHECK(table.find(key.first) == key.second)) {
+            break;
+        }
+    }
+
+    for (int i = 0; i < 10000; i++) {
+        uint64_t probe = rng();
+        if (!used.count(probe) && !CHECK(validMiss(table, keys, probe))) {
+            break;
+        }
+    }
+
+    // Stepped in small slices, with the keys in another order
+    Keys shuffled = keys;
+    std::shuffle(shuffled.begin(), shuffled.end(), rng);
+    NodeIdTable::Builder builder;
+    builder.reserve(shuffled.size());
+    for (const auto& key : shuffled) {
+        builder.add(key.first, key.second);
+    }
+    int steps = 0;
+    while (!builder.step(64)) {
+        steps++;
+    }
+    NodeIdTable stepped;
+    std::vector<int> steppedRejected;
+    CHECK(builder.finish(stepped, steppedRejected));
+    CHECK(steppedRejected.empty());
+    CHECK(stepped.size() == table.size());
+    CHECK(stepped.memoryBytes() == table.memoryBytes());
+    CHECK(count < 1000 || steps > 10);
+    for (const auto& key : keys) {
+        if (!CHECK(stepped.find(key.first) == key.second)) {
+            break;
+        }
+    }
+    for (int i = 0; i < 1000; i++) {
+        uint64_t probe = rng();
+        if (!CHECK(stepped.find(probe) == table.find(probe))) {
+            break;
+        }
+    }
+}
+
+void checkEdgeCases() {
+    NodeIdTable table;
+    CHECK(table.find(42) == -1);
+
+    std::vector<int> rejected;
+    CHECK(table.build(Keys(), rejected));
+    CHECK(rejected.empty());
+    CHECK(table.find(42) == -1);
+
+    CHECK(table.build(Keys{{7, 3}}, rejected));
+    CHECK(table.find(7) == 3);
+
+    // The same hash twice: the lowest index stays, the other comes back
+    Keys keys{{10, 0}, {20, 1}, {10, 2}, {30, 3}, {20, 4}};
+    CHECK(table.build(keys, rejected));
+    CHECK(table.find(10) == 0);
+    CHECK(table.find(20) == 1);
+    CHECK(table.find(30) == 3);
+    CHECK(rejected.size() == 2);
+    CHECK(std::find(rejected.begin(), rejected.end(), 2) != rejected.end());
+    CHECK(std::find(rejected.begin(), rejected.end(), 4) != rejected.end());
+
+    table.clear();
+    CHECK(table.size() == 0);
+    CHECK(table.find(10) == -1);
+}
+
+// Lookups through GameState: table hits, overflow nodes added after the
+// build, and ids that were never added
+void checkGameStateLookup() {
+    avg::GameState state;
+    const int count = 20000;
+    for (int i = 0; i < count; i++) {
+        avg::DialogueNode node;
+        node.id = "chapter" + std::to_string(i / 100) + "_" + std::to_string(i);
+        state.addNode(node);
+    }
+    state.optimizeNodeLookup();
+    CHECK(state.getNodeIdTable().size() == static_cast<size_t>(count));
+
+    for (int i = 0; i < 50; i++) {
+        avg::DialogueNode node;
+        node.id = "late_" + std::to_string(i);
+        state.addNode(node);
+    }
+
+    for (int i = 0; i < count; i++) {
+        std::string id = "chapter" + std::to_string(i / 100) + "_" + std::to_string(i);
+        if (!CHECK(state.getNodeIndex(id) == i)) {
+            break;
+        }
+    }
+    for (int i = 0; i < 50; i++) {
+        CHECK(state.getNodeIndex("late_" + std::to_string(i)) == count + i);
+    }
+    for (int i = 0; i < 10000; i++) {
+        std::string id = "missing_" + std::to_string(i);
+        if (!CHECK(state.getNodeIndex(id) == -1 && state.getNode(id) == nullptr)) {
+            break;
+        }
+    }
+    CHECK(state.getNodeIndex("") == -1);
+}
+
+} // namespace
+
+int main() {
+    checkEdgeCases();
+    checkTable(1, 1);
+    checkTable(5, 2);
+    checkTable(1000, 3);
+    // Past the radix sort threshold
+    checkTable(5000, 4);
+    checkTable(100000, 5);
+    checkGameStateLookup();
+    return avg::check::checkResult("node_id_table_check");
+}
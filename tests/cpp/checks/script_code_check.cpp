@@ -0,0 +1,422 @@
+// Script code: compiled conditions evaluate like the C expressions they are
+// written as (checked against a reference evaluator over random
+// expressions), effects store what they assign, malformed source is refused
+// without touching the code, and the verifier rejects code a corrupted or
+// hand-made blob could carry.
+
+#include "check.h"
+#include "core/flag_set.h"
+#include "core/script_code.h"
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using avg::FlagSet;
+using avg::ScriptCode;
+namespace sc = avg::script_code;
+
+// Opcode numbers of the instruction encoding; they are part of the compiled
+// blob format, so they do not move
+enum Op : uint32_t {
+    kEnd = 0,
+    kReturn = 1,
+    kConst = 2,
+    kLoad = 3,
+    kStore = 4,
+    kAdd = 8,
+    kJumpIfZero = 19,
+    kOpCount = 25
+};
+
+uint32_t word(uint32_t op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+    return op | a << 8 | b << 16 | c << 24;
+}
+
+const int kVariables = 5;
+
+// Binds names the way GameState does: "@group" to a group index, declared
+// flags to ~flag, anything else to the variable slot named v<N>
+void bind(ScriptCode& code, const FlagSet& flags) {
+    std::vector<std::string> names;
+    sc::getNames(code, names);
+    code.slots.clear();
+    for (const auto& name : names) {
+        if (!name.empty() && name[0] == '@') {
+            code.slots.push_back(flags.findGroup(name.substr(1)));
+        } else if (flags.find(name) >= 0) {
+            code.slots.push_back(~flags.find(name));
+        } else {
+            code.slots.push_back(std::stoi(name.substr(1)));
+        }
+    }
+}
+
+int32_t wrap(int64_t value) {
+    return static_cast<int32_t>(static_cast<uint32_t>(value));
+}
+
+// Random expression tree, printed with only the parentheses precedence needs
+struct Expr {
+    enum Kind { Literal, Variable, Unary, Binary } kind;
+    int value;           // literal, variable number
+    std::string op;
+    std::unique_ptr<Expr> lhs;
+    std::unique_ptr<Expr> rhs;
+};
+
+struct BinaryOp {
+    const char* text;
+    int precedence;
+};
+
+const BinaryOp kBinaryOps[] = {
+    {"||", 1}, {"&&", 2}, {"==", 3}, {"!=", 3}, {"<", 4}, {"<=", 4}, {">", 4}, {">=", 4},
+    {"+", 5}, {"-", 5}, {"*", 6}, {"/", 6}, {"%", 6}
+};
+
+int precedenceOf(const Expr& e) {
+    if (e.kind != Expr::Binary) {
+        return e.kind == Expr::Unary ? 7 : 8;
+    }
+    for (const auto& op : kBinaryOps) {
+        if (e.op == op.text) {
+            return op.precedence;
+        }
+    }
+    return 0;
+}
+
+std::unique_ptr<Expr> randomExpr(std::mt19937_64& rng, int depth) {
+    std::unique_ptr<Expr> e(new Expr());
+    uint64_t pick = depth <= 0 ? rng() % 2 : rng() % 6;
+    if (pick == 0) {
+        e->kind = Expr::Literal;
+        // Mostly small, sometimes large enough to wrap
+        e->value = rng() % 8 == 0 ? static_cast<int>(rng() % 2000000000) : static_cast<int>(rng() % 10);
+    } else if (pick == 1) {
+        e->kind = Expr::Variable;
+        e->value = static_cast<int>(rng() % kVariables);
+    } else if (pick == 2) {
+        e->kind = Expr::Unary;
+        e->op = rng() % 2 ? "!" : "-";
+        e->lhs = randomExpr(rng, depth - 1);
+    } else {
+        e->kind = Expr::Binary;
+        e->op = kBinaryOps[rng() % (sizeof(kBinaryOps) / sizeof(kBinaryOps[0]))].text;
+        e->lhs = randomExpr(rng, depth - 1);
+        e->rhs = randomExpr(rng, depth - 1);
+    }
+    return e;
+}
+
+std::string print(const Expr& e) {
+    switch (e.kind) {
+        case Expr::Literal: return std::to_string(e.value);
+        case Expr::Variable: return "v" + std::to_string(e.value);
+        case Expr::Unary: {
+            std::string operand = print(*e.lhs);
+            if (precedenceOf(*e.lhs) < 7) {
+                operand = "(" + operand + ")";
+            } else if (operand[0] == '-' || operand[0] == '!') {
+                operand = " " + operand;
+            }
+            return e.op + operand;
+        }
+        case Expr::Binary: {
+            int precedence = precedenceOf(e);
+            std::string lhs = print(*e.lhs);
+            std::string rhs = print(*e.rhs);
+            if (precedenceOf(*e.lhs) < precedence) {
+                lhs = "(" + lhs + ")";
+            }
+            // Left associative: an equal right operand needs parentheses
+            if (precedenceOf(*e.rhs) <= precedence) {
+                rhs = "(" + rhs + ")";
+            }
+            return lhs + " " + e.op + " " + rhs;
+        }
+    }
+    return "";
+}
+
+int32_t reference(const Expr& e, const int32_t* values) {
+    switch (e.kind) {
+        case Expr::Literal: return e.value;
+        case Expr::Variable: return values[e.value];
+        case Expr::Unary: {
+            int32_t v = reference(*e.lhs, values);
+            return e.op == "!" ? (v == 0) : wrap(-static_cast<int64_t>(v));
+        }
+        case Expr::Binary: {
+            int64_t l = reference(*e.lhs, values);
+            if (e.op == "&&") {
+                return l != 0 && reference(*e.rhs, values) != 0;
+            }
+            if (e.op == "||") {
+                return l != 0 || reference(*e.rhs, values) != 0;
+            }
+            int64_t r = reference(*e.rhs, values);
+            if (e.op == "==") return l == r;
+            if (e.op == "!=") return l != r;
+            if (e.op == "<") return l < r;
+            if (e.op == "<=") return l <= r;
+            if (e.op == ">") return l > r;
+            if (e.op == ">=") return l >= r;
+            if (e.op == "+") return wrap(l + r);
+            if (e.op == "-") return wrap(l - r);
+            if (e.op == "*") return wrap(l * r);
+            if (e.op == "/") return r == 0 ? 0 : wrap(l / r);
+            if (e.op == "%") return r == 0 ? 0 : wrap(l % r);
+        }
+    }
+    return 0;
+}
+
+int32_t evaluate(const std::string& source, const int32_t* values, const FlagSet& flags) {
+    ScriptCode code;
+    uint32_t entry = sc::kNone;
+    if (!CHECK(sc::compileCondition(source, code, entry))) {
+        std::fprintf(stderr, "  source: %s\n", source.c_str());
+        return 0;
+    }
+    bind(code, flags);
+    return sc::evaluate(code, entry, values, flags);
+}
+
+void checkConditions() {
+    FlagSet flags;
+    int32_t values[kVariables] = {3, -7, 0, 12, 2};
+
+    CHECK(evaluate("1 + 2 * 3", values, flags) == 7);
+    CHECK(evaluate("(1 + 2) * 3", values, flags) == 9);
+    CHECK(evaluate("10 - 4 - 3", values, flags) == 3);
+    CHECK(evaluate("v0 * v1", values, flags) == -21);
+    CHECK(evaluate("7 / -2", values, flags) == -3);
+    CHECK(evaluate("-7 % 3", values, flags) == -1);
+    CHECK(evaluate("5 / 0", values, flags) == 0);
+    CHECK(evaluate("5 % v2", values, flags) == 0);
+    CHECK(evaluate("5 && 7", values, flags) == 1);
+    CHECK(evaluate("0 || 9", values, flags) == 1);
+    CHECK(evaluate("0 && 1 || 1", values, flags) == 1);
+    CHECK(evaluate("!v2 && v3 >= 12", values, flags) == 1);
+    CHECK(evaluate("v0 < v1 == 0", values, flags) == 1);
+    CHECK(evaluate("true + true", values, flags) == 2);
+    CHECK(evaluate("false", values, flags) == 0);
+    CHECK(evaluate("2147483647 + 1", values, flags) == INT32_MIN);
+    CHECK(evaluate("v4 != 2", values, flags) == 0);
+
+    // An empty condition is absent and always true
+    ScriptCode code;
+    uint32_t entry = 0;
+    CHECK(sc::compileCondition("", code, entry));
+    CHECK(entry == sc::kNone && code.empty());
+    CHECK(sc::evaluate(code, entry, values, flags) == 1);
+
+    // Several conditions share one code block, each from its own entry
+    uint32_t first = 0;
+    uint32_t second = 0;
+    CHECK(sc::compileCondition("v0 + v4", code, first));
+    CHECK(sc::compileCondition("v3 / v4", code, second));
+    bind(code, flags);
+    CHECK(sc::evaluate(code, first, values, flags) == 5);
+    CHECK(sc::evaluate(code, second, values, flags) == 6);
+}
+
+void checkRandomConditions() {
+    std::mt19937_64 rng(41);
+    FlagSet flags;
+    for (int i = 0; i < 3000; i++) {
+        int32_t values[kVariables];
+        for (auto& v : values) {
+            v = static_cast<int32_t>(rng() % 21) - 10;
+        }
+        std::unique_ptr<Expr> e = randomExpr(rng, 1 + static_cast<int>(rng() % 5));
+        std::string source = print(*e);
+        int32_t expected = reference(*e, values);
+        int32_t actual = evaluate(source, values, flags);
+        if (!CHECK(actual == expected)) {
+            std::fprintf(stderr, "  %s = %d, expected %d\n", source.c_str(), actual, expected);
+            break;
+        }
+    }
+}
+
+void checkEffects() {
+    FlagSet flags;
+    int met = flags.declare("met");
+    int seen = flags.declare("seen");
+    int route = flags.declareGroup("route");
+    flags.addToGroup(route, met);
+    flags.addToGroup(route, seen);
+
+    ScriptCode code;
+    uint32_t effects = 0;
+    CHECK(sc::compileEffects("v0 = 3; v1 += v0 * 2, v2 -= 1; v3 *= -2; met = 5", code, effects));
+    uint32_t fill = 0;
+    CHECK(sc::compileEffects("set(route)", code, fill));
+    uint32_t clear = 0;
+    CHECK(sc::compileEffects("clear(route)", code, clear));
+    uint32_t test = 0;
+    CHECK(sc::compileCondition("met && count(route) == 2 && all(route) && any(route)", code, test));
+    bind(code, flags);
+    CHECK(sc::verify(code, static_cast<uint32_t>(code.slots.size())));
+
+    int32_t values[kVariables] = {0, 1, 10, 4, 9};
+    uint8_t assigned[kVariables] = {};
+    sc::execute(code, effects, values, assigned, flags);
+    CHECK(values[0] == 3 && values[1] == 7 && values[2] == 9 && values[3] == -8 && values[4] == 9);
+    CHECK(assigned[0] && assigned[1] && assigned[2] && assigned[3] && !assigned[4]);
+    CHECK(flags.test(met) && !flags.test(seen));
+    CHECK(sc::evaluate(code, test, values, flags) == 0);
+
+    sc::execute(code, fill, values, assigned, flags);
+    CHECK(flags.test(met) && flags.test(seen));
+    CHECK(sc::evaluate(code, test, values, flags) == 1);
+
+    sc::execute(code, clear, values, assigned, flags);
+    CHECK(!flags.any(route));
+    CHECK(sc::evaluate(code, test, values, flags) == 0);
+}
+
+void checkSyntaxErrors() {
+    const char* const conditions[] = {
+        "v0 +", "(v0", "v0)", "v0 v1", "* 3", "v0 = 1", "any(", "count(route", "1 +* 2", "@x", "v0 &&"
+    };
+    const char* const effects[] = {
+        "v0", "3 = 4", "v0 =", "v0 += ", "= 1", "v0 = 1;; v1 = 2 +", "set(", "set()", "v0 == 1"
+    };
+
+    ScriptCode code;
+    uint32_t entry = 0;
+    CHECK(sc::compileCondition("v0 > 1", code, entry));
+    std::vector<uint32_t> words = code.words;
+    std::string names = code.names;
+
+    for (const char* source : conditions) {
+        uint32_t failed = 12345;
+        if (!CHECK(!sc::compileCondition(source, code, failed))) {
+            std::fprintf(stderr, "  accepted condition: %s\n", source);
+        }
+        CHECK(code.words == words && code.names == names);
+    }
+    for (const char* source : effects) {
+        uint32_t failed = 12345;
+        if (!CHECK(!sc::compileEffects(source, code, failed))) {
+            std::fprintf(stderr, "  accepted effects: %s\n", source);
+        }
+        CHECK(code.words == words && code.names == names);
+    }
+
+    // Too deep for the registers or the parser
+    std::string deep;
+    for (int i = 0; i < 200; i++) {
+        deep += "(v0 + ";
+    }
+    deep += "1";
+    for (int i = 0; i < 200; i++) {
+        deep += ")";
+    }
+    CHECK(!sc::compileCondition(deep, code, entry));
+    CHECK(code.words == words && code.names == names);
+}
+
+void checkVerifier() {
+    // Well-formed code passes with its own name count, but not with fewer
+    ScriptCode code;
+    uint32_t entry = 0;
+    CHECK(sc::compileCondition("v0 > 1 && v1 < 2 || !v2", code, entry));
+    CHECK(sc::compileEffects("v3 = v0 + 1; v4 -= 2", code, entry));
+    std::vector<std::string> names;
+    sc::getNames(code, names);
+    CHECK(names.size() == 5);
+    CHECK(sc::verify(code, 5));
+    CHECK(!sc::verify(code, 4));
+
+    auto verifies = [](std::vector<uint32_t> words, uint32_t nameCount) {
+        ScriptCode handmade;
+        handmade.words = std::move(words);
+        return sc::verify(handmade, nameCount);
+    };
+
+    CHECK(verifies({}, 0));
+    CHECK(verifies({word(kConst, 0), 7, word(kReturn, 0)}, 0));
+    CHECK(verifies({word(kLoad, 1, 0), word(kReturn, 1)}, 1));
+    // Forward jump to an instruction
+    CHECK(verifies({word(kConst, 0), 0, word(kJumpIfZero, 0), 6, word(kConst, 0), 1, word(kReturn, 0)}, 0));
+    // Jump to the very end is allowed: the run just stops
+    CHECK(verifies({word(kConst, 0), 0, word(kJumpIfZero, 0), 4}, 0));
+
+    CHECK(!verifies({word(kOpCount)}, 0));
+    CHECK(!verifies({word(0xFF)}, 0));
+    // Register out of range, as the target and as an operand
+    CHECK(!verifies({word(kConst, 16), 1}, 0));
+    CHECK(!verifies({word(kAdd, 0, 16, 0)}, 0));
+    CHECK(!verifies({word(kAdd, 0, 0, 200)}, 0));
+    // Name operand past the names
+    CHECK(!verifies({word(kLoad, 0, 1), word(kReturn, 0)}, 1));
+    CHECK(!verifies({word(kStore, 0, 0, 1)}, 1));
+    // Immediate cut off
+    CHECK(!verifies({word(kReturn, 0), word(kConst, 0)}, 0));
+    CHECK(!verifies({word(kJumpIfZero, 0)}, 0));
+    // Backward, self, past the end and into an immediate
+    CHECK(!verifies({word(kConst, 0), 1, word(kJumpIfZero, 0), 0, word(kEnd)}, 0));
+    CHECK(!verifies({word(kConst, 0), 1, word(kJumpIfZero, 0), 2, word(kEnd)}, 0));
+    CHECK(!verifies({word(kConst, 0), 1, word(kJumpIfZero, 0), 6, word(kEnd)}, 0));
+    CHECK(!verifies({word(kJumpIfZero, 0), 3, word(kConst, 0), 9, word(kReturn, 0)}, 0));
+}
+
+// Random corruption of compiled code: whatever the verifier lets through
+// must still run to an end without reaching outside the code or the slots
+void checkCorruptedCode() {
+    ScriptCode pristine;
+    uint32_t entry = 0;
+    CHECK(sc::compileCondition("v0 > 1 && (v1 < 2 || !v2) && v3 * v4 != 6", pristine, entry));
+    CHECK(sc::compileEffects("v3 = v0 + 1; v4 -= 2; v0 *= v1", pristine, entry));
+    FlagSet flags;
+    bind(pristine, flags);
+    const uint32_t nameCount = static_cast<uint32_t>(pristine.slots.size());
+
+    std::mt19937_64 rng(7);
+    int accepted = 0;
+    int rejected = 0;
+    for (int i = 0; i < 20000; i++) {
+        ScriptCode code = pristine;
+        int flips = 1 + static_cast<int>(rng() % 3);
+        for (int f = 0; f < flips; f++) {
+            uint32_t& w = code.words[rng() % code.words.size()];
+            w ^= static_cast<uint32_t>(1 + rng() % 255) << (8 * (rng() % 4));
+        }
+        if (rng() % 8 == 0) {
+            code.words.resize(rng() % code.words.size());
+        }
+
+        if (!sc::verify(code, nameCount)) {
+            rejected++;
+            continue;
+        }
+        accepted++;
+        int32_t values[kVariables] = {1, 2, 3, 4, 5};
+        uint8_t assigned[kVariables] = {};
+        sc::evaluate(code, 0, values, flags);
+        sc::execute(code, 0, values, assigned, flags);
+    }
+    CHECK(rejected > 0);
+    CHECK(accepted > 0);
+}
+
+} // namespace
+
+int main() {
+    checkConditions();
+    checkRandomConditions();
+    checkEffects();
+    checkSyntaxErrors();
+    checkVerifier();
+    checkCorruptedCode();
+    return avg::check::checkResult("script_code_check");
+}
@@ -0,0 +1,269 @@
+// Session snapshots: a record restores exactly the session it was taken
+// from and turns into the same save JSON as serialize(), while truncated or
+// corrupted records are refused without touching the state. Random damage
+// that still passes the checks must restore without reading past the record.
+
+#include "check.h"
+#include "core/game_state.h"
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using avg::GameState;
+using Record = std::vector<uint8_t>;
+
+// Mirrors the record header written by GameState::takeSnapshot
+struct Header {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t variableCount;
+    uint32_t flagCount;
+    uint32_t historyCount;
+    uint32_t historyBytes;
+    uint32_t stringBytes;
+    uint32_t reserved;
+};
+
+Header headerOf(const Record& record) {
+    Header h;
+    std::memcpy(&h, record.data(), sizeof(h));
+    return h;
+}
+
+void setHeader(Record& record, const Header& h) {
+    std::memcpy(record.data(), &h, sizeof(h));
+}
+
+size_t historyOffsetsAt(const Header& h) {
+    return sizeof(Header) + (h.flagCount + 63) / 64 * sizeof(uint64_t) + h.variableCount * sizeof(int32_t);
+}
+
+void setUpSession(GameState& state) {
+    for (const char* id : {"start", "hall \"east\"", "\xe5\xba\xad", "end"}) {
+        avg::DialogueNode node;
+        node.id = id;
+        node.text = "text";
+        state.addNode(node);
+    }
+    state.declareFlags("route", {"met_guide", "saw_letter"});
+    state.setVariable("trust", 3);
+    state.setVariable("gold", -250);
+    state.setVariable("met_guide", 1);
+    state.pushHistory("start");
+    state.pushHistory("hall \"east\"");
+    state.setCurrentNode("\xe5\xba\xad");
+
+    avg::SceneState scene;
+    scene.background = "garden.png";
+    scene.bgm = "theme.ogg";
+    scene.characters[0].character = "alice";
+    scene.characters[0].expression = "smile";
+    scene.characters[2].character = "bob";
+    state.setScene(scene);
+}
+
+// Move the session somewhere else, including a variable slot the record
+// does not cover
+void changeSession(GameState& state) {
+    state.setVariable("trust", 9);
+    state.setVariable("later", 4);
+    state.getFlags().set(state.getFlags().find("met_guide"), false);
+    state.getFlags().set(state.getFlags().find("saw_letter"), true);
+    state.pushHistory("\xe5\xba\xad");
+    state.setCurrentNode("end");
+    avg::SceneState scene;
+    scene.background = "night.png";
+    state.setScene(scene);
+}
+
+void checkRoundTrip() {
+    GameState state;
+    setUpSession(state);
+    const std::string saved = state.serialize();
+
+    Record record;
+    state.takeSnapshot(record);
+    CHECK(headerOf(record).size == record.size());
+    CHECK(state.serializeSnapshot(record.data(), record.size()) == saved);
+
+    changeSession(state);
+    CHECK(state.serialize() != saved);
+    CHECK(state.restoreSnapshot(record.data(), record.size()));
+    CHECK(state.serialize() == saved);
+    CHECK(state.getCurrentNodeId() == "\xe5\xba\xad");
+    CHECK(state.getVariable("trust") == 3);
+    CHECK(state.getVariable("gold") == -250);
+    CHECK(!state.hasVariable("later") || state.getVariable("later") == 0);
+    CHECK(state.getScene().characters[0].expression == "smile");
+    CHECK(state.popHistory() == "hall \"east\"");
+    CHECK(state.popHistory() == "start");
+    CHECK(!state.canGoBack());
+
+    // Retaking reuses the buffer and gives the same bytes
+    CHECK(state.restoreSnapshot(record.data(), record.size()));
+    Record again;
+    state.takeSnapshot(again);
+    Record retaken = record;
+    state.takeSnapshot(retaken);
+    CHECK(again == retaken);
+
+    // The save JSON loads back into the same session
+    GameState loaded;
+    setUpSession(loaded);
+    changeSession(loaded);
+    CHECK(loaded.deserialize(saved.c_str()));
+    CHECK(loaded.getCurrentNodeId() == state.getCurrentNodeId());
+    CHECK(loaded.getVariable("trust") == 3);
+
+    // An empty session round trips too
+    GameState empty;
+    Record blank;
+    empty.takeSnapshot(blank);
+    CHECK(empty.restoreSnapshot(blank.data(), blank.size()));
+    CHECK(empty.serializeSnapshot(blank.data(), blank.size()) == empty.serialize());
+}
+
+// A refused record leaves the state exactly as it was
+bool refused(GameState& state, const Record& record, size_t size) {
+    const std::string before = state.serialize();
+    bool ok = CHECK(!state.restoreSnapshot(record.data(), size));
+    ok = CHECK(state.serializeSnapshot(record.data(), size).empty()) && ok;
+    return CHECK(state.serialize() == before) && ok;
+}
+
+void checkTruncated() {
+    GameState state;
+    setUpSession(state);
+    Record record;
+    state.takeSnapshot(record);
+    changeSession(state);
+
+    CHECK(!state.restoreSnapshot(nullptr, 0));
+    for (size_t size = 0; size < record.size(); size++) {
+        if (!refused(state, record, size)) {
+            std::fprintf(stderr, "  truncated to %zu of %zu bytes\n", size, record.size());
+            break;
+        }
+    }
+
+    // A header that claims the shorter length still does not add up
+    for (size_t cut = 1; cut < 8; cut++) {
+        Record shorter(record.begin(), record.end() - static_cast<std::ptrdiff_t>(cut));
+        Header h = headerOf(shorter);
+        h.size -= static_cast<uint32_t>(cut);
+        setHeader(shorter, h);
+        refused(state, shorter, shorter.size());
+    }
+
+    // Trailing bytes are refused as well
+    Record longer = record;
+    longer.push_back(0);
+    refused(state, longer, longer.size());
+}
+
+void checkCorrupted() {
+    GameState state;
+    setUpSession(state);
+    Record record;
+    state.takeSnapshot(record);
+    changeSession(state);
+    const Header h = headerOf(record);
+
+    Record bad = record;
+    bad[0] ^= 1;
+    refused(state, bad, bad.size());
+
+    // Every count of the header checked against the size (a flag count
+    // within the same word is harmless, hence a step of a whole word)
+    for (size_t field = 1; field < 7; field++) {
+        bad = record;
+        uint32_t value;
+        std::memcpy(&value, bad.data() + field * sizeof(uint32_t), sizeof(value));
+        value += 64;
+        std::memcpy(bad.data() + field * sizeof(uint32_t), &value, sizeof(value));
+        if (!refused(state, bad, bad.size())) {
+            std::fprintf(stderr, "  header field %zu\n", field);
+        }
+    }
+
+    // Sizes that add up but split the strings in the wrong place
+    bad = record;
+    Header moved = h;
+    moved.stringBytes -= 1;
+    moved.historyBytes += 1;
+    setHeader(bad, moved);
+    refused(state, bad, bad.size());
+
+    // History without its final NUL
+    bad = record;
+    bad.back() = 'x';
+    refused(state, bad, bad.size());
+
+    // A history offset into the middle of an id, past the ids, or a later
+    // one back at 0
+    size_t offsets = historyOffsetsAt(h);
+    bad = record;
+    uint32_t offset;
+    std::memcpy(&offset, bad.data() + offsets + sizeof(uint32_t), sizeof(offset));
+    offset += 1;
+    std::memcpy(bad.data() + offsets + sizeof(uint32_t), &offset, sizeof(offset));
+    refused(state, bad, bad.size());
+    offset = h.historyBytes;
+    std::memcpy(bad.data() + offsets + sizeof(uint32_t), &offset, sizeof(offset));
+    refused(state, bad, bad.size());
+    bad = record;
+    offset = 1;
+    std::memcpy(bad.data() + offsets, &offset, sizeof(offset));
+    refused(state, bad, bad.size());
+    bad = record;
+    offset = 0;
+    std::memcpy(bad.data() + offsets + sizeof(uint32_t), &offset, sizeof(offset));
+    refused(state, bad, bad.size());
+
+    // The untouched record still works after all that
+    CHECK(state.restoreSnapshot(record.data(), record.size()));
+}
+
+// Flag words, values and set bytes have no invalid patterns, so random
+// damage may pass; whatever passes must restore and serialize safely
+void checkRandomDamage() {
+    GameState state;
+    setUpSession(state);
+    Record record;
+    state.takeSnapshot(record);
+
+    std::mt19937_64 rng(11);
+    int accepted = 0;
+    for (int i = 0; i < 20000; i++) {
+        Record bad = record;
+        int flips = 1 + static_cast<int>(rng() % 4);
+        for (int f = 0; f < flips; f++) {
+            bad[rng() % bad.size()] ^= static_cast<uint8_t>(1 + rng() % 255);
+        }
+        std::string json = state.serializeSnapshot(bad.data(), bad.size());
+        if (state.restoreSnapshot(bad.data(), bad.size())) {
+            accepted++;
+            CHECK(!json.empty());
+            state.serialize();
+        } else {
+            CHECK(json.empty());
+        }
+    }
+    CHECK(accepted > 0);
+    CHECK(state.restoreSnapshot(record.data(), record.size()));
+}
+
+} // namespace
+
+int main() {
+    checkRoundTrip();
+    checkTruncated();
+    checkCorrupted();
+    checkRandomDamage();
+    return avg::check::checkResult("snapshot_check");
+}
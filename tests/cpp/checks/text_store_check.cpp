@@ -0,0 +1,219 @@
+// TextStore round trips: every stored text reads back byte for byte, for
+// script-like lines, random bytes the first batch never trained on, texts
+// spanning several blocks, and after a clear and retrain. GameState's
+// compactText is driven into its own retrain path as well.
+
+#include "check.h"
+#include "core/game_state.h"
+#include "core/text_store.h"
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using avg::TextStore;
+
+const char* const kWords[] = {
+    "the", "door", "opens", "and", "you", "see", "a", "long", "corridor", "lit", "by",
+    "candles", "Alice", "whispers", "\"Did you hear that?\"", "...", "I", "don't", "know",
+    "maybe", "we", "should", "go", "back", "\xe3\x81\x93\xe3\x82\x93\xe3\x81\xab\xe3\x81\xa1\xe3\x81\xaf",
+    "\xe2\x99\xaa", "[player]", "{trust}"
+};
+
+std::string dialogueLine(std::mt19937_64& rng) {
+    const size_t wordCount = sizeof(kWords) / sizeof(kWords[0]);
+    std::string line;
+    size_t words = 1 + rng() % 24;
+    for (size_t i = 0; i < words; i++) {
+        if (i > 0) {
+            line += ' ';
+        }
+        line += kWords[rng() % wordCount];
+    }
+    return line;
+}
+
+// Any byte value, including NUL and bytes absent from the training text
+std::string randomBytes(std::mt19937_64& rng, size_t length) {
+    std::string text(length, '\0');
+    for (auto& c : text) {
+        c = static_cast<char>(rng() & 0xFF);
+    }
+    return text;
+}
+
+void storeAll(TextStore& store, const std::vector<std::string>& texts, int firstIndex) {
+    std::vector<std::pair<int, const std::string*>> batch;
+    for (size_t i = 0; i < texts.size(); i++) {
+        batch.push_back({firstIndex + static_cast<int>(i), &texts[i]});
+    }
+    store.add(batch);
+}
+
+bool readsBack(const TextStore& store, const std::vector<std::string>& texts, int firstIndex) {
+    bool ok = true;
+    std::string out;
+    for (size_t i = 0; i < texts.size(); i++) {
+        int index = firstIndex + static_cast<int>(i);
+        ok = CHECK(store.contains(index)) && ok;
+        ok = CHECK(store.read(index, out)) && ok;
+        ok = CHECK(out == texts[i]) && ok;
+    }
+    return ok;
+}
+
+void checkRoundTrip() {
+    std::mt19937_64 rng(1);
+    std::vector<std::string> lines;
+    for (int i = 0; i < 3000; i++) {
+        lines.push_back(dialogueLine(rng));
+    }
+
+    TextStore store;
+    CHECK(store.empty());
+    std::vector<const std::string*> samples;
+    for (const auto& line : lines) {
+        samples.push_back(&line);
+    }
+    store.train(samples);
+    storeAll(store, lines, 0);
+    CHECK(!store.empty());
+    readsBack(store, lines, 0);
+
+    TextStore::Stats stats = store.getStats();
+    CHECK(stats.blocks > 1);
+    CHECK(stats.compressedBytes < stats.textBytes);
+
+    // Later batches reuse the codes trained on the first one, so they must
+    // still encode symbols that never appeared in it
+    std::vector<std::string> odd;
+    odd.push_back("x");
+    odd.push_back(std::string(1, '\0'));
+    odd.push_back(std::string(TextStore::kBlockBytes * 3 + 17, 'a'));
+    for (int i = 0; i < 200; i++) {
+        odd.push_back(randomBytes(rng, 1 + rng() % 300));
+    }
+    odd.push_back(randomBytes(rng, TextStore::kBlockBytes * 2 + 5));
+    storeAll(store, odd, 5000);
+    readsBack(store, odd, 5000);
+    // The earlier texts are untouched, whatever the cache holds now
+    readsBack(store, lines, 0);
+
+    // Reading in random order goes through cache misses
+    std::string out;
+    for (int i = 0; i < 2000; i++) {
+        size_t pick = rng() % lines.size();
+        CHECK(store.read(static_cast<int>(pick), out) && out == lines[pick]);
+    }
+
+    // Forgotten texts are gone, the rest stay readable
+    for (int i = 0; i < 3000; i += 2) {
+        store.forget(i);
+    }
+    for (int i = 0; i < 3000; i++) {
+        bool stored = (i % 2) != 0;
+        CHECK(store.contains(i) == stored);
+        CHECK(store.read(i, out) == stored);
+        if (stored) {
+            CHECK(out == lines[i]);
+        }
+    }
+    CHECK(!store.contains(4999));
+    CHECK(!store.read(-1, out));
+    CHECK(!store.read(100000, out));
+}
+
+void checkRetrain() {
+    std::mt19937_64 rng(2);
+    std::vector<std::string> first;
+    for (int i = 0; i < 500; i++) {
+        first.push_back(dialogueLine(rng));
+    }
+    TextStore store;
+    std::vector<const std::string*> samples;
+    for (const auto& text : first) {
+        samples.push_back(&text);
+    }
+    store.train(samples);
+    storeAll(store, first, 0);
+    for (int i = 0; i < 500; i++) {
+        store.forget(i);
+    }
+    CHECK(store.wasteful() || store.getStats().textBytes == 0);
+
+    // A new corpus with different statistics after a clear
+    store.clear();
+    CHECK(store.empty());
+    std::vector<std::string> second;
+    for (int i = 0; i < 800; i++) {
+        second.push_back(randomBytes(rng, 20 + rng() % 200));
+    }
+    samples.clear();
+    for (const auto& text : second) {
+        samples.push_back(&text);
+    }
+    store.train(samples);
+    storeAll(store, second, 0);
+    readsBack(store, second, 0);
+
+    // Untrained store: no dictionary, codes from the first batch only
+    TextStore untrained;
+    storeAll(untrained, first, 10);
+    readsBack(untrained, first, 10);
+}
+
+avg::DialogueNode makeNode(const std::string& id, const std::string& text) {
+    avg::DialogueNode node;
+    node.id = id;
+    node.text = text;
+    return node;
+}
+
+// GameState keeps texts in a TextStore once compacted; replacing most nodes
+// makes the store wasteful, so the next compactText expands and retrains
+void checkGameStateRetrain() {
+    std::mt19937_64 rng(3);
+    avg::GameState state;
+    std::vector<std::string> texts;
+    for (int i = 0; i < 1000; i++) {
+        texts.push_back(dialogueLine(rng));
+        state.addNode(makeNode("n" + std::to_string(i), texts.back()));
+    }
+    state.compactText();
+    CHECK(state.getTextStats().blocks > 0);
+    for (int i = 0; i < 1000; i++) {
+        CHECK(state.getNodeText(state.getNodeIndex("n" + std::to_string(i))) == texts[i]);
+    }
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 1000; i++) {
+            if (rng() % 4 != 0) {
+                texts[i] = randomBytes(rng, 1 + rng() % 120);
+                state.addNode(makeNode("n" + std::to_string(i), texts[i]));
+            }
+        }
+        state.compactText();
+        for (int i = 0; i < 1000; i++) {
+            CHECK(state.getNodeText(state.getNodeIndex("n" + std::to_string(i))) == texts[i]);
+        }
+    }
+
+    state.expandText();
+    CHECK(state.getTextStats().blocks == 0);
+    for (int i = 0; i < 1000; i++) {
+        const avg::DialogueNode* node = state.getNode("n" + std::to_string(i));
+        CHECK(node && node->text == texts[i]);
+    }
+}
+
+} // namespace
+
+int main() {
+    checkRoundTrip();
+    checkRetrain();
+    checkGameStateRetrain();
+    return avg::check::checkResult("text_store_check");
+}
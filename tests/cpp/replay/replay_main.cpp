@@ -0,0 +1,404 @@
+// Session replay for the AVG engine core.
+//
+// Re-executes session logs recorded by the engine (AVGEngine::
+// setSessionRecording) against the native library, either as fast as
+// possible or at the pace they were recorded, and reports the latency of
+// every operation type. A directory of recorded sessions plus the script
+// they were played on makes a performance regression suite.
+//
+// Without logs it synthesises one: a generated script is played through
+// with recording on, and the recorded session is then replayed.
+
+#include "script_generator.h"
+#include "core/avg_engine.h"
+#include "core/session_recorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    const char* scriptPath = nullptr;
+    std::vector<const char*> logPaths;
+    bool paced = false;
+    int repeat = 1;
+    const char* outPath = nullptr;
+    // Synthetic session
+    avg::bench::ScriptShape shape;
+    int steps = 10000;
+    const char* emitScript = nullptr;
+    const char* emitSession = nullptr;
+};
+
+// Latencies of one operation type across every replayed session
+struct OpStats {
+    const char* name;
+    std::vector<double> ns;
+    long long failed = 0;
+};
+
+struct SessionResult {
+    std::string path;
+    size_t events = 0;
+    double totalMs = 0.0;
+    std::string error;
+};
+
+const int kOpCount = static_cast<int>(avg::SessionOp::Reset) + 1;
+
+const char* opName(avg::SessionOp op) {
+    switch (op) {
+        case avg::SessionOp::Script: return "load_script";
+        case avg::SessionOp::Goto: return "goto_node";
+        case avg::SessionOp::Choice: return "select_choice";
+        case avg::SessionOp::Back: return "go_back";
+        case avg::SessionOp::SetVariable: return "set_variable";
+        case avg::SessionOp::Save: return "save_state";
+        case avg::SessionOp::Load: return "load_state";
+        case avg::SessionOp::SnapshotTake: return "snapshot_take";
+        case avg::SessionOp::SnapshotRestore: return "snapshot_restore";
+        case avg::SessionOp::Reset: return "reset";
+    }
+    return "unknown";
+}
+
+void printUsage() {
+    std::printf(
+        "Usage: avg_replay [options] [session.avgr ...]\n"
+        "  --script PATH       script the sessions were recorded on\n"
+        "  --paced             wait for each event's recorded time\n"
+        "  --repeat N          replay each session N times (default 1)\n"
+        "  --out PATH          write JSON results to PATH instead of stdout\n"
+        "Without session logs a session is synthesised and replayed:\n"
+        "  --nodes N           generated script size (default 1000)\n"
+        "  --steps N           recorded operations (default 10000)\n"
+        "  --seed N            generator seed (default 1)\n"
+        "  --emit-script PATH  write the generated script to PATH\n"
+        "  --emit-session PATH write the recorded session to PATH\n");
+}
+
+bool parseArgs(int argc, char** argv, Options& opts) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (std::strcmp(arg, "--paced") == 0) {
+            opts.paced = true;
+            continue;
+        }
+        if (std::strcmp(arg, "--help") == 0 || std::strcmp(arg, "-h") == 0) {
+            printUsage();
+            std::exit(0);
+        }
+        if (std::strncmp(arg, "--", 2) != 0) {
+            opts.logPaths.push_back(arg);
+            continue;
+        }
+        if (!value) {
+            std::fprintf(stderr, "Missing value for %s\n", arg);
+            return false;
+        }
+
+        if (std::strcmp(arg, "--script") == 0) opts.scriptPath = value;
+        else if (std::strcmp(arg, "--repeat") == 0) opts.repeat = std::atoi(value);
+        else if (std::strcmp(arg, "--out") == 0) opts.outPath = value;
+        else if (std::strcmp(arg, "--nodes") == 0) opts.shape.nodeCount = std::atoi(value);
+        else if (std::strcmp(arg, "--steps") == 0) opts.steps = std::atoi(value);
+        else if (std::strcmp(arg, "--seed") == 0) opts.shape.seed = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(arg, "--emit-script") == 0) opts.emitScript = value;
+        else if (std::strcmp(arg, "--emit-session") == 0) opts.emitSession = value;
+        else {
+            std::fprintf(stderr, "Unknown option %s\n", arg);
+            return false;
+        }
+        i++;
+    }
+
+    if (!opts.logPaths.empty() && !opts.scriptPath) {
+        std::fprintf(stderr, "--script is required to replay session logs\n");
+        return false;
+    }
+    if (opts.repeat < 1 || opts.steps < 1 || opts.shape.nodeCount < 2) {
+        std::fprintf(stderr, "Invalid options\n");
+        return false;
+    }
+    return true;
+}
+
+bool readFile(const char* path, std::string& out) {
+    std::FILE* f = std::fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    out.clear();
+    char buffer[65536];
+    size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        out.append(buffer, n);
+    }
+    std::fclose(f);
+    return true;
+}
+
+bool writeFile(const char* path, const void* data, size_t size) {
+    std::FILE* f = std::fopen(path, "wb");
+    if (!f) {
+        std::fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+    std::fwrite(data, 1, size, f);
+    std::fclose(f);
+    return true;
+}
+
+// Play a generated script the way a player would, with recording on. The
+// host clock advances by a plausible reading time per step.
+std::vector<uint8_t> synthesiseSession(const std::string& script, const std::vector<std::string>& ids,
+                                       const Options& opts) {
+    avg::AVGEngine engine;
+    engine.init();
+    engine.setSessionRecording(true);
+    engine.loadScript(script.c_str());
+    engine.gotoNode(ids.front().c_str());
+
+    avg::bench::Random rng(opts.shape.seed + 3);
+    uint64_t now = 0;
+    std::string saved;
+    for (int i = 0; i < opts.steps; i++) {
+        now += static_cast<uint64_t>(rng.range(300, 4000)) * 1000;
+        engine.setSessionTime(now);
+
+        int roll = rng.range(0, 99);
+        const avg::DialogueNode* node = engine.getCurrentNode();
+        if (roll < 4 && engine.canGoBack()) {
+            engine.goBack();
+        } else if (roll < 6) {
+            engine.setVariable(("var" + std::to_string(rng.range(0, 15))).c_str(), rng.range(-100, 100));
+        } else if (roll < 7) {
+            saved = engine.saveState();
+        } else if (roll < 8 && !saved.empty()) {
+            engine.loadState(saved.c_str());
+        } else if (roll < 9) {
+            engine.takeSnapshot(0);
+        } else if (roll < 10 && engine.hasSnapshot(0)) {
+            engine.restoreSnapshot(0);
+        } else if (!node || node->type == avg::NodeType::END) {
+            engine.gotoNode(ids.front().c_str());
+        } else if (!node->choices.empty()) {
+            engine.selectChoice(static_cast<int>(rng.next() % node->choices.size()));
+        } else {
+            engine.gotoNode(node->nextNodeId.c_str());
+        }
+    }
+    engine.setSessionRecording(false);
+    return engine.getSessionLog();
+}
+
+// Run one event; false if the engine refused the call
+bool apply(avg::AVGEngine& engine, const avg::SessionEvent& event, const std::string& script) {
+    switch (event.op) {
+        case avg::SessionOp::Script:
+            return engine.loadScript(script.c_str());
+        case avg::SessionOp::Goto: {
+            if (!event.text.empty() || event.value < 0) {
+                return engine.gotoNode(event.text.c_str());
+            }
+            const avg::DialogueNode* node =
+                engine.getGameState().getNodeByIndex(static_cast<int>(event.value));
+            return node && engine.gotoNode(node->id.c_str());
+        }
+        case avg::SessionOp::Choice:
+            return engine.selectChoice(static_cast<int>(event.value));
+        case avg::SessionOp::Back:
+            return engine.goBack();
+        case avg::SessionOp::SetVariable:
+            engine.setVariable(event.text.c_str(), static_cast<int>(event.value));
+            return true;
+        case avg::SessionOp::Save:
+            return !engine.saveState().empty();
+        case avg::SessionOp::Load:
+            return engine.loadState(event.text.c_str());
+        case avg::SessionOp::SnapshotTake:
+            return engine.takeSnapshot(static_cast<int>(event.value));
+        case avg::SessionOp::SnapshotRestore:
+            return engine.restoreSnapshot(static_cast<int>(event.value));
+        case avg::SessionOp::Reset:
+            engine.reset();
+            return true;
+    }
+    return false;
+}
+
+void replay(const std::vector<avg::SessionEvent>& events, const std::string& script, const Options& opts,
+            std::vector<OpStats>& stats, SessionResult& result) {
+    uint64_t scriptHash = avg::AVGEngine::hashScript(script.c_str());
+    for (const auto& event : events) {
+        if (event.op == avg::SessionOp::Script && event.hash != scriptHash) {
+            result.error = "script hash mismatch";
+            return;
+        }
+    }
+
+    for (int round = 0; round < opts.repeat; round++) {
+        avg::AVGEngine engine;
+        engine.init();
+
+        Clock::time_point start = Clock::now();
+        for (const auto& event : events) {
+            if (opts.paced) {
+                std::this_thread::sleep_until(start + std::chrono::microseconds(event.timeMicros));
+            }
+
+            Clock::time_point before = Clock::now();
+            bool ok = apply(engine, event, script);
+            double ns = std::chrono::duration<double, std::nano>(Clock::now() - before).count();
+
+            OpStats& op = stats[static_cast<int>(event.op)];
+            op.ns.push_back(ns);
+            if (!ok) {
+                op.failed++;
+            }
+            result.totalMs += ns / 1e6;
+        }
+        result.events += events.size();
+    }
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void writeString(std::FILE* out, const char* s) {
+    std::fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') std::fputc('\\', out);
+        std::fputc(*s, out);
+    }
+    std::fputc('"', out);
+}
+
+void writeResults(std::FILE* out, const Options& opts, const std::vector<SessionResult>& sessions,
+                  std::vector<OpStats>& stats) {
+    std::fprintf(out, "{\n  \"suite\": \"avg_replay\",\n  \"engineVersion\": ");
+    writeString(out, AVG_ENGINE_VERSION);
+    std::fprintf(out, ",\n  \"config\": {\"paced\": %s, \"repeat\": %d},\n  \"sessions\": [\n",
+                 opts.paced ? "true" : "false", opts.repeat);
+    for (size_t i = 0; i < sessions.size(); i++) {
+        const SessionResult& s = sessions[i];
+        std::fprintf(out, "    {\"path\": ");
+        writeString(out, s.path.c_str());
+        std::fprintf(out, ", \"events\": %zu, \"busyMs\": %.3f, \"error\": ", s.events, s.totalMs);
+        writeString(out, s.error.c_str());
+        std::fprintf(out, "}%s\n", i + 1 < sessions.size() ? "," : "");
+    }
+    std::fprintf(out, "  ],\n  \"results\": [\n");
+
+    bool first = true;
+    for (auto& op : stats) {
+        if (op.ns.empty()) {
+            continue;
+        }
+        std::sort(op.ns.begin(), op.ns.end());
+        double total = 0.0;
+        for (double ns : op.ns) {
+            total += ns;
+        }
+
+        std::fprintf(out, "%s    {\"name\": ", first ? "" : ",\n");
+        writeString(out, op.name);
+        std::fprintf(out,
+            ", \"operations\": %zu, \"failed\": %lld, \"totalMs\": %.3f, \"meanNs\": %.1f, "
+            "\"p50Ns\": %.1f, \"p95Ns\": %.1f, \"p99Ns\": %.1f, \"maxNs\": %.1f}",
+            op.ns.size(), op.failed, total / 1e6, total / static_cast<double>(op.ns.size()),
+            percentile(op.ns, 0.50), percentile(op.ns, 0.95), percentile(op.ns, 0.99), op.ns.back());
+        first = false;
+    }
+    std::fprintf(out, "\n  ]\n}\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    if (!parseArgs(argc, argv, opts)) {
+        printUsage();
+        return 1;
+    }
+
+    std::string script;
+    std::vector<std::pair<std::string, std::vector<uint8_t>>> logs;
+    if (opts.logPaths.empty()) {
+        std::vector<std::string> ids;
+        script = avg::bench::generateScript(opts.shape, &ids);
+        logs.emplace_back("synthetic", synthesiseSession(script, ids, opts));
+        if ((opts.emitScript && !writeFile(opts.emitScript, script.data(), script.size())) ||
+            (opts.emitSession && !writeFile(opts.emitSession, logs[0].second.data(), logs[0].second.size()))) {
+            return 1;
+        }
+    } else {
+        if (!readFile(opts.scriptPath, script)) {
+            std::fprintf(stderr, "Cannot read %s\n", opts.scriptPath);
+            return 1;
+        }
+        for (const char* path : opts.logPaths) {
+            std::string data;
+            if (!readFile(path, data)) {
+                std::fprintf(stderr, "Cannot read %s\n", path);
+                return 1;
+            }
+            logs.emplace_back(path, std::vector<uint8_t>(data.begin(), data.end()));
+        }
+    }
+
+    std::vector<OpStats> stats(kOpCount);
+    for (int i = 0; i < kOpCount; i++) {
+        stats[i].name = opName(static_cast<avg::SessionOp>(i));
+    }
+
+    int failures = 0;
+    std::vector<SessionResult> sessions;
+    for (const auto& log : logs) {
+        SessionResult result;
+        result.path = log.first;
+        std::vector<avg::SessionEvent> events;
+        if (!avg::SessionRecorder::decode(log.second.data(), log.second.size(), events)) {
+            result.error = "malformed session log";
+        } else {
+            replay(events, script, opts, stats, result);
+        }
+        if (!result.error.empty()) {
+            std::fprintf(stderr, "%s: %s\n", result.path.c_str(), result.error.c_str());
+            failures++;
+        }
+        sessions.push_back(result);
+    }
+
+    std::FILE* out = stdout;
+    if (opts.outPath) {
+        out = std::fopen(opts.outPath, "w");
+        if (!out) {
+            std::fprintf(stderr, "Cannot open %s\n", opts.outPath);
+            return 1;
+        }
+    }
+
+    writeResults(out, opts, sessions, stats);
+
+    if (out != stdout) {
+        std::fclose(out);
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -3,6 +3,28 @@ class AVGEngine {
     constructor() {
         this.wasm = null;
         this.initialized = false;
+        this.analyticsEnabled = false;
+        this.sessionRecording = false;
+
+        // Script modules: moduleSource(id) resolves to the module's JSON text
+        this.moduleSource = (id) => fetch(`../assets/data/modules/${id}.json`).then(r => {
+            if (!r.ok) {
+                throw new Error(`Failed to load module: ${id}`);
+            }
+            return r.text();
+        });
+        this.moduleLoads = new Map();
+
+        // Scene event ring state and asset id -> file name cache
+        this.sceneEventsDropped = 0;
+        this.assetNames = new Map();
+
+        // Backlog page buffer in the WASM heap (grown on demand) and
+        // speaker id -> name cache
+        this.backlogBuffer = 0;
+        this.backlogBufferBytes = 0;
+        this.backlogSpeakers = new Map();
+        this.textDecoder = new TextDecoder();
 
         // Function wrappers
         this.functions = {};
@@ -37,6 +59,32 @@ class AVGEngine {
 
         // Script loading
         this.functions.loadScript = w.cwrap('avg_load_script', 'number', ['string']);
+        this.functions.loadScriptBegin = w.cwrap('avg_load_script_begin', 'number', ['number']);
+        this.functions.loadScriptBeginAsync = w.cwrap('avg_load_script_begin_async', 'number', ['number']);
+        this.functions.loadScriptStep = w.cwrap('avg_load_script_step', 'number', ['number']);
+        this.functions.loadScriptProgress = w.cwrap('avg_load_script_progress', 'number', []);
+        this.functions.hashScript = w.cwrap('avg_hash_script', 'string', ['number']);
+        this.functions.getScriptHash = w.cwrap('avg_get_script_hash', 'string', []);
+        this.functions.exportCompiled = w.cwrap('avg_export_compiled', 'number', []);
+        this.functions.exportCompiledSize = w.cwrap('avg_export_compiled_size', 'number', []);
+        this.functions.importCompiled = w.cwrap('avg_import_compiled', 'number', ['number', 'number']);
+        this.functions.linkScript = w.cwrap('avg_link_script', 'number', ['string', 'number']);
+        this.functions.linkScriptBegin = w.cwrap('avg_link_script_begin', 'number', ['string', 'number', 'number']);
+        this.functions.getUnresolvedLinks = w.cwrap('avg_get_unresolved_links', 'string', []);
+        this.functions.reloadScript = w.cwrap('avg_reload_script', 'number', ['number']);
+        this.functions.reloadLinkedScript = w.cwrap('avg_reload_linked_script', 'number', ['string', 'number']);
+        this.functions.getReloadStats = w.cwrap('avg_get_reload_stats', 'string', []);
+
+        // Script modules
+        this.functions.registerModules = w.cwrap('avg_register_modules', 'number', ['string']);
+        this.functions.loadModule = w.cwrap('avg_load_module', 'number', ['string', 'number']);
+        this.functions.unloadModule = w.cwrap('avg_unload_module', 'number', ['string']);
+        this.functions.isModuleLoaded = w.cwrap('avg_is_module_loaded', 'number', ['string']);
+        this.functions.getPendingModule = w.cwrap('avg_get_pending_module', 'string', []);
+        this.functions.nextPrefetchModule = w.cwrap('avg_next_prefetch_module', 'string', []);
+        this.functions.setModuleBudget = w.cwrap('avg_set_module_budget', null, ['number']);
+        this.functions.setModulePrefetchDepth = w.cwrap('avg_set_module_prefetch_depth', null, ['number']);
+        this.functions.getModuleResidentBytes = w.cwrap('avg_get_module_resident_bytes', 'number', []);
 
         // Navigation
         this.functions.gotoNode = w.cwrap('avg_goto_node', 'number', ['string']);
@@ -44,15 +92,39 @@ class AVGEngine {
         this.functions.goBack = w.cwrap('avg_go_back', 'number', []);
         this.functions.canGoBack = w.cwrap('avg_can_go_back', 'number', []);
 
+        // Timeline
+        this.functions.tick = w.cwrap('avg_tick', 'number', ['number']);
+        this.functions.getTickEvents = w.cwrap('avg_get_tick_events', 'number', []);
+        this.functions.setAutoMode = w.cwrap('avg_set_auto_mode', null, ['number']);
+        this.functions.getAutoMode = w.cwrap('avg_get_auto_mode', 'number', []);
+        this.functions.setTextSpeed = w.cwrap('avg_set_text_speed', null, ['number']);
+        this.functions.setAutoDelay = w.cwrap('avg_set_auto_delay', null, ['number', 'number']);
+        this.functions.completeText = w.cwrap('avg_complete_text', null, []);
+        this.functions.getChoiceTimeRemaining = w.cwrap('avg_get_choice_time_remaining', 'number', []);
+
         // Current node access
         this.functions.getCurrentNodeId = w.cwrap('avg_get_current_node_id', 'string', []);
         this.functions.getNodeType = w.cwrap('avg_get_node_type', 'string', []);
         this.functions.getSpeaker = w.cwrap('avg_get_speaker', 'string', []);
         this.functions.getText = w.cwrap('avg_get_text', 'string', []);
+        this.functions.getTextSpans = w.cwrap('avg_get_text_spans', 'number', []);
+        this.functions.getTextSpanCount = w.cwrap('avg_get_text_span_count', 'number', []);
+        this.functions.getSpanString = w.cwrap('avg_get_span_string', 'string', ['number']);
+        this.functions.getChoiceSpans = w.cwrap('avg_get_choice_spans', 'number', ['number']);
+        this.functions.getChoiceSpanCount = w.cwrap('avg_get_choice_span_count', 'number', ['number']);
+        this.functions.getChoiceSpanString = w.cwrap('avg_get_choice_span_string', 'string', ['number', 'number']);
+        this.functions.setTextCompression = w.cwrap('avg_set_text_compression', null, ['number']);
+        this.functions.getTextStats = w.cwrap('avg_get_text_stats', 'string', []);
+
+        // Localisation
+        this.functions.loadLocale = w.cwrap('avg_load_locale', 'number', ['string']);
+        this.functions.unloadLocale = w.cwrap('avg_unload_locale', null, []);
+        this.functions.getLocale = w.cwrap('avg_get_locale', 'string', []);
         this.functions.getNextNodeId = w.cwrap('avg_get_next_node_id', 'string', []);
         this.functions.getChoiceCount = w.cwrap('avg_get_choice_count', 'number', []);
         this.functions.getChoiceText = w.cwrap('avg_get_choice_text', 'string', ['number']);
         this.functions.getChoiceNext = w.cwrap('avg_get_choice_next', 'string', ['number']);
+        this.functions.getChoiceVisibility = w.cwrap('avg_get_choice_visibility', 'number', []);
 
         // Scene data
         this.functions.getBackground = w.cwrap('avg_get_background', 'string', []);
@@ -65,46 +137,232 @@ class AVGEngine {
         this.functions.setVariable = w.cwrap('avg_set_variable', null, ['string', 'number']);
         this.functions.getVariable = w.cwrap('avg_get_variable', 'number', ['string']);
 
+        // Story flags
+        this.functions.getFlagIndex = w.cwrap('avg_get_flag_index', 'number', ['string']);
+        this.functions.getFlag = w.cwrap('avg_get_flag', 'number', ['number']);
+        this.functions.setFlag = w.cwrap('avg_set_flag', null, ['number', 'number']);
+        this.functions.getFlagGroup = w.cwrap('avg_get_flag_group', 'number', ['string']);
+        this.functions.flagGroupAny = w.cwrap('avg_flag_group_any', 'number', ['number']);
+        this.functions.flagGroupAll = w.cwrap('avg_flag_group_all', 'number', ['number']);
+        this.functions.flagGroupCount = w.cwrap('avg_flag_group_count', 'number', ['number']);
+        this.functions.setFlagGroup = w.cwrap('avg_set_flag_group', null, ['number', 'number']);
+        this.functions.getFlagCount = w.cwrap('avg_get_flag_count', 'number', []);
+        this.functions.getFlagWords = w.cwrap('avg_get_flag_words', 'number', []);
+
         // Save/Load
         this.functions.saveState = w.cwrap('avg_save_state', 'string', []);
         this.functions.loadState = w.cwrap('avg_load_state', 'number', ['string']);
+        this.functions.takeSnapshot = w.cwrap('avg_snapshot_take', 'number', ['number']);
+        this.functions.restoreSnapshot = w.cwrap('avg_snapshot_restore', 'number', ['number']);
+        this.functions.hasSnapshot = w.cwrap('avg_snapshot_has', 'number', ['number']);
+        this.functions.saveSnapshot = w.cwrap('avg_snapshot_save', 'string', ['number']);
+        this.functions.clearSnapshot = w.cwrap('avg_snapshot_clear', null, ['number']);
+
+        // Read tracking
+        this.functions.isNodeRead = w.cwrap('avg_is_node_read', 'number', ['string']);
+        this.functions.isCurrentNodeRead = w.cwrap('avg_is_current_node_read', 'number', []);
+        this.functions.getNodeCount = w.cwrap('avg_get_node_count', 'number', []);
+        this.functions.getReadCount = w.cwrap('avg_get_read_count', 'number', []);
+        this.functions.getChapterNodeCount = w.cwrap('avg_get_chapter_node_count', 'number', ['string']);
+        this.functions.getChapterReadCount = w.cwrap('avg_get_chapter_read_count', 'number', ['string']);
+        this.functions.saveReadState = w.cwrap('avg_save_read_state', 'string', []);
+        this.functions.loadReadState = w.cwrap('avg_load_read_state', 'number', ['string']);
+        this.functions.clearReadState = w.cwrap('avg_clear_read_state', null, []);
+
+        // Analytics
+        this.functions.analyticsEnable = w.cwrap('avg_analytics_enable', null, ['number']);
+        this.functions.analyticsSetTime = w.cwrap('avg_analytics_set_time', null, ['number']);
+        this.functions.analyticsExport = w.cwrap('avg_analytics_export', 'number', []);
+        this.functions.analyticsExportSize = w.cwrap('avg_analytics_export_size', 'number', []);
+        this.functions.analyticsReset = w.cwrap('avg_analytics_reset', null, []);
+        this.functions.sessionRecord = w.cwrap('avg_session_record', null, ['number']);
+        this.functions.sessionSetTime = w.cwrap('avg_session_set_time', null, ['number']);
+        this.functions.sessionLog = w.cwrap('avg_session_log', 'number', []);
+        this.functions.sessionLogSize = w.cwrap('avg_session_log_size', 'number', []);
+        this.functions.getNodeVisitCount = w.cwrap('avg_get_node_visit_count', 'number', ['string']);
+
+        // Tracing
+        this.functions.dumpTrace = w.cwrap('avg_dump_trace', 'string', []);
+        this.functions.clearTrace = w.cwrap('avg_clear_trace', null, []);
 
         // Reset
         this.functions.reset = w.cwrap('avg_reset', null, []);
 
-        // Audio callbacks
-        this.functions.setAudioPlayBGMCallback = w.cwrap('avg_set_audio_play_bgm_callback', null, ['number']);
-        this.functions.setAudioPlaySECallback = w.cwrap('avg_set_audio_play_se_callback', null, ['number']);
-        this.functions.setAudioStopBGMCallback = w.cwrap('avg_set_audio_stop_bgm_callback', null, ['number']);
-        this.functions.triggerAudioFromNode = w.cwrap('avg_trigger_audio_from_node', null, []);
+        // Scene events
+        this.functions.getSceneEvents = w.cwrap('avg_get_scene_events', 'number', []);
+        this.functions.getAssetName = w.cwrap('avg_get_asset_name', 'string', ['number']);
+        this.functions.getSceneState = w.cwrap('avg_get_scene_state', 'string', []);
+
+        // Backlog
+        this.functions.backlogSize = w.cwrap('avg_backlog_size', 'number', []);
+        this.functions.backlogPage = w.cwrap('avg_backlog_page', 'number', ['number', 'number', 'number', 'number']);
+        this.functions.backlogSpeaker = w.cwrap('avg_backlog_speaker', 'string', ['number']);
+
+        // Full-text search
+        this.functions.setSearchIndexing = w.cwrap('avg_set_search_indexing', null, ['number']);
+        this.functions.search = w.cwrap('avg_search', 'number', ['string', 'number']);
+        this.functions.getSearchResults = w.cwrap('avg_get_search_results', 'number', []);
+        this.functions.getNodeId = w.cwrap('avg_get_node_id', 'string', ['number']);
+    }
+
+    // Drain the engine's scene event ring; call once per frame. Returns
+    // [{ type, slot, nodeIndex, asset, detail }] with type one of
+    // AVGEngine.SceneEvent, slot the character slot and file names as asset
+    // ids (see getAssetName). If the ring overflowed since the last drain,
+    // the result has overflowed = true and the caller should rebuild the
+    // scene from getSceneState().
+    drainSceneEvents() {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        // Re-read the heap view every time; it changes when memory grows
+        const words = this.wasm.HEAP32;
+        const base = this.functions.getSceneEvents() >> 2;
+        const head = words[base] >>> 0;
+        let tail = words[base + 1] >>> 0;
+        const mask = words[base + 2] - 1;
+        const dropped = words[base + 3];
+
+        const events = [];
+        while (tail !== head) {
+            const offset = base + 4 + (tail & mask) * 4;
+            events.push({
+                type: words[offset] & 0xffff,
+                slot: words[offset] >>> 16,
+                nodeIndex: words[offset + 1],
+                asset: words[offset + 2],
+                detail: words[offset + 3]
+            });
+            tail = (tail + 1) >>> 0;
+        }
+        words[base + 1] = tail | 0;
+
+        events.overflowed = dropped !== this.sceneEventsDropped;
+        this.sceneEventsDropped = dropped;
+        return events;
+    }
+
+    // File name for a scene event asset id ('' for -1); ids never change
+    getAssetName(assetId) {
+        if (!this.initialized || assetId < 0) {
+            return '';
+        }
+
+        let name = this.assetNames.get(assetId);
+        if (name === undefined) {
+            name = this.functions.getAssetName(assetId) || '';
+            this.assetNames.set(assetId, name);
+        }
+        return name;
+    }
+
+    // Effective scene after the nodes entered so far:
+    // { generation, dirty, background, bgm, characters: [{ name, expression }] }
+    // with one entry per character slot. dirty holds the layers changed since
+    // the last call (AVGEngine.SceneLayer bits).
+    getSceneState() {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        return JSON.parse(this.functions.getSceneState());
+    }
+
+    // Number of lines in the backlog (lines shown this session)
+    getBacklogSize() {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        return this.functions.backlogSize();
     }
 
-    setupAudioCallbacks() {
+    // Backlog lines counting back offset from the newest, oldest first:
+    // [{ nodeIndex, speaker, text }]. Only the requested page crosses the
+    // boundary, in one copy.
+    getBacklogPage(offset, count) {
         if (!this.initialized) {
             throw new Error('Engine not initialized');
         }
-        // Audio is now handled directly in JavaScript via triggerAudio()
-        // No WASM callbacks needed - this avoids addFunction requirements
+
+        const wanted = Math.max(0, Math.min(count, this.functions.backlogSize() - offset));
+        let written = 0;
+        for (;;) {
+            written = this.backlogBuffer
+                ? this.functions.backlogPage(offset, count, this.backlogBuffer, this.backlogBufferBytes)
+                : 0;
+            if (written > 0 && this.wasm.HEAP32[this.backlogBuffer >> 2] >= wanted) {
+                break;
+            }
+            // Too small for the page: grow and retry
+            if (this.backlogBuffer) {
+                this.wasm._free(this.backlogBuffer);
+            }
+            this.backlogBufferBytes = Math.max(16384, this.backlogBufferBytes * 2);
+            this.backlogBuffer = this.wasm._malloc(this.backlogBufferBytes);
+        }
+
+        const words = this.wasm.HEAP32;
+        const base = this.backlogBuffer >> 2;
+        const lineCount = words[base];
+        const textBase = this.backlogBuffer + 8 + lineCount * 16;
+        const lines = [];
+        for (let i = 0; i < lineCount; i++) {
+            const record = base + 2 + i * 4;
+            const start = textBase + (words[record + 2] >>> 0);
+            lines.push({
+                nodeIndex: words[record],
+                speaker: this.getBacklogSpeaker(words[record + 1]),
+                text: this.textDecoder.decode(this.wasm.HEAPU8.subarray(start, start + (words[record + 3] >>> 0)))
+            });
+        }
+        return lines;
     }
 
-    triggerAudio() {
+    // Speaker name for a backlog speaker id ('' for -1); ids never change
+    getBacklogSpeaker(speakerId) {
+        if (speakerId < 0) {
+            return '';
+        }
+
+        let name = this.backlogSpeakers.get(speakerId);
+        if (name === undefined) {
+            name = this.functions.backlogSpeaker(speakerId) || '';
+            this.backlogSpeakers.set(speakerId, name);
+        }
+        return name;
+    }
+
+    // Build (and keep current) the full-text index; off by default
+    setSearchIndexing(enabled) {
         if (!this.initialized) {
             throw new Error('Engine not initialized');
         }
 
-        // Handle audio directly in JavaScript using node data
-        const bgm = this.functions.getBGM();
-        const soundEffect = this.functions.getSoundEffect();
+        this.functions.setSearchIndexing(enabled ? 1 : 0);
+    }
+
+    // Nodes whose speaker, text or choices match query, best first:
+    // [{ nodeIndex, nodeId, position }]. See the C++ API for the syntax.
+    search(query, maxResults = 50) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
 
-        if (bgm) {
-            const fullUrl = `assets/audio/bgm/${bgm}`;
-            audioManager.playBGM(fullUrl, true);
+        const count = this.functions.search(query, maxResults);
+        if (count === 0) {
+            return [];
         }
 
-        if (soundEffect) {
-            const fullUrl = `assets/audio/se/${soundEffect}`;
-            audioManager.playSE(fullUrl);
+        const base = this.functions.getSearchResults() >> 2;
+        const words = this.wasm.HEAP32;
+        const hits = new Array(count);
+        for (let i = 0; i < count; i++) {
+            const nodeIndex = words[base + i * 2];
+            hits[i] = { nodeIndex, nodeId: this.functions.getNodeId(nodeIndex), position: words[base + i * 2 + 1] };
         }
+        return hits;
     }
 
     async loadScript(jsonData) {
@@ -116,11 +374,236 @@ class AVGEngine {
         return this.functions.loadScript(jsonString) === 1;
     }
 
+    // Content hash of script source (hex string), the compiled-cache key
+    hashScript(jsonString) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        const ptr = wasmLoader.writeString(jsonString);
+        try {
+            return this.functions.hashScript(ptr);
+        } finally {
+            wasmLoader.free(ptr);
+        }
+    }
+
+    getScriptHash() {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        return this.functions.getScriptHash();
+    }
+
+    // Linked script graph as a relocatable blob (Uint8Array); empty once a
+    // link, reload or module load has changed the graph since the load
+    exportCompiled() {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        const ptr = this.functions.exportCompiled();
+        const size = this.functions.exportCompiledSize();
+        return this.wasm.HEAPU8.slice(ptr, ptr + size);
+    }
+
+    importCompiled(bytes) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        const ptr = this.wasm._malloc(bytes.length);
+        try {
+            this.wasm.HEAPU8.set(bytes, ptr);
+            return this.functions.importCompiled(ptr, bytes.length) === 1;
+        } finally {
+            this.wasm._free(ptr);
+        }
+    }
+
+    // Link another script file (e.g. a DLC route) under a namespace. Its node
+    // ids become "<namespace>:<id>"; fails if any of them already exist.
+    linkScript(nameSpace, jsonData) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        const jsonString = typeof jsonData === 'string' ? jsonData : JSON.stringify(jsonData);
+        const ptr = wasmLoader.writeString(jsonString);
+        try {
+            return this.functions.linkScript(nameSpace, ptr) === 1;
+        } finally {
+            wasmLoader.free(ptr);
+        }
+    }
+
+    // Apply an edited script without restarting. Returns
+    // { added, changed, unchanged, removed } or null if the script is invalid.
+    reloadScript(jsonData, nameSpace) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        const jsonString = typeof jsonData === 'string' ? jsonData : JSON.stringify(jsonData);
+        const ptr = wasmLoader.writeString(jsonString);
+        let ok;
+        try {
+            ok = nameSpace === undefined
+                ? this.functions.reloadScript(ptr) === 1
+                : this.functions.reloadLinkedScript(nameSpace, ptr) === 1;
+        } finally {
+            wasmLoader.free(ptr);
+        }
+
+        return ok ? JSON.parse(this.functions.getReloadStats()) : null;
+    }
+
+    // References from linked files that do not name a node yet
+    getUnresolvedLinks() {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        return JSON.parse(this.functions.getUnresolvedLinks() || '[]');
+    }
+
+    // Load a script in time-sliced steps, yielding to the browser between
+    // frames. options: budgetMicros (per frame), onProgress(0..1), useWorker,
+    // namespace (link the file like linkScript instead of loading it)
+    async loadScriptIncremental(jsonData, options = {}) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        const budgetMicros = options.budgetMicros ?? 4000;
+        const onProgress = options.onProgress ?? null;
+        const jsonString = typeof jsonData === 'string' ? jsonData : JSON.stringify(jsonData);
+
+        // The engine copies the input, so the heap buffer is freed right away
+        const ptr = wasmLoader.writeString(jsonString);
+        let started = false;
+        try {
+            if (options.namespace !== undefined) {
+                started = this.functions.linkScriptBegin(options.namespace, ptr, options.useWorker ? 1 : 0) === 1;
+            } else if (options.useWorker) {
+                started = this.functions.loadScriptBeginAsync(ptr) === 1;
+            }
+            if (!started && options.namespace === undefined) {
+                started = this.functions.loadScriptBegin(ptr) === 1;
+            }
+        } finally {
+            wasmLoader.free(ptr);
+        }
+
+        if (!started) {
+            return false;
+        }
+
+        const nextFrame = () => new Promise(resolve => {
+            if (typeof requestAnimationFrame === 'function') {
+                requestAnimationFrame(() => resolve());
+            } else {
+                setTimeout(resolve, 0);
+            }
+        });
+
+        while (true) {
+            const result = this.functions.loadScriptStep(budgetMicros);
+            if (onProgress) {
+                onProgress(this.functions.loadScriptProgress());
+            }
+            if (result !== 0) {
+                return result === 1;
+            }
+            await nextFrame();
+        }
+    }
+
+    registerModules(manifest) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        const json = typeof manifest === 'string' ? manifest : JSON.stringify(manifest);
+        return this.functions.registerModules(json) === 1;
+    }
+
+    setModuleSource(source) {
+        this.moduleSource = source;
+    }
+
+    setModuleBudget(bytes, prefetchDepth) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        this.functions.setModuleBudget(bytes);
+        if (prefetchDepth !== undefined) {
+            this.functions.setModulePrefetchDepth(prefetchDepth);
+        }
+    }
+
+    // Fetch and load a module once, sharing the request between callers
+    loadModule(moduleId) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        if (this.moduleLoads.has(moduleId)) {
+            return this.moduleLoads.get(moduleId);
+        }
+
+        const promise = Promise.resolve(this.moduleSource(moduleId)).then(text => {
+            const json = typeof text === 'string' ? text : JSON.stringify(text);
+            // Module files can be large; pass them on the heap, not the stack
+            const ptr = wasmLoader.writeString(json);
+            try {
+                return this.functions.loadModule(moduleId, ptr) === 1;
+            } finally {
+                wasmLoader.free(ptr);
+            }
+        }).finally(() => {
+            this.moduleLoads.delete(moduleId);
+        });
+
+        this.moduleLoads.set(moduleId, promise);
+        return promise;
+    }
+
+    // Load the module a blocked navigation is waiting for, if any.
+    // Resolves to true once the navigation has completed.
+    async resolvePendingModule() {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        const moduleId = this.functions.getPendingModule();
+        if (!moduleId) {
+            return false;
+        }
+
+        return this.loadModule(moduleId);
+    }
+
+    // Start background loads for modules the current node leads into
+    prefetchModules() {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        let moduleId;
+        while ((moduleId = this.functions.nextPrefetchModule())) {
+            this.loadModule(moduleId).catch(error => console.warn('Module prefetch failed:', error));
+        }
+    }
+
     gotoNode(nodeId) {
         if (!this.initialized) {
             throw new Error('Engine not initialized');
         }
 
+        this.stampTime();
         return this.functions.gotoNode(nodeId) === 1;
     }
 
@@ -129,6 +612,7 @@ class AVGEngine {
             throw new Error('Engine not initialized');
         }
 
+        this.stampTime();
         return this.functions.selectChoice(choiceIndex) === 1;
     }
 
@@ -137,6 +621,7 @@ class AVGEngine {
             throw new Error('Engine not initialized');
         }
 
+        this.stampTime();
         return this.functions.goBack() === 1;
     }
 
@@ -148,6 +633,83 @@ class AVGEngine {
         return this.functions.canGoBack() === 1;
     }
 
+    // Advance the engine timeline by deltaMicros. Returns the fired events as
+    // { type, nodeIndex, value } with type one of AVGEngine.TimelineEvent;
+    // after AUTO_ADVANCE or CHOICE_TIMEOUT the engine is already on the next node.
+    tick(deltaMicros) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        this.stampTime();
+        const count = this.functions.tick(Math.max(0, Math.round(deltaMicros)));
+        if (count === 0) {
+            return [];
+        }
+
+        const base = this.functions.getTickEvents() >> 2;
+        const words = this.wasm.HEAP32;
+        const events = new Array(count);
+        for (let i = 0; i < count; i++) {
+            const offset = base + i * 3;
+            events[i] = { type: words[offset], nodeIndex: words[offset + 1], value: words[offset + 2] };
+        }
+        return events;
+    }
+
+    setAutoMode(enabled) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        this.functions.setAutoMode(enabled ? 1 : 0);
+    }
+
+    isAutoMode() {
+        if (!this.initialized) {
+            return false;
+        }
+
+        return this.functions.getAutoMode() === 1;
+    }
+
+    // Typewriter speed in milliseconds per character
+    setTextSpeed(msPerChar) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        this.functions.setTextSpeed(Math.round(msPerChar * 1000));
+    }
+
+    // Auto mode reading time: baseMs + msPerChar per character
+    setAutoDelay(baseMs, msPerChar) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        this.functions.setAutoDelay(Math.round(baseMs * 1000), Math.round(msPerChar * 1000));
+    }
+
+    // The player skipped the typewriter effect
+    completeText() {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        this.functions.completeText();
+    }
+
+    // Milliseconds left on the current timed choice, or -1
+    getChoiceTimeRemaining() {
+        if (!this.initialized) {
+            return -1;
+        }
+
+        const micros = this.functions.getChoiceTimeRemaining();
+        return micros < 0 ? -1 : micros / 1000;
+    }
+
     getCurrentNode() {
         if (!this.initialized) {
             return null;
@@ -163,6 +725,7 @@ class AVGEngine {
             type: this.functions.getNodeType(),
             speaker: this.functions.getSpeaker(),
             text: this.functions.getText(),
+            spans: this.getTextSpans(),
             nextNodeId: this.functions.getNextNodeId(),
             background: this.functions.getBackground(),
             character: this.functions.getCharacter(),
@@ -172,15 +735,20 @@ class AVGEngine {
             choices: []
         };
 
-        // Get choices
+        // Get choices; their conditions are evaluated in one call
         const choiceCount = this.functions.getChoiceCount();
         if (typeof choiceCount === 'number' && choiceCount > 0) {
+            const visibility = this.functions.getChoiceVisibility();
             for (let i = 0; i < choiceCount; i++) {
                 const text = this.functions.getChoiceText(i);
                 const nextNodeId = this.functions.getChoiceNext(i);
                 node.choices.push({
                     text: text || '',
-                    nextNodeId: nextNodeId || ''
+                    spans: this.readSpans(this.functions.getChoiceSpanCount(i),
+                                          () => this.functions.getChoiceSpans(i),
+                                          (offset) => this.functions.getChoiceSpanString(i, offset)),
+                    nextNodeId: nextNodeId || '',
+                    visible: visibility ? this.wasm.HEAPU8[visibility + i] === 1 : true
                 });
             }
         }
@@ -188,11 +756,100 @@ class AVGEngine {
         return node;
     }
 
+    // Markup spans of the current node's text, tokenised by the engine at
+    // load: [{ type, style, start, length, color, value, string }] with type
+    // one of AVGEngine.TextSpan and style AVGEngine.TextStyle bits. start and
+    // length count codepoints of the node's text. string is the ruby
+    // annotation or variable name. Empty when the text has no markup.
+    getTextSpans() {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        return this.readSpans(this.functions.getTextSpanCount(),
+                              () => this.functions.getTextSpans(),
+                              (offset) => this.functions.getSpanString(offset));
+    }
+
+    // Span records of five 32-bit words each, for node or choice text
+    readSpans(count, getPointer, getString) {
+        if (count <= 0) {
+            return [];
+        }
+
+        const words = this.wasm.HEAP32;
+        const base = getPointer() >> 2;
+        const spans = [];
+        for (let i = 0; i < count; i++) {
+            const offset = base + i * 5;
+            const span = {
+                type: words[offset] & 0xffff,
+                style: words[offset] >>> 16,
+                start: words[offset + 1] >>> 0,
+                length: words[offset + 2] >>> 0,
+                color: words[offset + 3] >>> 0,
+                value: words[offset + 4] >>> 0,
+                string: ''
+            };
+            if (span.type === AVGEngine.TextSpan.RUBY || span.type === AVGEngine.TextSpan.VARIABLE) {
+                span.string = getString(span.value) || '';
+            }
+            spans.push(span);
+        }
+        return spans;
+    }
+
+    // Keep dialogue text compressed in engine memory; decoded on access
+    setTextCompression(enabled) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        this.functions.setTextCompression(enabled ? 1 : 0);
+    }
+
+    getTextStats() {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        return JSON.parse(this.functions.getTextStats());
+    }
+
+    // Replace the active locale with a string table
+    // ({locale, strings: [{id, text, speaker, choices}]}); re-read the
+    // current node afterwards to show it in the new language
+    loadLocale(jsonData) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        const jsonString = typeof jsonData === 'string' ? jsonData : JSON.stringify(jsonData);
+        return this.functions.loadLocale(jsonString) === 1;
+    }
+
+    unloadLocale() {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        this.functions.unloadLocale();
+    }
+
+    getLocale() {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        return this.functions.getLocale();
+    }
+
     setVariable(name, value) {
         if (!this.initialized) {
             throw new Error('Engine not initialized');
         }
 
+        this.stampTime();
         this.functions.setVariable(name, value);
     }
 
@@ -204,11 +861,88 @@ class AVGEngine {
         return this.functions.getVariable(name);
     }
 
+    // Story flags. Look an index up once with getFlagIndex (-1 if the
+    // script does not declare the name) and use it from then on.
+    getFlagIndex(name) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        return this.functions.getFlagIndex(name);
+    }
+
+    getFlag(index) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        return this.functions.getFlag(index) === 1;
+    }
+
+    setFlag(index, value) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        this.functions.setFlag(index, value ? 1 : 0);
+    }
+
+    getFlagGroup(name) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        return this.functions.getFlagGroup(name);
+    }
+
+    // { any, all, count } over a group's flags
+    testFlagGroup(group) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        return {
+            any: this.functions.flagGroupAny(group) === 1,
+            all: this.functions.flagGroupAll(group) === 1,
+            count: this.functions.flagGroupCount(group)
+        };
+    }
+
+    setFlagGroup(group, value) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        this.functions.setFlagGroup(group, value ? 1 : 0);
+    }
+
+    // Every flag as a Uint8Array of 0/1 in index order
+    getFlags() {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        const count = this.functions.getFlagCount();
+        const result = new Uint8Array(count);
+        const ptr = this.functions.getFlagWords();
+        if (!ptr || count === 0) {
+            return result;
+        }
+
+        // The bitset is 64-bit little-endian words, read as 32-bit halves
+        const base = ptr >> 2;
+        for (let i = 0; i < count; i++) {
+            result[i] = (this.wasm.HEAP32[base + (i >> 5)] >>> (i & 31)) & 1;
+        }
+        return result;
+    }
+
     saveState() {
         if (!this.initialized) {
             throw new Error('Engine not initialized');
         }
 
+        this.stampTime();
         return this.functions.saveState();
     }
 
@@ -217,14 +951,192 @@ class AVGEngine {
             throw new Error('Engine not initialized');
         }
 
+        this.stampTime();
         return this.functions.loadState(saveData) === 1;
     }
 
+    // In-memory snapshot slots (0-15): take and restore copy the session
+    // inside the engine without going through JSON. saveSnapshot returns a
+    // slot as saveState() JSON for writing to storage later.
+    takeSnapshot(slot) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        this.stampTime();
+        return this.functions.takeSnapshot(slot) === 1;
+    }
+
+    restoreSnapshot(slot) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        this.stampTime();
+        return this.functions.restoreSnapshot(slot) === 1;
+    }
+
+    hasSnapshot(slot) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        return this.functions.hasSnapshot(slot) === 1;
+    }
+
+    saveSnapshot(slot) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        return this.functions.saveSnapshot(slot);
+    }
+
+    clearSnapshot(slot) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        this.functions.clearSnapshot(slot);
+    }
+
+    isNodeRead(nodeId) {
+        if (!this.initialized) {
+            return false;
+        }
+
+        return this.functions.isNodeRead(nodeId) === 1;
+    }
+
+    // True if the current node was already read before this visit (skip-read-only mode)
+    isCurrentNodeRead() {
+        if (!this.initialized) {
+            return false;
+        }
+
+        return this.functions.isCurrentNodeRead() === 1;
+    }
+
+    // Completion statistics; pass a chapter name to restrict to that chapter
+    getReadStats(chapter) {
+        if (!this.initialized) {
+            return { read: 0, total: 0 };
+        }
+
+        if (chapter) {
+            return {
+                read: this.functions.getChapterReadCount(chapter),
+                total: this.functions.getChapterNodeCount(chapter)
+            };
+        }
+
+        return {
+            read: this.functions.getReadCount(),
+            total: this.functions.getNodeCount()
+        };
+    }
+
+    saveReadState() {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        return this.functions.saveReadState();
+    }
+
+    loadReadState(readData) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        return this.functions.loadReadState(readData) === 1;
+    }
+
+    setAnalyticsEnabled(enabled) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        this.analyticsEnabled = !!enabled;
+        this.stampTime();
+        this.functions.analyticsEnable(this.analyticsEnabled ? 1 : 0);
+    }
+
+    // Hand the engine the current time before each transition so dwell times
+    // are measured and recorded calls carry their timestamps
+    stampTime() {
+        if (this.analyticsEnabled || this.sessionRecording) {
+            const now = performance.now() * 1000;
+            if (this.analyticsEnabled) {
+                this.functions.analyticsSetTime(now);
+            }
+            if (this.sessionRecording) {
+                this.functions.sessionSetTime(now);
+            }
+        }
+    }
+
+    // Session recording for the native replay tool (avg_replay)
+    setSessionRecording(enabled) {
+        if (!this.initialized) {
+            throw new Error('Engine not initialized');
+        }
+
+        this.sessionRecording = !!enabled;
+        this.stampTime();
+        this.functions.sessionRecord(this.sessionRecording ? 1 : 0);
+    }
+
+    // Copy of the recorded session log (the recording may continue)
+    exportSessionLog() {
+        if (!this.initialized) {
+            return null;
+        }
+
+        const ptr = this.functions.sessionLog();
+        const size = this.functions.sessionLogSize();
+        return this.wasm.HEAPU8.slice(ptr, ptr + size);
+    }
+
+    // Copy of the compact analytics blob, ready to upload
+    exportAnalytics() {
+        if (!this.initialized) {
+            return null;
+        }
+
+        const ptr = this.functions.analyticsExport();
+        const size = this.functions.analyticsExportSize();
+        return this.wasm.HEAPU8.slice(ptr, ptr + size);
+    }
+
+    resetAnalytics() {
+        if (this.initialized) {
+            this.stampTime();
+            this.functions.analyticsReset();
+        }
+    }
+
+    // Chrome Trace Event Format JSON; open in chrome://tracing or Perfetto
+    dumpTrace() {
+        if (!this.initialized) {
+            return null;
+        }
+
+        return JSON.parse(this.functions.dumpTrace());
+    }
+
+    clearTrace() {
+        if (this.initialized) {
+            this.functions.clearTrace();
+        }
+    }
+
     reset() {
         if (!this.initialized) {
             throw new Error('Engine not initialized');
         }
 
+        this.stampTime();
         this.functions.reset();
     }
 
@@ -236,5 +1148,46 @@ class AVGEngine {
     }
 }
 
+// Timeline event types returned by AVGEngine.tick()
+AVGEngine.TimelineEvent = Object.freeze({
+    TEXT_REVEALED: 1,
+    AUTO_ADVANCE: 2,
+    SOUND_EFFECT: 3,
+    CHOICE_TIMEOUT: 4
+});
+
+// Scene event types returned by AVGEngine.drainSceneEvents()
+AVGEngine.SceneEvent = Object.freeze({
+    BGM_CHANGE: 1,
+    BGM_STOP: 2,
+    SOUND_EFFECT: 3,
+    BACKGROUND: 4,
+    CHARACTER_ENTER: 5,
+    CHARACTER_EXIT: 6,
+    CHARACTER_EXPRESSION: 7,
+    CHOICE_SHOWN: 8
+});
+
+// Span types and style bits returned by AVGEngine.getTextSpans()
+AVGEngine.TextSpan = Object.freeze({
+    TEXT: 1,
+    PAUSE: 2,
+    RUBY: 3,
+    VARIABLE: 4
+});
+
+AVGEngine.TextStyle = Object.freeze({
+    BOLD: 1,
+    ITALIC: 2,
+    COLOR: 4
+});
+
+// Layer bits in getSceneState().dirty
+AVGEngine.SceneLayer = Object.freeze({
+    BACKGROUND: 1,
+    BGM: 2,
+    character: slot => 4 << slot
+});
+
 // Global engine instance
 const avgEngine = new AVGEngine();
@@ -0,0 +1,80 @@
+// Compiled script cache in IndexedDB, keyed by the script's content hash.
+// A hit skips JSON parsing entirely; a miss parses and stores the result.
+class ScriptCache {
+    constructor() {
+        this.dbName = 'avg_script_cache';
+        this.storeName = 'compiled';
+        this.db = null;
+    }
+
+    async open() {
+        if (this.db || typeof indexedDB === 'undefined') {
+            return this.db;
+        }
+
+        this.db = await new Promise(resolve => {
+            const request = indexedDB.open(this.dbName, 1);
+            request.onupgradeneeded = () => request.result.createObjectStore(this.storeName);
+            request.onsuccess = () => resolve(request.result);
+            // Private browsing etc.: run without a cache
+            request.onerror = () => resolve(null);
+        });
+        return this.db;
+    }
+
+    async get(hash) {
+        const db = await this.open();
+        if (!db) {
+            return null;
+        }
+
+        return new Promise(resolve => {
+            const request = db.transaction(this.storeName, 'readonly').objectStore(this.storeName).get(hash);
+            request.onsuccess = () => resolve(request.result || null);
+            request.onerror = () => resolve(null);
+        });
+    }
+
+    async put(hash, bytes) {
+        const db = await this.open();
+        if (!db) {
+            return;
+        }
+
+        // One entry per script: drop blobs of older versions
+        const store = db.transaction(this.storeName, 'readwrite').objectStore(this.storeName);
+        store.clear();
+        store.put(bytes, hash);
+    }
+
+    // Load a script through the cache. options are passed to
+    // avgEngine.loadScriptIncremental on a miss.
+    async loadScript(jsonString, options = {}) {
+        const hash = avgEngine.hashScript(jsonString);
+
+        const cached = await this.get(hash);
+        // The blob carries the hash it was exported under; a mismatch means
+        // a stale entry, so parse instead
+        if (cached && avgEngine.importCompiled(cached) && avgEngine.getScriptHash() === hash) {
+            options.onProgress?.(1);
+            return true;
+        }
+
+        const loaded = await avgEngine.loadScriptIncremental(jsonString, options);
+        if (loaded && avgEngine.getScriptHash() === hash) {
+            try {
+                // Empty when the graph was linked or reloaded in the meantime
+                const bytes = avgEngine.exportCompiled();
+                if (bytes.length > 0) {
+                    await this.put(hash, bytes);
+                }
+            } catch (error) {
+                console.warn('Failed to cache compiled script:', error);
+            }
+        }
+        return loaded;
+    }
+}
+
+// Global script cache instance
+const scriptCache = new ScriptCache();
@@ -30,7 +30,12 @@ class ChoiceUI {
 
         // Set question text
         if (this.choiceQuestion) {
-            this.choiceQuestion.textContent = node.text || 'Choose an option:';
+            this.choiceQuestion.textContent = '';
+            if (node.text) {
+                textRenderer.fill(textRenderer.layout(node.text, node.spans || [], this.choiceQuestion));
+            } else {
+                this.choiceQuestion.textContent = 'Choose an option:';
+            }
         }
 
         // Clear previous choices
@@ -39,9 +44,13 @@ class ChoiceUI {
         // Create choice buttons
         return new Promise(resolve => {
             node.choices.forEach((choice, index) => {
+                // Hidden by its "if" condition; indices stay the engine's
+                if (choice.visible === false) {
+                    return;
+                }
                 const button = document.createElement('button');
                 button.className = 'choice-button';
-                button.textContent = choice.text;
+                textRenderer.fill(textRenderer.layout(choice.text, choice.spans || [], button));
                 button.onclick = async () => {
                     await audioManager.playSE('assets/audio/se/click.mp3');
                     this.clear();
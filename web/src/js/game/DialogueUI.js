@@ -29,13 +29,14 @@ class DialogueUI {
         this.removeClickHandler();
 
         this.show();
-        await textRenderer.setText(node.text, node.speaker, true);
+        await textRenderer.setText(node.text, node.speaker, true, node.spans);
 
         // Wait for user input
         return new Promise(resolve => {
             this.clickHandler = () => {
                 if (textRenderer.isTyping) {
                     textRenderer.skip();
+                    avgEngine.completeText();
                 } else {
                     this.removeClickHandler();
                     resolve();
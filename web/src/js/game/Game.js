@@ -5,9 +5,15 @@ class Game {
         this.isPaused = false;
         this.autoMode = false;
         this.skipMode = false;
+
+        // Bumped whenever the engine timeline moves to another node
+        this.timelineMoves = 0;
+        this.timelineWaiter = null;
+        this.resumeWaiter = null;
+        this.timelineStarted = false;
     }
 
-    async init() {
+    async init(onProgress = null) {
         try {
             // Initialize WASM engine
             const success = await avgEngine.init('../build/wasm/avg_engine.wasm');
@@ -17,7 +23,18 @@ class Game {
 
             // Load game script
             const script = await assetLoader.loadJSON('../assets/data/script.json');
-            await avgEngine.loadScript(script);
+
+            // Chapters split out by scripts/split_script.js load on demand
+            if (script.modules) {
+                avgEngine.registerModules({ modules: script.modules });
+            }
+
+            const loaded = await scriptCache.loadScript(JSON.stringify(script), { onProgress });
+            if (!loaded) {
+                throw new Error('Failed to load script');
+            }
+            // The start node is already marked read; this merges the rest
+            saveSystem.loadReadState();
 
             // Setup event listeners
             this.setupEventListeners();
@@ -68,47 +85,136 @@ class Game {
         document.getElementById('game-screen')?.classList.add('active');
 
         // Start game loop
+        this.startTimeline();
         await this.gameLoop();
     }
 
+    // Advance the engine timeline once per animation frame
+    startTimeline() {
+        if (this.timelineStarted) {
+            return;
+        }
+        this.timelineStarted = true;
+        avgEngine.setTextSpeed(textRenderer.typewriterSpeed);
+
+        let last = performance.now();
+        const frame = (now) => {
+            const delta = now - last;
+            last = now;
+            if (this.isRunning && !this.isPaused) {
+                this.handleTimelineEvents(avgEngine.tick(delta * 1000));
+                sceneManager.update();
+            }
+            requestAnimationFrame(frame);
+        };
+        requestAnimationFrame(frame);
+    }
+
+    handleTimelineEvents(events) {
+        for (const event of events) {
+            // Sound effects arrive as scene events
+            switch (event.type) {
+                case AVGEngine.TimelineEvent.AUTO_ADVANCE:
+                case AVGEngine.TimelineEvent.CHOICE_TIMEOUT:
+                    this.timelineMoves++;
+                    if (this.timelineWaiter) {
+                        this.timelineWaiter();
+                        this.timelineWaiter = null;
+                    }
+                    break;
+            }
+        }
+    }
+
+    // Resolves once the timeline has moved past the node entered at `moves`
+    waitForTimeline(moves) {
+        if (this.timelineMoves !== moves) {
+            return Promise.resolve();
+        }
+        return new Promise(resolve => {
+            this.timelineWaiter = resolve;
+        });
+    }
+
+    waitForResume() {
+        return new Promise(resolve => {
+            this.resumeWaiter = resolve;
+        });
+    }
+
+    nextFrame() {
+        return new Promise(resolve => requestAnimationFrame(resolve));
+    }
+
     async gameLoop() {
         while (this.isRunning) {
             if (this.isPaused) {
-                await this.sleep(100);
+                await this.waitForResume();
                 continue;
             }
 
+            // Finish a navigation that is waiting for its chapter module
+            await avgEngine.resolvePendingModule();
+            avgEngine.prefetchModules();
+
             const node = avgEngine.getCurrentNode();
             if (!node) {
                 console.error('No current node');
                 break;
             }
+            saveSystem.scheduleReadStatePersist();
 
-            // Load scene
-            await sceneManager.loadScene(node);
+            const moves = this.timelineMoves;
+
+            // Apply the scene changes of entering this node
+            await sceneManager.update();
 
             // Handle node based on type
             if (node.type === 'dialogue') {
-                await dialogueUI.displayDialogue(node);
+                // Skip mode only skips text that has been read before
+                if (this.skipMode && !avgEngine.isCurrentNodeRead()) {
+                    this.skipMode = false;
+                }
 
-                // Auto advance if next node exists
-                if (node.nextNodeId) {
-                    avgEngine.gotoNode(node.nextNodeId);
+                let movedByTimeline = false;
+                if (this.skipMode) {
+                    textRenderer.setText(node.text, node.speaker, false, node.spans);
+                    await this.nextFrame();
                 } else {
-                    break;
+                    // Auto mode advances from the engine timeline
+                    movedByTimeline = await Promise.race([
+                        dialogueUI.displayDialogue(node).then(() => false),
+                        this.waitForTimeline(moves).then(() => true)
+                    ]);
+                    if (movedByTimeline) {
+                        dialogueUI.removeClickHandler();
+                        textRenderer.skip();
+                    }
+                }
+
+                if (!movedByTimeline) {
+                    if (node.nextNodeId) {
+                        avgEngine.gotoNode(node.nextNodeId);
+                    } else {
+                        break;
+                    }
                 }
             } else if (node.type === 'choice') {
-                const choiceIndex = await choiceUI.displayChoices(node);
+                // A timed choice may be decided by the timeline
+                const choiceIndex = await Promise.race([
+                    choiceUI.displayChoices(node),
+                    this.waitForTimeline(moves).then(() => -1)
+                ]);
                 if (choiceIndex >= 0) {
                     avgEngine.selectChoice(choiceIndex);
+                } else {
+                    choiceUI.clear();
                 }
             } else if (node.type === 'end') {
                 dialogueUI.hide();
                 choiceUI.hide();
                 break;
             }
-
-            await this.sleep(50);
         }
     }
 
@@ -116,6 +222,7 @@ class Game {
         // Skip typewriter effect
         if (textRenderer.isTyping) {
             textRenderer.skip();
+            avgEngine.completeText();
         }
     }
 
@@ -127,6 +234,10 @@ class Game {
     hideMenu() {
         this.isPaused = false;
         document.getElementById('menu-screen')?.classList.remove('active');
+        if (this.resumeWaiter) {
+            this.resumeWaiter();
+            this.resumeWaiter = null;
+        }
     }
 
     toggleMenu() {
@@ -161,6 +272,7 @@ class Game {
 
     toggleAuto() {
         this.autoMode = !this.autoMode;
+        avgEngine.setAutoMode(this.autoMode);
         console.log('Auto mode:', this.autoMode);
     }
 
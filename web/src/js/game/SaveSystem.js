@@ -3,7 +3,13 @@ class SaveSystem {
     constructor() {
         this.saveSlots = 10;
         this.storageKey = 'avg_save_';
+        this.readStateKey = 'avg_read_state';
         this.currentVersion = '1.0.0';
+        // Quick save uses save slot 0 and engine snapshot slot 0
+        this.quickSlot = 0;
+        this.persistPending = false;
+        this.readStatePending = false;
+        this.flushOnHide = null;
     }
 
     save(slotIndex, gameState) {
@@ -123,19 +129,121 @@ class SaveSystem {
         return saves;
     }
 
+    // Read state is global, not per slot
+    saveReadState() {
+        try {
+            localStorage.setItem(this.readStateKey, avgEngine.saveReadState());
+            return true;
+        } catch (error) {
+            console.error('Failed to save read state:', error);
+            return false;
+        }
+    }
+
+    // Merges into what the engine already marked read
+    loadReadState() {
+        const data = localStorage.getItem(this.readStateKey);
+        if (!data) {
+            return false;
+        }
+
+        return avgEngine.loadReadState(data);
+    }
+
+    // Write the read state when the browser is idle after nodes were read;
+    // call after each navigation. It is also written when the page is
+    // hidden, independently of quick saves.
+    scheduleReadStatePersist() {
+        this.watchPageHide();
+        if (this.readStatePending) {
+            return;
+        }
+        this.readStatePending = true;
+
+        const flush = () => this.flushReadState();
+        if (typeof requestIdleCallback === 'function') {
+            requestIdleCallback(flush, { timeout: 5000 });
+        } else {
+            setTimeout(flush, 1000);
+        }
+    }
+
+    flushReadState() {
+        if (!this.readStatePending) {
+            return true;
+        }
+        this.readStatePending = false;
+        return this.saveReadState();
+    }
+
+    // pagehide (and hiding the tab, since mobile browsers may never fire
+    // pagehide) writes whatever is still pending
+    watchPageHide() {
+        if (this.flushOnHide) {
+            return;
+        }
+
+        this.flushOnHide = () => {
+            this.flushReadState();
+            this.flushPersist();
+        };
+        window.addEventListener('pagehide', this.flushOnHide);
+        document.addEventListener('visibilitychange', () => {
+            if (document.visibilityState === 'hidden') {
+                this.flushOnHide();
+            }
+        });
+    }
+
+    // Quick save keeps an engine snapshot in memory and writes it to
+    // storage when the browser is idle; quick load restores the snapshot
+    // directly and only falls back to storage after a page reload.
     quickSave() {
-        const state = avgEngine.saveState();
-        return this.save(0, state);
+        if (!avgEngine.takeSnapshot(this.quickSlot)) {
+            return false;
+        }
+
+        this.schedulePersist();
+        return true;
     }
 
     quickLoad() {
-        const saveData = this.load(0);
+        if (avgEngine.hasSnapshot(this.quickSlot)) {
+            return avgEngine.restoreSnapshot(this.quickSlot);
+        }
+
+        const saveData = this.load(this.quickSlot);
         if (!saveData) {
             return false;
         }
 
         return avgEngine.loadState(saveData.state);
     }
+
+    schedulePersist() {
+        if (this.persistPending) {
+            return;
+        }
+        this.persistPending = true;
+        this.watchPageHide();
+
+        if (typeof requestIdleCallback === 'function') {
+            requestIdleCallback(() => this.flushPersist(), { timeout: 2000 });
+        } else {
+            setTimeout(() => this.flushPersist(), 0);
+        }
+    }
+
+    // Write the quick-save snapshot to storage if it has not been yet
+    flushPersist() {
+        if (!this.persistPending) {
+            return true;
+        }
+        this.persistPending = false;
+
+        const state = avgEngine.saveSnapshot(this.quickSlot);
+        return state ? this.save(this.quickSlot, state) : false;
+    }
 }
 
 const saveSystem = new SaveSystem();
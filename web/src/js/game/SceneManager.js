@@ -1,33 +1,99 @@
-// Scene manager
+// Scene manager: applies the engine's scene events to renderers and audio
 class SceneManager {
     constructor() {
         this.currentScene = null;
+        // Batches are applied in order even when a frame's update starts
+        // before the previous one finished loading images
+        this.applying = Promise.resolve();
     }
 
-    async loadScene(node) {
-        if (!node) {
-            return;
+    // Drain and apply pending scene events; called once per frame and by the
+    // game loop before it shows a node
+    update() {
+        const events = avgEngine.drainSceneEvents();
+        if (events.length === 0 && !events.overflowed) {
+            return this.applying;
         }
 
-        this.currentScene = node;
+        this.applying = this.applying.then(async () => {
+            if (events.overflowed) {
+                await this.loadScene(avgEngine.getSceneState());
+                return;
+            }
+            for (const event of events) {
+                await this.applyEvent(event);
+            }
+        });
+        return this.applying;
+    }
+
+    async applyEvent(event) {
+        const Type = AVGEngine.SceneEvent;
+        const name = avgEngine.getAssetName(event.asset);
 
-        // Load background
-        if (node.background) {
-            await backgroundRenderer.setBackground(`assets/images/backgrounds/${node.background}`);
+        switch (event.type) {
+            case Type.BGM_CHANGE:
+                audioManager.playBGM(`assets/audio/bgm/${name}`, event.detail === 1);
+                break;
+            case Type.BGM_STOP:
+                audioManager.stopBGM();
+                break;
+            case Type.SOUND_EFFECT:
+                audioManager.playSE(`assets/audio/se/${name}`);
+                break;
+            case Type.BACKGROUND:
+                if (name) {
+                    await backgroundRenderer.setBackground(`assets/images/backgrounds/${name}`);
+                } else {
+                    backgroundRenderer.clear();
+                }
+                break;
+            case Type.CHARACTER_ENTER:
+                await characterRenderers[event.slot].setCharacter(`assets/images/characters/${name}`,
+                    avgEngine.getAssetName(event.detail));
+                break;
+            case Type.CHARACTER_EXPRESSION:
+                await characterRenderers[event.slot].setCharacter(
+                    `assets/images/characters/${avgEngine.getAssetName(event.detail)}`, name);
+                break;
+            case Type.CHARACTER_EXIT:
+                characterRenderers[event.slot].clear();
+                break;
+            case Type.CHOICE_SHOWN:
+                eventBus.emit('choice-shown', { nodeIndex: event.nodeIndex, count: event.detail });
+                break;
         }
 
-        // Load character
-        if (node.character) {
-            const characterPath = `assets/images/characters/${node.character}`;
-            await characterRenderer.setCharacter(characterPath, node.expression);
+        eventBus.emit('scene-event', event);
+    }
+
+    // Rebuild the visible scene from the engine's scene state (used after an
+    // event overflow)
+    async loadScene(scene) {
+        this.currentScene = scene;
+
+        if (scene.background) {
+            await backgroundRenderer.setBackground(`assets/images/backgrounds/${scene.background}`);
         } else {
-            characterRenderer.clear();
+            backgroundRenderer.clear();
         }
 
-        // Trigger audio through C++ engine callbacks
-        avgEngine.triggerAudio();
+        await Promise.all(scene.characters.map((slot, index) => {
+            if (!slot.name) {
+                characterRenderers[index].clear();
+                return null;
+            }
+            return characterRenderers[index].setCharacter(`assets/images/characters/${slot.name}`,
+                slot.expression);
+        }));
+
+        if (scene.bgm) {
+            audioManager.playBGM(`assets/audio/bgm/${scene.bgm}`, true);
+        } else {
+            audioManager.stopBGM();
+        }
 
-        eventBus.emit('scene-loaded', node);
+        eventBus.emit('scene-loaded', scene);
     }
 
     getCurrentScene() {
@@ -36,7 +102,7 @@ class SceneManager {
 
     clear() {
         backgroundRenderer.clear();
-        characterRenderer.clear();
+        characterRenderers.forEach(renderer => renderer.clear());
         audioManager.stopBGM();
         this.currentScene = null;
     }
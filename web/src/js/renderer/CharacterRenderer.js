@@ -1,8 +1,22 @@
-// Character renderer
+// Character renderer for one stage slot. Slot 0 uses the #character-image
+// element from the page; other slots add their own next to it.
 class CharacterRenderer extends Renderer {
-    constructor() {
+    constructor(slot = 0) {
         super('character-image');
+        this.slot = slot;
         this.currentCharacter = '';
+
+        if (slot > 0 && this.element) {
+            const image = this.element.cloneNode(false);
+            image.id = `character-image-${slot}`;
+            image.removeAttribute('src');
+            image.style.display = 'none';
+            this.element.parentNode.appendChild(image);
+            this.element = image;
+        }
+        if (this.element) {
+            this.element.style.order = slot;
+        }
     }
 
     async setCharacter(imagePath, expression = '') {
@@ -35,4 +49,6 @@ class CharacterRenderer extends Renderer {
     }
 }
 
-const characterRenderer = new CharacterRenderer();
+// One renderer per engine character slot (SceneState::kCharacterSlots)
+const characterRenderers = [0, 1, 2, 3].map(slot => new CharacterRenderer(slot));
+const characterRenderer = characterRenderers[0];
@@ -1,4 +1,5 @@
-// Text renderer with typewriter effect
+// Text renderer with typewriter effect. Markup (styles, pauses, ruby,
+// variables) arrives pre-parsed as engine spans; see AVGEngine.getTextSpans().
 class TextRenderer {
     constructor() {
         this.textElement = document.getElementById('dialogue-text');
@@ -9,45 +10,135 @@ class TextRenderer {
         this.skipTyping = false;
     }
 
-    async setText(text, speaker = '', useTypewriter = true) {
+    async setText(text, speaker = '', useTypewriter = true, spans = []) {
         // Set speaker
         if (this.speakerElement) {
             this.speakerElement.textContent = speaker || '';
         }
 
         // Set text
-        if (!text) {
+        if (!text && spans.length === 0) {
             this.clear();
             return;
         }
 
         this.currentText = text;
+        this.textElement.textContent = '';
+        const segments = this.layout(text, spans);
 
         if (useTypewriter && this.typewriterSpeed > 0) {
-            await this.typewrite(text);
+            await this.typewrite(segments);
         } else {
-            this.textElement.textContent = text;
+            this.fill(segments);
+        }
+    }
+
+    // Build the line's elements with empty text nodes; returns the segments
+    // the typewriter fills in order: { node, chars } or { pause }. root
+    // defaults to the dialogue box; choices lay out into their buttons.
+    layout(text, spans, root = this.textElement) {
+        const chars = Array.from(text || '');
+        if (spans.length === 0) {
+            return [this.appendRun(root, chars, 0, 0)];
+        }
+
+        const Type = AVGEngine.TextSpan;
+        const segments = [];
+        let ruby = null;
+        let rubyEnd = 0;
+
+        for (const span of spans) {
+            if (ruby && span.start >= rubyEnd && span.type !== Type.RUBY) {
+                ruby = null;
+            }
+            const parent = ruby || root;
+
+            switch (span.type) {
+                case Type.TEXT:
+                    segments.push(this.appendRun(parent,
+                        chars.slice(span.start, span.start + span.length), span.style, span.color));
+                    break;
+                case Type.VARIABLE:
+                    segments.push(this.appendRun(parent,
+                        Array.from(String(avgEngine.getVariable(span.string))), span.style, span.color));
+                    break;
+                case Type.PAUSE:
+                    segments.push({ pause: span.value });
+                    break;
+                case Type.RUBY: {
+                    ruby = document.createElement('ruby');
+                    rubyEnd = span.start + span.length;
+                    root.appendChild(ruby);
+                    const annotation = document.createElement('rt');
+                    annotation.textContent = span.string;
+                    // The annotation goes after the base text once it is laid out
+                    segments.push({ ruby, annotation });
+                    break;
+                }
+            }
+        }
+
+        for (const segment of segments) {
+            if (segment.ruby) {
+                segment.ruby.appendChild(segment.annotation);
+            }
         }
+        return segments.filter(segment => !segment.ruby);
     }
 
-    async typewrite(text) {
+    appendRun(parent, chars, style, color) {
+        const Style = AVGEngine.TextStyle;
+        let element = parent;
+        if (style) {
+            element = document.createElement('span');
+            if (style & Style.BOLD) element.style.fontWeight = 'bold';
+            if (style & Style.ITALIC) element.style.fontStyle = 'italic';
+            if (style & Style.COLOR) element.style.color = `#${color.toString(16).padStart(6, '0')}`;
+            parent.appendChild(element);
+        }
+
+        const node = document.createTextNode('');
+        element.appendChild(node);
+        return { node, chars };
+    }
+
+    async typewrite(segments) {
         this.isTyping = true;
         this.skipTyping = false;
-        this.textElement.textContent = '';
 
-        for (let i = 0; i < text.length; i++) {
+        for (const segment of segments) {
             if (this.skipTyping) {
-                this.textElement.textContent = text;
                 break;
             }
 
-            this.textElement.textContent += text[i];
-            await this.sleep(this.typewriterSpeed);
+            if (segment.pause !== undefined) {
+                await this.sleep(segment.pause);
+                continue;
+            }
+
+            for (const char of segment.chars) {
+                if (this.skipTyping) {
+                    break;
+                }
+                segment.node.data += char;
+                await this.sleep(this.typewriterSpeed);
+            }
         }
 
+        if (this.skipTyping) {
+            this.fill(segments);
+        }
         this.isTyping = false;
     }
 
+    fill(segments) {
+        for (const segment of segments) {
+            if (segment.node) {
+                segment.node.data = segment.chars.join('');
+            }
+        }
+    }
+
     skip() {
         if (this.isTyping) {
             this.skipTyping = true;
@@ -22,11 +22,11 @@ async function main() {
         loadingText.textContent = 'Loading engine...';
         progressFill.style.width = '30%';
 
-        // Initialize game
-        await game.init();
-
-        // Setup audio callbacks after engine is initialized
-        avgEngine.setupAudioCallbacks();
+        // Initialize game; script loading fills the bar from 30% to 60%
+        await game.init(progress => {
+            loadingText.textContent = 'Loading script...';
+            progressFill.style.width = `${30 + Math.round(progress * 30)}%`;
+        });
 
         loadingText.textContent = 'Loading assets...';
         progressFill.style.width = '60%';